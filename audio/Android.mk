@@ -20,14 +20,27 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := audio.primary.$(TARGET_BOOTLOADER_BOARD_NAME)
 LOCAL_MODULE_RELATIVE_PATH := hw
 LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_CLASS := SHARED_LIBRARIES
 
-LOCAL_SRC_FILES := audio_hw.c ril_interface.c
+LOCAL_SRC_FILES := audio_hw.c dsp.c mixer_route.c resampler_poly.c ril_interface.c
+
+# Mixer paths are compiled into a table at build time
+intermediates := $(call local-generated-sources-dir)
+GEN := $(intermediates)/mixer_paths_table.h
+$(GEN): PRIVATE_PATH := $(LOCAL_PATH)
+$(GEN): PRIVATE_CUSTOM_TOOL = python $(PRIVATE_PATH)/gen_mixer_paths.py $< > $@
+$(GEN): $(LOCAL_PATH)/../configs/audio/mixer_paths.xml \
+	$(LOCAL_PATH)/../configs/audio/mixer_gains.xml \
+	$(LOCAL_PATH)/gen_mixer_paths.py
+	$(transform-generated-source)
+LOCAL_GENERATED_SOURCES += $(GEN)
 
 LOCAL_C_INCLUDES += \
 	external/tinyalsa/include \
+	external/tinycompress/include \
 	$(call include-path-for, audio-effects) \
 	$(call include-path-for, audio-utils) \
-	$(call include-path-for, audio-route) \
+	$(intermediates) \
 	hardware/samsung/ril/libsecril-client \
         $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include \
 
@@ -35,6 +48,29 @@ LOCAL_ADDITIONAL_DEPENDENCIES += \
 	$(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
 
 LOCAL_SHARED_LIBRARIES := liblog libcutils libtinyalsa libaudioutils libdl \
-	libaudioroute libsecril-client
+	libsecril-client
+
+# Compressed offload output. AUDIO_HW_COMPRESS_MOCK builds a mock compress
+# device instead of using libtinycompress, to run the offload path without
+# a DSP
+ifeq ($(AUDIO_HW_COMPRESS_MOCK),true)
+LOCAL_SRC_FILES += compress_mock.c
+else
+LOCAL_SHARED_LIBRARIES += libtinycompress
+endif
+
+# HDMI audio controls of the TV out driver. AUDIO_HW_HDMI_MOCK builds a
+# mock V4L2 node instead, to run the HDMI paths without the driver
+ifeq ($(AUDIO_HW_HDMI_MOCK),true)
+LOCAL_SRC_FILES += hdmi_v4l2_mock.c
+else
+LOCAL_SRC_FILES += hdmi_v4l2.c
+endif
+
+# Latency histograms of out_write, in_read, select_devices and
+# adev_set_mode, printed by "dumpsys media.audio_flinger"
+ifeq ($(AUDIO_HW_PROFILE),true)
+LOCAL_CFLAGS += -DAUDIO_HW_PROFILE
+endif
 
 include $(BUILD_SHARED_LIBRARY)
@@ -24,10 +24,14 @@
 #define LOG_NDEBUG 0
 
 #include <errno.h>
+#include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 #include <fcntl.h>
 
 #include <cutils/log.h>
@@ -43,10 +47,15 @@
 #include <system/audio.h>
 
 #include <tinyalsa/asoundlib.h>
+#include <sound/compress_params.h>
+#include <tinycompress/tinycompress.h>
 
 #include <audio_utils/resampler.h>
-#include <audio_route/audio_route.h>
 
+#include "dsp.h"
+#include "hdmi_v4l2.h"
+#include "mixer_route.h"
+#include "resampler_poly.h"
 #include "routing.h"
 #include "ril_interface.h"
 
@@ -58,6 +67,7 @@
 #define PCM_DEVICE_VOICE 1 /* Baseband link */
 #define PCM_DEVICE_SCO 2   /* Bluetooth link */
 #define PCM_DEVICE_DEEP 3  /* Deep buffer */
+#define PCM_DEVICE_OFFLOAD 4 /* Compressed offload */
 
 #define MIXER_CARD 0
 
@@ -73,9 +83,29 @@
 #define DEEP_BUFFER_OUTPUT_PERIOD_SIZE 960
 #define DEEP_BUFFER_OUTPUT_PERIOD_COUNT 5
 
+/*
+ * Range of the deep buffer periods set with the audio_hal.deep_buffer_*
+ * properties. Longer periods mean fewer wakeups while the screen is off,
+ * at the cost of latency. They only apply when the HAL is opened:
+ * AudioFlinger sizes its buffers from the period of the output when it
+ * opens it, and does not expect the size to change afterwards.
+ */
+#define DEEP_BUFFER_MIN_PERIOD_MS 5
+#define DEEP_BUFFER_MAX_PERIOD_MS 100
+#define DEEP_BUFFER_MIN_PERIOD_COUNT 2
+#define DEEP_BUFFER_MAX_PERIOD_COUNT 8
+
 #define LOW_LATENCY_OUTPUT_PERIOD_SIZE 240
 #define LOW_LATENCY_OUTPUT_PERIOD_COUNT 2
 
+/*
+ * Low-latency output in MMAP mode: the HAL fills the buffer from the
+ * hardware position without period interrupts, so shorter periods can be
+ * used (4 ms of buffering at 48 kHz).
+ */
+#define MMAP_OUTPUT_PERIOD_SIZE 96
+#define MMAP_OUTPUT_PERIOD_COUNT 2
+
 #define AUDIO_CAPTURE_PERIOD_SIZE 320
 #define AUDIO_CAPTURE_PERIOD_COUNT 2
 
@@ -85,18 +115,140 @@
 #define SCO_CAPTURE_PERIOD_SIZE 240
 #define SCO_CAPTURE_PERIOD_COUNT 2
 
+/*
+ * Compressed offload: the DSP decodes the stream from fragments of
+ * compressed data, so the latency is not known and only estimated.
+ */
+#define OFFLOAD_FRAGMENT_SIZE (32 * 1024)
+#define OFFLOAD_FRAGMENT_COUNT 4
+#define OFFLOAD_LATENCY_MS 100
+#define OFFLOAD_QUEUE_SIZE 8
+/* DSP volume of the offload stream, the control name depends on the driver */
+#define OFFLOAD_VOLUME_CTL "Compress Playback Volume"
+
 #define HDMI_MULTI_PERIOD_SIZE  336
 #define HDMI_MULTI_PERIOD_COUNT 8
 #define HDMI_MULTI_DEFAULT_CHANNEL_COUNT 6 /* 5.1 */
 #define HDMI_MULTI_DEFAULT_SAMPLING_RATE 48000
+/*
+ * Age after which the capabilities of the HDMI sink are read again when
+ * the HDMI output is opened, in case a hotplug event was missed. The
+ * framework opens the output several times in a row on a hotplug, those
+ * opens use the cached value.
+ */
+#define HDMI_SINK_CAPS_MAX_AGE_MS 2000
 /*
  * Default sampling for HDMI multichannel output
  *
  * Maximum number of channel mask configurations supported. Currently the
  * primary output only supports 1 (stereo) and the
- * multi channel HDMI output 2 (5.1 and 7.1)
+ * multi channel HDMI output 3 (5.1, 7.1 and stereo)
+ */
+#define HDMI_MAX_SUPPORTED_CHANNEL_MASKS 3
+
+/* audio of each output mixed into the HDMI output, about 43 ms at 48 kHz */
+#define HDMI_MIX_BUFFER_FRAMES 2048
+
+#define OUT_PARAMETER_HDMI_MIX_GAIN "hdmi_mix_gain"
+
+/*
+ * Software volume of the PCM outputs: the master volume and, on HDMI, the
+ * stream volume. Changes are ramped over OUT_VOLUME_RAMP_MS to avoid
+ * clicks. The gain is in 0.16 fixed point, OUT_GAIN_UNITY leaves the audio
+ * untouched.
  */
-#define HDMI_MAX_SUPPORTED_CHANNEL_MASKS 2
+#define OUT_VOLUME_RAMP_MS 20
+#define OUT_GAIN_UNITY 0x10000
+
+#ifdef AUDIO_HW_PROFILE
+/*
+ * Per-call latency histograms of the HAL entry points, printed by
+ * adev_dump(). Bucket n counts calls which took less than 2^n us.
+ */
+#define PROFILE_BUCKETS 20
+
+enum profile_point {
+    PROFILE_OUT_WRITE,
+    PROFILE_OUT_CONVERT,
+    PROFILE_IN_READ,
+    PROFILE_SELECT_DEVICES,
+    PROFILE_SET_MODE,
+    PROFILE_TOTAL
+};
+
+struct profile_stats {
+    uint64_t count;
+    uint64_t total_us;
+    uint64_t max_us;
+    uint64_t hist[PROFILE_BUCKETS];
+};
+
+static const char * const profile_names[PROFILE_TOTAL] = {
+    "out_write",
+    "out_convert",
+    "in_read",
+    "select_devices",
+    "adev_set_mode",
+};
+
+static struct profile_stats profile_stats[PROFILE_TOTAL];
+
+static uint64_t profile_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* may be called concurrently from different stream threads */
+static void profile_record(enum profile_point point, uint64_t start_us)
+{
+    struct profile_stats *stats = &profile_stats[point];
+    uint64_t delta_us = profile_now_us() - start_us;
+    uint64_t max_us = __atomic_load_n(&stats->max_us, __ATOMIC_RELAXED);
+    int bucket = 0;
+
+    while (bucket < PROFILE_BUCKETS - 1 && (delta_us >> bucket) != 0)
+        bucket++;
+
+    __atomic_fetch_add(&stats->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->total_us, delta_us, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->hist[bucket], 1, __ATOMIC_RELAXED);
+    while (delta_us > max_us &&
+           !__atomic_compare_exchange_n(&stats->max_us, &max_us, delta_us, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void profile_dump(int fd)
+{
+    int i, j;
+
+    dprintf(fd, "  Latency histograms (bucket n: calls < 2^n us):\n");
+    for (i = 0; i < PROFILE_TOTAL; i++) {
+        struct profile_stats *stats = &profile_stats[i];
+        uint64_t count = __atomic_load_n(&stats->count, __ATOMIC_RELAXED);
+
+        dprintf(fd, "    %s: count %llu, avg %llu us, max %llu us\n",
+                profile_names[i],
+                (unsigned long long)count,
+                (unsigned long long)(count ? stats->total_us / count : 0),
+                (unsigned long long)stats->max_us);
+        for (j = 0; j < PROFILE_BUCKETS; j++) {
+            if (stats->hist[j] != 0)
+                dprintf(fd, "      [%2d] %llu\n", j,
+                        (unsigned long long)stats->hist[j]);
+        }
+    }
+}
+
+#define PROFILE_START(name) uint64_t name = profile_now_us()
+#define PROFILE_END(point, name) profile_record(point, name)
+#else
+#define PROFILE_START(name)
+#define PROFILE_END(point, name)
+#endif
 
 
 struct pcm_config pcm_config_fast = {
@@ -107,6 +259,14 @@ struct pcm_config pcm_config_fast = {
     .format = PCM_FORMAT_S16_LE,
 };
 
+struct pcm_config pcm_config_fast_mmap = {
+    .channels = 2,
+    .rate = 48000,
+    .period_size = MMAP_OUTPUT_PERIOD_SIZE,
+    .period_count = MMAP_OUTPUT_PERIOD_COUNT,
+    .format = PCM_FORMAT_S16_LE,
+};
+
 struct pcm_config pcm_config_deep = {
     .channels = 2,
     .rate = 48000,
@@ -163,13 +323,167 @@ struct pcm_config pcm_config_hdmi_multi = {
     .format = PCM_FORMAT_S16_LE,
 };
 
+/*
+ * Conversions of the HDMI output to the channels of the sink, see
+ * set_hdmi_remix(). The surround channels are folded into the front ones
+ * at -3 dB or unity like the downmix effect of the framework does, and
+ * the stereo upmix feeds the center and the back at -9 and -3 dB.
+ * Channels are in the order of the audio_channel_mask_t bits:
+ * FL FR FC LFE BL BR SL SR.
+ */
+#define MATRIX_M3DB 11585 /* 0.7071 in 2.14 fixed point */
+#define MATRIX_M9DB 5793  /* 0.3536 */
+
+static const struct dsp_matrix remix_7point1_to_5point1 = {
+    .in_channels = 8,
+    .out_channels = 6,
+    .coef = {
+        { DSP_MATRIX_UNITY, 0, 0, 0, 0, 0, 0, 0 },
+        { 0, DSP_MATRIX_UNITY, 0, 0, 0, 0, 0, 0 },
+        { 0, 0, DSP_MATRIX_UNITY, 0, 0, 0, 0, 0 },
+        { 0, 0, 0, DSP_MATRIX_UNITY, 0, 0, 0, 0 },
+        { 0, 0, 0, 0, MATRIX_M3DB, 0, MATRIX_M3DB, 0 },
+        { 0, 0, 0, 0, 0, MATRIX_M3DB, 0, MATRIX_M3DB },
+    },
+};
+
+static const struct dsp_matrix remix_7point1_to_stereo = {
+    .in_channels = 8,
+    .out_channels = 2,
+    .coef = {
+        { DSP_MATRIX_UNITY, 0, MATRIX_M3DB, MATRIX_M3DB,
+          MATRIX_M3DB, 0, MATRIX_M3DB, 0 },
+        { 0, DSP_MATRIX_UNITY, MATRIX_M3DB, MATRIX_M3DB,
+          0, MATRIX_M3DB, 0, MATRIX_M3DB },
+    },
+};
+
+static const struct dsp_matrix remix_5point1_to_stereo = {
+    .in_channels = 6,
+    .out_channels = 2,
+    .coef = {
+        { DSP_MATRIX_UNITY, 0, MATRIX_M3DB, MATRIX_M3DB, DSP_MATRIX_UNITY, 0 },
+        { 0, DSP_MATRIX_UNITY, MATRIX_M3DB, MATRIX_M3DB, 0, DSP_MATRIX_UNITY },
+    },
+};
+
+static const struct dsp_matrix remix_stereo_to_5point1 = {
+    .in_channels = 2,
+    .out_channels = 6,
+    .coef = {
+        { DSP_MATRIX_UNITY, 0 },
+        { 0, DSP_MATRIX_UNITY },
+        { MATRIX_M9DB, MATRIX_M9DB },
+        { 0, 0 },
+        { MATRIX_M3DB, 0 },
+        { 0, MATRIX_M3DB },
+    },
+};
+
+static const struct dsp_matrix * const hdmi_remixes[] = {
+    &remix_7point1_to_5point1,
+    &remix_7point1_to_stereo,
+    &remix_5point1_to_stereo,
+    &remix_stereo_to_5point1,
+};
+
 enum output_type {
     OUTPUT_DEEP_BUF,      // deep PCM buffers output stream
     OUTPUT_LOW_LATENCY,   // low latency output stream
     OUTPUT_HDMI,          // HDMI multi channel
+    OUTPUT_OFFLOAD,       // compressed offload to the DSP
     OUTPUT_TOTAL
 };
 
+/*
+ * Output stream state. out_write() moves a stream from standby to starting
+ * with the stream mutex held and hands it over to the PCM worker, which opens
+ * the PCMs and sets it running with the hw device mutex held. The state is
+ * atomic so that other streams and the worker can check it without taking
+ * the stream mutex.
+ */
+enum stream_state {
+    STREAM_STANDBY,       // all PCMs are inactive
+    STREAM_STARTING,      // PCMs and routing are being set up
+    STREAM_RUNNING,       // PCMs are active
+    STREAM_DISABLED,      // started while the HDMI output owns the I2S, not mixable
+    STREAM_HDMI_MIX,      // mixed into the HDMI output, which owns the I2S
+};
+
+/* why audio written to an output stream did not reach the DMA in time */
+enum xrun_cause {
+    XRUN_UNDERRUN,        // the DMA ran out of audio, the PCM was restarted
+    XRUN_WRITE,           // pcm_write() failed with another error
+    XRUN_START,           // the PCMs could not be opened
+    XRUN_DISABLED,        // audio dropped while the HDMI output owns the I2S
+    XRUN_TOTAL
+};
+
+/*
+ * Presentation clock of one PCM: a least squares fit of the presented
+ * frames over the last samples taken by out_get_presentation_position(),
+ * which smooths out the period granularity of the DMA position.
+ */
+#define PRES_CLOCK_SAMPLES 16
+/* a sample further than this from the nominal rate restarts the fit */
+#define PRES_CLOCK_MAX_ERROR_US 5000
+
+struct pres_clock {
+    int64_t time_ns[PRES_CLOCK_SAMPLES];
+    int64_t frames[PRES_CLOCK_SAMPLES];
+    unsigned int count;
+    unsigned int next;
+};
+
+/* requests of an output to the PCM worker, see worker_request() */
+enum worker_request {
+    WORKER_OUT_START = 1 << 0,    // open the PCMs and select the route
+    WORKER_OUT_STANDBY = 1 << 1,  // close the PCMs and update the route
+};
+
+/* blocking calls of the offload thread, see offload_thread_loop() */
+enum offload_cmd {
+    OFFLOAD_CMD_WAIT_FOR_BUFFER,  // wait until the DSP buffer has room
+    OFFLOAD_CMD_DRAIN,            // wait until all the data is played
+    OFFLOAD_CMD_PARTIAL_DRAIN,    // wait until the current track is played
+    OFFLOAD_CMD_EXIT,
+};
+
+/*
+ * HDMI sink capabilities and HDMI audio driver state. Read from the driver
+ * on hotplug and when the HDMI output is opened after the capabilities are
+ * HDMI_SINK_CAPS_MAX_AGE_MS old, so that routing and the repeated opens of
+ * a hotplug do not issue V4L2 controls which would not change anything.
+ * Guarded by the hw device mutex.
+ */
+struct hdmi_sink {
+    bool caps_valid;      /* max_channels was read since the last hotplug */
+    struct timespec caps_time; /* when max_channels was read */
+    int max_channels;
+    int audio_enabled;    /* last V4L2_CID_TV_ENABLE_HDMI_AUDIO, -1 if unknown */
+    int channels;         /* last V4L2_CID_TV_SET_NUM_CHANNELS, 0 if unknown */
+    bool open_failed;     /* do not retry opening the driver before a hotplug */
+};
+
+/*
+ * Audio of an output in STREAM_HDMI_MIX: a ring of 16 bit stereo frames
+ * filled by out_write() of the output and emptied by out_write() of the
+ * HDMI output. Guarded by audio_device.hdmi_mix_lock.
+ */
+struct hdmi_mix_source {
+    int16_t buffer[HDMI_MIX_BUFFER_FRAMES * 2];
+    uint64_t written;
+    uint64_t read;
+    uint16_t gain;        /* 1.15 fixed point, see dsp_mix_stereo_s16() */
+    bool active;
+};
+
+/* mixer paths of a route_config, resolved when the device is opened */
+struct route_paths {
+    int output;
+    int input;
+};
+
 struct audio_device {
     struct audio_hw_device hw_device;
     
@@ -177,10 +491,13 @@ struct audio_device {
     audio_devices_t out_device; /* "or" of stream_out.device for all active output streams */
     audio_devices_t in_device;
     bool mic_mute;
-    struct audio_route *ar;
+    struct mixer_route *mr;
+    struct route_paths route_paths[IN_SOURCE_TAB_SIZE][OUT_DEVICE_TAB_SIZE];
     audio_source_t input_source;
     int cur_route_id;     /* current route ID: combination of input source
                            * and output device IDs */
+    int cur_output_path;  /* mixer paths applied by select_devices() */
+    int cur_input_path;
     audio_mode_t mode;
     
     /* Call audio */
@@ -192,14 +509,21 @@ struct audio_device {
     struct pcm *pcm_sco_tx;
     
     float voice_volume;
+    float master_volume;  /* guarded by lock_outputs */
     bool in_call;
     bool tty_mode;
     bool bluetooth_nrec;
     bool wb_amr;
     bool two_mic_control;
     bool two_mic_disabled;
+    bool fast_mmap;       /* low-latency output and fast inputs in MMAP mode */
+    enum dsp_mono_mode mono_mode; /* stereo to mono conversion of mono inputs */
+    bool speex_resampler; /* capture resampling with audio_utils */
+    enum poly_resampler_quality resampler_quality;
     
     int hdmi_drv_fd;
+    struct hdmi_sink hdmi;
+    bool hdmi_upmix;      /* stereo HDMI streams are upmixed to 5.1 */
     audio_channel_mask_t in_channel_mask;
     
     /* RIL */
@@ -207,6 +531,34 @@ struct audio_device {
     
     struct stream_out *outputs[OUTPUT_TOTAL];
     pthread_mutex_t lock_outputs; /* see note below on mutex acquisition order */
+    
+    /*
+     * Outputs mixed into the HDMI output. hdmi_mix_lock is never held while
+     * acquiring another mutex.
+     */
+    struct hdmi_mix_source hdmi_mix[OUTPUT_TOTAL];
+    pthread_mutex_t hdmi_mix_lock;
+    pthread_cond_t hdmi_mix_cond; /* signaled when the HDMI output reads */
+    
+    /*
+     * PCM worker: opens and closes the output PCMs and updates the routing
+     * so that out_write() and out_standby() never wait for the hardware.
+     * The requests of an output are flags, repeated requests are merged.
+     * worker_lock is never held while acquiring another mutex.
+     */
+    pthread_t worker_thread;
+    pthread_mutex_t worker_lock;
+    pthread_cond_t worker_cond;      /* signaled when a request is made */
+    pthread_cond_t worker_idle_cond; /* signaled when the requests of an output are done */
+    struct stream_out *worker_list;  /* outputs with requests, oldest first */
+    struct stream_out *worker_out;   /* output whose requests are being done */
+    bool worker_exit;
+};
+
+/* a buffer of out_write(), grown to the largest write */
+struct out_buffer {
+    int16_t *data;
+    size_t size;
 };
 
 struct stream_out {
@@ -216,18 +568,75 @@ struct stream_out {
     struct pcm *pcm[PCM_TOTAL];
     struct pcm_config config;
     unsigned int pcm_device;
-    bool standby; /* true if all PCMs are inactive */
+    enum output_type type;
+    /* When HDMI multichannel output is active, it owns the I2S shared by HDMI and WM1811:
+     * the other outputs are mixed into it in software, see out_write_hdmi_mix(). */
+    atomic_int state; /* enum stream_state */
     audio_devices_t device;
-    /* FIXME: when HDMI multichannel output is active, other outputs must be disabled as
-     * HDMI and WM1811 share the same I2S. This means that notifications and other sounds are
-     * silent when watching a 5.1 movie. */
-    bool disabled;
     
     audio_channel_mask_t channel_mask;
     /* Array of supported channel mask configurations. +1 so that the last entry is always 0 */
     audio_channel_mask_t supported_channel_masks[HDMI_MAX_SUPPORTED_CHANNEL_MASKS + 1];
-    bool muted;
+    float volume[2];   /* last out_set_volume(), 1.0 until then */
+    bool mmap;         /* PCM_CARD is opened in MMAP NOIRQ mode */
+    bool mmap_started; /* PCM_CARD started since it was opened */
     uint64_t written; /* total frames written, not cleared when entering standby */
+    unsigned int write_seq; /* number of out_write() calls */
+    unsigned int xruns[XRUN_TOTAL]; /* see out_count_xrun() */
+    struct pres_clock clock[PCM_TOTAL];
+    uint64_t presented; /* last frames returned by get_presentation_position() */
+    uint64_t start_frames; /* written when the stream last left standby */
+    struct timespec start_time; /* when out_write() last left standby */
+    unsigned int start_write_seq; /* write_seq when it last left standby */
+    
+    /* HDMI output: conversion to the channels of the PCMs, see out_remix() */
+    const struct dsp_matrix *remix;
+    
+    /* software volume, see out_apply_volume() */
+    uint32_t gain;
+    uint32_t gain_target;
+    int16_t gain_step;       /* added to gain after each frame of the ramp */
+    size_t gain_ramp_frames; /* frames left in the ramp */
+    
+    /*
+     * Each step of out_write() writes to its own buffer, as the next step
+     * reads its source while writing: the audio converted by out_convert(),
+     * remixed by out_remix(), then with the software volume applied and, on
+     * HDMI, the other outputs mixed in
+     */
+    struct out_buffer convert_buf;
+    struct out_buffer remix_buf;
+    struct out_buffer scratch;
+    
+    /* requests to the PCM worker, guarded by audio_device.worker_lock */
+    unsigned int worker_requests;    /* enum worker_request flags */
+    unsigned int standby_write_seq;  /* write_seq when standby was requested */
+    struct stream_out *worker_next;  /* in audio_device.worker_list */
+    /* signaled when the stream leaves STREAM_STARTING, with the stream mutex */
+    pthread_cond_t start_cond;
+    
+    /* audio received while the PCM worker opens the PCMs */
+    char *pending;
+    size_t pending_bytes;
+    size_t pending_size;
+    
+    /* compressed offload */
+    audio_format_t format;
+    struct compress *compr;
+    struct compr_config compr_config;
+    struct snd_codec codec;
+    stream_callback_t offload_callback;
+    void *offload_cookie;
+    bool offload_started; /* compress_start() called since the stream started */
+    bool offload_paused;
+    struct compr_gapless_mdata gapless_mdata;
+    bool send_gapless_mdata;
+    pthread_t offload_thread;
+    pthread_cond_t offload_cond; /* signaled when a command is queued or done */
+    enum offload_cmd offload_queue[OFFLOAD_QUEUE_SIZE];
+    unsigned int offload_head;
+    unsigned int offload_tail;
+    bool offload_blocked; /* the offload thread is in a compress call */
     
     struct audio_device *dev;
 };
@@ -242,9 +651,19 @@ struct stream_in {
     unsigned int requested_rate;
     struct resampler_itfe *resampler;
     struct resampler_buffer_provider buf_provider;
+    bool speex_resampler; /* resampler comes from create_resampler() */
     int16_t *buffer;
     size_t frames_in;
     int read_status;
+    bool mmap; /* pcm is opened in MMAP NOIRQ mode */
+    int64_t frames_read; /* at requested_rate, since the stream was opened */
+    
+    /* capture overruns, see in_account_overrun() */
+    struct timespec last_read_time; /* end of the last read from the driver */
+    struct timespec last_overrun_time;
+    unsigned int overruns;
+    uint32_t frames_lost; /* since the last in_get_input_frames_lost() */
+    uint64_t total_frames_lost;
     
     audio_source_t input_source;
     audio_io_handle_t io_handle;
@@ -268,6 +687,35 @@ struct string_to_enum {
     uint32_t value;
 };
 
+/* out_get_parameters() keys are "xrun_" followed by the name */
+static const char * const xrun_names[XRUN_TOTAL] = {
+    "underrun",
+    "write",
+    "start",
+    "disabled",
+};
+
+/*
+ * Latency of what comes after the PCM, per output device: codec DSP, HDMI
+ * sink or dock. The audio_hal.latency_us.<name> properties set them in
+ * adev_open().
+ */
+struct downstream_latency {
+    audio_devices_t devices;
+    const char *name;
+    unsigned int latency_us;
+};
+
+static struct downstream_latency downstream_latencies[] = {
+    { AUDIO_DEVICE_OUT_EARPIECE, "earpiece", 0 },
+    { AUDIO_DEVICE_OUT_SPEAKER, "speaker", 0 },
+    { AUDIO_DEVICE_OUT_WIRED_HEADSET | AUDIO_DEVICE_OUT_WIRED_HEADPHONE,
+      "headset", 0 },
+    { AUDIO_DEVICE_OUT_ALL_SCO, "sco", 0 },
+    { AUDIO_DEVICE_OUT_AUX_DIGITAL, "hdmi", 0 },
+    { AUDIO_DEVICE_OUT_DGTL_DOCK_HEADSET, "dock", 0 },
+};
+
 const struct string_to_enum out_channels_name_to_enum_table[] = {
     STRING_TO_ENUM(AUDIO_CHANNEL_OUT_STEREO),
     STRING_TO_ENUM(AUDIO_CHANNEL_OUT_5POINT1),
@@ -350,85 +798,176 @@ static int adev_set_voice_volume(struct audio_hw_device *dev, float volume);
 
 /* Helper functions */
 
+/* must be called with hw device mutex locked */
 static int open_hdmi_driver(struct audio_device *adev)
 {
-    if (adev->hdmi_drv_fd < 0) {
-        adev->hdmi_drv_fd = open("/dev/video16", O_RDWR);
+    if (adev->hdmi_drv_fd < 0 && !adev->hdmi.open_failed) {
+        adev->hdmi_drv_fd = hdmi_v4l2_open();
         if (adev->hdmi_drv_fd < 0)
-            ALOGE("%s cannot open video16 - error: %s\n",
-                  __func__, strerror(errno));
+            adev->hdmi.open_failed = true;
     }
     return adev->hdmi_drv_fd;
 }
 
+/*
+ * Forgets the cached HDMI sink: the capabilities are read again and the
+ * driver state is set again on the next use, and a failed open is retried.
+ * must be called with hw device mutex locked
+ */
+static void invalidate_hdmi_sink(struct audio_device *adev)
+{
+    ALOGV("%s", __func__);
+    
+    adev->hdmi.caps_valid = false;
+    adev->hdmi.audio_enabled = -1;
+    adev->hdmi.channels = 0;
+    adev->hdmi.open_failed = false;
+}
+
 /* must be called with hw device mutex locked */
 static int enable_hdmi_audio(struct audio_device *adev, int enable)
 {
     int ret;
-    struct v4l2_control ctrl;
+    
+    if (adev->hdmi.audio_enabled == !!enable)
+        return 0;
     
     ret = open_hdmi_driver(adev);
     if (ret < 0) {
         return ret;
     }
     
-    ctrl.id = V4L2_CID_TV_ENABLE_HDMI_AUDIO;
-    ctrl.value = !!enable;
-    ret = ioctl(adev->hdmi_drv_fd, VIDIOC_S_CTRL, &ctrl);
-    
-    if (ret < 0) {
-        ALOGE("V4L2_CID_TV_ENABLE_HDMI_AUDIO ioctl error (%d)", errno);
-    }
+    ret = hdmi_v4l2_set_ctrl(adev->hdmi_drv_fd,
+                             V4L2_CID_TV_ENABLE_HDMI_AUDIO, !!enable);
+    adev->hdmi.audio_enabled = ret == 0 ? !!enable : -1;
     
     return ret;
 }
 
 /* must be called with hw device mutex locked */
+static bool hdmi_sink_caps_expired(struct audio_device *adev)
+{
+    struct timespec now;
+    int64_t age_ms;
+    
+    if (!adev->hdmi.caps_valid)
+        return true;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    age_ms = (now.tv_sec - adev->hdmi.caps_time.tv_sec) * 1000LL +
+             (now.tv_nsec - adev->hdmi.caps_time.tv_nsec) / 1000000;
+    return age_ms >= HDMI_SINK_CAPS_MAX_AGE_MS;
+}
+
+/*
+ * Sets the channel masks of the HDMI output: all of them, as the audio is
+ * converted to what the sink supports. Returns the channels of the sink.
+ * must be called with hw device mutex locked
+ */
 static int read_hdmi_channel_masks(struct audio_device *adev, struct stream_out *out) {
     int ret;
-    struct v4l2_control ctrl;
-    
-    ret = open_hdmi_driver(adev);
-    if (ret < 0)
-        return ret;
+    int32_t value;
     
-    ctrl.id = V4L2_CID_TV_MAX_AUDIO_CHANNELS;
-    ret = ioctl(adev->hdmi_drv_fd, VIDIOC_G_CTRL, &ctrl);
-    if (ret < 0) {
-        ALOGE("V4L2_CID_TV_MAX_AUDIO_CHANNELS ioctl error (%d)", errno);
-        return ret;
+    if (hdmi_sink_caps_expired(adev)) {
+        ret = open_hdmi_driver(adev);
+        if (ret < 0)
+            return ret;
+        
+        ret = hdmi_v4l2_get_ctrl(adev->hdmi_drv_fd,
+                                 V4L2_CID_TV_MAX_AUDIO_CHANNELS, &value);
+        if (ret < 0)
+            return ret;
+        
+        ALOGV("%s got %d max channels", __func__, value);
+        adev->hdmi.max_channels = value;
+        adev->hdmi.caps_valid = true;
+        clock_gettime(CLOCK_MONOTONIC, &adev->hdmi.caps_time);
     }
     
-    ALOGV("%s ioctl %d got %d max channels", __func__, ret, ctrl.value);
+    out->supported_channel_masks[0] = AUDIO_CHANNEL_OUT_5POINT1;
+    out->supported_channel_masks[1] = AUDIO_CHANNEL_OUT_7POINT1;
+    out->supported_channel_masks[2] = AUDIO_CHANNEL_OUT_STEREO;
     
-    if (ctrl.value != 6 && ctrl.value != 8)
-        return -ENOSYS;
+    return adev->hdmi.max_channels;
+}
+
+/*
+ * Chooses the channels of the HDMI PCMs: those of the stream when the sink
+ * supports them, the largest layout the sink supports otherwise, or 5.1
+ * for stereo streams on multichannel sinks when upmix is set. The audio is
+ * converted by out_remix().
+ */
+static void set_hdmi_remix(struct stream_out *out, int sink_channels,
+                           bool upmix)
+{
+    unsigned int channels = popcount(out->channel_mask);
+    unsigned int pcm_channels;
+    unsigned int i;
+    
+    if (sink_channels >= 8)
+        pcm_channels = 8;
+    else if (sink_channels >= 6)
+        pcm_channels = 6;
+    else
+        pcm_channels = 2;
     
-    out->supported_channel_masks[0] = AUDIO_CHANNEL_OUT_5POINT1;
-    if (ctrl.value == 8)
-        out->supported_channel_masks[1] = AUDIO_CHANNEL_OUT_7POINT1;
+    if (channels == 2 && upmix && pcm_channels > 2)
+        pcm_channels = 6;
+    else if (channels < pcm_channels)
+        pcm_channels = channels;
     
-    return ret;
+    out->config.channels = channels;
+    out->remix = NULL;
+    if (pcm_channels == channels)
+        return;
+    
+    for (i = 0; i < ARRAY_SIZE(hdmi_remixes); i++) {
+        if (hdmi_remixes[i]->in_channels == channels &&
+            hdmi_remixes[i]->out_channels == pcm_channels) {
+            out->remix = hdmi_remixes[i];
+            out->config.channels = pcm_channels;
+            break;
+        }
+    }
+    
+    ALOGW_IF(!out->remix, "%s: cannot convert %u channels to %u, sink has %d",
+             __func__, channels, pcm_channels, sink_channels);
+    ALOGV("%s: %u channels on a sink of %d, PCM of %u", __func__, channels,
+          sink_channels, out->config.channels);
 }
 
 /* must be called with hw device mutex locked */
 static int set_hdmi_channels(struct audio_device *adev, int channels) {
     int ret;
-    struct v4l2_control ctrl;
+    
+    if (adev->hdmi.channels == channels)
+        return 0;
     
     ret = open_hdmi_driver(adev);
     if (ret < 0)
         return ret;
     
-    ctrl.id = V4L2_CID_TV_SET_NUM_CHANNELS;
-    ctrl.value = channels;
-    ret = ioctl(adev->hdmi_drv_fd, VIDIOC_S_CTRL, &ctrl);
-    if (ret < 0)
-        ALOGE("V4L2_CID_TV_SET_NUM_CHANNELS ioctl error (%d)", errno);
+    ret = hdmi_v4l2_set_ctrl(adev->hdmi_drv_fd,
+                             V4L2_CID_TV_SET_NUM_CHANNELS, channels);
+    adev->hdmi.channels = ret == 0 ? channels : 0;
     
     return ret;
 }
 
+/*
+ * Mixer path of a route of routing.h, NULL or "none" for no path. Returns
+ * -EINVAL if the path is not in mixer_paths.xml.
+ */
+static int get_route_path(const char *route, int *path)
+{
+    *path = MIXER_PATH_INVALID;
+    if (route == NULL || strcmp(route, "none") == 0)
+        return 0;
+    
+    *path = mixer_route_get_path(route);
+    return *path == MIXER_PATH_INVALID ? -EINVAL : 0;
+}
+
 static bool route_changed(struct audio_device *adev)
 {
     int output_device_id = get_output_device_id(adev->out_device);
@@ -443,17 +982,18 @@ static void select_devices(struct audio_device *adev)
 {
     int output_device_id = get_output_device_id(adev->out_device);
     int input_source_id = get_input_source_id(adev->input_source, adev->wb_amr);
-    const char *output_route = NULL;
-    const char *input_route = NULL;
-    char current_device[64] = {0};
+    int output_path = MIXER_PATH_INVALID;
+    int input_path = MIXER_PATH_INVALID;
     int new_route_id;
+    PROFILE_START(start);
     
-    if (adev->hdmi_drv_fd == 0)
+    if (adev->hdmi_drv_fd >= 0)
         enable_hdmi_audio(adev, adev->out_device & AUDIO_DEVICE_OUT_AUX_DIGITAL);
     
     new_route_id = (1 << (input_source_id + OUT_DEVICE_CNT)) + (1 << output_device_id);
     if (new_route_id == adev->cur_route_id) {
         ALOGV("*** %s: Routing hasn't changed, leaving function.", __func__);
+        PROFILE_END(PROFILE_SELECT_DEVICES, start);
         return;
     }
     
@@ -461,10 +1001,10 @@ static void select_devices(struct audio_device *adev)
     
     if (input_source_id != IN_SOURCE_NONE) {
         if (output_device_id != OUT_DEVICE_NONE) {
-            input_route =
-            route_configs[input_source_id][output_device_id]->input_route;
-            output_route =
-            route_configs[input_source_id][output_device_id]->output_route;
+            input_path =
+            adev->route_paths[input_source_id][output_device_id].input;
+            output_path =
+            adev->route_paths[input_source_id][output_device_id].output;
         } else {
             switch (adev->in_device) {
                 case AUDIO_DEVICE_IN_WIRED_HEADSET & ~AUDIO_DEVICE_BIT_IN:
@@ -482,13 +1022,13 @@ static void select_devices(struct audio_device *adev)
                     break;
             }
             
-            input_route =
-            (route_configs[input_source_id][output_device_id])->input_route;
+            input_path =
+            adev->route_paths[input_source_id][output_device_id].input;
         }
     } else {
         if (output_device_id != OUT_DEVICE_NONE) {
-            output_route =
-            (route_configs[IN_SOURCE_MIC][output_device_id])->output_route;
+            output_path =
+            adev->route_paths[IN_SOURCE_MIC][output_device_id].output;
         }
     }
     
@@ -496,27 +1036,112 @@ static void select_devices(struct audio_device *adev)
           "output route: %s, input route: %s",
           __func__,
           adev->out_device, adev->input_source,
-          output_route ? output_route : "none",
-          input_route ? input_route : "none");
+          mixer_route_get_path_name(output_path),
+          mixer_route_get_path_name(input_path));
+    
+    /* Several route IDs map to the same mixer paths */
+    if (output_path == adev->cur_output_path &&
+        input_path == adev->cur_input_path) {
+        ALOGV("*** %s: Mixer paths haven't changed, leaving function.", __func__);
+        PROFILE_END(PROFILE_SELECT_DEVICES, start);
+        return;
+    }
     
     /*
-     * Reset the audio routes to deactivate active audio paths
+     * Reset the active audio paths and apply the new ones before updating
+     * the mixer. mixer_route_update_mixer() only writes the controls whose
+     * value differs from the current one, so controls shared by the old
+     * and the new paths are left untouched.
      */
-    audio_route_reset(adev->ar);
-    audio_route_update_mixer(adev->ar);
+    mixer_route_reset_path(adev->mr, adev->cur_output_path);
+    mixer_route_reset_path(adev->mr, adev->cur_input_path);
     
     /*
      * Apply the new audio routes and set volumes
      */
-    if (output_route != NULL) {
-        audio_route_apply_path(adev->ar, output_route);
+    mixer_route_apply_path(adev->mr, output_path);
+    mixer_route_apply_path(adev->mr, input_path);
+    mixer_route_update_mixer(adev->mr);
+    
+    adev->cur_output_path = output_path;
+    adev->cur_input_path = input_path;
+    
+    PROFILE_END(PROFILE_SELECT_DEVICES, start);
+}
+
+static int out_get_state(struct stream_out *out)
+{
+    return atomic_load_explicit(&out->state, memory_order_acquire);
+}
+
+/* must be called with output stream mutex locked */
+static void out_set_state(struct stream_out *out, int state)
+{
+    int old = atomic_exchange_explicit(&out->state, state, memory_order_acq_rel);
+    
+    if (old == STREAM_STARTING && state != STREAM_STARTING)
+        pthread_cond_broadcast(&out->start_cond);
+}
+
+/* size of a frame of audio in the format and channels of the PCMs */
+static size_t out_pcm_frame_size(const struct stream_out *out)
+{
+    return out->config.channels * (pcm_format_to_bits(out->config.format) / 8);
+}
+
+/*
+ * Sample format of an output stream for dsp_convert(), DSP_FORMAT_S16 for
+ * the formats which are not converted.
+ */
+static enum dsp_format out_dsp_format(audio_format_t format)
+{
+    switch (format) {
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+        return DSP_FORMAT_S24_3LE;
+    case AUDIO_FORMAT_PCM_8_24_BIT:
+        return DSP_FORMAT_S24_LE;
+    case AUDIO_FORMAT_PCM_FLOAT:
+        return DSP_FORMAT_FLOAT;
+    default:
+        return DSP_FORMAT_S16;
     }
-    if (input_route != NULL) {
-        audio_route_apply_path(adev->ar, input_route);
+}
+
+static enum dsp_format pcm_dsp_format(enum pcm_format format)
+{
+    return format == PCM_FORMAT_S24_LE ? DSP_FORMAT_S24_LE : DSP_FORMAT_S16;
+}
+
+/*
+ * Whether a playback PCM device takes 24 bit samples on the codec card and,
+ * when it is there, on the dock card, which share the config of the output.
+ */
+static bool pcm_supports_s24(unsigned int device)
+{
+    static const unsigned int cards[] = { PCM_CARD, PCM_CARD_SPDIF };
+    struct pcm_params *params;
+    bool supported;
+    unsigned int i;
+    
+    for (i = 0; i < sizeof(cards) / sizeof(cards[0]); i++) {
+        params = pcm_params_get(cards[i], device, PCM_OUT);
+        if (!params) {
+            if (cards[i] == PCM_CARD) {
+                ALOGW("%s: cannot read the parameters of PCM %u", __func__,
+                      device);
+                return false;
+            }
+            continue;
+        }
+        supported = pcm_params_format_test(params, PCM_FORMAT_S24_LE);
+        pcm_params_free(params);
+        if (!supported)
+            return false;
     }
-    audio_route_update_mixer(adev->ar);
+    return true;
 }
 
+/* must be called with hw device outputs list, all out streams, and hw device mutex locked */
 static void force_non_hdmi_out_standby(struct audio_device *adev)
 {
     enum output_type type;
@@ -526,9 +1151,62 @@ static void force_non_hdmi_out_standby(struct audio_device *adev)
         out = adev->outputs[type];
         if (type == OUTPUT_HDMI || !out)
             continue;
-        pthread_mutex_lock(&out->lock);
         do_out_standby(out);
-        pthread_mutex_unlock(&out->lock);
+    }
+}
+
+/* whether the audio of an output can be mixed into the HDMI output */
+static bool hdmi_mix_supported(struct stream_out *out, struct stream_out *hdmi)
+{
+    return out->type != OUTPUT_OFFLOAD && out->config.channels == 2 &&
+           out->config.format == PCM_FORMAT_S16_LE &&
+           out->config.rate == hdmi->config.rate;
+}
+
+static void hdmi_mix_set_active(struct stream_out *out, bool active)
+{
+    struct audio_device *adev = out->dev;
+    struct hdmi_mix_source *source = &adev->hdmi_mix[out->type];
+    
+    pthread_mutex_lock(&adev->hdmi_mix_lock);
+    source->active = active;
+    source->written = 0;
+    source->read = 0;
+    pthread_cond_broadcast(&adev->hdmi_mix_cond);
+    pthread_mutex_unlock(&adev->hdmi_mix_lock);
+}
+
+/*
+ * The HDMI output takes over the I2S: close the PCMs of the running outputs
+ * and mix their audio into the HDMI output instead, without going through
+ * standby. The outputs which cannot be mixed are put in standby.
+ * must be called with hw device outputs list, all out streams, and hw device mutex locked
+ */
+static void hdmi_mix_attach_outputs(struct audio_device *adev,
+                                    struct stream_out *hdmi)
+{
+    enum output_type type;
+    struct stream_out *out;
+    int i;
+    
+    for (type = 0; type < OUTPUT_TOTAL; ++type) {
+        out = adev->outputs[type];
+        if (type == OUTPUT_HDMI || !out)
+            continue;
+        if (out_get_state(out) != STREAM_RUNNING ||
+            !hdmi_mix_supported(out, hdmi)) {
+            do_out_standby(out);
+            continue;
+        }
+        
+        for (i = 0; i < PCM_TOTAL; i++) {
+            if (out->pcm[i]) {
+                pcm_close(out->pcm[i]);
+                out->pcm[i] = NULL;
+            }
+        }
+        hdmi_mix_set_active(out, true);
+        out_set_state(out, STREAM_HDMI_MIX);
     }
 }
 
@@ -546,6 +1224,9 @@ static void start_bt_sco(struct audio_device *adev)
     
     ALOGV("%s: Opening SCO PCMs", __func__);
     
+    /* the SCO route must be set before the PCMs are started */
+    mixer_route_flush(adev->mr);
+    
     adev->pcm_sco_rx = pcm_open(PCM_CARD,
                                 PCM_DEVICE_SCO,
                                 PCM_OUT | PCM_MONOTONIC,
@@ -615,6 +1296,9 @@ static int start_voice_call(struct audio_device *adev)
     
     ALOGV("%s: Opening voice PCMs", __func__);
     
+    /* the call route must be set before the PCMs are started */
+    mixer_route_flush(adev->mr);
+    
     if (adev->wb_amr) {
         voice_config = &pcm_config_voice_wide;
     } else {
@@ -787,8 +1471,10 @@ static void adev_set_wb_amr_callback(void *data, int enable)
                   __func__,
                   enable ? "Turn on" : "Turn off");
             
+            mixer_route_begin_batch(adev->mr);
             stop_call(adev);
             start_call(adev);
+            mixer_route_end_batch(adev->mr);
         }
     }
     
@@ -832,50 +1518,234 @@ static void adev_set_call_audio_path(struct audio_device *adev)
     ril_set_call_audio_path(&adev->ril, device_type);
 }
 
-/* must be called with hw device outputs list, output stream, and hw device mutexes locked */
-static int start_output_stream(struct stream_out *out)
+/* may be called from the PCM worker without the stream mutex */
+static void out_count_xrun(struct stream_out *out, enum xrun_cause cause)
 {
-    struct audio_device *adev = out->dev;
+    __atomic_fetch_add(&out->xruns[cause], 1, __ATOMIC_RELAXED);
+}
+
+/**********************************************************
+ * Compressed offload functions
+ **********************************************************/
+
+/* must be called with output stream mutex locked */
+static int offload_queue_cmd(struct stream_out *out, enum offload_cmd cmd)
+{
+    if (out->offload_tail - out->offload_head == OFFLOAD_QUEUE_SIZE) {
+        ALOGE("%s: command queue full, dropping command %d", __func__, cmd);
+        return -EAGAIN;
+    }
     
-    ALOGV("%s: starting stream", __func__);
+    out->offload_queue[out->offload_tail % OFFLOAD_QUEUE_SIZE] = cmd;
+    out->offload_tail++;
+    pthread_cond_broadcast(&out->offload_cond);
     
-    if (out == adev->outputs[OUTPUT_HDMI]) {
-        force_non_hdmi_out_standby(adev);
-    } else if (adev->outputs[OUTPUT_HDMI] && !adev->outputs[OUTPUT_HDMI]->standby) {
-        out->disabled = true;
-        return 0;
+    return 0;
+}
+
+/*
+ * Stops the DSP, which drops the data not played yet and wakes up the
+ * offload thread, then drops the queued commands.
+ * must be called with output stream mutex locked. If adev_locked, the hw
+ * device mutex is locked too: it is released while the offload thread
+ * returns from the DSP, which does not need it, so that the other streams
+ * are not held up meanwhile.
+ */
+static void offload_stop(struct stream_out *out, bool adev_locked)
+{
+    compress_stop(out->compr);
+    out->offload_started = false;
+    out->offload_paused = false;
+    
+    /* the offload thread must not use the stream once it is closed */
+    if (out->offload_blocked) {
+        if (adev_locked)
+            pthread_mutex_unlock(&out->dev->lock);
+        while (out->offload_blocked)
+            pthread_cond_wait(&out->offload_cond, &out->lock);
+        if (adev_locked)
+            pthread_mutex_lock(&out->dev->lock);
     }
+    out->offload_head = out->offload_tail;
+}
+
+/*
+ * Makes the blocking compress calls for a non-blocking offload stream and
+ * notifies the client through its callback, without holding any mutex.
+ * The stream mutex is released while the thread waits on the DSP, so that
+ * out_write() and offload_stop() can run.
+ */
+static void *offload_thread_loop(void *context)
+{
+    struct stream_out *out = (struct stream_out *)context;
+    stream_callback_event_t event;
+    stream_callback_t callback;
+    struct compress *compr;
+    enum offload_cmd cmd;
+    void *cookie;
     
-    out->disabled = false;
-    
-    if (out->device & (AUDIO_DEVICE_OUT_SPEAKER |
+    pthread_mutex_lock(&out->lock);
+    for (;;) {
+        while (out->offload_head == out->offload_tail)
+            pthread_cond_wait(&out->offload_cond, &out->lock);
+        
+        cmd = out->offload_queue[out->offload_head % OFFLOAD_QUEUE_SIZE];
+        out->offload_head++;
+        if (cmd == OFFLOAD_CMD_EXIT)
+            break;
+        
+        /* nothing to wait for if standby or flush dropped the data */
+        compr = out->offload_started ? out->compr : NULL;
+        out->offload_blocked = compr != NULL;
+        pthread_mutex_unlock(&out->lock);
+        
+        switch (cmd) {
+            case OFFLOAD_CMD_WAIT_FOR_BUFFER:
+                if (compr)
+                    compress_wait(compr, -1);
+                event = STREAM_CBK_EVENT_WRITE_READY;
+                break;
+            case OFFLOAD_CMD_PARTIAL_DRAIN:
+                if (compr) {
+                    compress_next_track(compr);
+                    compress_partial_drain(compr);
+                }
+                event = STREAM_CBK_EVENT_DRAIN_READY;
+                break;
+            case OFFLOAD_CMD_DRAIN:
+            default:
+                if (compr)
+                    compress_drain(compr);
+                event = STREAM_CBK_EVENT_DRAIN_READY;
+                break;
+        }
+        
+        pthread_mutex_lock(&out->lock);
+        out->offload_blocked = false;
+        pthread_cond_broadcast(&out->offload_cond);
+        if (cmd == OFFLOAD_CMD_PARTIAL_DRAIN)
+            out->send_gapless_mdata = true;
+        callback = out->offload_callback;
+        cookie = out->offload_cookie;
+        pthread_mutex_unlock(&out->lock);
+        
+        if (callback)
+            callback(event, NULL, cookie);
+        
+        pthread_mutex_lock(&out->lock);
+    }
+    pthread_mutex_unlock(&out->lock);
+    
+    return NULL;
+}
+
+/* must be called with the stream in standby, so that the thread is idle */
+static void offload_thread_exit(struct stream_out *out)
+{
+    pthread_mutex_lock(&out->lock);
+    out->offload_head = out->offload_tail;
+    offload_queue_cmd(out, OFFLOAD_CMD_EXIT);
+    pthread_mutex_unlock(&out->lock);
+    
+    pthread_join(out->offload_thread, NULL);
+}
+
+/*
+ * must be called from the PCM worker with the output stream and hw device
+ * mutexes locked and the stream in STREAM_STARTING. The HDMI output
+ * additionally needs the hw device outputs list and all out streams locked,
+ * as it forces the other outputs into standby. The offload
+ * output is started by out_write() with its stream and the hw device mutex
+ * locked: compress_open() does not wait for the hardware.
+ */
+static int start_output_stream(struct stream_out *out)
+{
+    struct audio_device *adev = out->dev;
+    int i;
+    
+    ALOGV("%s: starting stream", __func__);
+    
+    if (out->type == OUTPUT_HDMI) {
+        hdmi_mix_attach_outputs(adev, out);
+    } else if (adev->outputs[OUTPUT_HDMI] &&
+               out_get_state(adev->outputs[OUTPUT_HDMI]) != STREAM_STANDBY) {
+        if (hdmi_mix_supported(out, adev->outputs[OUTPUT_HDMI])) {
+            hdmi_mix_set_active(out, true);
+            out_set_state(out, STREAM_HDMI_MIX);
+        } else {
+            out_set_state(out, STREAM_DISABLED);
+        }
+        return 0;
+    }
+    
+    out_set_state(out, STREAM_STARTING);
+    
+    if (out->type == OUTPUT_OFFLOAD) {
+        out->compr = compress_open(PCM_CARD, PCM_DEVICE_OFFLOAD, COMPRESS_IN,
+                                   &out->compr_config);
+        if (!out->compr || !is_compress_ready(out->compr)) {
+            ALOGE("compress_open(PCM_DEVICE_OFFLOAD) failed: %s",
+                  out->compr ? compress_get_error(out->compr) : "no memory");
+            goto err_pcm_open;
+        }
+        /* without a callback, the client expects blocking writes */
+        compress_nonblock(out->compr, out->offload_callback != NULL);
+        out->offload_started = false;
+        out->offload_paused = false;
+    } else if (out->device & (AUDIO_DEVICE_OUT_SPEAKER |
                        AUDIO_DEVICE_OUT_WIRED_HEADSET |
                        AUDIO_DEVICE_OUT_WIRED_HEADPHONE |
                        AUDIO_DEVICE_OUT_AUX_DIGITAL |
                        AUDIO_DEVICE_OUT_ALL_SCO)) {
-        out->pcm[PCM_CARD] = pcm_open(PCM_CARD,
-                                      out->pcm_device,
-                                      PCM_OUT | PCM_MONOTONIC,
-                                      &out->config);
+        if (out->mmap) {
+            out->pcm[PCM_CARD] = pcm_open(PCM_CARD,
+                                          out->pcm_device,
+                                          PCM_OUT | PCM_MMAP | PCM_NOIRQ |
+                                          PCM_MONOTONIC,
+                                          &out->config);
+            if (out->pcm[PCM_CARD] && !pcm_is_ready(out->pcm[PCM_CARD])) {
+                ALOGW("%s: MMAP mode not supported (%s), using pcm_write()",
+                      __func__, pcm_get_error(out->pcm[PCM_CARD]));
+                pcm_close(out->pcm[PCM_CARD]);
+                out->mmap = false;
+                
+                /* keep the MMAP periods, but use the normal buffer size */
+                out->config.period_count = (LOW_LATENCY_OUTPUT_PERIOD_SIZE *
+                                            LOW_LATENCY_OUTPUT_PERIOD_COUNT) /
+                                           out->config.period_size;
+                out->pcm[PCM_CARD] = pcm_open(PCM_CARD,
+                                              out->pcm_device,
+                                              PCM_OUT | PCM_MONOTONIC |
+                                              PCM_NORESTART,
+                                              &out->config);
+            }
+            out->mmap_started = false;
+        } else {
+            out->pcm[PCM_CARD] = pcm_open(PCM_CARD,
+                                          out->pcm_device,
+                                          PCM_OUT | PCM_MONOTONIC |
+                                          PCM_NORESTART,
+                                          &out->config);
+        }
         if (out->pcm[PCM_CARD] && !pcm_is_ready(out->pcm[PCM_CARD])) {
             ALOGE("pcm_open(PCM_CARD) failed: %s",
                   pcm_get_error(out->pcm[PCM_CARD]));
-            pcm_close(out->pcm[PCM_CARD]);
-            return -ENOMEM;
+            goto err_pcm_open;
         }
     }
     
-    if (out->device & AUDIO_DEVICE_OUT_DGTL_DOCK_HEADSET) {
+    if (out->type != OUTPUT_OFFLOAD &&
+        (out->device & AUDIO_DEVICE_OUT_DGTL_DOCK_HEADSET)) {
         out->pcm[PCM_CARD_SPDIF] = pcm_open(PCM_CARD_SPDIF,
                                             out->pcm_device,
-                                            PCM_OUT | PCM_MONOTONIC,
+                                            PCM_OUT | PCM_MONOTONIC |
+                                            PCM_NORESTART,
                                             &out->config);
         if (out->pcm[PCM_CARD_SPDIF] &&
             !pcm_is_ready(out->pcm[PCM_CARD_SPDIF])) {
             ALOGE("pcm_open(PCM_CARD_SPDIF) failed: %s",
                   pcm_get_error(out->pcm[PCM_CARD_SPDIF]));
-            pcm_close(out->pcm[PCM_CARD_SPDIF]);
-            return -ENOMEM;
+            goto err_pcm_open;
         }
     }
     
@@ -892,6 +1762,51 @@ static int start_output_stream(struct stream_out *out)
     ALOGV("%s: stream out device: %d, actual: %d",
           __func__, out->device, adev->out_device);
     
+    for (i = 0; i < PCM_TOTAL; i++)
+        out->clock[i].count = 0;
+    out->start_frames = out->written;
+    out_set_state(out, STREAM_RUNNING);
+    
+    return 0;
+    
+err_pcm_open:
+    for (i = 0; i < PCM_TOTAL; i++) {
+        if (out->pcm[i]) {
+            pcm_close(out->pcm[i]);
+            out->pcm[i] = NULL;
+        }
+    }
+    if (out->compr) {
+        compress_close(out->compr);
+        out->compr = NULL;
+    }
+    out_count_xrun(out, XRUN_START);
+    out_set_state(out, STREAM_STANDBY);
+    /* the audio buffered while starting is dropped with the start */
+    out->pending_bytes = 0;
+    
+    return -ENOMEM;
+}
+
+/*
+ * Sets the periods of a deep buffer config, keeping the current value of a
+ * parameter which is 0. Returns -EINVAL if a value is out of range.
+ */
+static int set_deep_buffer_config(struct pcm_config *config,
+                                  unsigned int period_ms,
+                                  unsigned int period_count)
+{
+    if ((period_ms != 0 && (period_ms < DEEP_BUFFER_MIN_PERIOD_MS ||
+                            period_ms > DEEP_BUFFER_MAX_PERIOD_MS)) ||
+        (period_count != 0 && (period_count < DEEP_BUFFER_MIN_PERIOD_COUNT ||
+                               period_count > DEEP_BUFFER_MAX_PERIOD_COUNT)))
+        return -EINVAL;
+    
+    if (period_ms != 0)
+        config->period_size = period_ms * config->rate / 1000;
+    if (period_count != 0)
+        config->period_count = period_count;
+    
     return 0;
 }
 
@@ -900,10 +1815,29 @@ static int start_input_stream(struct stream_in *in)
 {
     struct audio_device *adev = in->dev;
     
-    in->pcm = pcm_open(PCM_CARD,
-                       PCM_DEVICE,
-                       PCM_IN,
-                       in->config);
+    if (in->mmap) {
+        in->pcm = pcm_open(PCM_CARD,
+                           PCM_DEVICE,
+                           PCM_IN | PCM_MMAP | PCM_NOIRQ | PCM_MONOTONIC,
+                           in->config);
+        if (in->pcm && !pcm_is_ready(in->pcm)) {
+            ALOGW("%s: MMAP mode not supported (%s), using pcm_read()",
+                  __func__, pcm_get_error(in->pcm));
+            pcm_close(in->pcm);
+            in->mmap = false;
+        } else if (in->pcm && pcm_start(in->pcm) != 0) {
+            ALOGE("pcm_start() failed: %s", pcm_get_error(in->pcm));
+            pcm_close(in->pcm);
+            in->pcm = NULL;
+            return -ENOMEM;
+        }
+    }
+    
+    if (!in->mmap)
+        in->pcm = pcm_open(PCM_CARD,
+                           PCM_DEVICE,
+                           PCM_IN | PCM_MONOTONIC | PCM_NORESTART,
+                           in->config);
     if (in->pcm && !pcm_is_ready(in->pcm)) {
         ALOGE("pcm_open() failed: %s", pcm_get_error(in->pcm));
         pcm_close(in->pcm);
@@ -916,6 +1850,8 @@ static int start_input_stream(struct stream_in *in)
     }
     
     in->frames_in = 0;
+    in->last_read_time.tv_sec = 0;
+    in->last_read_time.tv_nsec = 0;
     /* in call routing must go through set_parameters */
     if (!adev->in_call) {
         adev->input_source = in->input_source;
@@ -953,11 +1889,73 @@ static size_t get_input_buffer_size(unsigned int sample_rate,
     return size * channel_count * audio_bytes_per_sample(format);
 }
 
+/*
+ * Accounts for a capture overrun: the driver buffer filled up and the
+ * frames captured until the stream was restarted are lost.
+ * must be called with input stream mutex locked
+ */
+static void in_account_overrun(struct stream_in *in, uint64_t frames,
+                               const struct timespec *now)
+{
+    in->overruns++;
+    in->total_frames_lost += frames;
+    in->frames_lost = in->frames_lost + frames > UINT32_MAX ?
+                      UINT32_MAX : in->frames_lost + frames;
+    in->last_overrun_time = *now;
+    
+    ALOGW("%s: overrun %u, %llu frames lost", __func__, in->overruns,
+          (unsigned long long)frames);
+}
+
+/*
+ * Reads from the driver in pcm_read() mode, recovering from overruns. The
+ * PCM is opened with PCM_NORESTART so that tinyalsa returns the overruns
+ * of the driver as -EPIPE instead of restarting the stream on its own. An
+ * overrun is also assumed when the stream was not read for longer than
+ * its buffer lasts; the time in excess gives the frames lost.
+ * must be called with input stream mutex locked
+ */
+static int in_pcm_read(struct stream_in *in, void *data, unsigned int bytes)
+{
+    unsigned int buffer_frames = in->config->period_size *
+                                 in->config->period_count;
+    uint64_t lost = 0;
+    bool overrun = false;
+    struct timespec now;
+    int ret;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (in->last_read_time.tv_sec != 0 || in->last_read_time.tv_nsec != 0) {
+        uint64_t idle_ns = (now.tv_sec - in->last_read_time.tv_sec) * 1000000000LL +
+                           now.tv_nsec - in->last_read_time.tv_nsec;
+        uint64_t idle_frames = idle_ns * in->config->rate / 1000000000;
+        
+        if (idle_frames > buffer_frames) {
+            overrun = true;
+            lost = idle_frames - buffer_frames;
+        }
+    }
+    
+    ret = pcm_read(in->pcm, data, bytes);
+    if (ret == -EPIPE) {
+        overrun = true;
+        ret = pcm_prepare(in->pcm);
+        if (ret == 0)
+            ret = pcm_read(in->pcm, data, bytes);
+    }
+    
+    if (overrun)
+        in_account_overrun(in, lost, &now);
+    if (ret == 0)
+        clock_gettime(CLOCK_MONOTONIC, &in->last_read_time);
+    
+    return ret;
+}
+
 static int get_next_buffer(struct resampler_buffer_provider *buffer_provider,
                            struct resampler_buffer* buffer)
 {
     struct stream_in *in;
-    size_t i;
     
     if (buffer_provider == NULL || buffer == NULL) {
         return -EINVAL;
@@ -974,9 +1972,9 @@ static int get_next_buffer(struct resampler_buffer_provider *buffer_provider,
     }
     
     if (in->frames_in == 0) {
-        in->read_status = pcm_read(in->pcm,
-                                   (void*)in->buffer,
-                                   pcm_frames_to_bytes(in->pcm, in->config->period_size));
+        in->read_status = in_pcm_read(in,
+                                      (void*)in->buffer,
+                                      pcm_frames_to_bytes(in->pcm, in->config->period_size));
         if (in->read_status != 0) {
             ALOGE("get_next_buffer() pcm_read error %d", in->read_status);
             buffer->raw = NULL;
@@ -986,10 +1984,10 @@ static int get_next_buffer(struct resampler_buffer_provider *buffer_provider,
         
         in->frames_in = in->config->period_size;
         
-        /* Do stereo to mono conversion in place by discarding right channel */
+        /* Do stereo to mono conversion in place */
         if (in->channel_mask == AUDIO_CHANNEL_IN_MONO)
-            for (i = 1; i < in->frames_in; i++)
-                in->buffer[i] = in->buffer[i * 2];
+            dsp_stereo_to_mono_s16(in->buffer, in->buffer, in->frames_in,
+                                   in->dev->mono_mode);
     }
     
     buffer->frame_count = (buffer->frame_count > in->frames_in) ?
@@ -1016,6 +2014,108 @@ static void release_buffer(struct resampler_buffer_provider *buffer_provider,
     in->frames_in -= buffer->frame_count;
 }
 
+/*
+ * Reads one period from the kernel driver straight into buffer, without
+ * going through in->buffer, when no resampling is needed. A stereo capture
+ * converted to mono is still read into in->buffer, but converted directly
+ * into buffer.
+ */
+static void read_period_direct(struct stream_in *in, int16_t *buffer)
+{
+    bool mono = in->channel_mask == AUDIO_CHANNEL_IN_MONO;
+    
+    if (in->pcm == NULL) {
+        in->read_status = -ENODEV;
+        return;
+    }
+    
+    in->read_status = in_pcm_read(in,
+                                  mono ? (void *)in->buffer : (void *)buffer,
+                                  pcm_frames_to_bytes(in->pcm, in->config->period_size));
+    if (in->read_status != 0) {
+        ALOGE("read_period_direct() pcm_read error %d", in->read_status);
+        return;
+    }
+    
+    if (mono)
+        dsp_stereo_to_mono_s16(buffer, in->buffer, in->config->period_size,
+                               in->dev->mono_mode);
+}
+
+/*
+ * Reads from a PCM opened in MMAP NOIRQ mode, copying the frames straight
+ * from the DMA buffer into the caller's buffer. There is no period
+ * interrupt to wait for: the available frames are computed from the
+ * hardware position and the caller sleeps until the DMA has captured
+ * enough frames.
+ */
+static ssize_t read_frames_mmap(struct stream_in *in, void *buffer,
+                                size_t frames)
+{
+    struct pcm *pcm = in->pcm;
+    unsigned int buffer_size = pcm_get_buffer_size(pcm);
+    size_t frame_size = audio_stream_in_frame_size(&in->stream);
+    bool mono = in->channel_mask == AUDIO_CHANNEL_IN_MONO;
+    char *dst = buffer;
+    size_t frames_rd = 0;
+    
+    while (frames_rd < frames) {
+        void *areas;
+        const int16_t *src;
+        unsigned int offset;
+        unsigned int count;
+        int avail;
+        
+        avail = pcm_mmap_avail(pcm);
+        if (avail < 0 || (unsigned int)avail > buffer_size) {
+            /* overrun: the DMA overwrote unread frames, start over */
+            struct timespec now;
+            
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            in_account_overrun(in, avail > 0 ? avail - buffer_size : 0, &now);
+            in->read_status = pcm_prepare(pcm);
+            if (in->read_status == 0)
+                in->read_status = pcm_start(pcm);
+            if (in->read_status != 0)
+                return in->read_status;
+            continue;
+        }
+        
+        /* wait until one period, or what is left to read, is captured */
+        count = frames - frames_rd < in->config->period_size ?
+                frames - frames_rd : in->config->period_size;
+        if ((unsigned int)avail < count) {
+            usleep(((count - avail) * 1000000 + in->config->rate - 1) /
+                   in->config->rate);
+            continue;
+        }
+        
+        count = (size_t)avail < frames - frames_rd ?
+                (unsigned int)avail : frames - frames_rd;
+        in->read_status = pcm_mmap_begin(pcm, &areas, &offset, &count);
+        if (in->read_status != 0)
+            return in->read_status;
+        
+        src = (const int16_t *)((char *)areas +
+                                pcm_frames_to_bytes(pcm, offset));
+        if (mono)
+            dsp_stereo_to_mono_s16((int16_t *)dst, src, count,
+                                   in->dev->mono_mode);
+        else
+            memcpy(dst, src, count * frame_size);
+        
+        in->read_status = pcm_mmap_commit(pcm, offset, count);
+        if (in->read_status < 0)
+            return in->read_status;
+        in->read_status = 0;
+        
+        dst += count * frame_size;
+        frames_rd += count;
+    }
+    
+    return frames_rd;
+}
+
 /* read_frames() reads frames from kernel driver, down samples to capture rate
  * if necessary and output the number of frames requested to the buffer specified */
 static ssize_t read_frames(struct stream_in *in, void *buffer, ssize_t frames)
@@ -1023,6 +2123,9 @@ static ssize_t read_frames(struct stream_in *in, void *buffer, ssize_t frames)
     ssize_t frames_wr = 0;
     size_t frame_size = audio_stream_in_frame_size(&in->stream);
     
+    if (in->mmap)
+        return read_frames_mmap(in, buffer, frames);
+    
     while (frames_wr < frames) {
         size_t frames_rd = frames - frames_wr;
         if (in->resampler != NULL) {
@@ -1030,6 +2133,11 @@ static ssize_t read_frames(struct stream_in *in, void *buffer, ssize_t frames)
                                                   (int16_t *)((char *)buffer +
                                                               frames_wr * frame_size),
                                                   &frames_rd);
+        } else if (in->frames_in == 0 &&
+                   frames_rd >= in->config->period_size) {
+            frames_rd = in->config->period_size;
+            read_period_direct(in, (int16_t *)((char *)buffer +
+                                               frames_wr * frame_size));
         } else {
             struct resampler_buffer buf = {
                 { raw : NULL, },
@@ -1074,6 +2182,9 @@ static size_t out_get_buffer_size(const struct audio_stream *stream)
 {
     struct stream_out *out = (struct stream_out *)stream;
     
+    if (out->type == OUTPUT_OFFLOAD)
+        return out->compr_config.fragment_size;
+    
     return out->config.period_size *
     audio_stream_out_frame_size((const struct audio_stream_out *)stream);
 }
@@ -1085,9 +2196,11 @@ static audio_channel_mask_t out_get_channels(const struct audio_stream *stream)
     return out->channel_mask;
 }
 
-static audio_format_t out_get_format(const struct audio_stream *stream __unused)
+static audio_format_t out_get_format(const struct audio_stream *stream)
 {
-    return AUDIO_FORMAT_PCM_16_BIT;
+    struct stream_out *out = (struct stream_out *)stream;
+    
+    return out->format;
 }
 
 static int out_set_format(struct audio_stream *stream __unused,
@@ -1107,7 +2220,7 @@ static audio_devices_t output_devices(struct stream_out *out)
     
     for (type = 0; type < OUTPUT_TOTAL; ++type) {
         struct stream_out *other = dev->outputs[type];
-        if (other && (other != out) && !other->standby) {
+        if (other && (other != out) && out_get_state(other) != STREAM_STANDBY) {
             // TODO no longer accurate
             /* safe to access other stream without a mutex,
              * because we hold the dev lock,
@@ -1120,26 +2233,40 @@ static audio_devices_t output_devices(struct stream_out *out)
     return devices;
 }
 
-/* must be called with hw device outputs list, all out streams, and hw device mutex locked */
+/*
+ * must be called with hw device outputs list, all out streams, and hw device
+ * mutex locked. Outputs other than HDMI only need their own stream and the hw
+ * device mutex locked. The hw device mutex is released while the offload
+ * output waits for its thread, see offload_stop().
+ */
 static void do_out_standby(struct stream_out *out)
 {
     struct audio_device *adev = out->dev;
     int i;
+    int state = out_get_state(out);
     
-    ALOGV("%s: output standby: %d", __func__, out->standby);
+    ALOGV("%s: output state: %d", __func__, state);
     
-    if (!out->standby) {
+    if (state != STREAM_STANDBY) {
         for (i = 0; i < PCM_TOTAL; i++) {
             if (out->pcm[i]) {
                 pcm_close(out->pcm[i]);
                 out->pcm[i] = NULL;
             }
         }
-        out->standby = true;
+        if (out->compr) {
+            offload_stop(out, true);
+            compress_close(out->compr);
+            out->compr = NULL;
+        }
+        if (state == STREAM_HDMI_MIX)
+            hdmi_mix_set_active(out, false);
+        out_set_state(out, STREAM_STANDBY);
+        out->pending_bytes = 0;
         
-        if (out == adev->outputs[OUTPUT_HDMI]) {
-            /* force standby on low latency output stream so that it can reuse HDMI driver if
-             * necessary when restarted */
+        if (out->type == OUTPUT_HDMI) {
+            /* force standby on the outputs mixed into HDMI so that they reopen their PCMs
+             * when restarted */
             force_non_hdmi_out_standby(adev);
         }
         
@@ -1179,22 +2306,245 @@ static void unlock_all_outputs(struct audio_device *adev, struct stream_out *exc
     pthread_mutex_unlock(&adev->lock_outputs);
 }
 
+/**********************************************************
+ * PCM worker functions
+ **********************************************************/
+
+/*
+ * Asks the PCM worker to start or put an output in standby. The requests
+ * are merged with those the worker has not taken yet: a start is done
+ * before a standby, which is skipped if the output was written to since.
+ * must be called with the output stream mutex locked
+ */
+static void worker_request(struct stream_out *out, unsigned int request)
+{
+    struct audio_device *adev = out->dev;
+    struct stream_out **next;
+    
+    pthread_mutex_lock(&adev->worker_lock);
+    if (request & WORKER_OUT_STANDBY)
+        out->standby_write_seq = out->write_seq;
+    if (!out->worker_requests) {
+        for (next = &adev->worker_list; *next; next = &(*next)->worker_next)
+            ;
+        out->worker_next = NULL;
+        *next = out;
+        pthread_cond_signal(&adev->worker_cond);
+    }
+    out->worker_requests |= request;
+    pthread_mutex_unlock(&adev->worker_lock);
+}
+
+/* drops the requests of an output and waits until the worker is done with it */
+static void worker_cancel(struct stream_out *out)
+{
+    struct audio_device *adev = out->dev;
+    struct stream_out **next;
+    
+    pthread_mutex_lock(&adev->worker_lock);
+    if (out->worker_requests) {
+        for (next = &adev->worker_list; *next != out; next = &(*next)->worker_next)
+            ;
+        *next = out->worker_next;
+        out->worker_requests = 0;
+    }
+    while (adev->worker_out == out)
+        pthread_cond_wait(&adev->worker_idle_cond, &adev->worker_lock);
+    pthread_mutex_unlock(&adev->worker_lock);
+}
+
+static void worker_out_start(struct stream_out *out)
+{
+    struct audio_device *adev = out->dev;
+    
+    if (out->type == OUTPUT_HDMI) {
+        lock_all_outputs(adev);
+        if (out_get_state(out) == STREAM_STARTING)
+            start_output_stream(out);
+        unlock_all_outputs(adev, NULL);
+        return;
+    }
+    
+    /*
+     * start_output_stream() sets up the PCMs and clocks of the stream:
+     * out_write() only holds the stream mutex to buffer audio while the
+     * stream is starting, so it waits for the open at most once.
+     */
+    pthread_mutex_lock(&out->lock);
+    pthread_mutex_lock(&adev->lock);
+    /* the stream might have been forced into standby in the meantime */
+    if (out_get_state(out) == STREAM_STARTING)
+        start_output_stream(out);
+    pthread_mutex_unlock(&adev->lock);
+    pthread_mutex_unlock(&out->lock);
+}
+
+static void worker_out_standby(struct stream_out *out, unsigned int write_seq)
+{
+    struct audio_device *adev = out->dev;
+    struct pcm *pcm[PCM_TOTAL];
+    int i;
+    
+    if (out->type == OUTPUT_HDMI) {
+        lock_all_outputs(adev);
+        if (out->write_seq == write_seq)
+            do_out_standby(out);
+        unlock_all_outputs(adev, NULL);
+        return;
+    }
+    
+    pthread_mutex_lock(&out->lock);
+    pthread_mutex_lock(&adev->lock);
+    
+    /* skip the standby request if the stream has been written to since */
+    if (out->write_seq != write_seq ||
+        out_get_state(out) == STREAM_STANDBY) {
+        pthread_mutex_unlock(&adev->lock);
+        pthread_mutex_unlock(&out->lock);
+        return;
+    }
+    
+    for (i = 0; i < PCM_TOTAL; i++) {
+        pcm[i] = out->pcm[i];
+        out->pcm[i] = NULL;
+    }
+    if (out_get_state(out) == STREAM_HDMI_MIX)
+        hdmi_mix_set_active(out, false);
+    out_set_state(out, STREAM_STANDBY);
+    out->pending_bytes = 0;
+    
+    /* closing the PCMs and changing the route must not block out_write() */
+    pthread_mutex_unlock(&out->lock);
+    
+    for (i = 0; i < PCM_TOTAL; i++) {
+        if (pcm[i])
+            pcm_close(pcm[i]);
+    }
+    
+    /* re-calculate the set of active devices from other streams */
+    adev->out_device = output_devices(out);
+    
+    /* Skip resetting the mixer if no output device is active */
+    if (adev->out_device)
+        select_devices(adev);
+    
+    pthread_mutex_unlock(&adev->lock);
+}
+
+static void *worker_thread_loop(void *context)
+{
+    struct audio_device *adev = (struct audio_device *)context;
+    struct stream_out *out;
+    unsigned int requests;
+    unsigned int write_seq;
+    
+    pthread_mutex_lock(&adev->worker_lock);
+    for (;;) {
+        while (!adev->worker_list && !adev->worker_exit)
+            pthread_cond_wait(&adev->worker_cond, &adev->worker_lock);
+        
+        if (!adev->worker_list)
+            break;
+        
+        out = adev->worker_list;
+        adev->worker_list = out->worker_next;
+        requests = out->worker_requests;
+        write_seq = out->standby_write_seq;
+        out->worker_requests = 0;
+        adev->worker_out = out;
+        pthread_mutex_unlock(&adev->worker_lock);
+        
+        if (requests & WORKER_OUT_START)
+            worker_out_start(out);
+        if (requests & WORKER_OUT_STANDBY)
+            worker_out_standby(out, write_seq);
+        
+        pthread_mutex_lock(&adev->worker_lock);
+        adev->worker_out = NULL;
+        pthread_cond_broadcast(&adev->worker_idle_cond);
+    }
+    pthread_mutex_unlock(&adev->worker_lock);
+    
+    return NULL;
+}
+
 static int out_standby(struct audio_stream *stream)
 {
     struct stream_out *out = (struct stream_out *)stream;
     struct audio_device *adev = out->dev;
     
-    lock_all_outputs(adev);
-    
-    do_out_standby(out);
+    if (out->type == OUTPUT_OFFLOAD) {
+        /* the offload output is started and stopped synchronously */
+        pthread_mutex_lock(&out->lock);
+        if (out->compr)
+            offload_stop(out, false);
+        pthread_mutex_lock(&adev->lock);
+        do_out_standby(out);
+        pthread_mutex_unlock(&adev->lock);
+        pthread_mutex_unlock(&out->lock);
+        return 0;
+    }
     
-    unlock_all_outputs(adev, NULL);
+    /* the PCM worker closes the PCMs and updates the routing */
+    pthread_mutex_lock(&out->lock);
+    if (out_get_state(out) != STREAM_STANDBY)
+        worker_request(out, WORKER_OUT_STANDBY);
+    pthread_mutex_unlock(&out->lock);
     
     return 0;
 }
 
-static int out_dump(const struct audio_stream *stream __unused, int fd __unused)
+static int out_dump(const struct audio_stream *stream, int fd)
 {
+    struct stream_out *out = (struct stream_out *)stream;
+    static const char * const state_names[] = {
+        "standby", "starting", "running", "disabled", "hdmi mix",
+    };
+    int i;
+    
+    pthread_mutex_lock(&out->lock);
+    if (out->type == OUTPUT_OFFLOAD)
+        dprintf(fd, "  Output stream %d: %u Hz, %u channels, format %#x, fragment %u bytes x %u%s\n",
+                out->type, out->config.rate, out->config.channels, out->format,
+                out->compr_config.fragment_size, out->compr_config.fragments,
+                out->offload_paused ? ", paused" : "");
+    else
+        dprintf(fd, "  Output stream %d: %u Hz, %u channels, period %u frames x %u%s\n",
+                out->type, out->config.rate, out->config.channels,
+                out->config.period_size, out->config.period_count,
+                out->mmap ? ", MMAP" : "");
+    if (out->remix)
+        dprintf(fd, "    Converted from %u channels\n", out->remix->in_channels);
+    if (out->type != OUTPUT_OFFLOAD && out->format != AUDIO_FORMAT_PCM_16_BIT)
+        dprintf(fd, "    Converted from format %#x to %u bit\n", out->format,
+                pcm_format_to_bits(out->config.format));
+    dprintf(fd, "    State: %s, frames written: %llu\n",
+            state_names[out_get_state(out)],
+            (unsigned long long)out->written);
+    if (out->type != OUTPUT_OFFLOAD)
+        dprintf(fd, "    Gain: %.3f%s\n", out->gain / (float)OUT_GAIN_UNITY,
+                out->gain_ramp_frames > 0 ? ", ramping" : "");
+    if (out->type != OUTPUT_OFFLOAD && out_get_state(out) == STREAM_RUNNING) {
+        /* the writes are the wakeups of the mixer thread */
+        struct timespec now;
+        int64_t elapsed_ms;
+        
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_ms = (now.tv_sec - out->start_time.tv_sec) * 1000LL +
+                     (now.tv_nsec - out->start_time.tv_nsec) / 1000000;
+        dprintf(fd, "    Wakeups: %u/s period interrupts, %.1f/s writes over %lld ms\n",
+                out->mmap ? 0 : out->config.rate / out->config.period_size,
+                elapsed_ms > 0 ?
+                (out->write_seq - out->start_write_seq) * 1000.0 / elapsed_ms : 0,
+                (long long)elapsed_ms);
+    }
+    dprintf(fd, "    Xruns:");
+    for (i = 0; i < XRUN_TOTAL; i++)
+        dprintf(fd, " %s %u", xrun_names[i],
+                __atomic_load_n(&out->xruns[i], __ATOMIC_RELAXED));
+    dprintf(fd, "\n");
+    pthread_mutex_unlock(&out->lock);
+    
     return 0;
 }
 
@@ -1218,6 +2568,9 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
         
         lock_all_outputs(adev);
         
+        /* write the mixer once for the whole rerouting sequence */
+        mixer_route_begin_batch(adev->mr);
+        
         if ((out->device != val) && (val != 0)) {
             /* Force standby if moving to/from SPDIF or if the output
              * device changes when in SPDIF mode */
@@ -1233,10 +2586,11 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
                 do_out_standby(out);
             }
             
-            if (adev->hdmi_drv_fd == 0) {
-                if (!out->standby && (out == adev->outputs[OUTPUT_HDMI] ||
-                                      !adev->outputs[OUTPUT_HDMI] ||
-                                      adev->outputs[OUTPUT_HDMI]->standby)) {
+            if (adev->hdmi_drv_fd >= 0) {
+                if (out_get_state(out) != STREAM_STANDBY &&
+                    (out->type == OUTPUT_HDMI ||
+                     !adev->outputs[OUTPUT_HDMI] ||
+                     out_get_state(adev->outputs[OUTPUT_HDMI]) == STREAM_STANDBY)) {
                     adev->out_device = output_devices(out) | val;
                     select_devices(adev);
                 }
@@ -1264,9 +2618,45 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
             }
         }
         
+        mixer_route_end_batch(adev->mr);
+        
         unlock_all_outputs(adev, NULL);
     }
     
+    /* gain of the output when it is mixed into the HDMI output */
+    if (out->type != OUTPUT_HDMI && out->type != OUTPUT_OFFLOAD &&
+        str_parms_get_str(parms, OUT_PARAMETER_HDMI_MIX_GAIN,
+                          value, sizeof(value)) >= 0) {
+        float gain = atof(value);
+        
+        if (gain >= 0.0f && gain <= 1.0f) {
+            pthread_mutex_lock(&adev->hdmi_mix_lock);
+            adev->hdmi_mix[out->type].gain = lrintf(gain * DSP_UNITY_GAIN);
+            pthread_mutex_unlock(&adev->hdmi_mix_lock);
+            ret = 0;
+        } else {
+            ret = -EINVAL;
+        }
+    }
+    
+    /* gapless playback: encoder delay and padding of the next track */
+    if (out->type == OUTPUT_OFFLOAD) {
+        pthread_mutex_lock(&out->lock);
+        if (str_parms_get_str(parms, AUDIO_OFFLOAD_CODEC_DELAY_SAMPLES,
+                              value, sizeof(value)) >= 0) {
+            out->gapless_mdata.encoder_delay = atoi(value);
+            out->send_gapless_mdata = true;
+            ret = 0;
+        }
+        if (str_parms_get_str(parms, AUDIO_OFFLOAD_CODEC_PADDING_SAMPLES,
+                              value, sizeof(value)) >= 0) {
+            out->gapless_mdata.encoder_padding = atoi(value);
+            out->send_gapless_mdata = true;
+            ret = 0;
+        }
+        pthread_mutex_unlock(&out->lock);
+    }
+    
     str_parms_destroy(parms);
     return ret;
 }
@@ -1279,12 +2669,13 @@ static char *out_get_parameters(const struct audio_stream *stream, const char *k
 {
     struct stream_out *out = (struct stream_out *)stream;
     struct str_parms *query = str_parms_create_str(keys);
-    const char *str;
+    char *str;
     char value[256];
     struct str_parms *reply = str_parms_create();
     size_t i, j;
     int ret;
     bool first = true;
+    bool has_reply = false;
     
     ret = str_parms_get_str(query, AUDIO_PARAMETER_STREAM_SUP_CHANNELS, value, sizeof(value));
     if (ret >= 0) {
@@ -1305,157 +2696,974 @@ static char *out_get_parameters(const struct audio_stream *stream, const char *k
             i++;
         }
         str_parms_add_str(reply, AUDIO_PARAMETER_STREAM_SUP_CHANNELS, value);
-        str = str_parms_to_str(reply);
-    } else {
-        str = keys;
+        has_reply = true;
+    }
+    
+    for (i = 0; i < XRUN_TOTAL; i++) {
+        char key[32];
+        
+        snprintf(key, sizeof(key), "xrun_%s", xrun_names[i]);
+        if (str_parms_has_key(query, key)) {
+            str_parms_add_int(reply, key,
+                              __atomic_load_n(&out->xruns[i], __ATOMIC_RELAXED));
+            has_reply = true;
+        }
+    }
+    
+    str = has_reply ? str_parms_to_str(reply) : strdup(keys);
+    
+    str_parms_destroy(query);
+    str_parms_destroy(reply);
+    return str;
+}
+
+static uint32_t out_get_latency(const struct audio_stream_out *stream)
+{
+    struct stream_out *out = (struct stream_out *)stream;
+    
+    if (out->type == OUTPUT_OFFLOAD)
+        return OFFLOAD_LATENCY_MS;
+    
+    return (out->config.period_size * out->config.period_count * 1000) /
+    out->config.rate;
+}
+
+/*
+ * The DSP applies the volume of the decoded stream, times the master
+ * volume.
+ * must be called with output stream and hw device mutexes locked
+ */
+static int set_offload_volume(struct stream_out *out, float master)
+{
+    struct mixer_ctl *ctl;
+    unsigned int i;
+    
+    ctl = mixer_get_ctl_by_name(mixer_route_get_mixer(out->dev->mr),
+                                OFFLOAD_VOLUME_CTL);
+    if (!ctl) {
+        ALOGW("%s: no %s control", __func__, OFFLOAD_VOLUME_CTL);
+        return -ENOSYS;
+    }
+    for (i = 0; i < mixer_ctl_get_num_values(ctl); i++)
+        mixer_ctl_set_percent(ctl, i, (int)(out->volume[i & 1] * master * 100));
+    
+    return 0;
+}
+
+/*
+ * Sets the software volume of a PCM output to its stream volume times the
+ * master volume, ramping from the current gain unless ramp is false.
+ * must be called with output stream mutex locked
+ */
+static void out_update_gain(struct stream_out *out, float master, bool ramp)
+{
+    /* only take left channel into account: the API is for stereo anyway */
+    float volume = out->volume[0] * master;
+    uint32_t target;
+    int32_t start, end, frames;
+    
+    if (volume >= 1.0f)
+        target = OUT_GAIN_UNITY;
+    else if (volume > 0.0f)
+        target = (uint32_t)(volume * OUT_GAIN_UNITY);
+    else
+        target = 0;
+    
+    if (target == out->gain_target)
+        return;
+    out->gain_target = target;
+    
+    /* dsp_gain_s16() stops short of unity, the ramp ends at 0xffff */
+    start = out->gain < 0xffff ? out->gain : 0xffff;
+    end = target < 0xffff ? target : 0xffff;
+    if (!ramp || start == end) {
+        out->gain = target;
+        out->gain_ramp_frames = 0;
+        return;
+    }
+    
+    frames = out->config.rate * OUT_VOLUME_RAMP_MS / 1000;
+    out->gain_step = (end - start) / frames;
+    if (out->gain_step == 0)
+        out->gain_step = end > start ? 1 : -1;
+    /* the last step of the ramp is the jump to the exact target */
+    out->gain_ramp_frames = (end - start) / out->gain_step;
+    out->gain = start;
+}
+
+static int out_set_volume(struct audio_stream_out *stream,
+                          float left,
+                          float right)
+{
+    struct stream_out *out = (struct stream_out *)stream;
+    struct audio_device *adev = out->dev;
+    int ret = 0;
+    
+    /* the mixer of the framework applies the volume of the other outputs */
+    if (out->type != OUTPUT_OFFLOAD && out->type != OUTPUT_HDMI)
+        return -ENOSYS;
+    
+    pthread_mutex_lock(&adev->lock_outputs);
+    pthread_mutex_lock(&out->lock);
+    out->volume[0] = left;
+    out->volume[1] = right;
+    if (out->type == OUTPUT_OFFLOAD) {
+        pthread_mutex_lock(&adev->lock);
+        ret = set_offload_volume(out, adev->master_volume);
+        pthread_mutex_unlock(&adev->lock);
+    } else {
+        out_update_gain(out, adev->master_volume, true);
+    }
+    pthread_mutex_unlock(&out->lock);
+    pthread_mutex_unlock(&adev->lock_outputs);
+    
+    return ret;
+}
+
+/* must be called with output stream mutex locked */
+static int16_t *out_get_buffer(struct out_buffer *buf, size_t bytes)
+{
+    if (buf->size < bytes) {
+        int16_t *data = realloc(buf->data, bytes);
+        
+        if (!data) {
+            ALOGE("%s: cannot allocate %zu bytes", __func__, bytes);
+            return NULL;
+        }
+        buf->data = data;
+        buf->size = bytes;
+    }
+    return buf->data;
+}
+
+/*
+ * Converts the audio of the HDMI output from the channels of the stream to
+ * the channels of its PCMs, in the remix buffer. Returns the converted
+ * audio, or NULL if the remix buffer cannot be allocated, and updates bytes
+ * to its size.
+ * must be called with output stream mutex locked
+ */
+static const void *out_remix(struct stream_out *out, const void *buffer,
+                             size_t *bytes)
+{
+    const struct dsp_matrix *m = out->remix;
+    size_t frames;
+    int16_t *dst;
+    
+    if (!m)
+        return buffer;
+    
+    frames = *bytes / (m->in_channels * sizeof(int16_t));
+    *bytes = frames * m->out_channels * sizeof(int16_t);
+    dst = out_get_buffer(&out->remix_buf, *bytes);
+    if (dst)
+        dsp_matrix_s16(dst, buffer, frames, m);
+    
+    return dst;
+}
+
+/*
+ * Converts the audio of an output with more than 16 bits to the format of
+ * its PCMs, in the convert buffer. Returns the converted audio, or NULL if
+ * the convert buffer cannot be allocated, and updates bytes to its size.
+ * must be called with output stream mutex locked
+ */
+static const void *out_convert(struct stream_out *out, const void *buffer,
+                               size_t *bytes)
+{
+    size_t samples;
+    void *dst;
+    PROFILE_START(start);
+    
+    if (out->format == AUDIO_FORMAT_PCM_16_BIT)
+        return buffer;
+    
+    samples = *bytes / audio_stream_out_frame_size(&out->stream) *
+              out->config.channels;
+    *bytes = samples * (pcm_format_to_bits(out->config.format) / 8);
+    dst = out_get_buffer(&out->convert_buf, *bytes);
+    if (dst)
+        dsp_convert(dst, pcm_dsp_format(out->config.format), buffer,
+                    out_dsp_format(out->format), samples);
+    
+    PROFILE_END(PROFILE_OUT_CONVERT, start);
+    return dst;
+}
+
+/* must be called with output stream mutex locked */
+static uint16_t out_gain_frames(struct stream_out *out, void *dst,
+                                const void *src, size_t frames,
+                                uint16_t gain, int16_t step)
+{
+    if (out->config.format == PCM_FORMAT_S24_LE)
+        return dsp_gain_s24(dst, src, frames, out->config.channels, gain, step);
+    return dsp_gain_s16(dst, src, frames, out->config.channels, gain, step);
+}
+
+/*
+ * Applies the software volume of the output to a copy of its audio, so
+ * that the buffer of the caller is left untouched. Returns the audio to
+ * write: the copy, or the audio itself at unity gain.
+ * must be called with output stream mutex locked
+ */
+static const void *out_apply_volume(struct stream_out *out, const void *buffer,
+                                    size_t bytes)
+{
+    size_t frame_size = out_pcm_frame_size(out);
+    size_t frames = bytes / frame_size;
+    size_t ramp = out->gain_ramp_frames < frames ? out->gain_ramp_frames : frames;
+    const char *src = buffer;
+    char *dst;
+    
+    if (ramp == 0 && out->gain == OUT_GAIN_UNITY)
+        return buffer;
+    
+    dst = (char *)out_get_buffer(&out->scratch, bytes);
+    if (!dst)
+        return buffer;
+    
+    if (ramp > 0) {
+        out->gain = out_gain_frames(out, dst, src, ramp, out->gain,
+                                    out->gain_step);
+        out->gain_ramp_frames -= ramp;
+        if (out->gain_ramp_frames == 0)
+            out->gain = out->gain_target;
+        dst += ramp * frame_size;
+        src += ramp * frame_size;
+        frames -= ramp;
+    }
+    
+    if (out->gain == OUT_GAIN_UNITY) {
+        memcpy(dst, src, frames * frame_size);
+    } else if (out->gain == 0) {
+        memset(dst, 0, frames * frame_size);
+    } else {
+        out_gain_frames(out, dst, src, frames, out->gain, 0);
+    }
+    
+    return out->scratch.data;
+}
+
+/* must be called with output stream mutex locked */
+/*
+ * Writes to a PCM opened in MMAP NOIRQ mode. There is no period interrupt
+ * to wait for: the free space is computed from the hardware position and
+ * the caller sleeps until the DMA has consumed enough frames.
+ */
+static int out_write_mmap(struct stream_out *out, struct pcm *pcm,
+                          const void *buffer, size_t bytes)
+{
+    unsigned int frame_size = pcm_frames_to_bytes(pcm, 1);
+    unsigned int buffer_size = pcm_get_buffer_size(pcm);
+    const char *src = buffer;
+    size_t frames = bytes / frame_size;
+    
+    while (frames > 0) {
+        void *areas;
+        unsigned int offset;
+        unsigned int count;
+        int avail;
+        int ret;
+        
+        avail = pcm_mmap_avail(pcm);
+        if (avail < 0 || (unsigned int)avail > buffer_size) {
+            /* underrun: the DMA went past the data, start over */
+            ALOGW("%s: underrun, restarting", __func__);
+            out_count_xrun(out, XRUN_UNDERRUN);
+            ret = pcm_prepare(pcm);
+            if (ret != 0)
+                return ret;
+            out->mmap_started = false;
+            continue;
+        }
+        
+        /* wait until one period, or what is left to write, is free */
+        count = frames < out->config.period_size ?
+                frames : out->config.period_size;
+        if ((unsigned int)avail < count) {
+            usleep(((count - avail) * 1000000 + out->config.rate - 1) /
+                   out->config.rate);
+            continue;
+        }
+        
+        count = (size_t)avail < frames ? (unsigned int)avail : frames;
+        ret = pcm_mmap_begin(pcm, &areas, &offset, &count);
+        if (ret != 0)
+            return ret;
+        
+        memcpy((char *)areas + pcm_frames_to_bytes(pcm, offset), src,
+               pcm_frames_to_bytes(pcm, count));
+        
+        ret = pcm_mmap_commit(pcm, offset, count);
+        if (ret < 0)
+            return ret;
+        
+        src += pcm_frames_to_bytes(pcm, count);
+        frames -= count;
+        
+        if (!out->mmap_started) {
+            ret = pcm_start(pcm);
+            if (ret != 0)
+                return ret;
+            out->mmap_started = true;
+        }
+    }
+    
+    return 0;
+}
+
+/*
+ * must be called with output stream mutex locked
+ * The PCMs written with pcm_write() are opened with PCM_NORESTART, so that
+ * an underrun is returned as -EPIPE instead of being silently recovered by
+ * tinyalsa: count it, prepare the PCM and write the audio again.
+ */
+static int out_write_pcm(struct stream_out *out, int card,
+                         const void *buffer, size_t bytes)
+{
+    struct pcm *pcm = out->pcm[card];
+    int ret;
+    
+    if (card == PCM_CARD && out->mmap)
+        return out_write_mmap(out, pcm, buffer, bytes);
+    
+    ret = pcm_write(pcm, (void *)buffer, bytes);
+    if (ret == 0)
+        return 0;
+    
+    if (ret == -EPIPE) {
+        ALOGW("%s: underrun on card %d, restarting", __func__, card);
+        out_count_xrun(out, XRUN_UNDERRUN);
+    } else {
+        ALOGE("%s: pcm_write() on card %d failed: %s", __func__, card,
+              pcm_get_error(pcm));
+        out_count_xrun(out, XRUN_WRITE);
+    }
+    
+    ret = pcm_prepare(pcm);
+    if (ret == 0)
+        ret = pcm_write(pcm, (void *)buffer, bytes);
+    
+    return ret;
+}
+
+static int out_write_pcms(struct stream_out *out, const void *buffer,
+                          size_t bytes)
+{
+    int ret = 0;
+    int i;
+    
+    /* Write to all active PCMs */
+    for (i = 0; i < PCM_TOTAL; i++)
+        if (out->pcm[i]) {
+            ret = out_write_pcm(out, i, buffer, bytes);
+            if (ret != 0)
+                break;
+        }
+    if (ret == 0)
+        out->written += bytes / out_pcm_frame_size(out);
+    
+    return ret;
+}
+
+/*
+ * Queues the audio of an output in STREAM_HDMI_MIX for the HDMI output.
+ * The HDMI output reads it at the pace of its PCM, so the caller waits for
+ * room like it would on a PCM, but the audio is dropped if the HDMI output
+ * stops reading or the output leaves STREAM_HDMI_MIX.
+ * must be called with output stream mutex locked, which is released while
+ * waiting so that the standby and the routing of the outputs do not wait
+ */
+static void out_write_hdmi_mix(struct stream_out *out, const void *buffer,
+                               size_t bytes)
+{
+    struct audio_device *adev = out->dev;
+    struct hdmi_mix_source *source = &adev->hdmi_mix[out->type];
+    const int16_t *src = buffer;
+    size_t frames = bytes / (2 * sizeof(int16_t));
+    struct timespec deadline;
+    uint64_t timeout_ns;
+    int ret;
+    
+    /* the audio written and the whole ring must have been read by then */
+    timeout_ns = (frames + HDMI_MIX_BUFFER_FRAMES) * 1000000000ULL /
+                 out->config.rate;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ns / 1000000000;
+    deadline.tv_nsec += timeout_ns % 1000000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    
+    pthread_mutex_lock(&adev->hdmi_mix_lock);
+    while (frames > 0 && source->active) {
+        size_t room = HDMI_MIX_BUFFER_FRAMES - (source->written - source->read);
+        size_t offset = source->written % HDMI_MIX_BUFFER_FRAMES;
+        size_t count;
+        
+        if (room == 0) {
+            /*
+             * Leaving STREAM_HDMI_MIX goes through hdmi_mix_set_active(),
+             * which wakes us up. The buffers of out_write(), which buffer
+             * may point to, are only used by out_write().
+             */
+            pthread_mutex_unlock(&out->lock);
+            ret = pthread_cond_timedwait(&adev->hdmi_mix_cond,
+                                         &adev->hdmi_mix_lock, &deadline);
+            pthread_mutex_unlock(&adev->hdmi_mix_lock);
+            pthread_mutex_lock(&out->lock);
+            if (out_get_state(out) != STREAM_HDMI_MIX)
+                return;
+            if (ret == ETIMEDOUT) {
+                out_count_xrun(out, XRUN_DISABLED);
+                return;
+            }
+            pthread_mutex_lock(&adev->hdmi_mix_lock);
+            continue;
+        }
+        
+        count = frames < room ? frames : room;
+        if (count > HDMI_MIX_BUFFER_FRAMES - offset)
+            count = HDMI_MIX_BUFFER_FRAMES - offset;
+        memcpy(source->buffer + 2 * offset, src, count * 2 * sizeof(int16_t));
+        source->written += count;
+        src += 2 * count;
+        frames -= count;
+    }
+    pthread_mutex_unlock(&adev->hdmi_mix_lock);
+}
+
+/*
+ * Mixes the audio queued by the outputs in STREAM_HDMI_MIX into a copy of
+ * the HDMI audio, made in the scratch buffer unless the audio is already
+ * there. Returns the audio to write: the copy, or the HDMI audio itself
+ * when there is nothing to mix.
+ * must be called with output stream mutex locked
+ */
+static const void *hdmi_mix_outputs(struct stream_out *out, const void *buffer,
+                                    size_t bytes)
+{
+    struct audio_device *adev = out->dev;
+    unsigned int channels = out->config.channels;
+    size_t frames = bytes / (channels * sizeof(int16_t));
+    enum output_type type;
+    bool mixed = false;
+    
+    if (!out_get_buffer(&out->scratch, bytes))
+        return buffer;
+    
+    pthread_mutex_lock(&adev->hdmi_mix_lock);
+    for (type = 0; type < OUTPUT_TOTAL; type++) {
+        struct hdmi_mix_source *source = &adev->hdmi_mix[type];
+        size_t avail = source->written - source->read;
+        size_t done = 0;
+        
+        if (!source->active || avail == 0)
+            continue;
+        
+        if (!mixed) {
+            if (buffer != out->scratch.data)
+                memcpy(out->scratch.data, buffer, bytes);
+            mixed = true;
+        }
+        
+        /* what the output did not write in time is silence */
+        if (avail > frames)
+            avail = frames;
+        while (done < avail) {
+            size_t offset = source->read % HDMI_MIX_BUFFER_FRAMES;
+            size_t count = avail - done;
+            
+            if (count > HDMI_MIX_BUFFER_FRAMES - offset)
+                count = HDMI_MIX_BUFFER_FRAMES - offset;
+            dsp_mix_stereo_s16(out->scratch.data + done * channels, channels,
+                               source->buffer + 2 * offset, count,
+                               source->gain);
+            source->read += count;
+            done += count;
+        }
+    }
+    if (mixed)
+        pthread_cond_broadcast(&adev->hdmi_mix_cond);
+    pthread_mutex_unlock(&adev->hdmi_mix_lock);
+    
+    return mixed ? out->scratch.data : buffer;
+}
+
+/*
+ * Writes compressed data. With a callback, the write does not block: when
+ * the DSP buffer is full, it returns the bytes accepted and the offload
+ * thread sends STREAM_CBK_EVENT_WRITE_READY once there is room again.
+ * must be called with output stream mutex locked
+ */
+static ssize_t out_write_offload(struct stream_out *out, const void *buffer,
+                                 size_t bytes)
+{
+    struct audio_device *adev = out->dev;
+    int state = out_get_state(out);
+    int ret;
+    
+    if (state == STREAM_STANDBY) {
+        pthread_mutex_lock(&adev->lock);
+        ret = start_output_stream(out);
+        pthread_mutex_unlock(&adev->lock);
+        if (ret != 0)
+            return ret;
+        state = out_get_state(out);
+    }
+    
+    if (state == STREAM_DISABLED) {
+        out_count_xrun(out, XRUN_DISABLED);
+        return -ENODEV;
+    }
+    
+    if (out->send_gapless_mdata) {
+        compress_set_gapless_metadata(out->compr, &out->gapless_mdata);
+        out->send_gapless_mdata = false;
+    }
+    
+    ret = compress_write(out->compr, buffer, bytes);
+    if (ret < 0) {
+        ALOGE("%s: compress_write() failed: %s", __func__,
+              compress_get_error(out->compr));
+        out_count_xrun(out, XRUN_WRITE);
+        return ret;
+    }
+    
+    if ((size_t)ret < bytes && out->offload_callback)
+        offload_queue_cmd(out, OFFLOAD_CMD_WAIT_FOR_BUFFER);
+    
+    if (!out->offload_started && ret > 0) {
+        compress_start(out->compr);
+        out->offload_started = true;
+    }
+    
+    return ret;
+}
+
+static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
+                         size_t bytes)
+{
+    int ret = 0;
+    struct stream_out *out = (struct stream_out *)stream;
+    bool paced = false; /* the audio did not block on a PCM */
+    size_t pcm_bytes = bytes;
+    ssize_t written;
+    int state;
+    PROFILE_START(start);
+    
+    if (out->type == OUTPUT_OFFLOAD) {
+        pthread_mutex_lock(&out->lock);
+        written = out_write_offload(out, buffer, bytes);
+        pthread_mutex_unlock(&out->lock);
+        PROFILE_END(PROFILE_OUT_WRITE, start);
+        return written;
+    }
+    
+    pthread_mutex_lock(&out->lock);
+    out->write_seq++;
+    
+    state = out_get_state(out);
+    if (state == STREAM_STANDBY) {
+        /* let the PCM worker open the PCMs, do not wait for the hardware */
+        clock_gettime(CLOCK_MONOTONIC, &out->start_time);
+        out->start_write_seq = out->write_seq;
+        out_set_state(out, STREAM_STARTING);
+        worker_request(out, WORKER_OUT_START);
+        state = STREAM_STARTING;
+    }
+    
+    if (state == STREAM_DISABLED) {
+        /* the HDMI output owns the I2S: drop the audio, this is not an error */
+        out_count_xrun(out, XRUN_DISABLED);
+        paced = true;
+        goto exit;
+    }
+    
+    /* from here on, the audio has the format and channels of the PCMs */
+    buffer = out_convert(out, buffer, &pcm_bytes);
+    if (buffer)
+        buffer = out_remix(out, buffer, &pcm_bytes);
+    if (!buffer) {
+        ret = -ENOMEM;
+        goto exit;
+    }
+    buffer = out_apply_volume(out, buffer, pcm_bytes);
+    
+    if (state == STREAM_STARTING) {
+        /*
+         * Keep up to one kernel buffer of audio until the PCMs are open and
+         * pace the caller as if it had been written.
+         */
+        size_t copy = out->pending_size - out->pending_bytes;
+        
+        if (copy > pcm_bytes)
+            copy = pcm_bytes;
+        memcpy(out->pending + out->pending_bytes, buffer, copy);
+        out->pending_bytes += copy;
+        if (copy == pcm_bytes) {
+            paced = true;
+            goto exit;
+        }
+        
+        /*
+         * The pending buffer is full: block until the worker has started
+         * this stream, as pcm_write() would on a full kernel buffer. The
+         * worker needs the stream mutex to start the stream. The buffers of
+         * out_write(), which buffer may point to, are only used by
+         * out_write().
+         */
+        buffer = (const char *)buffer + copy;
+        pcm_bytes -= copy;
+        while (out_get_state(out) == STREAM_STARTING)
+            pthread_cond_wait(&out->start_cond, &out->lock);
+        
+        state = out_get_state(out);
+        if (state != STREAM_RUNNING && state != STREAM_HDMI_MIX) {
+            /* the start failed or the stream was put in standby meanwhile */
+            ALOGW("%s: output not started, dropping %zu bytes", __func__,
+                  out->pending_bytes + pcm_bytes);
+            out->pending_bytes = 0;
+            ret = -ENODEV;
+            goto exit;
+        }
+    }
+    
+    if (state == STREAM_HDMI_MIX) {
+        if (out->pending_bytes > 0) {
+            out_write_hdmi_mix(out, out->pending, out->pending_bytes);
+            out->pending_bytes = 0;
+        }
+        out_write_hdmi_mix(out, buffer, pcm_bytes);
+        goto exit;
+    }
+    
+    if (out->pending_bytes > 0) {
+        ret = out_write_pcms(out, out->pending, out->pending_bytes);
+        out->pending_bytes = 0;
+        if (ret != 0)
+            goto exit;
+    }
+    
+    if (out->type == OUTPUT_HDMI)
+        buffer = hdmi_mix_outputs(out, buffer, pcm_bytes);
+    
+    ret = out_write_pcms(out, buffer, pcm_bytes);
+    
+exit:
+    pthread_mutex_unlock(&out->lock);
+    
+    /* no PCM to block on: pace the caller as if the audio had been played */
+    if (paced) {
+        usleep(bytes * 1000000 / audio_stream_out_frame_size(stream) /
+               out_get_sample_rate(&stream->common));
+    }
+    
+    PROFILE_END(PROFILE_OUT_WRITE, start);
+    return ret != 0 ? ret : (ssize_t)bytes;
+}
+
+static int out_add_audio_effect(const struct audio_stream *stream __unused,
+                                effect_handle_t effect __unused)
+{
+    return 0;
+}
+
+static int out_remove_audio_effect(const struct audio_stream *stream __unused,
+                                   effect_handle_t effect __unused)
+{
+    return 0;
+}
+
+static int out_set_callback(struct audio_stream_out *stream,
+                            stream_callback_t callback, void *cookie)
+{
+    struct stream_out *out = (struct stream_out *)stream;
+    
+    pthread_mutex_lock(&out->lock);
+    out->offload_callback = callback;
+    out->offload_cookie = cookie;
+    pthread_mutex_unlock(&out->lock);
+    
+    return 0;
+}
+
+static int out_pause(struct audio_stream_out *stream)
+{
+    struct stream_out *out = (struct stream_out *)stream;
+    int ret = 0;
+    
+    pthread_mutex_lock(&out->lock);
+    if (out->offload_started && !out->offload_paused) {
+        ret = compress_pause(out->compr);
+        if (ret == 0)
+            out->offload_paused = true;
+    }
+    pthread_mutex_unlock(&out->lock);
+    
+    return ret;
+}
+
+static int out_resume(struct audio_stream_out *stream)
+{
+    struct stream_out *out = (struct stream_out *)stream;
+    int ret = 0;
+    
+    pthread_mutex_lock(&out->lock);
+    if (out->offload_started && out->offload_paused) {
+        ret = compress_resume(out->compr);
+        if (ret == 0)
+            out->offload_paused = false;
+    }
+    pthread_mutex_unlock(&out->lock);
+    
+    return ret;
+}
+
+/* drops the data written but not played, e.g. on seek */
+static int out_flush(struct audio_stream_out *stream)
+{
+    struct stream_out *out = (struct stream_out *)stream;
+    
+    pthread_mutex_lock(&out->lock);
+    if (out->compr)
+        offload_stop(out, false);
+    pthread_mutex_unlock(&out->lock);
+    
+    return 0;
+}
+
+/*
+ * Returns immediately: the offload thread sends STREAM_CBK_EVENT_DRAIN_READY
+ * when the data written has been played, or only the current track for
+ * AUDIO_DRAIN_EARLY_NOTIFY so that the next one can be written gaplessly.
+ */
+static int out_drain(struct audio_stream_out *stream, audio_drain_type_t type)
+{
+    struct stream_out *out = (struct stream_out *)stream;
+    int ret;
+    
+    pthread_mutex_lock(&out->lock);
+    if (!out->offload_callback)
+        ret = -ENOSYS;
+    else
+        ret = offload_queue_cmd(out, type == AUDIO_DRAIN_EARLY_NOTIFY ?
+                                     OFFLOAD_CMD_PARTIAL_DRAIN :
+                                     OFFLOAD_CMD_DRAIN);
+    pthread_mutex_unlock(&out->lock);
+    
+    return ret;
+}
+
+/*
+ * Adds a sample to a presentation clock and returns the presented frames
+ * at its time according to the fit.
+ */
+static int64_t pres_clock_update(struct pres_clock *clock, int64_t time_ns,
+                                 int64_t frames, unsigned int rate)
+{
+    double sum_t = 0, sum_f = 0, sum_tt = 0, sum_tf = 0, det;
+    unsigned int i, n;
+    
+    if (clock->count > 0) {
+        unsigned int last = (clock->next + PRES_CLOCK_SAMPLES - 1) %
+                            PRES_CLOCK_SAMPLES;
+        int64_t delta_ns = time_ns - clock->time_ns[last];
+        int64_t error = frames - clock->frames[last] -
+                        delta_ns * rate / 1000000000;
+        
+        if (delta_ns < 0 ||
+            llabs(error) > (int64_t)PRES_CLOCK_MAX_ERROR_US * rate / 1000000) {
+            clock->count = 0;
+        } else if (delta_ns == 0) {
+            /* same DMA position as the last sample: replace it */
+            clock->next = last;
+            clock->count--;
+        }
+    }
+    
+    if (clock->count == 0)
+        clock->next = 0;
+    clock->time_ns[clock->next] = time_ns;
+    clock->frames[clock->next] = frames;
+    clock->next = (clock->next + 1) % PRES_CLOCK_SAMPLES;
+    if (clock->count < PRES_CLOCK_SAMPLES)
+        clock->count++;
+    
+    n = clock->count;
+    if (n < 3)
+        return frames;
+    
+    /* fit frames = a + b * t with t relative to the new sample */
+    for (i = 0; i < n; i++) {
+        unsigned int j = (clock->next + PRES_CLOCK_SAMPLES - 1 - i) %
+                         PRES_CLOCK_SAMPLES;
+        double t = (clock->time_ns[j] - time_ns) / 1000000000.0;
+        double f = clock->frames[j] - frames;
+        
+        sum_t += t;
+        sum_f += f;
+        sum_tt += t * t;
+        sum_tf += t * f;
     }
+    det = n * sum_tt - sum_t * sum_t;
+    if (det <= 0)
+        return frames;
     
-    str_parms_destroy(query);
-    str_parms_destroy(reply);
-    return strdup(str);
+    return frames + llrint((sum_f * sum_tt - sum_t * sum_tf) / det);
 }
 
-static uint32_t out_get_latency(const struct audio_stream_out *stream)
+/* must be called with output stream mutex locked */
+static int64_t out_downstream_latency(struct stream_out *out, int card)
 {
-    struct stream_out *out = (struct stream_out *)stream;
+    audio_devices_t devices = out->device;
+    unsigned int latency_us = 0;
+    size_t i;
     
-    return (out->config.period_size * out->config.period_count * 1000) /
-    out->config.rate;
-}
-
-static int out_set_volume(struct audio_stream_out *stream,
-                          float left,
-                          float right __unused)
-{
-    struct stream_out *out = (struct stream_out *)stream;
-    struct audio_device *adev = out->dev;
+    if (card == PCM_CARD_SPDIF)
+        devices &= AUDIO_DEVICE_OUT_DGTL_DOCK_HEADSET;
+    else
+        devices &= ~AUDIO_DEVICE_OUT_DGTL_DOCK_HEADSET;
     
-    if (out == adev->outputs[OUTPUT_HDMI]) {
-        /* only take left channel into account: the API is for stereo anyway */
-        out->muted = (left == 0.0f);
-        return 0;
+    for (i = 0; i < ARRAY_SIZE(downstream_latencies); i++) {
+        if ((devices & downstream_latencies[i].devices) &&
+            downstream_latencies[i].latency_us > latency_us)
+            latency_us = downstream_latencies[i].latency_us;
     }
-    return -ENOSYS;
+    
+    return (int64_t)latency_us * out->config.rate / 1000000;
 }
 
-static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
-                         size_t bytes)
+/*
+ * Each open PCM has its own clock: the frames written, less those still in
+ * the kernel buffer and the downstream latency of its devices. When both
+ * cards play, the one which is heard last is reported.
+ * must be called with output stream mutex locked
+ */
+static int out_get_presented_frames(struct stream_out *out, uint64_t *frames,
+                                    struct timespec *timestamp)
 {
-    int ret = 0;
-    struct stream_out *out = (struct stream_out *)stream;
-    struct audio_device *adev = out->dev;
+    int64_t presented = -1;
     int i;
     
-    /* FIXME This comment is no longer correct
-     * acquiring hw device mutex systematically is useful if a low
-     * priority thread is waiting on the output stream mutex - e.g.
-     * executing out_set_parameters() while holding the hw device
-     * mutex
-     */
-    pthread_mutex_lock(&out->lock);
-    if (out->standby) {
-        pthread_mutex_unlock(&out->lock);
-        lock_all_outputs(adev);
-        if (!out->standby) {
-            unlock_all_outputs(adev, out);
-            goto false_alarm;
-        }
-        ret = start_output_stream(out);
-        if (ret < 0) {
-            unlock_all_outputs(adev, NULL);
-            goto final_exit;
-        }
-        out->standby = false;
-        unlock_all_outputs(adev, out);
-    }
-false_alarm:
+    /* the PCM worker owns the PCMs while the stream is starting */
+    if (out_get_state(out) != STREAM_RUNNING)
+        return -ENODEV;
     
-    if (out->disabled) {
-        ret = -EPIPE;
-        goto exit;
+    /* the DSP counts the frames decoded since compress_start() */
+    if (out->type == OUTPUT_OFFLOAD) {
+        unsigned long samples;
+        unsigned int rate;
+        
+        if (!out->offload_started ||
+            compress_get_tstamp(out->compr, &samples, &rate) != 0)
+            return -ENODEV;
+        *frames = samples;
+        clock_gettime(CLOCK_MONOTONIC, timestamp);
+        return 0;
     }
     
-    if (out->muted)
-        memset((void *)buffer, 0, bytes);
-    
-    /* Write to all active PCMs */
-    for (i = 0; i < PCM_TOTAL; i++)
-        if (out->pcm[i]) {
-            ret = pcm_write(out->pcm[i], (void *)buffer, bytes);
-            if (ret != 0)
-                break;
+    for (i = 0; i < PCM_TOTAL; i++) {
+        unsigned int buffer_size, avail;
+        struct timespec ts;
+        int64_t pcm_frames;
+        
+        if (!out->pcm[i] || pcm_get_htimestamp(out->pcm[i], &avail, &ts) != 0)
+            continue;
+        
+        /* skip the PCM if it underran */
+        buffer_size = pcm_get_buffer_size(out->pcm[i]);
+        if (avail > buffer_size)
+            continue;
+        
+        pcm_frames = (int64_t)out->written - (buffer_size - avail) -
+                     out_downstream_latency(out, i);
+        if (pcm_frames < 0)
+            continue;
+        
+        pcm_frames = pres_clock_update(&out->clock[i],
+                                       ts.tv_sec * 1000000000LL + ts.tv_nsec,
+                                       pcm_frames, out->config.rate);
+        if (presented < 0 || pcm_frames < presented) {
+            presented = pcm_frames;
+            *timestamp = ts;
         }
-    if (ret == 0)
-        out->written += bytes / (out->config.channels * sizeof(short));
+    }
     
-exit:
-    pthread_mutex_unlock(&out->lock);
-final_exit:
+    if (presented < 0)
+        return -ENODEV;
     
-    if (ret != 0) {
-        usleep(bytes * 1000000 / audio_stream_out_frame_size(stream) /
-               out_get_sample_rate(&stream->common));
-    }
+    /* the fit must not make the position go backwards */
+    if ((uint64_t)presented < out->presented)
+        presented = out->presented;
+    out->presented = presented;
+    *frames = presented;
     
-    return bytes;
-}
-
-static int out_get_render_position(const struct audio_stream_out *stream __unused,
-                                   uint32_t *dsp_frames __unused)
-{
-    return -EINVAL;
-}
-
-static int out_add_audio_effect(const struct audio_stream *stream __unused,
-                                effect_handle_t effect __unused)
-{
     return 0;
 }
 
-static int out_remove_audio_effect(const struct audio_stream *stream __unused,
-                                   effect_handle_t effect __unused)
+static int out_get_presentation_position(const struct audio_stream_out *stream,
+                                         uint64_t *frames, struct timespec *timestamp)
 {
-    return 0;
+    struct stream_out *out = (struct stream_out *)stream;
+    int ret;
+    
+    pthread_mutex_lock(&out->lock);
+    ret = out_get_presented_frames(out, frames, timestamp);
+    pthread_mutex_unlock(&out->lock);
+    
+    return ret == 0 ? 0 : -1;
 }
 
-static int out_get_next_write_timestamp(const struct audio_stream_out *stream __unused,
-                                        int64_t *timestamp __unused)
+/* frames presented since the stream left standby */
+static int out_get_render_position(const struct audio_stream_out *stream,
+                                   uint32_t *dsp_frames)
 {
-    return -EINVAL;
+    struct stream_out *out = (struct stream_out *)stream;
+    struct timespec timestamp;
+    uint64_t frames;
+    int ret;
+    
+    if (dsp_frames == NULL)
+        return -EINVAL;
+    
+    pthread_mutex_lock(&out->lock);
+    ret = out_get_presented_frames(out, &frames, &timestamp);
+    if (ret == 0)
+        *dsp_frames = frames > out->start_frames ?
+                      (uint32_t)(frames - out->start_frames) : 0;
+    pthread_mutex_unlock(&out->lock);
+    
+    return ret == 0 ? 0 : -EINVAL;
 }
 
-static int out_get_presentation_position(const struct audio_stream_out *stream,
-                                         uint64_t *frames, struct timespec *timestamp)
+/*
+ * Time in microseconds, on CLOCK_MONOTONIC, at which the next frame
+ * written will be presented: everything written before it has to be
+ * played first.
+ */
+static int out_get_next_write_timestamp(const struct audio_stream_out *stream,
+                                        int64_t *timestamp)
 {
     struct stream_out *out = (struct stream_out *)stream;
-    int ret = -1;
-    
-    pthread_mutex_lock(&out->lock);
+    struct timespec ts;
+    uint64_t frames;
+    int ret;
     
-    int i;
-    // There is a question how to implement this correctly when there is more than one PCM stream.
-    // We are just interested in the frames pending for playback in the kernel buffer here,
-    // not the total played since start.  The current behavior should be safe because the
-    // cases where both cards are active are marginal.
-    for (i = 0; i < PCM_TOTAL; i++)
-        if (out->pcm[i]) {
-            size_t avail;
-            if (pcm_get_htimestamp(out->pcm[i], &avail, timestamp) == 0) {
-                size_t kernel_buffer_size = out->config.period_size * out->config.period_count;
-                // FIXME This calculation is incorrect if there is buffering after app processor
-                int64_t signed_frames = out->written - kernel_buffer_size + avail;
-                // It would be unusual for this value to be negative, but check just in case ...
-                if (signed_frames >= 0) {
-                    *frames = signed_frames;
-                    ret = 0;
-                }
-                break;
-            }
-        }
+    /* out->written does not count the frames of compressed data */
+    if (timestamp == NULL || out->type == OUTPUT_OFFLOAD)
+        return -EINVAL;
     
+    pthread_mutex_lock(&out->lock);
+    ret = out_get_presented_frames(out, &frames, &ts);
+    if (ret == 0)
+        *timestamp = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000 +
+                     (int64_t)(out->written - frames) * 1000000 /
+                     out->config.rate;
     pthread_mutex_unlock(&out->lock);
     
-    return ret;
+    return ret == 0 ? 0 : -EINVAL;
 }
 
 /** audio_stream_in implementation **/
@@ -1535,8 +3743,26 @@ static int in_standby(struct audio_stream *stream)
     return 0;
 }
 
-static int in_dump(const struct audio_stream *stream __unused, int fd __unused)
+static int in_dump(const struct audio_stream *stream, int fd)
 {
+    struct stream_in *in = (struct stream_in *)stream;
+    
+    pthread_mutex_lock(&in->lock);
+    dprintf(fd, "  Input stream: %u Hz, period %u frames x %u%s\n",
+            in->requested_rate, in->config->period_size,
+            in->config->period_count, in->mmap ? ", MMAP" : "");
+    dprintf(fd, "    Overruns: %u, frames lost: %llu\n", in->overruns,
+            (unsigned long long)in->total_frames_lost);
+    if (in->overruns != 0) {
+        struct timespec now;
+        
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        dprintf(fd, "    Last overrun: %lld ms ago\n",
+                (long long)(now.tv_sec - in->last_overrun_time.tv_sec) * 1000 +
+                (now.tv_nsec - in->last_overrun_time.tv_nsec) / 1000000);
+    }
+    pthread_mutex_unlock(&in->lock);
+    
     return 0;
 }
 
@@ -1609,28 +3835,11 @@ static int in_set_gain(struct audio_stream_in *stream __unused,
 
 static void in_apply_ramp(struct stream_in *in, int16_t *buffer, size_t frames)
 {
-    size_t i;
-    uint16_t vol = in->ramp_vol;
-    uint16_t step = in->ramp_step;
-    
     frames = (frames < in->ramp_frames) ? frames : in->ramp_frames;
     
-    if (in->channel_mask == AUDIO_CHANNEL_IN_MONO)
-        for (i = 0; i < frames; i++)
-        {
-            buffer[i] = (int16_t)((buffer[i] * vol) >> 16);
-            vol += step;
-        }
-    else
-        for (i = 0; i < frames; i++)
-        {
-            buffer[2*i] = (int16_t)((buffer[2*i] * vol) >> 16);
-            buffer[2*i + 1] = (int16_t)((buffer[2*i + 1] * vol) >> 16);
-            vol += step;
-        }
-    
-    
-    in->ramp_vol = vol;
+    in->ramp_vol = dsp_ramp_s16(buffer, frames,
+                                audio_channel_count_from_in_mask(in->channel_mask),
+                                in->ramp_vol, in->ramp_step);
     in->ramp_frames -= frames;
 }
 
@@ -1641,6 +3850,7 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
     struct stream_in *in = (struct stream_in *)stream;
     struct audio_device *adev = in->dev;
     size_t frames_rq = bytes / audio_stream_in_frame_size(stream);
+    PROFILE_START(start);
     
     /*
      * acquiring hw device mutex systematically is useful if a low
@@ -1663,8 +3873,10 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
      else */
     ret = read_frames(in, buffer, frames_rq);
     
-    if (ret > 0)
+    if (ret > 0) {
+        in->frames_read += frames_rq;
         ret = 0;
+    }
     
     if (in->ramp_frames > 0)
         in_apply_ramp(in, buffer, frames_rq);
@@ -1682,12 +3894,59 @@ exit:
                in_get_sample_rate(&stream->common));
     
     pthread_mutex_unlock(&in->lock);
+    
+    PROFILE_END(PROFILE_IN_READ, start);
     return bytes;
 }
 
-static uint32_t in_get_input_frames_lost(struct audio_stream_in *stream __unused)
+/* frames lost to overruns since the last call */
+static uint32_t in_get_input_frames_lost(struct audio_stream_in *stream)
 {
-    return 0;
+    struct stream_in *in = (struct stream_in *)stream;
+    uint32_t frames_lost;
+    
+    pthread_mutex_lock(&in->lock);
+    frames_lost = in->frames_lost;
+    in->frames_lost = 0;
+    pthread_mutex_unlock(&in->lock);
+    
+    return frames_lost;
+}
+
+/*
+ * The position is that of the last frame captured by the driver: the
+ * frames read by the client plus those still in the driver buffer,
+ * in in->buffer and in the resampler.
+ */
+static int in_get_capture_position(const struct audio_stream_in *stream,
+                                   int64_t *frames, int64_t *time)
+{
+    struct stream_in *in = (struct stream_in *)stream;
+    struct timespec timestamp;
+    unsigned int avail;
+    int ret = -ENOSYS;
+    
+    if (frames == NULL || time == NULL)
+        return -EINVAL;
+    
+    pthread_mutex_lock(&in->lock);
+    
+    if (in->pcm && pcm_get_htimestamp(in->pcm, &avail, &timestamp) == 0) {
+        int64_t buffered = (int64_t)(avail + in->frames_in) *
+                           in->requested_rate / in->config->rate;
+        
+        if (in->resampler)
+            buffered += (int64_t)in->resampler->delay_ns(in->resampler) *
+                        in->requested_rate / 1000000000;
+        
+        *frames = in->frames_read + buffered;
+        *time = timestamp.tv_sec * 1000000000LL + timestamp.tv_nsec;
+        ret = 0;
+    }
+    
+    pthread_mutex_unlock(&in->lock);
+    
+    return ret;
 }
 
 static int in_add_audio_effect(const struct audio_stream *stream __unused,
@@ -1714,6 +3973,7 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     struct stream_out *out;
     int ret;
     enum output_type type;
+    bool has_volume;
     
     out = (struct stream_out *)calloc(1, sizeof(struct stream_out));
     if (!out)
@@ -1724,14 +3984,65 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     if (devices == AUDIO_DEVICE_NONE)
         devices = AUDIO_DEVICE_OUT_SPEAKER;
     out->device = devices;
-    
-    if (flags & AUDIO_OUTPUT_FLAG_DIRECT &&
-        devices == AUDIO_DEVICE_OUT_AUX_DIGITAL) {
+    out->format = AUDIO_FORMAT_PCM_16_BIT;
+    
+    if (flags & AUDIO_OUTPUT_FLAG_COMPRESS_OFFLOAD) {
+        /* the DSP decodes MP3 at the rates of audio_policy.conf */
+        if ((config->offload_info.format & AUDIO_FORMAT_MAIN_MASK) != AUDIO_FORMAT_MP3 ||
+            (config->sample_rate != 32000 && config->sample_rate != 44100 &&
+             config->sample_rate != 48000)) {
+            ALOGE("%s: unsupported offload format %#x at %u Hz", __func__,
+                  config->offload_info.format, config->sample_rate);
+            ret = -EINVAL;
+            goto err_open;
+        }
+        if (config->channel_mask != 0)
+            out->channel_mask = config->channel_mask;
+        out->format = config->offload_info.format;
+        out->config.rate = config->sample_rate;
+        out->config.channels = popcount(out->channel_mask);
+        out->codec.id = SND_AUDIOCODEC_MP3;
+        out->codec.ch_in = out->config.channels;
+        out->codec.ch_out = out->config.channels;
+        out->codec.sample_rate = config->sample_rate;
+        out->codec.bit_rate = config->offload_info.bit_rate;
+        out->compr_config.fragment_size = OFFLOAD_FRAGMENT_SIZE;
+        out->compr_config.fragments = OFFLOAD_FRAGMENT_COUNT;
+        out->compr_config.codec = &out->codec;
+        /*
+         * Refuse the stream rather than fail at the first write, or play
+         * at full volume: AudioFlinger then plays the track through a PCM
+         * output and applies its volume itself.
+         */
+        if (!is_codec_supported(PCM_CARD, PCM_DEVICE_OFFLOAD, COMPRESS_IN,
+                                &out->codec)) {
+            ALOGE("%s: compress device %d does not decode MP3", __func__,
+                  PCM_DEVICE_OFFLOAD);
+            ret = -ENODEV;
+            goto err_open;
+        }
         pthread_mutex_lock(&adev->lock);
-        ret = read_hdmi_channel_masks(adev, out);
+        has_volume = mixer_get_ctl_by_name(mixer_route_get_mixer(adev->mr),
+                                           OFFLOAD_VOLUME_CTL) != NULL;
         pthread_mutex_unlock(&adev->lock);
-        if (ret != 0)
+        if (!has_volume) {
+            ALOGE("%s: no %s control for the offload volume", __func__,
+                  OFFLOAD_VOLUME_CTL);
+            ret = -ENODEV;
+            goto err_open;
+        }
+        type = OUTPUT_OFFLOAD;
+    } else if (flags & AUDIO_OUTPUT_FLAG_DIRECT &&
+               devices == AUDIO_DEVICE_OUT_AUX_DIGITAL) {
+        int sink_channels;
+        
+        pthread_mutex_lock(&adev->lock);
+        sink_channels = read_hdmi_channel_masks(adev, out);
+        pthread_mutex_unlock(&adev->lock);
+        if (sink_channels < 0) {
+            ret = sink_channels;
             goto err_open;
+        }
         if (config->sample_rate == 0)
             config->sample_rate = HDMI_MULTI_DEFAULT_SAMPLING_RATE;
         if (config->channel_mask == 0)
@@ -1739,7 +4050,7 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
         out->channel_mask = config->channel_mask;
         out->config = pcm_config_hdmi_multi;
         out->config.rate = config->sample_rate;
-        out->config.channels = popcount(config->channel_mask);
+        set_hdmi_remix(out, sink_channels, adev->hdmi_upmix);
         out->pcm_device = PCM_DEVICE;
         type = OUTPUT_HDMI;
     } else if (flags & AUDIO_OUTPUT_FLAG_DEEP_BUFFER) {
@@ -1747,6 +4058,12 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
         out->config = pcm_config_deep;
         out->pcm_device = PCM_DEVICE_DEEP;
         type = OUTPUT_DEEP_BUF;
+    } else if (adev->fast_mmap) {
+        ALOGV("*** %s: Fast buffer MMAP pcm config", __func__);
+        out->config = pcm_config_fast_mmap;
+        out->pcm_device = PCM_DEVICE;
+        out->mmap = true;
+        type = OUTPUT_LOW_LATENCY;
     } else {
         ALOGV("*** %s: Fast buffer pcm config", __func__);
         out->config = pcm_config_fast;
@@ -1754,6 +4071,15 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
         type = OUTPUT_LOW_LATENCY;
     }
     
+    if ((type == OUTPUT_LOW_LATENCY || type == OUTPUT_DEEP_BUF) &&
+        out_dsp_format(config->format) != DSP_FORMAT_S16) {
+        out->format = config->format;
+        if (pcm_supports_s24(out->pcm_device))
+            out->config.format = PCM_FORMAT_S24_LE;
+        ALOGV("%s: format %#x, %u bit PCM", __func__, out->format,
+              pcm_format_to_bits(out->config.format));
+    }
+    
     out->stream.common.get_sample_rate = out_get_sample_rate;
     out->stream.common.set_sample_rate = out_set_sample_rate;
     out->stream.common.get_buffer_size = out_get_buffer_size;
@@ -1772,31 +4098,74 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     out->stream.get_render_position = out_get_render_position;
     out->stream.get_next_write_timestamp = out_get_next_write_timestamp;
     out->stream.get_presentation_position = out_get_presentation_position;
+    if (type == OUTPUT_OFFLOAD) {
+        out->stream.set_callback = out_set_callback;
+        out->stream.pause = out_pause;
+        out->stream.resume = out_resume;
+        out->stream.drain = out_drain;
+        out->stream.flush = out_flush;
+    }
     
     out->dev = adev;
+    out->type = type;
     
     config->format = out_get_format(&out->stream.common);
     config->channel_mask = out_get_channels(&out->stream.common);
     config->sample_rate = out_get_sample_rate(&out->stream.common);
     
-    out->standby = true;
-    /* out->muted = false; by calloc() */
+    atomic_init(&out->state, STREAM_STANDBY);
+    out->volume[0] = 1.0f;
+    out->volume[1] = 1.0f;
     /* out->written = 0; by calloc() */
     
+    if (type == OUTPUT_OFFLOAD) {
+        pthread_cond_init(&out->offload_cond, NULL);
+        ret = pthread_create(&out->offload_thread, NULL, offload_thread_loop, out);
+        if (ret != 0) {
+            ALOGE("%s: failed to create offload thread: %s",
+                  __func__, strerror(ret));
+            pthread_cond_destroy(&out->offload_cond);
+            ret = -ret;
+            goto err_open;
+        }
+    } else {
+        /* the pending audio is converted to the channels and format of the PCMs */
+        out->pending_size = out->config.period_size * out->config.period_count *
+                            out_pcm_frame_size(out);
+        out->pending = malloc(out->pending_size);
+        if (!out->pending) {
+            ret = -ENOMEM;
+            goto err_open;
+        }
+    }
+    
+    pthread_cond_init(&out->start_cond, NULL);
+    
     pthread_mutex_lock(&adev->lock_outputs);
     if (adev->outputs[type]) {
         pthread_mutex_unlock(&adev->lock_outputs);
         ret = -EBUSY;
-        goto err_open;
+        goto err_busy;
     }
+    out_update_gain(out, adev->master_volume, false);
+    /* start_output_stream() looks up the HDMI output with only the hw device locked */
+    pthread_mutex_lock(&adev->lock);
     adev->outputs[type] = out;
+    pthread_mutex_unlock(&adev->lock);
     pthread_mutex_unlock(&adev->lock_outputs);
     
     *stream_out = &out->stream;
     
     return 0;
     
+err_busy:
+    pthread_cond_destroy(&out->start_cond);
+    if (type == OUTPUT_OFFLOAD) {
+        offload_thread_exit(out);
+        pthread_cond_destroy(&out->offload_cond);
+    }
 err_open:
+    free(out->pending);
     free(out);
     *stream_out = NULL;
     return ret;
@@ -1808,16 +4177,34 @@ static void adev_close_output_stream(struct audio_hw_device *dev,
     struct audio_device *adev;
     enum output_type type;
     
-    out_standby(&stream->common);
+    struct stream_out *out = (struct stream_out *)stream;
+    
     adev = (struct audio_device *)dev;
+    if (out->type == OUTPUT_OFFLOAD) {
+        out_standby(&stream->common);
+        offload_thread_exit(out);
+        pthread_cond_destroy(&out->offload_cond);
+    } else {
+        /* the stream is freed below: close the PCMs now, not in the worker */
+        worker_cancel(out);
+        worker_out_standby(out, out->write_seq);
+    }
+    
     pthread_mutex_lock(&adev->lock_outputs);
+    pthread_mutex_lock(&adev->lock);
     for (type = 0; type < OUTPUT_TOTAL; type++) {
         if (adev->outputs[type] == (struct stream_out *) stream) {
             adev->outputs[type] = NULL;
             break;
         }
     }
+    pthread_mutex_unlock(&adev->lock);
     pthread_mutex_unlock(&adev->lock_outputs);
+    free(out->convert_buf.data);
+    free(out->remix_buf.data);
+    free(out->scratch.data);
+    free(out->pending);
+    pthread_cond_destroy(&out->start_cond);
     free(stream);
 }
 
@@ -1854,6 +4241,21 @@ static int adev_set_parameters(struct audio_hw_device *dev, const char *kvpairs)
         }
     }
     
+    /*
+     * HDMI hotplug, forwarded by the framework from the switch uevent: the
+     * new sink may have other capabilities and the driver state is reset
+     */
+    if (str_parms_get_str(parms, AUDIO_PARAMETER_DEVICE_CONNECT,
+                          value, sizeof(value)) >= 0 ||
+        str_parms_get_str(parms, AUDIO_PARAMETER_DEVICE_DISCONNECT,
+                          value, sizeof(value)) >= 0) {
+        if (strtoul(value, NULL, 0) & AUDIO_DEVICE_OUT_AUX_DIGITAL) {
+            pthread_mutex_lock(&adev->lock);
+            invalidate_hdmi_sink(adev);
+            pthread_mutex_unlock(&adev->lock);
+        }
+    }
+    
     str_parms_destroy(parms);
     return ret;
 }
@@ -1905,10 +4307,50 @@ static int adev_set_voice_volume(struct audio_hw_device *dev, float volume)
     return 0;
 }
 
-static int adev_set_master_volume(struct audio_hw_device *dev __unused,
-                                  float volume __unused)
+/*
+ * The master volume is applied by the HAL, so that the framework does not
+ * apply it in software before the output: by the DSP on the offload
+ * output, with the software volume on the PCM outputs.
+ */
+static int adev_set_master_volume(struct audio_hw_device *dev, float volume)
 {
-    return -ENOSYS;
+    struct audio_device *adev = (struct audio_device *)dev;
+    enum output_type type;
+    
+    if (volume < 0.0f || volume > 1.0f)
+        return -EINVAL;
+    
+    pthread_mutex_lock(&adev->lock_outputs);
+    adev->master_volume = volume;
+    for (type = 0; type < OUTPUT_TOTAL; ++type) {
+        struct stream_out *out = adev->outputs[type];
+        
+        if (!out)
+            continue;
+        pthread_mutex_lock(&out->lock);
+        if (type == OUTPUT_OFFLOAD) {
+            pthread_mutex_lock(&adev->lock);
+            set_offload_volume(out, volume);
+            pthread_mutex_unlock(&adev->lock);
+        } else {
+            out_update_gain(out, volume, true);
+        }
+        pthread_mutex_unlock(&out->lock);
+    }
+    pthread_mutex_unlock(&adev->lock_outputs);
+    
+    return 0;
+}
+
+static int adev_get_master_volume(struct audio_hw_device *dev, float *volume)
+{
+    struct audio_device *adev = (struct audio_device *)dev;
+    
+    pthread_mutex_lock(&adev->lock_outputs);
+    *volume = adev->master_volume;
+    pthread_mutex_unlock(&adev->lock_outputs);
+    
+    return 0;
 }
 
 static int adev_set_mode(struct audio_hw_device *dev, audio_mode_t mode)
@@ -1919,9 +4361,12 @@ static int adev_set_mode(struct audio_hw_device *dev, audio_mode_t mode)
         return 0;
     }
     
+    PROFILE_START(start);
     pthread_mutex_lock(&adev->lock);
     adev->mode = mode;
     
+    mixer_route_begin_batch(adev->mr);
+    
     if (adev->mode == AUDIO_MODE_IN_CALL) {
         ALOGV("*** %s: Entering IN_CALL mode", __func__);
         start_call(adev);
@@ -1930,8 +4375,11 @@ static int adev_set_mode(struct audio_hw_device *dev, audio_mode_t mode)
         stop_call(adev);
     }
     
+    mixer_route_end_batch(adev->mr);
+    
     pthread_mutex_unlock(&adev->lock);
     
+    PROFILE_END(PROFILE_SET_MODE, start);
     return 0;
 }
 
@@ -2010,6 +4458,7 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
     in->stream.set_gain = in_set_gain;
     in->stream.read = in_read;
     in->stream.get_input_frames_lost = in_get_input_frames_lost;
+    in->stream.get_capture_position = in_get_capture_position;
     
     in->dev = adev;
     in->standby = true;
@@ -2024,6 +4473,11 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
     &pcm_config_in_low_latency : &pcm_config_in;
     in->config = pcm_config;
     
+    /* MMAP NOIRQ mode for fast inputs which need no resampling */
+    if ((flags & AUDIO_INPUT_FLAG_FAST) && adev->fast_mmap &&
+        in->requested_rate == pcm_config->rate)
+        in->mmap = true;
+    
     in->buffer = malloc(pcm_config->period_size * pcm_config->channels
                         * audio_stream_in_frame_size(&in->stream));
     
@@ -2036,12 +4490,21 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
         in->buf_provider.get_next_buffer = get_next_buffer;
         in->buf_provider.release_buffer = release_buffer;
         
-        ret = create_resampler(pcm_config->rate,
-                               in->requested_rate,
-                               audio_channel_count_from_in_mask(in->channel_mask),
-                               RESAMPLER_QUALITY_DEFAULT,
-                               &in->buf_provider,
-                               &in->resampler);
+        in->speex_resampler = adev->speex_resampler;
+        if (in->speex_resampler)
+            ret = create_resampler(pcm_config->rate,
+                                   in->requested_rate,
+                                   audio_channel_count_from_in_mask(in->channel_mask),
+                                   RESAMPLER_QUALITY_DEFAULT,
+                                   &in->buf_provider,
+                                   &in->resampler);
+        else
+            ret = create_poly_resampler(pcm_config->rate,
+                                        in->requested_rate,
+                                        audio_channel_count_from_in_mask(in->channel_mask),
+                                        adev->resampler_quality,
+                                        &in->buf_provider,
+                                        &in->resampler);
         if (ret != 0) {
             ret = -EINVAL;
             goto err_resampler;
@@ -2071,15 +4534,40 @@ static void adev_close_input_stream(struct audio_hw_device *dev __unused,
     
     in_standby(&stream->common);
     if (in->resampler) {
-        release_resampler(in->resampler);
+        if (in->speex_resampler)
+            release_resampler(in->resampler);
+        else
+            release_poly_resampler(in->resampler);
         in->resampler = NULL;
     }
     free(in->buffer);
     free(stream);
 }
 
-static int adev_dump(const audio_hw_device_t *device __unused, int fd __unused)
+static int adev_dump(const audio_hw_device_t *device, int fd)
 {
+    struct audio_device *adev = (struct audio_device *)device;
+    struct mixer_route_snapshot *snapshot;
+    int output_path, input_path;
+    
+    pthread_mutex_lock(&adev->lock);
+    output_path = adev->cur_output_path;
+    input_path = adev->cur_input_path;
+    snapshot = mixer_route_snapshot(adev->mr);
+    pthread_mutex_unlock(&adev->lock);
+    
+    /* writing the dump and reading the mixer back must not block the routing */
+    dprintf(fd, "  Route: output %s, input %s\n",
+            mixer_route_get_path_name(output_path),
+            mixer_route_get_path_name(input_path));
+    if (snapshot) {
+        mixer_route_dump(snapshot, fd);
+        free(snapshot);
+    }
+    
+#ifdef AUDIO_HW_PROFILE
+    profile_dump(fd);
+#endif
     return 0;
 }
 
@@ -2087,10 +4575,16 @@ static int adev_close(hw_device_t *device)
 {
     struct audio_device *adev = (struct audio_device *)device;
     
-    audio_route_free(adev->ar);
+    pthread_mutex_lock(&adev->worker_lock);
+    adev->worker_exit = true;
+    pthread_cond_signal(&adev->worker_cond);
+    pthread_mutex_unlock(&adev->worker_lock);
+    pthread_join(adev->worker_thread, NULL);
+    
+    mixer_route_free(adev->mr);
     
     if (adev->hdmi_drv_fd >= 0) {
-        close(adev->hdmi_drv_fd);
+        hdmi_v4l2_close(adev->hdmi_drv_fd);
     }
     
     /* RIL */
@@ -2104,6 +4598,8 @@ static int adev_open(const hw_module_t* module, const char* name,
                      hw_device_t** device)
 {
     struct audio_device *adev;
+    pthread_condattr_t condattr;
+    int i, j;
     int ret;
     
     if (strcmp(name, AUDIO_HARDWARE_INTERFACE) != 0) {
@@ -2123,6 +4619,7 @@ static int adev_open(const hw_module_t* module, const char* name,
     adev->hw_device.init_check = adev_init_check;
     adev->hw_device.set_voice_volume = adev_set_voice_volume;
     adev->hw_device.set_master_volume = adev_set_master_volume;
+    adev->hw_device.get_master_volume = adev_get_master_volume;
     adev->hw_device.set_mode = adev_set_mode;
     adev->hw_device.set_mic_mute = adev_set_mic_mute;
     adev->hw_device.get_mic_mute = adev_get_mic_mute;
@@ -2135,15 +4632,66 @@ static int adev_open(const hw_module_t* module, const char* name,
     adev->hw_device.close_input_stream = adev_close_input_stream;
     adev->hw_device.dump = adev_dump;
     
-    adev->ar = audio_route_init(MIXER_CARD, NULL);
+    adev->mr = mixer_route_init(MIXER_CARD);
+    if (adev->mr == NULL) {
+        free(adev);
+        return -EINVAL;
+    }
+    
+    /*
+     * Look up the mixer paths of all routes once. routing.h and
+     * mixer_paths.xml are built together, a route without its path is a
+     * build error.
+     */
+    for (i = 0; i < IN_SOURCE_TAB_SIZE; i++) {
+        for (j = 0; j < OUT_DEVICE_TAB_SIZE; j++) {
+            const struct route_config *route = route_configs[i][j];
+            
+            if (get_route_path(route->output_route,
+                               &adev->route_paths[i][j].output) != 0 ||
+                get_route_path(route->input_route,
+                               &adev->route_paths[i][j].input) != 0) {
+                ALOGE("%s: route %d/%d has no mixer path", __func__, i, j);
+                mixer_route_free(adev->mr);
+                free(adev);
+                return -EINVAL;
+            }
+        }
+    }
+    adev->cur_output_path = MIXER_PATH_INVALID;
+    adev->cur_input_path = MIXER_PATH_INVALID;
     adev->input_source = AUDIO_SOURCE_DEFAULT;
     /* adev->cur_route_id initial value is 0 and such that first device
      * selection is always applied by select_devices() */
     
     adev->hdmi_drv_fd = -1;
+    invalidate_hdmi_sink(adev);
     
     adev->mode = AUDIO_MODE_NORMAL;
     adev->voice_volume = 1.0f;
+    adev->master_volume = 1.0f;
+    
+    /* Outputs mixed into HDMI, the writers wait on CLOCK_MONOTONIC */
+    pthread_mutex_init(&adev->hdmi_mix_lock, NULL);
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&adev->hdmi_mix_cond, &condattr);
+    pthread_condattr_destroy(&condattr);
+    for (i = 0; i < OUTPUT_TOTAL; i++)
+        adev->hdmi_mix[i].gain = DSP_UNITY_GAIN;
+    
+    /* PCM worker */
+    pthread_mutex_init(&adev->worker_lock, NULL);
+    pthread_cond_init(&adev->worker_cond, NULL);
+    pthread_cond_init(&adev->worker_idle_cond, NULL);
+    ret = pthread_create(&adev->worker_thread, NULL, worker_thread_loop, adev);
+    if (ret != 0) {
+        ALOGE("%s: failed to create PCM worker thread: %s",
+              __func__, strerror(ret));
+        mixer_route_free(adev->mr);
+        free(adev);
+        return -ret;
+    }
     
     /* RIL */
     ril_open(&adev->ril);
@@ -2157,12 +4705,41 @@ static int adev_open(const hw_module_t* module, const char* name,
     if (property_get_bool("audio_hal.disable_two_mic", false))
         adev->two_mic_disabled = true;
     
+    /* MMAP NOIRQ mode for the low-latency output and fast inputs */
+    if (property_get_bool("audio_hal.fast_mmap", false))
+        adev->fast_mmap = true;
+    
+    /* Stereo to 5.1 upmix on multichannel HDMI sinks */
+    if (property_get_bool("audio_hal.hdmi_upmix", false))
+        adev->hdmi_upmix = true;
+    
     /* HDMI */
     open_hdmi_driver(adev);
     
     *device = &adev->hw_device.common;
     
     char value[PROPERTY_VALUE_MAX];
+    
+    /* Mono capture: left (main mic) by default, right or average of both */
+    adev->mono_mode = DSP_MONO_LEFT;
+    if (property_get("audio_hal.mono_capture", value, NULL) > 0) {
+        if (strcmp(value, "right") == 0)
+            adev->mono_mode = DSP_MONO_RIGHT;
+        else if (strcmp(value, "average") == 0)
+            adev->mono_mode = DSP_MONO_AVERAGE;
+    }
+    
+    /* Capture resampler: polyphase low, medium (default), high or speex */
+    adev->resampler_quality = POLY_RESAMPLER_MEDIUM;
+    if (property_get("audio_hal.resampler", value, NULL) > 0) {
+        if (strcmp(value, "low") == 0)
+            adev->resampler_quality = POLY_RESAMPLER_LOW;
+        else if (strcmp(value, "high") == 0)
+            adev->resampler_quality = POLY_RESAMPLER_HIGH;
+        else if (strcmp(value, "speex") == 0)
+            adev->speex_resampler = true;
+    }
+    
     if (property_get("audio_hal.period_size", value, NULL) > 0) {
         pcm_config_fast.period_size = atoi(value);
         pcm_config_in.period_size = pcm_config_fast.period_size;
@@ -2170,6 +4747,23 @@ static int adev_open(const hw_module_t* module, const char* name,
     if (property_get("audio_hal.in_period_size", value, NULL) > 0)
         pcm_config_in.period_size = atoi(value);
     
+    /* Deep buffer periods, in milliseconds and count */
+    if (set_deep_buffer_config(&pcm_config_deep,
+                               property_get_int32("audio_hal.deep_buffer_period_ms", 0),
+                               property_get_int32("audio_hal.deep_buffer_period_count", 0)) != 0)
+        ALOGW("%s: invalid deep buffer periods, using %u frames x %u", __func__,
+              pcm_config_deep.period_size, pcm_config_deep.period_count);
+    
+    /* Latency after the PCM of each output device */
+    for (i = 0; i < ARRAY_SIZE(downstream_latencies); i++) {
+        char key[PROPERTY_KEY_MAX];
+        
+        snprintf(key, sizeof(key), "audio_hal.latency_us.%s",
+                 downstream_latencies[i].name);
+        if (property_get(key, value, NULL) > 0)
+            downstream_latencies[i].latency_us = atoi(value);
+    }
+    
     return 0;
 }
 
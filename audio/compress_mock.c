@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Mock compress device, implementing the tinycompress API used by the
+ * compressed offload output. It is built instead of libtinycompress with
+ * AUDIO_HW_COMPRESS_MOCK := true, to run the offload path where there is
+ * no DSP.
+ *
+ * The "DSP" consumes the compressed data at the bit rate of the codec
+ * (128 kbit/s when unknown) from a buffer of fragments * fragment_size
+ * bytes, and renders the matching number of samples at the codec sample
+ * rate. Writes, waits and drains block or return like the kernel driver.
+ */
+
+#define LOG_TAG "audio_hw_primary"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cutils/log.h>
+
+#include <sound/compress_params.h>
+#include <tinycompress/tinycompress.h>
+
+#define MOCK_DEFAULT_BIT_RATE 128000
+
+struct compress {
+    pthread_mutex_t lock;
+    pthread_cond_t cond; /* signaled when the stream stops */
+    bool ready;
+    bool running;
+    bool paused;
+    bool nonblock;
+    int max_poll_wait_ms;
+    unsigned int buffer_size;
+    unsigned int fragment_size;
+    unsigned int byte_rate;
+    unsigned int sample_rate;
+    uint64_t written;   /* bytes written since the stream was started */
+    uint64_t consumed;  /* bytes consumed by the DSP */
+    struct timespec ref; /* time at which consumed was last updated */
+    char error[128];
+};
+
+static int64_t elapsed_ns(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000000000LL +
+           to->tv_nsec - from->tv_nsec;
+}
+
+/* must be called with the compress mutex locked */
+static void mock_update(struct compress *compress)
+{
+    struct timespec now;
+    uint64_t consumed;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (compress->running && !compress->paused) {
+        consumed = compress->consumed +
+                   elapsed_ns(&compress->ref, &now) * compress->byte_rate /
+                   1000000000;
+        /* the DSP starves when it consumes everything written */
+        compress->consumed = consumed < compress->written ?
+                             consumed : compress->written;
+    }
+    compress->ref = now;
+}
+
+/* must be called with the compress mutex locked */
+static unsigned int mock_avail(struct compress *compress)
+{
+    return compress->buffer_size -
+           (unsigned int)(compress->written - compress->consumed);
+}
+
+/*
+ * Sleeps until the DSP has consumed the given number of bytes, the stream
+ * is stopped or the timeout expires (negative for no timeout). Returns
+ * -EBADFD if the stream was stopped.
+ * must be called with the compress mutex locked
+ */
+static int mock_wait(struct compress *compress, unsigned int bytes,
+                     int timeout_ms)
+{
+    struct timespec deadline;
+    uint64_t wait_ns;
+    bool was_running = compress->running;
+
+    if (!compress->running || compress->paused)
+        wait_ns = timeout_ms < 0 ? 1000000000 : timeout_ms * 1000000LL;
+    else
+        wait_ns = (uint64_t)bytes * 1000000000 / compress->byte_rate + 1;
+    if (timeout_ms >= 0 && wait_ns > (uint64_t)timeout_ms * 1000000)
+        wait_ns = (uint64_t)timeout_ms * 1000000;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += wait_ns / 1000000000;
+    deadline.tv_nsec += wait_ns % 1000000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&compress->cond, &compress->lock, &deadline);
+
+    mock_update(compress);
+    if (was_running && !compress->running)
+        return -EBADFD;
+    return 0;
+}
+
+struct compress *compress_open(unsigned int card, unsigned int device,
+                               unsigned int flags, struct compr_config *config)
+{
+    struct compress *compress;
+    pthread_condattr_t attr;
+
+    compress = calloc(1, sizeof(struct compress));
+    if (compress == NULL)
+        return NULL;
+
+    pthread_mutex_init(&compress->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&compress->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    compress->max_poll_wait_ms = -1;
+
+    /* COMPRESS_IN is data going into the device, i.e. playback */
+    if (!(flags & COMPRESS_IN) || (flags & COMPRESS_OUT)) {
+        snprintf(compress->error, sizeof(compress->error),
+                 "mock compress device %u:%u only supports playback",
+                 card, device);
+        return compress;
+    }
+    if (config == NULL || config->codec == NULL ||
+        config->fragment_size == 0 || config->fragments == 0 ||
+        config->codec->id != SND_AUDIOCODEC_MP3) {
+        snprintf(compress->error, sizeof(compress->error),
+                 "mock compress device %u:%u: invalid config", card, device);
+        return compress;
+    }
+
+    compress->fragment_size = config->fragment_size;
+    compress->buffer_size = config->fragment_size * config->fragments;
+    compress->byte_rate = (config->codec->bit_rate ?
+                           config->codec->bit_rate : MOCK_DEFAULT_BIT_RATE) / 8;
+    compress->sample_rate = config->codec->sample_rate;
+    compress->ready = true;
+
+    ALOGV("%s: %u:%u, %u bytes, %u bytes/s, %u Hz", __func__, card, device,
+          compress->buffer_size, compress->byte_rate, compress->sample_rate);
+
+    return compress;
+}
+
+void compress_close(struct compress *compress)
+{
+    if (compress == NULL)
+        return;
+
+    pthread_cond_destroy(&compress->cond);
+    pthread_mutex_destroy(&compress->lock);
+    free(compress);
+}
+
+int is_compress_ready(struct compress *compress)
+{
+    return compress != NULL && compress->ready;
+}
+
+int is_compress_running(struct compress *compress)
+{
+    return compress != NULL && compress->running;
+}
+
+const char *compress_get_error(struct compress *compress)
+{
+    return compress->error;
+}
+
+bool is_codec_supported(unsigned int card __unused, unsigned int device __unused,
+                        unsigned int flags, struct snd_codec *codec)
+{
+    return (flags & COMPRESS_IN) && codec != NULL &&
+           codec->id == SND_AUDIOCODEC_MP3;
+}
+
+void compress_set_max_poll_wait(struct compress *compress, int milliseconds)
+{
+    compress->max_poll_wait_ms = milliseconds;
+}
+
+void compress_nonblock(struct compress *compress, int nonblock)
+{
+    compress->nonblock = nonblock != 0;
+}
+
+int compress_write(struct compress *compress, const void *buf __unused,
+                   unsigned int size)
+{
+    unsigned int done = 0;
+
+    if (!is_compress_ready(compress))
+        return -ENODEV;
+
+    pthread_mutex_lock(&compress->lock);
+    while (done < size) {
+        unsigned int count;
+
+        mock_update(compress);
+        count = mock_avail(compress);
+        if (count > size - done)
+            count = size - done;
+        compress->written += count;
+        done += count;
+
+        if (done == size || compress->nonblock)
+            break;
+        /* wait until one fragment is free, like poll() would */
+        if (mock_wait(compress, compress->fragment_size,
+                      compress->max_poll_wait_ms) != 0)
+            break;
+    }
+    pthread_mutex_unlock(&compress->lock);
+
+    return done;
+}
+
+int compress_read(struct compress *compress __unused, void *buf __unused,
+                  unsigned int size __unused)
+{
+    return -ENOSYS;
+}
+
+int compress_wait(struct compress *compress, int timeout_ms)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&compress->lock);
+    mock_update(compress);
+    if (mock_avail(compress) < compress->fragment_size) {
+        ret = mock_wait(compress,
+                        compress->fragment_size - mock_avail(compress),
+                        timeout_ms);
+        if (ret == 0 && mock_avail(compress) < compress->fragment_size)
+            ret = -ETIME;
+    }
+    pthread_mutex_unlock(&compress->lock);
+
+    return ret;
+}
+
+int compress_start(struct compress *compress)
+{
+    if (!is_compress_ready(compress))
+        return -ENODEV;
+
+    pthread_mutex_lock(&compress->lock);
+    compress->running = true;
+    compress->paused = false;
+    clock_gettime(CLOCK_MONOTONIC, &compress->ref);
+    pthread_mutex_unlock(&compress->lock);
+
+    return 0;
+}
+
+/* drops the data not consumed yet and wakes up the waiters */
+int compress_stop(struct compress *compress)
+{
+    if (!is_compress_ready(compress))
+        return -ENODEV;
+
+    pthread_mutex_lock(&compress->lock);
+    compress->running = false;
+    compress->paused = false;
+    compress->written = 0;
+    compress->consumed = 0;
+    pthread_cond_broadcast(&compress->cond);
+    pthread_mutex_unlock(&compress->lock);
+
+    return 0;
+}
+
+int compress_pause(struct compress *compress)
+{
+    if (!is_compress_running(compress))
+        return -EBADFD;
+
+    pthread_mutex_lock(&compress->lock);
+    mock_update(compress);
+    compress->paused = true;
+    pthread_mutex_unlock(&compress->lock);
+
+    return 0;
+}
+
+int compress_resume(struct compress *compress)
+{
+    if (!is_compress_running(compress))
+        return -EBADFD;
+
+    pthread_mutex_lock(&compress->lock);
+    mock_update(compress);
+    compress->paused = false;
+    pthread_mutex_unlock(&compress->lock);
+
+    return 0;
+}
+
+int compress_drain(struct compress *compress)
+{
+    int ret = 0;
+
+    if (!is_compress_running(compress))
+        return -EBADFD;
+
+    pthread_mutex_lock(&compress->lock);
+    mock_update(compress);
+    while (ret == 0 && compress->consumed < compress->written)
+        ret = mock_wait(compress,
+                        (unsigned int)(compress->written - compress->consumed),
+                        -1);
+    pthread_mutex_unlock(&compress->lock);
+
+    return ret;
+}
+
+/* there is a single track in the mock, so this is a full drain */
+int compress_partial_drain(struct compress *compress)
+{
+    return compress_drain(compress);
+}
+
+int compress_next_track(struct compress *compress)
+{
+    return is_compress_running(compress) ? 0 : -EBADFD;
+}
+
+int compress_set_gapless_metadata(struct compress *compress,
+                                  struct compr_gapless_mdata *mdata)
+{
+    if (!is_compress_ready(compress) || mdata == NULL)
+        return -EINVAL;
+
+    ALOGV("%s: delay %u, padding %u", __func__, mdata->encoder_delay,
+          mdata->encoder_padding);
+    return 0;
+}
+
+int compress_get_hpointer(struct compress *compress, unsigned int *avail,
+                          struct timespec *tstamp)
+{
+    uint64_t samples;
+
+    if (!is_compress_ready(compress))
+        return -ENODEV;
+
+    pthread_mutex_lock(&compress->lock);
+    mock_update(compress);
+    *avail = mock_avail(compress);
+    samples = compress->consumed * compress->sample_rate / compress->byte_rate;
+    tstamp->tv_sec = samples / compress->sample_rate;
+    tstamp->tv_nsec = (samples % compress->sample_rate) * 1000000000 /
+                      compress->sample_rate;
+    pthread_mutex_unlock(&compress->lock);
+
+    return 0;
+}
+
+int compress_get_tstamp(struct compress *compress, unsigned long *samples,
+                        unsigned int *sampling_rate)
+{
+    if (!is_compress_ready(compress))
+        return -ENODEV;
+
+    pthread_mutex_lock(&compress->lock);
+    mock_update(compress);
+    *samples = compress->consumed * compress->sample_rate / compress->byte_rate;
+    *sampling_rate = compress->sample_rate;
+    pthread_mutex_unlock(&compress->lock);
+
+    return 0;
+}
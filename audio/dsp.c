@@ -0,0 +1,919 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dsp.h"
+
+/* DSP_NO_SIMD builds the C versions only, the reference of the host tests */
+#if defined(DSP_NO_SIMD)
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DSP_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define DSP_SSE2
+#endif
+
+/*
+ * Gain ramp
+ *
+ * The vector versions process groups of frames which fill a whole number
+ * of vectors: with 8 samples in each, 8 mono frames in one vector, 4
+ * stereo or 5.1 frames in one or three vectors, and so on. Each lane holds the gain of
+ * the frame of its sample. The gains are added modulo 2^16 like in the C
+ * version, which is how a negative step ramps down. The product of a
+ * signed sample and an unsigned gain does not fit in 16 bits, so its
+ * upper half is computed exactly, like the C version does.
+ */
+
+#if defined(DSP_NEON) || defined(DSP_SSE2)
+
+/* frames in the smallest group which fills whole vectors of lanes samples */
+static inline unsigned int gain_group_frames(unsigned int channels,
+                                             unsigned int lanes)
+{
+    unsigned int group;
+
+    for (group = 1; (group * channels) % lanes != 0; group *= 2)
+        ;
+    return group;
+}
+
+#endif
+
+#if defined(DSP_NEON)
+
+static inline int16x8_t ramp_mul_s16(int16x8_t s, uint16x8_t v)
+{
+    int32x4_t lo = vmulq_s32(vmovl_s16(vget_low_s16(s)),
+                             vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(v))));
+    int32x4_t hi = vmulq_s32(vmovl_s16(vget_high_s16(s)),
+                             vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(v))));
+
+    return vcombine_s16(vshrn_n_s32(lo, 16), vshrn_n_s32(hi, 16));
+}
+
+static size_t gain_s16_vector(int16_t *dst, const int16_t *src, size_t frames,
+                              unsigned int channels, uint16_t vol,
+                              uint16_t step)
+{
+    unsigned int group = gain_group_frames(channels, 8);
+    unsigned int vectors = group * channels / 8;
+    uint16_t lanes[8];
+    uint16x8_t v[8], inc;
+    unsigned int n;
+    size_t i;
+
+    for (n = 0; n < vectors; n++) {
+        for (i = 0; i < 8; i++)
+            lanes[i] = vol + ((n * 8 + i) / channels) * step;
+        v[n] = vld1q_u16(lanes);
+    }
+    inc = vdupq_n_u16((uint16_t)(group * step));
+
+    for (i = 0; i + group <= frames; i += group) {
+        for (n = 0; n < vectors; n++) {
+            size_t offset = i * channels + n * 8;
+
+            vst1q_s16(dst + offset, ramp_mul_s16(vld1q_s16(src + offset), v[n]));
+            v[n] = vaddq_u16(v[n], inc);
+        }
+    }
+
+    return i;
+}
+
+#elif defined(DSP_SSE2)
+
+static inline __m128i ramp_mul_s16(__m128i s, __m128i v)
+{
+    /*
+     * Multiply as unsigned: a negative sample s is read as s + 65536,
+     * which adds exactly v to the upper half of the product.
+     */
+    __m128i hi = _mm_mulhi_epu16(s, v);
+    __m128i neg = _mm_srai_epi16(s, 15);
+
+    return _mm_sub_epi16(hi, _mm_and_si128(neg, v));
+}
+
+static size_t gain_s16_vector(int16_t *dst, const int16_t *src, size_t frames,
+                              unsigned int channels, uint16_t vol,
+                              uint16_t step)
+{
+    unsigned int group = gain_group_frames(channels, 8);
+    unsigned int vectors = group * channels / 8;
+    uint16_t lanes[8];
+    __m128i v[8], inc;
+    unsigned int n;
+    size_t i;
+
+    for (n = 0; n < vectors; n++) {
+        for (i = 0; i < 8; i++)
+            lanes[i] = vol + ((n * 8 + i) / channels) * step;
+        v[n] = _mm_loadu_si128((const __m128i *)lanes);
+    }
+    inc = _mm_set1_epi16((short)(group * step));
+
+    for (i = 0; i + group <= frames; i += group) {
+        for (n = 0; n < vectors; n++) {
+            size_t offset = i * channels + n * 8;
+            __m128i s = _mm_loadu_si128((const __m128i *)(src + offset));
+
+            _mm_storeu_si128((__m128i *)(dst + offset), ramp_mul_s16(s, v[n]));
+            v[n] = _mm_add_epi16(v[n], inc);
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+uint16_t dsp_gain_s16(int16_t *dst, const int16_t *src, size_t frames,
+                      unsigned int channels, uint16_t vol, int16_t step)
+{
+    uint16_t inc = (uint16_t)step;
+    size_t i = 0;
+    unsigned int c;
+
+#if defined(DSP_NEON) || defined(DSP_SSE2)
+    i = gain_s16_vector(dst, src, frames, channels, vol, inc);
+    vol += i * inc;
+#endif
+
+    for (; i < frames; i++) {
+        for (c = 0; c < channels; c++)
+            dst[i * channels + c] =
+                (int16_t)((src[i * channels + c] * vol) >> 16);
+        vol += inc;
+    }
+
+    return vol;
+}
+
+uint16_t dsp_ramp_s16(int16_t *buffer, size_t frames, unsigned int channels,
+                      uint16_t vol, uint16_t step)
+{
+    return dsp_gain_s16(buffer, buffer, frames, channels, vol, (int16_t)step);
+}
+
+/*
+ * Stereo to mono
+ *
+ * The vector versions convert 8 frames at a time. Both input vectors are
+ * loaded before the output is stored, so the conversion can be done in
+ * place. The average is computed without rounding, like the C version.
+ */
+
+#if defined(DSP_NEON)
+
+static size_t stereo_to_mono_s16_vector(int16_t *dst, const int16_t *src,
+                                        size_t frames,
+                                        enum dsp_mono_mode mode)
+{
+    size_t i;
+
+    for (i = 0; i + 8 <= frames; i += 8) {
+        int16x8x2_t s = vld2q_s16(src + 2 * i);
+
+        switch (mode) {
+        case DSP_MONO_LEFT:
+            vst1q_s16(dst + i, s.val[0]);
+            break;
+        case DSP_MONO_RIGHT:
+            vst1q_s16(dst + i, s.val[1]);
+            break;
+        case DSP_MONO_AVERAGE:
+            vst1q_s16(dst + i, vhaddq_s16(s.val[0], s.val[1]));
+            break;
+        }
+    }
+
+    return i;
+}
+
+#elif defined(DSP_SSE2)
+
+static size_t stereo_to_mono_s16_vector(int16_t *dst, const int16_t *src,
+                                        size_t frames,
+                                        enum dsp_mono_mode mode)
+{
+    size_t i;
+
+    for (i = 0; i + 8 <= frames; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 8));
+        /* sign extend the left and right samples of each frame */
+        __m128i left_a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+        __m128i left_b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+        __m128i right_a = _mm_srai_epi32(a, 16);
+        __m128i right_b = _mm_srai_epi32(b, 16);
+        __m128i out;
+
+        switch (mode) {
+        case DSP_MONO_LEFT:
+            out = _mm_packs_epi32(left_a, left_b);
+            break;
+        case DSP_MONO_RIGHT:
+            out = _mm_packs_epi32(right_a, right_b);
+            break;
+        case DSP_MONO_AVERAGE:
+        default:
+            out = _mm_packs_epi32(
+                    _mm_srai_epi32(_mm_add_epi32(left_a, right_a), 1),
+                    _mm_srai_epi32(_mm_add_epi32(left_b, right_b), 1));
+            break;
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), out);
+    }
+
+    return i;
+}
+
+#endif
+
+void dsp_stereo_to_mono_s16(int16_t *dst, const int16_t *src, size_t frames,
+                            enum dsp_mono_mode mode)
+{
+    size_t i = 0;
+
+#if defined(DSP_NEON) || defined(DSP_SSE2)
+    i = stereo_to_mono_s16_vector(dst, src, frames, mode);
+#endif
+
+    switch (mode) {
+    case DSP_MONO_LEFT:
+        for (; i < frames; i++)
+            dst[i] = src[2 * i];
+        break;
+    case DSP_MONO_RIGHT:
+        for (; i < frames; i++)
+            dst[i] = src[2 * i + 1];
+        break;
+    case DSP_MONO_AVERAGE:
+        for (; i < frames; i++)
+            dst[i] = (src[2 * i] + src[2 * i + 1]) >> 1;
+        break;
+    }
+}
+
+/*
+ * Dot product
+ *
+ * The vector versions accumulate 8 products at a time in 32 bit lanes.
+ * The sum does not overflow, so the order of the additions does not
+ * change the result.
+ */
+
+int32_t dsp_dot_s16(const int16_t *a, const int16_t *b, size_t n)
+{
+    int32_t sum = 0;
+    size_t i = 0;
+
+#if defined(DSP_NEON)
+    int32x4_t acc = vdupq_n_s32(0);
+
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t va = vld1q_s16(a + i);
+        int16x8_t vb = vld1q_s16(b + i);
+
+        acc = vmlal_s16(acc, vget_low_s16(va), vget_low_s16(vb));
+        acc = vmlal_s16(acc, vget_high_s16(va), vget_high_s16(vb));
+    }
+    sum = vgetq_lane_s32(acc, 0) + vgetq_lane_s32(acc, 1) +
+          vgetq_lane_s32(acc, 2) + vgetq_lane_s32(acc, 3);
+#elif defined(DSP_SSE2)
+    __m128i acc = _mm_setzero_si128();
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(va, vb));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = _mm_cvtsi128_si32(acc);
+#endif
+
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+
+    return sum;
+}
+
+/*
+ * Stereo mix
+ *
+ * The vector versions mix 4 frames at a time, gathering and scattering the
+ * destination frames one by one when they have more than 2 channels. The
+ * left and right samples of a frame are next to each other in both
+ * buffers: SSE2 moves each frame as one 32 bit lane, NEON loads the left
+ * and right samples in two vectors with structure loads, which only need
+ * the alignment of the samples. The gain is applied with the same
+ * truncation as the C version.
+ */
+
+#if defined(DSP_NEON)
+
+static size_t mix_stereo_s16_vector(int16_t *dst, unsigned int dst_channels,
+                                    const int16_t *src, size_t frames,
+                                    uint16_t gain)
+{
+    unsigned int ch = dst_channels;
+    int16x4_t g = vdup_n_s16((int16_t)gain);
+    size_t i;
+
+    for (i = 0; i + 4 <= frames; i += 4) {
+        int16x4x2_t s = vld2_s16(src + 2 * i);
+        int16_t *d = dst + i * ch;
+        int16x4x2_t dv;
+
+        if (ch == 2) {
+            dv = vld2_s16(d);
+        } else {
+            dv.val[0] = dv.val[1] = vdup_n_s16(0);
+            dv = vld2_lane_s16(d, dv, 0);
+            dv = vld2_lane_s16(d + ch, dv, 1);
+            dv = vld2_lane_s16(d + 2 * ch, dv, 2);
+            dv = vld2_lane_s16(d + 3 * ch, dv, 3);
+        }
+
+        /* (s * gain) >> 15, gain is not above 0x8000 */
+        if (gain != DSP_UNITY_GAIN) {
+            s.val[0] = vqdmulh_s16(s.val[0], g);
+            s.val[1] = vqdmulh_s16(s.val[1], g);
+        }
+        dv.val[0] = vqadd_s16(dv.val[0], s.val[0]);
+        dv.val[1] = vqadd_s16(dv.val[1], s.val[1]);
+
+        if (ch == 2) {
+            vst2_s16(d, dv);
+        } else {
+            vst2_lane_s16(d, dv, 0);
+            vst2_lane_s16(d + ch, dv, 1);
+            vst2_lane_s16(d + 2 * ch, dv, 2);
+            vst2_lane_s16(d + 3 * ch, dv, 3);
+        }
+    }
+
+    return i;
+}
+
+#elif defined(DSP_SSE2)
+
+static inline __m128i mix_gain_s16(__m128i s, __m128i g)
+{
+    /* (s * g) >> 15 from the upper and lower halves of the product */
+    __m128i hi = _mm_mulhi_epi16(s, g);
+    __m128i lo = _mm_mullo_epi16(s, g);
+
+    return _mm_or_si128(_mm_slli_epi16(hi, 1), _mm_srli_epi16(lo, 15));
+}
+
+static inline __m128i load_frame_s16(const int16_t *p)
+{
+    int32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return _mm_cvtsi32_si128(v);
+}
+
+static inline void store_frame_s16(int16_t *p, __m128i v)
+{
+    int32_t w = _mm_cvtsi128_si32(v);
+
+    memcpy(p, &w, sizeof(w));
+}
+
+static size_t mix_stereo_s16_vector(int16_t *dst, unsigned int dst_channels,
+                                    const int16_t *src, size_t frames,
+                                    uint16_t gain)
+{
+    __m128i g = _mm_set1_epi16((short)gain);
+    size_t i;
+
+    for (i = 0; i + 4 <= frames; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        int16_t *d = dst + i * dst_channels;
+        __m128i dv;
+
+        if (dst_channels == 2)
+            dv = _mm_loadu_si128((const __m128i *)d);
+        else
+            dv = _mm_unpacklo_epi64(
+                    _mm_unpacklo_epi32(load_frame_s16(d),
+                                       load_frame_s16(d + dst_channels)),
+                    _mm_unpacklo_epi32(load_frame_s16(d + 2 * dst_channels),
+                                       load_frame_s16(d + 3 * dst_channels)));
+
+        if (gain != DSP_UNITY_GAIN)
+            s = mix_gain_s16(s, g);
+        dv = _mm_adds_epi16(dv, s);
+
+        if (dst_channels == 2) {
+            _mm_storeu_si128((__m128i *)d, dv);
+        } else {
+            store_frame_s16(d, dv);
+            store_frame_s16(d + dst_channels, _mm_srli_si128(dv, 4));
+            store_frame_s16(d + 2 * dst_channels, _mm_srli_si128(dv, 8));
+            store_frame_s16(d + 3 * dst_channels, _mm_srli_si128(dv, 12));
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+static inline int16_t clamp_s16(int32_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+}
+
+void dsp_mix_stereo_s16(int16_t *dst, unsigned int dst_channels,
+                        const int16_t *src, size_t frames, uint16_t gain)
+{
+    size_t i = 0;
+
+#if defined(DSP_NEON) || defined(DSP_SSE2)
+    i = mix_stereo_s16_vector(dst, dst_channels, src, frames, gain);
+#endif
+
+    for (; i < frames; i++) {
+        int16_t *d = dst + i * dst_channels;
+
+        d[0] = clamp_s16(d[0] + ((src[2 * i] * gain) >> 15));
+        d[1] = clamp_s16(d[1] + ((src[2 * i + 1] * gain) >> 15));
+    }
+}
+
+/*
+ * Channel matrix
+ *
+ * The vector versions convert 4 frames at a time, with one 32 bit lane
+ * per frame for each output channel. SSE2 multiplies pairs of input
+ * channels, which are next to each other in a frame, and needs an even
+ * number of input and output channels. NEON gathers each input channel
+ * of the 4 frames in one vector. The sums are rounded and saturated like
+ * the C version.
+ */
+
+#if defined(DSP_NEON)
+
+static size_t matrix_s16_vector(int16_t *dst, const int16_t *src,
+                                size_t frames, const struct dsp_matrix *m)
+{
+    unsigned int in = m->in_channels;
+    unsigned int out = m->out_channels;
+    size_t i;
+
+    for (i = 0; i + 4 <= frames; i += 4) {
+        const int16_t *s = src + i * in;
+        int16_t *d = dst + i * out;
+        int32x4_t acc[DSP_MATRIX_MAX_CHANNELS];
+        unsigned int c, o;
+
+        for (o = 0; o < out; o++)
+            acc[o] = vdupq_n_s32(0);
+        for (c = 0; c < in; c++) {
+            int16x4_t x = vdup_n_s16(0);
+
+            x = vld1_lane_s16(s + c, x, 0);
+            x = vld1_lane_s16(s + in + c, x, 1);
+            x = vld1_lane_s16(s + 2 * in + c, x, 2);
+            x = vld1_lane_s16(s + 3 * in + c, x, 3);
+            for (o = 0; o < out; o++)
+                acc[o] = vmlal_n_s16(acc[o], x, m->coef[o][c]);
+        }
+        for (o = 0; o < out; o++) {
+            int16x4_t y = vqrshrn_n_s32(acc[o], DSP_MATRIX_SHIFT);
+
+            vst1_lane_s16(d + o, y, 0);
+            vst1_lane_s16(d + out + o, y, 1);
+            vst1_lane_s16(d + 2 * out + o, y, 2);
+            vst1_lane_s16(d + 3 * out + o, y, 3);
+        }
+    }
+
+    return i;
+}
+
+#elif defined(DSP_SSE2)
+
+static size_t matrix_s16_vector(int16_t *dst, const int16_t *src,
+                                size_t frames, const struct dsp_matrix *m)
+{
+    unsigned int in = m->in_channels;
+    unsigned int out = m->out_channels;
+    __m128i coef[DSP_MATRIX_MAX_CHANNELS][DSP_MATRIX_MAX_CHANNELS / 2];
+    __m128i round = _mm_set1_epi32(1 << (DSP_MATRIX_SHIFT - 1));
+    unsigned int o, p;
+    size_t i;
+
+    if (in % 2 != 0 || out % 2 != 0)
+        return 0;
+
+    /* the coefficients of channels 2p and 2p + 1 in each 32 bit lane */
+    for (o = 0; o < out; o++)
+        for (p = 0; p < in / 2; p++)
+            coef[o][p] = _mm_set1_epi32(
+                    (uint16_t)m->coef[o][2 * p] |
+                    ((uint32_t)(uint16_t)m->coef[o][2 * p + 1] << 16));
+
+    for (i = 0; i + 4 <= frames; i += 4) {
+        const int16_t *s = src + i * in;
+        int16_t *d = dst + i * out;
+        __m128i pairs[DSP_MATRIX_MAX_CHANNELS / 2];
+
+        for (p = 0; p < in / 2; p++)
+            pairs[p] = _mm_unpacklo_epi64(
+                    _mm_unpacklo_epi32(load_frame_s16(s + 2 * p),
+                                       load_frame_s16(s + in + 2 * p)),
+                    _mm_unpacklo_epi32(load_frame_s16(s + 2 * in + 2 * p),
+                                       load_frame_s16(s + 3 * in + 2 * p)));
+
+        for (o = 0; o < out; o += 2) {
+            __m128i a = round, b = round, y;
+
+            for (p = 0; p < in / 2; p++) {
+                a = _mm_add_epi32(a, _mm_madd_epi16(pairs[p], coef[o][p]));
+                b = _mm_add_epi32(b, _mm_madd_epi16(pairs[p], coef[o + 1][p]));
+            }
+            a = _mm_srai_epi32(a, DSP_MATRIX_SHIFT);
+            b = _mm_srai_epi32(b, DSP_MATRIX_SHIFT);
+            /* channels o and o + 1 of each frame, in a 32 bit lane */
+            y = _mm_unpacklo_epi16(_mm_packs_epi32(a, a), _mm_packs_epi32(b, b));
+
+            store_frame_s16(d + o, y);
+            store_frame_s16(d + out + o, _mm_srli_si128(y, 4));
+            store_frame_s16(d + 2 * out + o, _mm_srli_si128(y, 8));
+            store_frame_s16(d + 3 * out + o, _mm_srli_si128(y, 12));
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+void dsp_matrix_s16(int16_t *dst, const int16_t *src, size_t frames,
+                    const struct dsp_matrix *m)
+{
+    unsigned int in = m->in_channels;
+    unsigned int out = m->out_channels;
+    size_t i = 0;
+    unsigned int c, o;
+
+#if defined(DSP_NEON) || defined(DSP_SSE2)
+    i = matrix_s16_vector(dst, src, frames, m);
+#endif
+
+    for (; i < frames; i++) {
+        for (o = 0; o < out; o++) {
+            int32_t sum = 1 << (DSP_MATRIX_SHIFT - 1);
+
+            for (c = 0; c < in; c++)
+                sum += src[i * in + c] * m->coef[o][c];
+            dst[i * out + o] = clamp_s16(sum >> DSP_MATRIX_SHIFT);
+        }
+    }
+}
+
+/*
+ * Format conversion
+ *
+ * Every input format is first converted to 24 bit samples in 32 bit lanes,
+ * then stored as 24 or 16 bit, so there is a single rounding for each
+ * step. Floats are scaled by 2^23, which is exact, clipped, and rounded
+ * half away from zero; NaN becomes the negative full scale. 16 bit output
+ * is rounded half up and saturated. The vector versions convert 8 samples
+ * at a time with the same operations as the C version.
+ */
+
+#define S24_MIN (-0x800000)
+#define S24_MAX 0x7fffff
+
+static inline int32_t float_to_s24(float v)
+{
+    v *= 8388608.0f;
+    if (!(v > (float)S24_MIN))
+        v = (float)S24_MIN;
+    if (!(v < (float)S24_MAX))
+        v = (float)S24_MAX;
+    return (int32_t)(v + (v < 0.0f ? -0.5f : 0.5f));
+}
+
+static inline int32_t load_s24_3le(const uint8_t *p)
+{
+    return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 |
+                     (uint32_t)p[2] << 24) >> 8;
+}
+
+static inline int32_t clamp_s24(int32_t v)
+{
+    return v > S24_MAX ? S24_MAX : v < S24_MIN ? S24_MIN : v;
+}
+
+static inline int16_t s24_to_s16(int32_t v)
+{
+    return clamp_s16((v + 0x80) >> 8);
+}
+
+#if defined(DSP_NEON)
+
+static inline int32x4_t float_to_s24_vector(float32x4_t v)
+{
+    float32x4_t min = vdupq_n_f32((float)S24_MIN);
+    float32x4_t max = vdupq_n_f32((float)S24_MAX);
+    float32x4_t half;
+
+    v = vmulq_n_f32(v, 8388608.0f);
+    /* selects the limit when the comparison fails, including for NaN */
+    v = vbslq_f32(vcgtq_f32(v, min), v, min);
+    v = vbslq_f32(vcltq_f32(v, max), v, max);
+    half = vbslq_f32(vcltq_f32(v, vdupq_n_f32(0.0f)),
+                     vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+    return vcvtq_s32_f32(vaddq_f32(v, half));
+}
+
+static inline void load_s24_vector(const void *src, enum dsp_format format,
+                                   size_t i, int32x4_t *lo, int32x4_t *hi)
+{
+    switch (format) {
+    case DSP_FORMAT_S24_3LE: {
+        uint8x8x3_t b = vld3_u8((const uint8_t *)src + 3 * i);
+        uint16x8_t low = vorrq_u16(vmovl_u8(b.val[0]), vshll_n_u8(b.val[1], 8));
+        uint16x8_t high = vmovl_u8(b.val[2]);
+
+        /* place the 3 bytes at the top of the lane, then sign extend */
+        *lo = vshrq_n_s32(vreinterpretq_s32_u32(vorrq_u32(
+                vshlq_n_u32(vmovl_u16(vget_low_u16(high)), 24),
+                vshlq_n_u32(vmovl_u16(vget_low_u16(low)), 8))), 8);
+        *hi = vshrq_n_s32(vreinterpretq_s32_u32(vorrq_u32(
+                vshlq_n_u32(vmovl_u16(vget_high_u16(high)), 24),
+                vshlq_n_u32(vmovl_u16(vget_high_u16(low)), 8))), 8);
+        break;
+    }
+    case DSP_FORMAT_S24_LE: {
+        int32x4_t min = vdupq_n_s32(S24_MIN);
+        int32x4_t max = vdupq_n_s32(S24_MAX);
+
+        *lo = vmaxq_s32(vminq_s32(vld1q_s32((const int32_t *)src + i), max), min);
+        *hi = vmaxq_s32(vminq_s32(vld1q_s32((const int32_t *)src + i + 4), max), min);
+        break;
+    }
+    case DSP_FORMAT_FLOAT:
+    default:
+        *lo = float_to_s24_vector(vld1q_f32((const float *)src + i));
+        *hi = float_to_s24_vector(vld1q_f32((const float *)src + i + 4));
+        break;
+    }
+}
+
+static inline void store_s24_vector(void *dst, enum dsp_format format,
+                                    size_t i, int32x4_t lo, int32x4_t hi)
+{
+    if (format == DSP_FORMAT_S16) {
+        vst1q_s16((int16_t *)dst + i,
+                  vcombine_s16(vqrshrn_n_s32(lo, 8), vqrshrn_n_s32(hi, 8)));
+    } else {
+        vst1q_s32((int32_t *)dst + i, lo);
+        vst1q_s32((int32_t *)dst + i + 4, hi);
+    }
+}
+
+#elif defined(DSP_SSE2)
+
+static inline __m128i float_to_s24_vector(__m128 v)
+{
+    __m128 sign = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+
+    v = _mm_mul_ps(v, _mm_set1_ps(8388608.0f));
+    /* maxps returns its second operand for NaN */
+    v = _mm_max_ps(v, _mm_set1_ps((float)S24_MIN));
+    v = _mm_min_ps(v, _mm_set1_ps((float)S24_MAX));
+    /* 0.5 with the sign of v: -0.0 rounds to 0 either way */
+    v = _mm_add_ps(v, _mm_or_ps(_mm_and_ps(v, sign), _mm_set1_ps(0.5f)));
+    return _mm_cvttps_epi32(v);
+}
+
+static inline __m128i clamp_s24_vector(__m128i v)
+{
+    __m128i min = _mm_set1_epi32(S24_MIN);
+    __m128i max = _mm_set1_epi32(S24_MAX);
+    __m128i over = _mm_cmpgt_epi32(v, max);
+    __m128i under = _mm_cmplt_epi32(v, min);
+
+    v = _mm_or_si128(_mm_andnot_si128(over, v), _mm_and_si128(over, max));
+    return _mm_or_si128(_mm_andnot_si128(under, v), _mm_and_si128(under, min));
+}
+
+static inline void load_s24_vector(const void *src, enum dsp_format format,
+                                   size_t i, __m128i *lo, __m128i *hi)
+{
+    switch (format) {
+    case DSP_FORMAT_S24_3LE: {
+        /* no byte shuffle in SSE2 */
+        const uint8_t *p = (const uint8_t *)src + 3 * i;
+
+        *lo = _mm_set_epi32(load_s24_3le(p + 9), load_s24_3le(p + 6),
+                            load_s24_3le(p + 3), load_s24_3le(p));
+        *hi = _mm_set_epi32(load_s24_3le(p + 21), load_s24_3le(p + 18),
+                            load_s24_3le(p + 15), load_s24_3le(p + 12));
+        break;
+    }
+    case DSP_FORMAT_S24_LE:
+        *lo = clamp_s24_vector(_mm_loadu_si128((const __m128i *)((const int32_t *)src + i)));
+        *hi = clamp_s24_vector(_mm_loadu_si128((const __m128i *)((const int32_t *)src + i + 4)));
+        break;
+    case DSP_FORMAT_FLOAT:
+    default:
+        *lo = float_to_s24_vector(_mm_loadu_ps((const float *)src + i));
+        *hi = float_to_s24_vector(_mm_loadu_ps((const float *)src + i + 4));
+        break;
+    }
+}
+
+static inline void store_s24_vector(void *dst, enum dsp_format format,
+                                    size_t i, __m128i lo, __m128i hi)
+{
+    if (format == DSP_FORMAT_S16) {
+        __m128i round = _mm_set1_epi32(0x80);
+
+        lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 8);
+        hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 8);
+        _mm_storeu_si128((__m128i *)((int16_t *)dst + i), _mm_packs_epi32(lo, hi));
+    } else {
+        _mm_storeu_si128((__m128i *)((int32_t *)dst + i), lo);
+        _mm_storeu_si128((__m128i *)((int32_t *)dst + i + 4), hi);
+    }
+}
+
+#endif
+
+/* always inlined with constant formats, so that each loop is specialized */
+static inline __attribute__((always_inline))
+void convert_loop(void *dst, enum dsp_format dst_format, const void *src,
+                  enum dsp_format src_format, size_t samples)
+{
+    size_t i = 0;
+    int32_t v;
+
+#if defined(DSP_NEON)
+    for (; i + 8 <= samples; i += 8) {
+        int32x4_t lo, hi;
+
+        load_s24_vector(src, src_format, i, &lo, &hi);
+        store_s24_vector(dst, dst_format, i, lo, hi);
+    }
+#elif defined(DSP_SSE2)
+    for (; i + 8 <= samples; i += 8) {
+        __m128i lo, hi;
+
+        load_s24_vector(src, src_format, i, &lo, &hi);
+        store_s24_vector(dst, dst_format, i, lo, hi);
+    }
+#endif
+
+    for (; i < samples; i++) {
+        switch (src_format) {
+        case DSP_FORMAT_S24_3LE:
+            v = load_s24_3le((const uint8_t *)src + 3 * i);
+            break;
+        case DSP_FORMAT_S24_LE:
+            v = clamp_s24(((const int32_t *)src)[i]);
+            break;
+        case DSP_FORMAT_FLOAT:
+        default:
+            v = float_to_s24(((const float *)src)[i]);
+            break;
+        }
+        if (dst_format == DSP_FORMAT_S16)
+            ((int16_t *)dst)[i] = s24_to_s16(v);
+        else
+            ((int32_t *)dst)[i] = v;
+    }
+}
+
+void dsp_convert(void *dst, enum dsp_format dst_format, const void *src,
+                 enum dsp_format src_format, size_t samples)
+{
+    bool s16 = dst_format == DSP_FORMAT_S16;
+
+    switch (src_format) {
+    case DSP_FORMAT_S16:
+        memcpy(dst, src, samples * sizeof(int16_t));
+        break;
+    case DSP_FORMAT_S24_3LE:
+        if (s16)
+            convert_loop(dst, DSP_FORMAT_S16, src, DSP_FORMAT_S24_3LE, samples);
+        else
+            convert_loop(dst, DSP_FORMAT_S24_LE, src, DSP_FORMAT_S24_3LE, samples);
+        break;
+    case DSP_FORMAT_S24_LE:
+        if (s16)
+            convert_loop(dst, DSP_FORMAT_S16, src, DSP_FORMAT_S24_LE, samples);
+        else
+            convert_loop(dst, DSP_FORMAT_S24_LE, src, DSP_FORMAT_S24_LE, samples);
+        break;
+    case DSP_FORMAT_FLOAT:
+        if (s16)
+            convert_loop(dst, DSP_FORMAT_S16, src, DSP_FORMAT_FLOAT, samples);
+        else
+            convert_loop(dst, DSP_FORMAT_S24_LE, src, DSP_FORMAT_FLOAT, samples);
+        break;
+    }
+}
+
+/*
+ * 24 bit gain
+ *
+ * The product of a 24 bit sample and a 16 bit gain needs 64 bits. NEON
+ * processes groups of frames which fill whole 4 sample vectors, with the
+ * gain of each sample in its lane like the 16 bit version, and multiplies
+ * them into 64 bit lanes. SSE2 has no signed 32 bit multiply, so it uses
+ * the C version.
+ */
+
+#if defined(DSP_NEON)
+
+static size_t gain_s24_vector(int32_t *dst, const int32_t *src, size_t frames,
+                              unsigned int channels, uint16_t vol,
+                              uint16_t step)
+{
+    unsigned int group = gain_group_frames(channels, 4);
+    unsigned int vectors = group * channels / 4;
+    uint32x4_t mask = vdupq_n_u32(0xffff);
+    uint32_t lanes[4];
+    uint32x4_t v[8], inc;
+    unsigned int n;
+    size_t i;
+
+    for (n = 0; n < vectors; n++) {
+        for (i = 0; i < 4; i++)
+            lanes[i] = (uint16_t)(vol + ((n * 4 + i) / channels) * step);
+        v[n] = vld1q_u32(lanes);
+    }
+    inc = vdupq_n_u32((uint16_t)(group * step));
+
+    for (i = 0; i + group <= frames; i += group) {
+        for (n = 0; n < vectors; n++) {
+            size_t offset = i * channels + n * 4;
+            int32x4_t s = vld1q_s32(src + offset);
+            int64x2_t lo = vmull_s32(vget_low_s32(s),
+                                     vreinterpret_s32_u32(vget_low_u32(v[n])));
+            int64x2_t hi = vmull_s32(vget_high_s32(s),
+                                     vreinterpret_s32_u32(vget_high_u32(v[n])));
+
+            vst1q_s32(dst + offset,
+                      vcombine_s32(vshrn_n_s64(lo, 16), vshrn_n_s64(hi, 16)));
+            /* the gains wrap modulo 2^16 */
+            v[n] = vandq_u32(vaddq_u32(v[n], inc), mask);
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+uint16_t dsp_gain_s24(int32_t *dst, const int32_t *src, size_t frames,
+                      unsigned int channels, uint16_t vol, int16_t step)
+{
+    uint16_t inc = (uint16_t)step;
+    size_t i = 0;
+    unsigned int c;
+
+#if defined(DSP_NEON)
+    i = gain_s24_vector(dst, src, frames, channels, vol, inc);
+    vol += i * inc;
+#endif
+
+    for (; i < frames; i++) {
+        for (c = 0; c < channels; c++)
+            dst[i * channels + c] =
+                (int32_t)(((int64_t)src[i * channels + c] * vol) >> 16);
+        vol += inc;
+    }
+
+    return vol;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AUDIO_DSP_H
+#define AUDIO_DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Sample processing kernels of the HAL. They use NEON or SSE2 when the
+ * compiler targets it and fall back to plain C otherwise; all versions
+ * produce the same output.
+ */
+
+/*
+ * Multiply interleaved 16 bit frames by a gain ramp in 0.16 fixed point,
+ * starting at vol and increased by step after every frame. Returns the
+ * gain for the next frame.
+ */
+uint16_t dsp_ramp_s16(int16_t *buffer, size_t frames, unsigned int channels,
+                      uint16_t vol, uint16_t step);
+
+/*
+ * Copy interleaved 16 bit frames from src to dst multiplied by a gain in
+ * 0.16 fixed point, starting at vol and moved by step after every frame.
+ * The caller must keep the gain of every frame within 0 and 0xffff. dst
+ * may be the same buffer as src. Returns the gain for the next frame.
+ */
+uint16_t dsp_gain_s16(int16_t *dst, const int16_t *src, size_t frames,
+                      unsigned int channels, uint16_t vol, int16_t step);
+
+/* how a stereo capture is converted to mono */
+enum dsp_mono_mode {
+    DSP_MONO_LEFT,
+    DSP_MONO_RIGHT,
+    DSP_MONO_AVERAGE,
+};
+
+/*
+ * Convert 16 bit stereo frames to mono. dst may be the same buffer as
+ * src.
+ */
+void dsp_stereo_to_mono_s16(int16_t *dst, const int16_t *src, size_t frames,
+                            enum dsp_mono_mode mode);
+
+/*
+ * Dot product of two 16 bit vectors. The caller must make sure the sum
+ * fits in 32 bits.
+ */
+int32_t dsp_dot_s16(const int16_t *a, const int16_t *b, size_t n);
+
+/* gain of 1.0 for dsp_mix_stereo_s16() */
+#define DSP_UNITY_GAIN 0x8000
+
+/*
+ * Add 16 bit stereo frames, multiplied by a gain in 1.15 fixed point no
+ * larger than DSP_UNITY_GAIN, to the first two channels of interleaved
+ * frames of dst_channels, with saturation.
+ */
+void dsp_mix_stereo_s16(int16_t *dst, unsigned int dst_channels,
+                        const int16_t *src, size_t frames, uint16_t gain);
+
+/* a channel matrix coefficient of 1.0 */
+#define DSP_MATRIX_SHIFT 14
+#define DSP_MATRIX_UNITY (1 << DSP_MATRIX_SHIFT)
+#define DSP_MATRIX_MAX_CHANNELS 8
+
+/*
+ * Conversion of frames of in_channels to frames of out_channels: output
+ * channel o is the sum of the input channels c multiplied by coef[o][c],
+ * in 2.14 fixed point. The sum of the absolute coefficients of a row must
+ * stay below 4.0, so that it fits in 32 bits.
+ */
+struct dsp_matrix {
+    unsigned int in_channels;
+    unsigned int out_channels;
+    int16_t coef[DSP_MATRIX_MAX_CHANNELS][DSP_MATRIX_MAX_CHANNELS];
+};
+
+/*
+ * Convert interleaved 16 bit frames with a channel matrix, rounding and
+ * saturating the result. dst must not overlap src.
+ */
+void dsp_matrix_s16(int16_t *dst, const int16_t *src, size_t frames,
+                    const struct dsp_matrix *m);
+
+/* sample formats of dsp_convert() */
+enum dsp_format {
+    DSP_FORMAT_S16,     /* 16 bit */
+    DSP_FORMAT_S24_3LE, /* 24 bit packed in 3 bytes, source only */
+    DSP_FORMAT_S24_LE,  /* 24 bit in the low bits of 32 bit words */
+    DSP_FORMAT_FLOAT,   /* float in [-1.0, 1.0], source only */
+};
+
+/*
+ * Convert samples to DSP_FORMAT_S16 or DSP_FORMAT_S24_LE, clipping
+ * anything out of range. S24_LE sources may use the upper bits for
+ * headroom, like AUDIO_FORMAT_PCM_8_24_BIT. DSP_FORMAT_S16 sources are
+ * only copied, to DSP_FORMAT_S16. dst must not overlap src.
+ */
+void dsp_convert(void *dst, enum dsp_format dst_format, const void *src,
+                 enum dsp_format src_format, size_t samples);
+
+/*
+ * dsp_gain_s16() for interleaved 24 bit frames in 32 bit words
+ * (DSP_FORMAT_S24_LE).
+ */
+uint16_t dsp_gain_s24(int32_t *dst, const int32_t *src, size_t frames,
+                      unsigned int channels, uint16_t vol, int16_t step);
+
+#endif
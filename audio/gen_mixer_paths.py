@@ -0,0 +1,201 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2016 The CyanogenMod Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Compile mixer_paths.xml into a C table for mixer_route.c.
+
+Every path is flattened: referenced paths are inlined and a control which
+is set several times only keeps its last value. Control names and values
+are deduplicated and numeric values are parsed, so that the HAL only has
+to look up the controls and enum values once when it is opened.
+
+Usage: gen_mixer_paths.py mixer_paths.xml > mixer_paths_table.h
+"""
+
+import os
+import sys
+import xml.etree.ElementTree as ElementTree
+
+
+class MixerPaths(object):
+    def __init__(self):
+        self.reset = []   # [(ctl, value)] of the top level <ctl> elements
+        self.paths = {}   # name -> [('ctl', ctl, value) | ('path', name)]
+
+    def parse(self, filename):
+        root = ElementTree.parse(filename).getroot()
+        for element in root:
+            if element.tag == 'ctl':
+                self.reset.append(parse_ctl(filename, element))
+            elif element.tag == 'path':
+                self.parse_path(filename, element)
+            elif element.tag == 'include':
+                # includes refer to the installed location of the file
+                name = os.path.basename(element.get('name'))
+                included = os.path.join(os.path.dirname(filename), name)
+                if os.path.exists(included):
+                    self.parse(included)
+                else:
+                    warn('%s: cannot find included file %s' % (filename, name))
+
+    def parse_path(self, filename, element):
+        name = element.get('name')
+        if name in self.paths:
+            error('%s: path %s is defined twice' % (filename, name))
+        entries = []
+        for child in element:
+            if child.tag == 'ctl':
+                entries.append(('ctl',) + parse_ctl(filename, child))
+            elif child.tag == 'path':
+                entries.append(('path', child.get('name')))
+        self.paths[name] = entries
+
+    def flatten(self, name, stack=()):
+        if name in stack:
+            error('path %s references itself' % name)
+        if name not in self.paths:
+            error('path %s is not defined' % name)
+        settings = []
+        for entry in self.paths[name]:
+            if entry[0] == 'ctl':
+                settings.append(entry[1:])
+            else:
+                settings.extend(self.flatten(entry[1], stack + (name,)))
+        return settings
+
+
+def parse_ctl(filename, element):
+    if element.get('index') is not None:
+        error('%s: ctl %s: index attribute is not supported' %
+              (filename, element.get('name')))
+    return (element.get('name'), element.get('value'))
+
+
+def coalesce(settings):
+    """Keep the last value of every control, in order of first use."""
+    values = {}
+    order = []
+    for ctl, value in settings:
+        if ctl not in values:
+            order.append(ctl)
+        values[ctl] = value
+    return [(ctl, values[ctl]) for ctl in order]
+
+
+def parse_ints(value):
+    try:
+        return [int(v, 0) for v in value.split()]
+    except ValueError:
+        return []
+
+
+def c_string(s):
+    return '"%s"' % s.replace('\\', '\\\\').replace('"', '\\"')
+
+
+def warn(message):
+    sys.stderr.write('gen_mixer_paths.py: warning: %s\n' % message)
+
+
+def error(message):
+    sys.stderr.write('gen_mixer_paths.py: error: %s\n' % message)
+    sys.exit(1)
+
+
+def main(argv):
+    if len(argv) != 2:
+        sys.stderr.write(__doc__)
+        return 1
+
+    mixer_paths = MixerPaths()
+    mixer_paths.parse(argv[1])
+
+    reset = coalesce(mixer_paths.reset)
+    path_names = sorted(mixer_paths.paths)
+    paths = [coalesce(mixer_paths.flatten(name)) for name in path_names]
+
+    ctls = []
+    ctl_ids = {}
+    values = []
+    value_ids = {}
+    ints = []
+
+    def setting_ids(settings):
+        ids = []
+        for ctl, value in settings:
+            if ctl not in ctl_ids:
+                ctl_ids[ctl] = len(ctls)
+                ctls.append(ctl)
+            if value not in value_ids:
+                parsed = parse_ints(value)
+                value_ids[value] = len(values)
+                values.append((value, len(ints), len(parsed)))
+                ints.extend(parsed)
+            ids.append((ctl_ids[ctl], value_ids[value]))
+        return ids
+
+    reset_ids = setting_ids(reset)
+    path_ids = [setting_ids(settings) for settings in paths]
+
+    out = []
+    out.append('/* Generated by gen_mixer_paths.py from %s, do not edit */' %
+               os.path.basename(argv[1]))
+    out.append('')
+    out.append('#ifndef MIXER_PATHS_TABLE_H')
+    out.append('#define MIXER_PATHS_TABLE_H')
+    out.append('')
+    out.append('#define MIXER_CTL_COUNT %d' % len(ctls))
+    out.append('#define MIXER_PATH_COUNT %d' % len(path_names))
+    out.append('')
+    out.append('static const char * const mixer_ctl_names[MIXER_CTL_COUNT] = {')
+    for ctl in ctls:
+        out.append('    %s,' % c_string(ctl))
+    out.append('};')
+    out.append('')
+    out.append('static const int mixer_int_values[] = {')
+    for i in range(0, len(ints), 16):
+        out.append('    %s,' % ', '.join(str(v) for v in ints[i:i + 16]))
+    out.append('};')
+    out.append('')
+    out.append('static const struct mixer_value mixer_values[] = {')
+    for value, first, count in values:
+        out.append('    { %s, %d, %d },' % (c_string(value), first, count))
+    out.append('};')
+    out.append('')
+
+    settings = []
+    out.append('static const struct mixer_path mixer_paths[MIXER_PATH_COUNT] = {')
+    for name, ids in zip(path_names, path_ids):
+        out.append('    { %s, %d, %d },' % (c_string(name), len(reset_ids) +
+                                             len(settings), len(ids)))
+        settings.extend(ids)
+    out.append('};')
+    out.append('')
+    out.append('/* reset values, followed by the settings of every path */')
+    out.append('static const struct mixer_setting mixer_settings[] = {')
+    for ctl, value in reset_ids + settings:
+        out.append('    { %d, %d },' % (ctl, value))
+    out.append('};')
+    out.append('')
+    out.append('#define MIXER_RESET_SETTINGS %d' % len(reset_ids))
+    out.append('')
+    out.append('#endif')
+
+    sys.stdout.write('\n'.join(out) + '\n')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "audio_hw_primary"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+
+#include <linux/videodev2.h>
+
+#include "hdmi_v4l2.h"
+
+#define HDMI_V4L2_NODE "/dev/video16"
+
+int hdmi_v4l2_open(void)
+{
+    int fd;
+
+    fd = open(HDMI_V4L2_NODE, O_RDWR);
+    if (fd < 0) {
+        ALOGE("%s: cannot open %s: %s", __func__, HDMI_V4L2_NODE,
+              strerror(errno));
+        return -errno;
+    }
+    return fd;
+}
+
+void hdmi_v4l2_close(int fd)
+{
+    close(fd);
+}
+
+int hdmi_v4l2_get_ctrl(int fd, uint32_t id, int32_t *value)
+{
+    struct v4l2_control ctrl;
+
+    ctrl.id = id;
+    if (ioctl(fd, VIDIOC_G_CTRL, &ctrl) < 0) {
+        ALOGE("%s: control %#x: %s", __func__, id, strerror(errno));
+        return -errno;
+    }
+    *value = ctrl.value;
+    return 0;
+}
+
+int hdmi_v4l2_set_ctrl(int fd, uint32_t id, int32_t value)
+{
+    struct v4l2_control ctrl;
+
+    ctrl.id = id;
+    ctrl.value = value;
+    if (ioctl(fd, VIDIOC_S_CTRL, &ctrl) < 0) {
+        ALOGE("%s: control %#x = %d: %s", __func__, id, value,
+              strerror(errno));
+        return -errno;
+    }
+    return 0;
+}
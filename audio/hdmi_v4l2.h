@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HDMI_V4L2_H
+#define HDMI_V4L2_H
+
+#include <stdint.h>
+
+/*
+ * Controls of the HDMI audio driver, exposed by the TV out V4L2 node.
+ *
+ * The functions return 0 or a negative errno. hdmi_v4l2.c talks to
+ * /dev/video16, hdmi_v4l2_mock.c replaces it with AUDIO_HW_HDMI_MOCK := true
+ * to run the HDMI paths where there is no TV out driver.
+ */
+
+/* Function prototypes */
+int hdmi_v4l2_open(void);
+void hdmi_v4l2_close(int fd);
+int hdmi_v4l2_get_ctrl(int fd, uint32_t id, int32_t *value);
+int hdmi_v4l2_set_ctrl(int fd, uint32_t id, int32_t value);
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Mock HDMI V4L2 node, built instead of hdmi_v4l2.c with
+ * AUDIO_HW_HDMI_MOCK := true, to run the HDMI paths where there is no TV
+ * out driver.
+ *
+ * The sink is described by properties, read when the node is opened and
+ * each time the capabilities are queried, so that changing them and
+ * sending a hotplug event emulates plugging another sink:
+ * - audio_hal.hdmi_mock.connected: false to fail the open like a driver
+ *   that is not loaded (default true)
+ * - audio_hal.hdmi_mock.max_channels: channels of the sink (default 8)
+ * Each control access is logged, to check which ones the HAL issues.
+ */
+
+#define LOG_TAG "audio_hw_primary"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include <linux/videodev2.h>
+#include <linux/videodev2_exynos_media.h>
+
+#include "hdmi_v4l2.h"
+
+#define MOCK_FD 16
+#define MOCK_DEFAULT_MAX_CHANNELS 8
+
+static pthread_mutex_t mock_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool mock_open;
+static int32_t mock_audio_enabled;
+static int32_t mock_channels = 2;
+
+int hdmi_v4l2_open(void)
+{
+    int ret = MOCK_FD;
+
+    pthread_mutex_lock(&mock_lock);
+    if (!property_get_bool("audio_hal.hdmi_mock.connected", true)) {
+        ALOGE("%s: mock HDMI node not available", __func__);
+        ret = -ENODEV;
+    } else if (mock_open) {
+        ret = -EBUSY;
+    } else {
+        mock_open = true;
+    }
+    pthread_mutex_unlock(&mock_lock);
+
+    return ret;
+}
+
+void hdmi_v4l2_close(int fd)
+{
+    pthread_mutex_lock(&mock_lock);
+    if (fd == MOCK_FD)
+        mock_open = false;
+    pthread_mutex_unlock(&mock_lock);
+}
+
+int hdmi_v4l2_get_ctrl(int fd, uint32_t id, int32_t *value)
+{
+    int ret = 0;
+
+    if (fd != MOCK_FD)
+        return -EBADF;
+
+    pthread_mutex_lock(&mock_lock);
+    switch (id) {
+    case V4L2_CID_TV_MAX_AUDIO_CHANNELS:
+        *value = property_get_int32("audio_hal.hdmi_mock.max_channels",
+                                    MOCK_DEFAULT_MAX_CHANNELS);
+        break;
+    case V4L2_CID_TV_ENABLE_HDMI_AUDIO:
+        *value = mock_audio_enabled;
+        break;
+    case V4L2_CID_TV_SET_NUM_CHANNELS:
+        *value = mock_channels;
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+    pthread_mutex_unlock(&mock_lock);
+
+    if (ret == 0)
+        ALOGV("%s: control %#x = %d", __func__, id, *value);
+    return ret;
+}
+
+int hdmi_v4l2_set_ctrl(int fd, uint32_t id, int32_t value)
+{
+    int ret = 0;
+
+    if (fd != MOCK_FD)
+        return -EBADF;
+
+    pthread_mutex_lock(&mock_lock);
+    switch (id) {
+    case V4L2_CID_TV_ENABLE_HDMI_AUDIO:
+        mock_audio_enabled = !!value;
+        break;
+    case V4L2_CID_TV_SET_NUM_CHANNELS:
+        if (value < 2 || value > MOCK_DEFAULT_MAX_CHANNELS)
+            ret = -EINVAL;
+        else
+            mock_channels = value;
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+    pthread_mutex_unlock(&mock_lock);
+
+    ALOGV("%s: control %#x = %d (%d)", __func__, id, value, ret);
+    return ret;
+}
@@ -0,0 +1,555 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "audio_hw_primary"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include <tinyalsa/asoundlib.h>
+
+#include "mixer_route.h"
+
+/* Types of the tables generated by gen_mixer_paths.py */
+struct mixer_value {
+    const char *string;   /* enum value */
+    uint16_t first;       /* parsed numbers in mixer_int_values[] */
+    uint16_t count;       /* 0 if the value is not a number */
+};
+
+struct mixer_path {
+    const char *name;
+    uint16_t first;       /* settings in mixer_settings[] */
+    uint16_t count;
+};
+
+struct mixer_setting {
+    uint16_t ctl;         /* index into mixer_ctl_names[] */
+    uint16_t value;       /* index into mixer_values[] */
+};
+
+#include "mixer_paths_table.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define MIXER_SETTING_COUNT ARRAY_SIZE(mixer_settings)
+
+struct mixer_route_ctl {
+    struct mixer_ctl *ctl;  /* NULL if the control does not exist */
+    enum mixer_ctl_type type;
+    unsigned int num_values;
+    int *reset_values;      /* values after mixer_route_init() */
+    int *old_values;        /* values written to the mixer */
+    int *new_values;        /* values for the next mixer update */
+    bool dirty;             /* new_values set since the last flush */
+};
+
+struct mixer_route_setting {
+    const int *values;      /* NULL if the setting could not be resolved */
+    unsigned int num_values;
+};
+
+struct mixer_route {
+    struct mixer *mixer;
+    struct mixer_route_ctl ctls[MIXER_CTL_COUNT];
+    struct mixer_route_setting settings[MIXER_SETTING_COUNT];
+    int *value_pool;
+    unsigned int batch_depth;
+    bool batch_pending;   /* mixer_route_update_mixer() called in a batch */
+
+    /* statistics */
+    unsigned long requested;  /* control values set by paths */
+    unsigned long written;    /* control writes issued */
+    unsigned long flushes;
+    unsigned long hits;       /* controls already holding the new value */
+    unsigned long misses;     /* controls which had to be written */
+};
+
+static void read_ctl_values(const struct mixer_route_ctl *rctl, int *values)
+{
+    unsigned int i;
+
+    if (rctl->type == MIXER_CTL_TYPE_BYTE) {
+        unsigned char bytes[rctl->num_values];
+
+        mixer_ctl_get_array(rctl->ctl, bytes, rctl->num_values);
+        for (i = 0; i < rctl->num_values; i++)
+            values[i] = bytes[i];
+    } else {
+        for (i = 0; i < rctl->num_values; i++)
+            values[i] = mixer_ctl_get_value(rctl->ctl, i);
+    }
+}
+
+static int find_enum_value(struct mixer_ctl *ctl, const char *string)
+{
+    unsigned int num_enums = mixer_ctl_get_num_enums(ctl);
+    unsigned int i;
+
+    for (i = 0; i < num_enums; i++) {
+        if (strcmp(mixer_ctl_get_enum_string(ctl, i), string) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/*
+ * Convert the value of a setting into the values of its control. A single
+ * value is used for all values of the control, except for byte controls.
+ * Returns the number of values written to out.
+ */
+static unsigned int resolve_setting(const struct mixer_route_ctl *rctl,
+                                    const struct mixer_setting *setting,
+                                    int *out)
+{
+    const struct mixer_value *value = &mixer_values[setting->value];
+    const char *name = mixer_ctl_names[setting->ctl];
+    unsigned int i;
+    int enum_value;
+
+    if (rctl->type == MIXER_CTL_TYPE_ENUM) {
+        enum_value = find_enum_value(rctl->ctl, value->string);
+        if (enum_value < 0) {
+            ALOGE("%s: invalid value '%s' for control '%s'",
+                  __func__, value->string, name);
+            return 0;
+        }
+        for (i = 0; i < rctl->num_values; i++)
+            out[i] = enum_value;
+        return rctl->num_values;
+    }
+
+    if (value->count == 0) {
+        ALOGE("%s: invalid value '%s' for control '%s'",
+              __func__, value->string, name);
+        return 0;
+    }
+
+    if (value->count == 1 && rctl->type != MIXER_CTL_TYPE_BYTE) {
+        for (i = 0; i < rctl->num_values; i++)
+            out[i] = mixer_int_values[value->first];
+        return rctl->num_values;
+    }
+
+    for (i = 0; i < value->count && i < rctl->num_values; i++)
+        out[i] = mixer_int_values[value->first + i];
+
+    return i;
+}
+
+static void apply_settings(struct mixer_route *mr, unsigned int first,
+                           unsigned int count)
+{
+    unsigned int i;
+
+    for (i = first; i < first + count; i++) {
+        struct mixer_route_ctl *rctl = &mr->ctls[mixer_settings[i].ctl];
+        struct mixer_route_setting *setting = &mr->settings[i];
+
+        if (setting->values == NULL)
+            continue;
+
+        memcpy(rctl->new_values, setting->values,
+               setting->num_values * sizeof(int));
+        rctl->dirty = true;
+        mr->requested += setting->num_values;
+    }
+}
+
+int mixer_route_get_path(const char *name)
+{
+    int low = 0;
+    int high = MIXER_PATH_COUNT - 1;
+
+    if (name == NULL)
+        return MIXER_PATH_INVALID;
+
+    /* mixer_paths[] is sorted by name */
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        int cmp = strcmp(name, mixer_paths[mid].name);
+
+        if (cmp == 0)
+            return mid;
+        if (cmp < 0)
+            high = mid - 1;
+        else
+            low = mid + 1;
+    }
+
+    ALOGE("%s: unknown mixer path %s", __func__, name);
+    return MIXER_PATH_INVALID;
+}
+
+const char *mixer_route_get_path_name(int path)
+{
+    if (path < 0 || path >= MIXER_PATH_COUNT)
+        return "none";
+
+    return mixer_paths[path].name;
+}
+
+void mixer_route_apply_path(struct mixer_route *mr, int path)
+{
+    if (path < 0 || path >= MIXER_PATH_COUNT)
+        return;
+
+    apply_settings(mr, mixer_paths[path].first, mixer_paths[path].count);
+}
+
+void mixer_route_reset_path(struct mixer_route *mr, int path)
+{
+    unsigned int i;
+
+    if (path < 0 || path >= MIXER_PATH_COUNT)
+        return;
+
+    for (i = mixer_paths[path].first;
+         i < (unsigned int)mixer_paths[path].first + mixer_paths[path].count;
+         i++) {
+        struct mixer_route_ctl *rctl = &mr->ctls[mixer_settings[i].ctl];
+
+        if (rctl->ctl == NULL)
+            continue;
+
+        memcpy(rctl->new_values, rctl->reset_values,
+               rctl->num_values * sizeof(int));
+        rctl->dirty = true;
+        mr->requested += rctl->num_values;
+    }
+}
+
+/*
+ * Write a control in a single ioctl. mixer_ctl_set_value() reads back the
+ * whole control before writing one of its values, so it is only used for
+ * enums, which mixer_ctl_set_array() does not support.
+ */
+static void write_ctl(struct mixer_route *mr, struct mixer_route_ctl *rctl)
+{
+    unsigned int i;
+
+    switch (rctl->type) {
+    case MIXER_CTL_TYPE_BYTE: {
+        unsigned char bytes[rctl->num_values];
+
+        for (i = 0; i < rctl->num_values; i++)
+            bytes[i] = rctl->new_values[i];
+        mixer_ctl_set_array(rctl->ctl, bytes, rctl->num_values);
+        mr->written++;
+        break;
+    }
+    case MIXER_CTL_TYPE_BOOL:
+    case MIXER_CTL_TYPE_INT: {
+        long values[rctl->num_values];
+
+        for (i = 0; i < rctl->num_values; i++)
+            values[i] = rctl->new_values[i];
+        mixer_ctl_set_array(rctl->ctl, values, rctl->num_values);
+        mr->written++;
+        break;
+    }
+    default:
+        for (i = 0; i < rctl->num_values; i++) {
+            if (rctl->old_values[i] != rctl->new_values[i]) {
+                mixer_ctl_set_value(rctl->ctl, i, rctl->new_values[i]);
+                mr->written++;
+            }
+        }
+        break;
+    }
+}
+
+void mixer_route_flush(struct mixer_route *mr)
+{
+    unsigned long written = mr->written;
+    unsigned int i;
+
+    mr->batch_pending = false;
+
+    for (i = 0; i < MIXER_CTL_COUNT; i++) {
+        struct mixer_route_ctl *rctl = &mr->ctls[i];
+
+        if (!rctl->dirty)
+            continue;
+        rctl->dirty = false;
+
+        /* unchanged controls are not written at all */
+        if (memcmp(rctl->old_values, rctl->new_values,
+                   rctl->num_values * sizeof(int)) == 0) {
+            mr->hits++;
+            continue;
+        }
+        mr->misses++;
+
+        write_ctl(mr, rctl);
+        memcpy(rctl->old_values, rctl->new_values,
+               rctl->num_values * sizeof(int));
+    }
+
+    mr->flushes++;
+    ALOGV("%s: %lu control writes", __func__, mr->written - written);
+}
+
+void mixer_route_update_mixer(struct mixer_route *mr)
+{
+    if (mr->batch_depth > 0) {
+        mr->batch_pending = true;
+        return;
+    }
+
+    mixer_route_flush(mr);
+}
+
+void mixer_route_begin_batch(struct mixer_route *mr)
+{
+    mr->batch_depth++;
+}
+
+void mixer_route_end_batch(struct mixer_route *mr)
+{
+    if (mr->batch_depth == 0) {
+        ALOGE("%s: no batch in progress", __func__);
+        return;
+    }
+
+    if (--mr->batch_depth == 0 && mr->batch_pending)
+        mixer_route_flush(mr);
+}
+
+#define DUMP_MAX_VALUES 16
+
+static void dump_values(const struct mixer_route_ctl *rctl, const int *values,
+                        int fd)
+{
+    unsigned int i;
+
+    for (i = 0; i < rctl->num_values && i < DUMP_MAX_VALUES; i++) {
+        const char *string = NULL;
+
+        if (rctl->type == MIXER_CTL_TYPE_ENUM)
+            string = mixer_ctl_get_enum_string(rctl->ctl, values[i]);
+
+        if (string != NULL)
+            dprintf(fd, " %s", string);
+        else
+            dprintf(fd, " %d", values[i]);
+    }
+    if (rctl->num_values > DUMP_MAX_VALUES)
+        dprintf(fd, " ... (%u values)", rctl->num_values);
+}
+
+struct mixer_route_snapshot {
+    const struct mixer_route *mr;
+    unsigned long requested;
+    unsigned long written;
+    unsigned long flushes;
+    unsigned long hits;
+    unsigned long misses;
+    int *values[MIXER_CTL_COUNT];   /* cached values of the controls */
+};
+
+struct mixer_route_snapshot *mixer_route_snapshot(const struct mixer_route *mr)
+{
+    struct mixer_route_snapshot *snapshot;
+    size_t num_values = 0;
+    int *values;
+    unsigned int i;
+
+    for (i = 0; i < MIXER_CTL_COUNT; i++)
+        num_values += mr->ctls[i].num_values;
+
+    /* a single allocation, released with free() */
+    snapshot = malloc(sizeof(struct mixer_route_snapshot) +
+                      num_values * sizeof(int));
+    if (snapshot == NULL)
+        return NULL;
+
+    snapshot->mr = mr;
+    snapshot->requested = mr->requested;
+    snapshot->written = mr->written;
+    snapshot->flushes = mr->flushes;
+    snapshot->hits = mr->hits;
+    snapshot->misses = mr->misses;
+
+    values = (int *)(snapshot + 1);
+    for (i = 0; i < MIXER_CTL_COUNT; i++) {
+        const struct mixer_route_ctl *rctl = &mr->ctls[i];
+
+        snapshot->values[i] = values;
+        memcpy(values, rctl->old_values, rctl->num_values * sizeof(int));
+        values += rctl->num_values;
+    }
+
+    return snapshot;
+}
+
+/*
+ * Print the statistics and the cached value of every control. The mixer is
+ * read back as well, so that a control changed behind the back of the HAL
+ * shows up. Only the controls, types and sizes of mr are used, which do not
+ * change after mixer_route_init().
+ */
+void mixer_route_dump(const struct mixer_route_snapshot *snapshot, int fd)
+{
+    const struct mixer_route *mr = snapshot->mr;
+    unsigned long saved = 0;
+    unsigned int i;
+
+    if (snapshot->requested > snapshot->written)
+        saved = snapshot->requested - snapshot->written;
+
+    dprintf(fd, "  Mixer: %lu flushes, %lu control values requested, "
+            "%lu writes issued, %lu writes saved\n",
+            snapshot->flushes, snapshot->requested, snapshot->written, saved);
+    dprintf(fd, "  Mixer cache: %lu hits, %lu misses\n",
+            snapshot->hits, snapshot->misses);
+
+    for (i = 0; i < MIXER_CTL_COUNT; i++) {
+        const struct mixer_route_ctl *rctl = &mr->ctls[i];
+
+        if (rctl->ctl == NULL) {
+            dprintf(fd, "    %s: missing\n", mixer_ctl_names[i]);
+        } else {
+            int values[rctl->num_values];
+
+            read_ctl_values(rctl, values);
+
+            dprintf(fd, "    %s:", mixer_ctl_names[i]);
+            dump_values(rctl, snapshot->values[i], fd);
+            if (memcmp(values, snapshot->values[i],
+                       rctl->num_values * sizeof(int)) != 0) {
+                dprintf(fd, " (mixer:");
+                dump_values(rctl, values, fd);
+                dprintf(fd, ")");
+            }
+            dprintf(fd, "\n");
+        }
+    }
+}
+
+struct mixer_route *mixer_route_init(unsigned int card)
+{
+    struct mixer_route *mr;
+    size_t pool_size = 0;
+    int *values;
+    unsigned int i;
+
+    mr = calloc(1, sizeof(struct mixer_route));
+    if (mr == NULL)
+        return NULL;
+
+    mr->mixer = mixer_open(card);
+    if (mr->mixer == NULL) {
+        ALOGE("%s: unable to open mixer for card %u", __func__, card);
+        goto err_mixer_open;
+    }
+
+    /* look up every control once */
+    for (i = 0; i < MIXER_CTL_COUNT; i++) {
+        struct mixer_route_ctl *rctl = &mr->ctls[i];
+
+        rctl->ctl = mixer_get_ctl_by_name(mr->mixer, mixer_ctl_names[i]);
+        if (rctl->ctl == NULL) {
+            ALOGW("%s: control '%s' does not exist", __func__,
+                  mixer_ctl_names[i]);
+            continue;
+        }
+        rctl->type = mixer_ctl_get_type(rctl->ctl);
+        rctl->num_values = mixer_ctl_get_num_values(rctl->ctl);
+        pool_size += 3 * rctl->num_values;
+    }
+
+    for (i = 0; i < MIXER_SETTING_COUNT; i++)
+        pool_size += mr->ctls[mixer_settings[i].ctl].num_values;
+
+    mr->value_pool = calloc(pool_size, sizeof(int));
+    if (mr->value_pool == NULL)
+        goto err_pool;
+    values = mr->value_pool;
+
+    for (i = 0; i < MIXER_CTL_COUNT; i++) {
+        struct mixer_route_ctl *rctl = &mr->ctls[i];
+
+        if (rctl->ctl == NULL)
+            continue;
+
+        rctl->reset_values = values;
+        rctl->old_values = values + rctl->num_values;
+        rctl->new_values = values + 2 * rctl->num_values;
+        values += 3 * rctl->num_values;
+
+        read_ctl_values(rctl, rctl->old_values);
+        memcpy(rctl->new_values, rctl->old_values,
+               rctl->num_values * sizeof(int));
+    }
+
+    /* resolve the enum strings and numbers of all settings */
+    for (i = 0; i < MIXER_SETTING_COUNT; i++) {
+        const struct mixer_route_ctl *rctl = &mr->ctls[mixer_settings[i].ctl];
+
+        if (rctl->ctl == NULL)
+            continue;
+
+        mr->settings[i].num_values = resolve_setting(rctl, &mixer_settings[i],
+                                                     values);
+        if (mr->settings[i].num_values > 0)
+            mr->settings[i].values = values;
+        values += rctl->num_values;
+    }
+
+    /* apply the top level settings and use them as reset values */
+    apply_settings(mr, 0, MIXER_RESET_SETTINGS);
+    mixer_route_flush(mr);
+
+    for (i = 0; i < MIXER_CTL_COUNT; i++) {
+        struct mixer_route_ctl *rctl = &mr->ctls[i];
+
+        if (rctl->ctl != NULL)
+            memcpy(rctl->reset_values, rctl->old_values,
+                   rctl->num_values * sizeof(int));
+    }
+
+    return mr;
+
+err_pool:
+    mixer_close(mr->mixer);
+err_mixer_open:
+    free(mr);
+    return NULL;
+}
+
+void mixer_route_free(struct mixer_route *mr)
+{
+    if (mr == NULL)
+        return;
+
+    mixer_close(mr->mixer);
+    free(mr->value_pool);
+    free(mr);
+}
+
+/* for the controls which are not part of a path, like stream volumes */
+struct mixer *mixer_route_get_mixer(struct mixer_route *mr)
+{
+    return mr->mixer;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXER_ROUTE_H
+#define MIXER_ROUTE_H
+
+/*
+ * Mixer paths compiled from mixer_paths.xml at build time.
+ *
+ * Paths are identified by their index in the generated table. Applying or
+ * resetting a path only changes the cached control values, the mixer is
+ * written by mixer_route_update_mixer().
+ *
+ * Between mixer_route_begin_batch() and mixer_route_end_batch(),
+ * mixer_route_update_mixer() is deferred: all the route changes of the
+ * batch are written once, when the outermost batch ends, so a control
+ * changed several times is only written with its final value.
+ * mixer_route_flush() writes the pending changes immediately, e.g. before
+ * opening a PCM which needs the new route.
+ */
+
+#define MIXER_PATH_INVALID (-1)
+
+struct mixer_route;
+struct mixer_route_snapshot;
+
+/* Function prototypes */
+struct mixer_route *mixer_route_init(unsigned int card);
+
+void mixer_route_free(struct mixer_route *mr);
+
+struct mixer *mixer_route_get_mixer(struct mixer_route *mr);
+
+/* returns MIXER_PATH_INVALID if name is NULL or the path does not exist */
+int mixer_route_get_path(const char *name);
+
+const char *mixer_route_get_path_name(int path);
+
+void mixer_route_apply_path(struct mixer_route *mr, int path);
+
+void mixer_route_reset_path(struct mixer_route *mr, int path);
+
+void mixer_route_update_mixer(struct mixer_route *mr);
+
+void mixer_route_flush(struct mixer_route *mr);
+
+void mixer_route_begin_batch(struct mixer_route *mr);
+
+void mixer_route_end_batch(struct mixer_route *mr);
+
+/*
+ * The dump reads every control back from the mixer, which is slow: the
+ * state of the cache is copied by mixer_route_snapshot() with the lock of
+ * the caller held, then compared with the mixer by mixer_route_dump()
+ * without it. The snapshot is released with free().
+ */
+struct mixer_route_snapshot *mixer_route_snapshot(const struct mixer_route *mr);
+
+void mixer_route_dump(const struct mixer_route_snapshot *snapshot, int fd);
+
+#endif
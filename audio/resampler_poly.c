@@ -0,0 +1,453 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "audio_hw_primary"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include "dsp.h"
+#include "resampler_poly.h"
+
+/* input frames read from the provider at a time */
+#define POLY_CHUNK_FRAMES 256
+
+#define POLY_MAX_CHANNELS 2
+#define POLY_MAX_TABLES 32
+
+struct poly_quality {
+    unsigned int zero_crossings; /* half filter length, at the lower rate */
+    double attenuation;          /* designed stopband attenuation in dB */
+};
+
+static const struct poly_quality poly_qualities[] = {
+    [POLY_RESAMPLER_LOW] = { 8, 60.0 },
+    [POLY_RESAMPLER_MEDIUM] = { 16, 80.0 },
+    [POLY_RESAMPLER_HIGH] = { 32, 96.0 },
+};
+
+/*
+ * Filter of a rate pair: the output is computed at in_rate * up / down.
+ * Phase p holds the taps of the prototype filter starting at p, spaced by
+ * up, in reverse order so that they line up with the input frames.
+ */
+struct poly_table {
+    uint32_t in_rate;
+    uint32_t out_rate;
+    enum poly_resampler_quality quality;
+    unsigned int up;
+    unsigned int down;
+    unsigned int taps;    /* per phase, multiple of 8 */
+    unsigned int shift;   /* fractional bits of the coefficients */
+    int16_t *coefs;       /* up * taps */
+};
+
+static pthread_mutex_t poly_tables_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct poly_table *poly_tables[POLY_MAX_TABLES];
+
+struct poly_resampler {
+    struct resampler_itfe itfe;
+    struct resampler_buffer_provider *provider;
+    const struct poly_table *table;
+    uint32_t channels;
+    int16_t *history[POLY_MAX_CHANNELS]; /* input frames, one array per channel */
+    size_t size;        /* capacity of the history, in frames */
+    size_t frames;      /* frames in the history */
+    size_t pos;         /* newest input frame of the next output frame */
+    unsigned int phase; /* phase of the next output frame */
+};
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+    while (b != 0) {
+        unsigned int t = a % b;
+
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/* modified Bessel function of the first kind, order 0 */
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    unsigned int k;
+
+    for (k = 1; term > sum * 1e-12; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+/*
+ * Kaiser windowed sinc, with the transition band ending at the Nyquist
+ * frequency of the lower rate so that nothing aliases above the
+ * stopband attenuation.
+ */
+static struct poly_table *create_table(uint32_t in_rate, uint32_t out_rate,
+                                       enum poly_resampler_quality quality)
+{
+    const struct poly_quality *q = &poly_qualities[quality];
+    struct poly_table *t;
+    double low_rate = in_rate < out_rate ? in_rate : out_rate;
+    double transition = (q->attenuation - 7.95) /
+                        (14.36 * 2 * q->zero_crossings);
+    double beta = 0.1102 * (q->attenuation - 8.7);
+    double cutoff, center, max_sum = 0.0, max_coef = 0.0;
+    double *proto;
+    unsigned int length, p, j;
+
+    t = calloc(1, sizeof(struct poly_table));
+    if (t == NULL)
+        return NULL;
+
+    t->in_rate = in_rate;
+    t->out_rate = out_rate;
+    t->quality = quality;
+    t->up = out_rate / gcd(in_rate, out_rate);
+    t->down = in_rate / gcd(in_rate, out_rate);
+    t->taps = (unsigned int)ceil(2 * q->zero_crossings * in_rate / low_rate);
+    t->taps = (t->taps + 7) & ~7;
+
+    length = t->taps * t->up;
+    center = (length - 1) / 2.0;
+    /* cutoff in cycles per sample of the prototype */
+    cutoff = (0.5 - transition / 2) * low_rate / ((double)in_rate * t->up);
+
+    proto = malloc(length * sizeof(double));
+    t->coefs = malloc(length * sizeof(int16_t));
+    if (proto == NULL || t->coefs == NULL)
+        goto err_alloc;
+
+    for (j = 0; j < length; j++) {
+        double x = j - center;
+        double r = 2.0 * x / (length - 1);
+        double sinc = 1.0;
+
+        if (x != 0.0)
+            sinc = sin(2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x);
+        proto[j] = t->up * 2 * cutoff * sinc *
+                   bessel_i0(beta * sqrt(fmax(0.0, 1.0 - r * r))) /
+                   bessel_i0(beta);
+    }
+
+    /* use as many fractional bits as the 32 bit accumulator allows */
+    for (p = 0; p < t->up; p++) {
+        double sum = 0.0;
+
+        for (j = 0; j < t->taps; j++) {
+            sum += fabs(proto[p + j * t->up]);
+            max_coef = fmax(max_coef, fabs(proto[p + j * t->up]));
+        }
+        max_sum = fmax(max_sum, sum);
+    }
+    t->shift = 15;
+    while (t->shift > 1 &&
+           (max_sum * (1 << t->shift) * 32768.0 >= 2147483647.0 ||
+            max_coef * (1 << t->shift) >= 32767.0))
+        t->shift--;
+
+    for (p = 0; p < t->up; p++) {
+        for (j = 0; j < t->taps; j++)
+            t->coefs[p * t->taps + j] =
+                (int16_t)lrint(proto[p + (t->taps - 1 - j) * t->up] *
+                               (1 << t->shift));
+    }
+
+    free(proto);
+
+    ALOGV("%s: %u -> %u Hz, %u phases of %u taps, Q%u", __func__,
+          in_rate, out_rate, t->up, t->taps, t->shift);
+
+    return t;
+
+err_alloc:
+    free(proto);
+    free(t->coefs);
+    free(t);
+    return NULL;
+}
+
+/* tables are never freed, there is one per rate pair and quality used */
+static const struct poly_table *get_table(uint32_t in_rate, uint32_t out_rate,
+                                          enum poly_resampler_quality quality)
+{
+    struct poly_table *t = NULL;
+    unsigned int i;
+
+    pthread_mutex_lock(&poly_tables_lock);
+
+    for (i = 0; i < POLY_MAX_TABLES && poly_tables[i] != NULL; i++) {
+        if (poly_tables[i]->in_rate == in_rate &&
+            poly_tables[i]->out_rate == out_rate &&
+            poly_tables[i]->quality == quality) {
+            t = poly_tables[i];
+            break;
+        }
+    }
+
+    if (t == NULL && i < POLY_MAX_TABLES) {
+        t = create_table(in_rate, out_rate, quality);
+        poly_tables[i] = t;
+    }
+
+    pthread_mutex_unlock(&poly_tables_lock);
+
+    return t;
+}
+
+static inline int16_t poly_output(const struct poly_table *t,
+                                  const int16_t *coefs, const int16_t *x)
+{
+    int64_t acc = dsp_dot_s16(coefs, x, t->taps);
+
+    acc = (acc + (1 << (t->shift - 1))) >> t->shift;
+    if (acc > INT16_MAX)
+        return INT16_MAX;
+    if (acc < INT16_MIN)
+        return INT16_MIN;
+    return (int16_t)acc;
+}
+
+/* Computes output frames until the history runs out of input frames */
+static size_t poly_run(struct poly_resampler *r, int16_t *out, size_t count)
+{
+    const struct poly_table *t = r->table;
+    size_t n = 0;
+    uint32_t c;
+
+    if (t->up == 1) {
+        /* integer ratio: a single phase */
+        for (; n < count && r->pos < r->frames; n++) {
+            for (c = 0; c < r->channels; c++)
+                out[n * r->channels + c] =
+                    poly_output(t, t->coefs,
+                                r->history[c] + r->pos + 1 - t->taps);
+            r->pos += t->down;
+        }
+    } else {
+        for (; n < count && r->pos < r->frames; n++) {
+            const int16_t *coefs = t->coefs + r->phase * t->taps;
+
+            for (c = 0; c < r->channels; c++)
+                out[n * r->channels + c] =
+                    poly_output(t, coefs,
+                                r->history[c] + r->pos + 1 - t->taps);
+            r->phase += t->down;
+            r->pos += r->phase / t->up;
+            r->phase %= t->up;
+        }
+    }
+
+    return n;
+}
+
+/* Drops the input frames which are not needed anymore */
+static void poly_compact(struct poly_resampler *r)
+{
+    size_t drop = r->pos + 1 - r->table->taps;
+    uint32_t c;
+
+    if (drop == 0)
+        return;
+
+    for (c = 0; c < r->channels; c++)
+        memmove(r->history[c], r->history[c] + drop,
+                (r->frames - drop) * sizeof(int16_t));
+    r->frames -= drop;
+    r->pos -= drop;
+}
+
+/* Appends interleaved input frames to the history, returns the frames used */
+static size_t poly_append(struct poly_resampler *r, const int16_t *in,
+                          size_t count)
+{
+    size_t i;
+    uint32_t c;
+
+    if (count > r->size - r->frames)
+        count = r->size - r->frames;
+
+    for (c = 0; c < r->channels; c++) {
+        int16_t *dst = r->history[c] + r->frames;
+
+        for (i = 0; i < count; i++)
+            dst[i] = in[i * r->channels + c];
+    }
+    r->frames += count;
+
+    return count;
+}
+
+static void poly_reset(struct resampler_itfe *resampler)
+{
+    struct poly_resampler *r = (struct poly_resampler *)resampler;
+    uint32_t c;
+
+    /* start with silence in the filter */
+    r->frames = r->table->taps - 1;
+    r->pos = r->frames;
+    r->phase = 0;
+    for (c = 0; c < r->channels; c++)
+        memset(r->history[c], 0, r->frames * sizeof(int16_t));
+}
+
+static int poly_resample_from_provider(struct resampler_itfe *resampler,
+                                       int16_t *out, size_t *out_count)
+{
+    struct poly_resampler *r = (struct poly_resampler *)resampler;
+    size_t n = 0;
+
+    if (out == NULL || out_count == NULL)
+        return -EINVAL;
+
+    while (n < *out_count) {
+        struct resampler_buffer buf;
+
+        n += poly_run(r, out + n * r->channels, *out_count - n);
+        if (n == *out_count)
+            break;
+
+        poly_compact(r);
+        buf.frame_count = r->size - r->frames;
+        r->provider->get_next_buffer(r->provider, &buf);
+        if (buf.raw == NULL)
+            break;
+        buf.frame_count = poly_append(r, buf.i16, buf.frame_count);
+        r->provider->release_buffer(r->provider, &buf);
+    }
+
+    *out_count = n;
+    return 0;
+}
+
+static int poly_resample_from_input(struct resampler_itfe *resampler,
+                                    int16_t *in, size_t *in_count,
+                                    int16_t *out, size_t *out_count)
+{
+    struct poly_resampler *r = (struct poly_resampler *)resampler;
+    size_t used = 0;
+    size_t n = 0;
+
+    if (in == NULL || in_count == NULL || out == NULL || out_count == NULL)
+        return -EINVAL;
+
+    while (n < *out_count) {
+        n += poly_run(r, out + n * r->channels, *out_count - n);
+        if (n == *out_count || used == *in_count)
+            break;
+
+        poly_compact(r);
+        used += poly_append(r, in + used * r->channels, *in_count - used);
+    }
+
+    *in_count = used;
+    *out_count = n;
+    return 0;
+}
+
+/* delay of the next output frame behind the last input frame read */
+static int32_t poly_delay_ns(struct resampler_itfe *resampler)
+{
+    struct poly_resampler *r = (struct poly_resampler *)resampler;
+    const struct poly_table *t = r->table;
+    double center = (t->taps * t->up - 1) / 2.0;
+    double delay = (double)r->frames - 1 - r->pos +
+                   (center - r->phase) / t->up;
+
+    return (int32_t)(delay * 1000000000.0 / t->in_rate);
+}
+
+int create_poly_resampler(uint32_t in_rate,
+                          uint32_t out_rate,
+                          uint32_t channels,
+                          enum poly_resampler_quality quality,
+                          struct resampler_buffer_provider *provider,
+                          struct resampler_itfe **resampler)
+{
+    struct poly_resampler *r;
+    uint32_t c;
+
+    if (resampler == NULL)
+        return -EINVAL;
+    *resampler = NULL;
+
+    if (in_rate == 0 || out_rate == 0 || channels == 0 ||
+        channels > POLY_MAX_CHANNELS || quality > POLY_RESAMPLER_HIGH)
+        return -EINVAL;
+
+    r = calloc(1, sizeof(struct poly_resampler));
+    if (r == NULL)
+        return -ENOMEM;
+
+    r->table = get_table(in_rate, out_rate, quality);
+    if (r->table == NULL) {
+        ALOGE("%s: cannot create filter for %u -> %u Hz",
+              __func__, in_rate, out_rate);
+        goto err_table;
+    }
+
+    r->itfe.reset = poly_reset;
+    r->itfe.resample_from_provider = poly_resample_from_provider;
+    r->itfe.resample_from_input = poly_resample_from_input;
+    r->itfe.delay_ns = poly_delay_ns;
+    r->provider = provider;
+    r->channels = channels;
+    r->size = r->table->taps + POLY_CHUNK_FRAMES;
+
+    for (c = 0; c < channels; c++) {
+        r->history[c] = malloc(r->size * sizeof(int16_t));
+        if (r->history[c] == NULL)
+            goto err_history;
+    }
+
+    poly_reset(&r->itfe);
+
+    *resampler = &r->itfe;
+    return 0;
+
+err_history:
+    for (c = 0; c < channels; c++)
+        free(r->history[c]);
+err_table:
+    free(r);
+    return -ENOMEM;
+}
+
+void release_poly_resampler(struct resampler_itfe *resampler)
+{
+    struct poly_resampler *r = (struct poly_resampler *)resampler;
+    uint32_t c;
+
+    if (r == NULL)
+        return;
+
+    for (c = 0; c < r->channels; c++)
+        free(r->history[c]);
+    free(r);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RESAMPLER_POLY_H
+#define RESAMPLER_POLY_H
+
+#include <stdint.h>
+
+#include <audio_utils/resampler.h>
+
+/*
+ * Polyphase FIR resampler for 16 bit mono and stereo streams, behind the
+ * struct resampler_itfe interface of audio_utils so it can be used in
+ * place of the speex resampler.
+ *
+ * The filter of each rate pair and quality is computed once and shared by
+ * all resamplers. Integer decimation ratios (48 kHz to 24, 16, 12 or
+ * 8 kHz) use a single phase and skip the phase bookkeeping.
+ *
+ * The coefficients are rounded to 16 bits, which limits the attenuation
+ * to about 80 dB whatever the design of the filter. The long filters of
+ * the high quality also lose a bit so that the sum fits in 32 bits: they
+ * have the narrowest transition band, but attenuate only about 65 dB.
+ */
+
+enum poly_resampler_quality {
+    POLY_RESAMPLER_LOW,     /* 16 taps at the lower rate, about 60 dB */
+    POLY_RESAMPLER_MEDIUM,  /* 32 taps at the lower rate, about 76-80 dB */
+    POLY_RESAMPLER_HIGH,    /* 64 taps at the lower rate, about 65 dB */
+};
+
+/* Function prototypes */
+int create_poly_resampler(uint32_t in_rate,
+                          uint32_t out_rate,
+                          uint32_t channels,
+                          enum poly_resampler_quality quality,
+                          struct resampler_buffer_provider *provider,
+                          struct resampler_itfe **resampler);
+
+void release_poly_resampler(struct resampler_itfe *resampler);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmarks of the dsp.c kernels: time per frame of the vector
+ * version built for the host next to the C version (dsp_ref.h), over the
+ * period sizes of the HAL. The format conversions and the 24 bit gain run
+ * on stereo frames, as on the primary and deep buffer outputs.
+ *
+ * usage: bench_dsp [kernel]
+ */
+
+#include <time.h>
+
+#include "dsp_ref.h"
+#include "test.h"
+
+#define MAX_FRAMES 960
+#define MAX_CHANNELS 8
+/* samples processed per measurement */
+#define BENCH_SAMPLES 20000000
+
+static const size_t bench_frames[] = { 240, 320, 960 };
+
+static int16_t src_s16[MAX_FRAMES * MAX_CHANNELS];
+static int16_t dst_s16[MAX_FRAMES * MAX_CHANNELS];
+static int32_t src_s32[MAX_FRAMES * MAX_CHANNELS];
+static int32_t dst_s32[MAX_FRAMES * MAX_CHANNELS];
+static float src_f32[MAX_FRAMES * MAX_CHANNELS];
+
+struct kernel {
+    const char *name;
+    unsigned int channels;  /* of the frames processed */
+    void (*run)(bool ref, size_t frames);
+};
+
+static void run_ramp_mono(bool ref, size_t frames)
+{
+    (ref ? ref_dsp_ramp_s16 : dsp_ramp_s16)(dst_s16, frames, 1, 0, 13);
+}
+
+static void run_ramp_stereo(bool ref, size_t frames)
+{
+    (ref ? ref_dsp_ramp_s16 : dsp_ramp_s16)(dst_s16, frames, 2, 0, 13);
+}
+
+/* in place, as get_next_buffer() converts its buffer */
+static void run_mono_left(bool ref, size_t frames)
+{
+    (ref ? ref_dsp_stereo_to_mono_s16 : dsp_stereo_to_mono_s16)(
+            dst_s16, dst_s16, frames, DSP_MONO_LEFT);
+}
+
+static void run_mono_right(bool ref, size_t frames)
+{
+    (ref ? ref_dsp_stereo_to_mono_s16 : dsp_stereo_to_mono_s16)(
+            dst_s16, dst_s16, frames, DSP_MONO_RIGHT);
+}
+
+static void run_mono_average(bool ref, size_t frames)
+{
+    (ref ? ref_dsp_stereo_to_mono_s16 : dsp_stereo_to_mono_s16)(
+            dst_s16, dst_s16, frames, DSP_MONO_AVERAGE);
+}
+
+/* the format conversions of out_convert(), on stereo frames */
+static void convert(bool ref, enum dsp_format dst_format, const void *src,
+                    enum dsp_format src_format, size_t frames)
+{
+    (ref ? ref_dsp_convert : dsp_convert)(dst_s32, dst_format, src,
+                                          src_format, frames * 2);
+}
+
+static void run_copy_s16(bool ref, size_t frames)
+{
+    convert(ref, DSP_FORMAT_S16, src_s16, DSP_FORMAT_S16, frames);
+}
+
+static void run_float_s16(bool ref, size_t frames)
+{
+    convert(ref, DSP_FORMAT_S16, src_f32, DSP_FORMAT_FLOAT, frames);
+}
+
+static void run_float_s24(bool ref, size_t frames)
+{
+    convert(ref, DSP_FORMAT_S24_LE, src_f32, DSP_FORMAT_FLOAT, frames);
+}
+
+static void run_s24_3le_s16(bool ref, size_t frames)
+{
+    convert(ref, DSP_FORMAT_S16, src_s32, DSP_FORMAT_S24_3LE, frames);
+}
+
+static void run_s24_3le_s24(bool ref, size_t frames)
+{
+    convert(ref, DSP_FORMAT_S24_LE, src_s32, DSP_FORMAT_S24_3LE, frames);
+}
+
+static void run_s8_24_s16(bool ref, size_t frames)
+{
+    convert(ref, DSP_FORMAT_S16, src_s32, DSP_FORMAT_S24_LE, frames);
+}
+
+static void run_s8_24_s24(bool ref, size_t frames)
+{
+    convert(ref, DSP_FORMAT_S24_LE, src_s32, DSP_FORMAT_S24_LE, frames);
+}
+
+/* the software volume of a 24 bit stereo output, during a ramp */
+static void run_gain_s24(bool ref, size_t frames)
+{
+    (ref ? ref_dsp_gain_s24 : dsp_gain_s24)(dst_s32, src_s32, frames, 2,
+                                            0x8000, 13);
+}
+
+static const struct kernel kernels[] = {
+    { "ramp mono", 1, run_ramp_mono },
+    { "ramp stereo", 2, run_ramp_stereo },
+    { "stereo to mono left", 2, run_mono_left },
+    { "stereo to mono right", 2, run_mono_right },
+    { "stereo to mono average", 2, run_mono_average },
+    { "16 bit copy", 2, run_copy_s16 },
+    { "float to 16 bit", 2, run_float_s16 },
+    { "float to 24 bit", 2, run_float_s24 },
+    { "packed 24 to 16 bit", 2, run_s24_3le_s16 },
+    { "packed 24 to 24 bit", 2, run_s24_3le_s24 },
+    { "8_24 to 16 bit", 2, run_s8_24_s16 },
+    { "8_24 to 24 bit", 2, run_s8_24_s24 },
+    { "gain 24 bit stereo", 2, run_gain_s24 },
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double time_kernel(const struct kernel *k, bool ref, size_t frames)
+{
+    size_t runs = BENCH_SAMPLES / (frames * k->channels);
+    double start, best = 0;
+    size_t i;
+    int pass;
+
+    /* the best of 3 passes, the others are disturbed by something else */
+    for (pass = 0; pass < 3; pass++) {
+        double elapsed;
+
+        start = now_ns();
+        for (i = 0; i < runs; i++)
+            k->run(ref, frames);
+        elapsed = (now_ns() - start) / (runs * frames);
+        if (pass == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int i, f;
+
+    test_fill_s16(src_s16, MAX_FRAMES * MAX_CHANNELS);
+    test_fill_s16(dst_s16, MAX_FRAMES * MAX_CHANNELS);
+    /* 24 bit samples, and floats a little beyond full scale */
+    for (i = 0; i < MAX_FRAMES * MAX_CHANNELS; i++) {
+        src_s32[i] = (int32_t)test_rand() >> 8;
+        src_f32[i] = (int32_t)test_rand() / 1900000000.0f;
+    }
+
+    printf("%-24s %6s %12s %12s %8s\n", "kernel", "frames", "vector ns/f",
+           "C ns/f", "speedup");
+    for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (argc > 1 && strstr(kernels[i].name, argv[1]) == NULL)
+            continue;
+        for (f = 0; f < sizeof(bench_frames) / sizeof(bench_frames[0]); f++) {
+            double vector_ns = time_kernel(&kernels[i], false, bench_frames[f]);
+            double c_ns = time_kernel(&kernels[i], true, bench_frames[f]);
+
+            printf("%-24s %6zu %12.3f %12.3f %7.1fx\n", kernels[i].name,
+                   bench_frames[f], vector_ns, c_ns, c_ns / vector_ns);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
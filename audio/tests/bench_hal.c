@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmarks of the HAL entry points which run in the audio threads or
+ * block them: out_write() of the primary and deep buffer outputs, in_read()
+ * with and without resampling, the routing changes (select_devices()) and
+ * adev_set_mode(), and the wakeups of the deep buffer output for the
+ * periods the audio_hal.deep_buffer_* properties allow.
+ *
+ * Each call is timed twice: the CPU time of the calling thread, which is
+ * the cost of the HAL code, and the elapsed time on the HAL clock, which
+ * includes blocking on the PCMs, the mixer and the modem. The HAL clock is
+ * simulated unless -r is given, the mock sound card then plays the audio
+ * much faster than real time. The latency histograms the HAL records with
+ * AUDIO_HW_PROFILE are printed at the end, as adev_dump() prints them.
+ *
+ * usage: bench_hal [-r] [-n calls] [-m mixer_us] [-s modem_us]
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+
+#include "test.h"
+
+#define HIST_BUCKETS 24
+
+struct bench_stats {
+    const char *name;
+    unsigned int count;
+    double *cpu_us;
+    double *elapsed_us;
+};
+
+static unsigned int num_calls = 2000;
+
+static double thread_cpu_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double hal_clock_us(void)
+{
+    return fake_clock_now_ns() / 1e3;
+}
+
+static void stats_init(struct bench_stats *stats, const char *name)
+{
+    stats->name = name;
+    stats->count = 0;
+    stats->cpu_us = calloc(num_calls, sizeof(double));
+    stats->elapsed_us = calloc(num_calls, sizeof(double));
+}
+
+static void stats_add(struct bench_stats *stats, double cpu_us,
+                      double elapsed_us)
+{
+    if (stats->count == num_calls)
+        return;
+    stats->cpu_us[stats->count] = cpu_us;
+    stats->elapsed_us[stats->count] = elapsed_us;
+    stats->count++;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double da = *(const double *)a, db = *(const double *)b;
+
+    return da < db ? -1 : da > db;
+}
+
+static double percentile(const double *sorted, unsigned int count, double p)
+{
+    return sorted[(unsigned int)(p * (count - 1) + 0.5)];
+}
+
+static void print_series(const char *label, double *us, unsigned int count)
+{
+    unsigned int hist[HIST_BUCKETS] = { 0 };
+    double total = 0;
+    unsigned int i;
+
+    qsort(us, count, sizeof(double), compare_double);
+    for (i = 0; i < count; i++) {
+        int bucket = 0;
+
+        /* bucket n: calls < 2^n us, as the HAL histograms */
+        while (bucket < HIST_BUCKETS - 1 && ldexp(1, bucket) <= us[i])
+            bucket++;
+        hist[bucket]++;
+        total += us[i];
+    }
+
+    printf("    %s: avg %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           label, total / count, percentile(us, count, 0.5),
+           percentile(us, count, 0.99), us[count - 1]);
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        if (hist[i])
+            printf("      [%2u] %u\n", i, hist[i]);
+    }
+}
+
+static void stats_print(struct bench_stats *stats)
+{
+    printf("  %s: %u calls\n", stats->name, stats->count);
+    if (stats->count) {
+        print_series("cpu", stats->cpu_us, stats->count);
+        print_series("elapsed", stats->elapsed_us, stats->count);
+    }
+    free(stats->cpu_us);
+    free(stats->elapsed_us);
+}
+
+#define TIME_CALL(stats, call)                                          \
+    do {                                                                \
+        double _cpu = thread_cpu_us(), _elapsed = hal_clock_us();       \
+        call;                                                           \
+        stats_add(stats, thread_cpu_us() - _cpu,                        \
+                  hal_clock_us() - _elapsed);                           \
+    } while (0)
+
+static void bench_out_write(struct audio_hw_device *dev, const char *name,
+                            audio_output_flags_t flags)
+{
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    struct bench_stats stats;
+    unsigned int i;
+    void *buf;
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER, flags, &config);
+    if (!out) {
+        printf("  %s: cannot open the output\n", name);
+        return;
+    }
+    buf = hal_alloc_buffer(&out->common);
+
+    stats_init(&stats, name);
+    for (i = 0; i < num_calls; i++)
+        TIME_CALL(&stats, hal_write_buffer(out, buf));
+    stats_print(&stats);
+
+    free(buf);
+    dev->close_output_stream(dev, out);
+}
+
+static void bench_in_read(struct audio_hw_device *dev, const char *name,
+                          uint32_t rate)
+{
+    struct audio_config config = { .sample_rate = rate,
+                                   .channel_mask = AUDIO_CHANNEL_IN_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_in *in;
+    struct bench_stats stats;
+    unsigned int i;
+    size_t bytes;
+    void *buf;
+
+    in = hal_open_input(dev, AUDIO_DEVICE_IN_BUILTIN_MIC, AUDIO_INPUT_FLAG_NONE,
+                        &config);
+    if (!in) {
+        printf("  %s: cannot open the input\n", name);
+        return;
+    }
+    bytes = in->common.get_buffer_size(&in->common);
+    buf = malloc(bytes);
+
+    stats_init(&stats, name);
+    for (i = 0; i < num_calls; i++)
+        TIME_CALL(&stats, in->read(in, buf, bytes));
+    stats_print(&stats);
+
+    free(buf);
+    dev->close_input_stream(dev, in);
+}
+
+/* select_devices() runs on each routing change of an active output */
+static void bench_routing(struct audio_hw_device *dev)
+{
+    static const char * const routes[] = { "routing=2", "routing=4",
+                                           "routing=8", "routing=1" };
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    struct bench_stats stats;
+    unsigned int i;
+    void *buf;
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                          AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    if (!out)
+        return;
+    buf = hal_alloc_buffer(&out->common);
+    hal_write_buffer(out, buf);
+
+    stats_init(&stats, "select_devices (routing)");
+    for (i = 0; i < num_calls; i++)
+        TIME_CALL(&stats, out->common.set_parameters(&out->common,
+                                                     routes[i % 4]));
+    stats_print(&stats);
+
+    free(buf);
+    dev->close_output_stream(dev, out);
+}
+
+/* call setup and teardown, with the modem requests */
+static void bench_set_mode(struct audio_hw_device *dev)
+{
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    struct bench_stats stats;
+    unsigned int i;
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_EARPIECE,
+                          AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    if (!out)
+        return;
+
+    stats_init(&stats, "adev_set_mode");
+    for (i = 0; i < num_calls; i++)
+        TIME_CALL(&stats, dev->set_mode(dev, (i & 1) ? AUDIO_MODE_NORMAL :
+                                                       AUDIO_MODE_IN_CALL));
+    stats_print(&stats);
+
+    dev->set_mode(dev, AUDIO_MODE_NORMAL);
+    dev->close_output_stream(dev, out);
+}
+
+/*
+ * The deep buffer output wakes the playback thread once per period: each
+ * depth opens the HAL again with the periods set in the properties, and
+ * plays one minute of audio through it.
+ */
+static void bench_deep_buffer_wakeups(void)
+{
+    static const struct {
+        const char *period_ms;
+        const char *period_count;
+    } depths[] = {
+        { "20", "5" }, { "40", "4" }, { "60", "4" }, { "100", "2" },
+    };
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    unsigned int i;
+
+    printf("deep buffer wakeups, 60 s of audio:\n");
+    printf("  %-12s %9s %9s %9s %12s\n", "period", "latency",
+           "writes/s", "waits/s", "cpu us/s");
+    for (i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        struct audio_hw_device *dev;
+        struct audio_stream_out *out;
+        struct fake_pcm_stats before, after;
+        size_t bytes;
+        unsigned int writes;
+        double cpu, seconds;
+        void *buf;
+
+        property_set("audio_hal.deep_buffer_period_ms", depths[i].period_ms);
+        property_set("audio_hal.deep_buffer_period_count",
+                     depths[i].period_count);
+        dev = hal_open();
+        if (!dev)
+            continue;
+        out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                              AUDIO_OUTPUT_FLAG_DEEP_BUFFER, &config);
+        if (!out) {
+            printf("  %s ms x %s: cannot open the output\n",
+                   depths[i].period_ms, depths[i].period_count);
+            hal_close(dev);
+            continue;
+        }
+        bytes = out->common.get_buffer_size(&out->common);
+        buf = hal_alloc_buffer(&out->common);
+        writes = 60 * 48000 / (bytes / 4);
+
+        before = fake_pcm_get_stats(0, 3, PCM_OUT);
+        cpu = thread_cpu_us();
+        for (; writes > 0; writes--)
+            hal_write_buffer(out, buf);
+        cpu = thread_cpu_us() - cpu;
+        after = fake_pcm_get_stats(0, 3, PCM_OUT);
+        seconds = (double)(after.frames - before.frames) / 48000;
+
+        printf("  %3s ms x %-4s %6u ms %9.1f %9.1f %12.1f\n",
+               depths[i].period_ms, depths[i].period_count,
+               out->get_latency(out),
+               (after.writes - before.writes) / seconds,
+               (after.waits - before.waits) / seconds, cpu / seconds);
+
+        free(buf);
+        dev->close_output_stream(dev, out);
+        hal_close(dev);
+    }
+    property_set("audio_hal.deep_buffer_period_ms", "20");
+    property_set("audio_hal.deep_buffer_period_count", "5");
+}
+
+/* the latency histograms of adev_dump(), without the mixer state */
+static void print_hal_profile(struct audio_hw_device *dev)
+{
+    FILE *file = tmpfile();
+    char line[256];
+    bool print = false;
+
+    if (!file)
+        return;
+    dev->dump(dev, fileno(file));
+    rewind(file);
+    printf("HAL profile:\n");
+    while (fgets(line, sizeof(line), file)) {
+        print |= strstr(line, "Latency histograms") != NULL;
+        if (print)
+            fputs(line, stdout);
+    }
+    fclose(file);
+}
+
+int main(int argc, char **argv)
+{
+    struct audio_hw_device *dev;
+    unsigned int mixer_us = 20, modem_us = 1000;
+    bool real = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "rn:m:s:")) != -1) {
+        switch (opt) {
+        case 'r':
+            real = true;
+            break;
+        case 'n':
+            num_calls = atoi(optarg);
+            break;
+        case 'm':
+            mixer_us = atoi(optarg);
+            break;
+        case 's':
+            modem_us = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r] [-n calls] [-m mixer_us] "
+                    "[-s modem_us]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (num_calls == 0)
+        num_calls = 1;
+
+    fake_clock_set_mode(real ? FAKE_CLOCK_REAL : FAKE_CLOCK_SIMULATED);
+    /* an I2C write of the codec, a request to the RIL daemon */
+    fake_mixer_set_access_delay_us(mixer_us);
+    fake_secril_set_delay_us(modem_us);
+
+    dev = hal_open();
+    if (!dev) {
+        fprintf(stderr, "cannot open the HAL\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%s clock, %u calls, mixer control %u us, modem request %u us\n",
+           real ? "real" : "simulated", num_calls, mixer_us, modem_us);
+    bench_out_write(dev, "out_write (primary)", AUDIO_OUTPUT_FLAG_PRIMARY);
+    bench_out_write(dev, "out_write (deep buffer)",
+                    AUDIO_OUTPUT_FLAG_DEEP_BUFFER);
+    bench_in_read(dev, "in_read (48 kHz)", 48000);
+    bench_in_read(dev, "in_read (16 kHz, resampled)", 16000);
+    bench_routing(dev);
+    bench_set_mode(dev);
+
+    print_hal_profile(dev);
+
+    hal_close(dev);
+
+    bench_deep_buffer_wakeups();
+    return EXIT_SUCCESS;
+}
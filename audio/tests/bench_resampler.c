@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The resamplers of the capture streams: time per output frame, THD+N of
+ * a 1 kHz sine at -6 dBFS and level of what a sine at -6 dBFS above the
+ * output Nyquist frequency aliases to, from 48 kHz to the capture rates,
+ * for the
+ * qualities of the polyphase resampler, its C version (dsp_ref.h), and
+ * the audio_utils resampler the HAL used before, at the quality it used.
+ * On the host, audio_utils is the speex resampler only when the tests are
+ * built with speexdsp, see fake_audio_utils.c.
+ *
+ * usage: bench_resampler [rate]
+ */
+
+#include <time.h>
+
+#include "dsp_ref.h"
+#include "test.h"
+
+#define CHANNELS 2
+#define IN_RATE 48000
+/* 1 s at 48 kHz */
+#define IN_FRAMES 48000
+#define MAX_OUT_FRAMES 48000
+/* input frames per period of the capture stream */
+#define PERIOD_FRAMES 960
+/* frames resampled per measurement */
+#define BENCH_FRAMES 2400000
+
+static const uint32_t bench_rates[] = { 8000, 11025, 16000, 22050, 24000,
+                                        32000, 44100 };
+
+static int16_t in_s16[IN_FRAMES * CHANNELS];
+static int16_t stop_s16[IN_FRAMES * CHANNELS];
+static int16_t out_s16[MAX_OUT_FRAMES * CHANNELS];
+
+struct engine {
+    const char *name;
+    int (*create)(uint32_t out_rate, struct resampler_buffer_provider *provider,
+                  struct resampler_itfe **resampler);
+    void (*release)(struct resampler_itfe *resampler);
+};
+
+static int create_low(uint32_t out_rate,
+                      struct resampler_buffer_provider *provider,
+                      struct resampler_itfe **resampler)
+{
+    return create_poly_resampler(IN_RATE, out_rate, CHANNELS,
+                                 POLY_RESAMPLER_LOW, provider, resampler);
+}
+
+static int create_medium(uint32_t out_rate,
+                         struct resampler_buffer_provider *provider,
+                         struct resampler_itfe **resampler)
+{
+    return create_poly_resampler(IN_RATE, out_rate, CHANNELS,
+                                 POLY_RESAMPLER_MEDIUM, provider, resampler);
+}
+
+static int create_high(uint32_t out_rate,
+                       struct resampler_buffer_provider *provider,
+                       struct resampler_itfe **resampler)
+{
+    return create_poly_resampler(IN_RATE, out_rate, CHANNELS,
+                                 POLY_RESAMPLER_HIGH, provider, resampler);
+}
+
+static int create_medium_c(uint32_t out_rate,
+                           struct resampler_buffer_provider *provider,
+                           struct resampler_itfe **resampler)
+{
+    return ref_create_poly_resampler(IN_RATE, out_rate, CHANNELS,
+                                     POLY_RESAMPLER_MEDIUM, provider,
+                                     resampler);
+}
+
+static int create_audio_utils(uint32_t out_rate,
+                              struct resampler_buffer_provider *provider,
+                              struct resampler_itfe **resampler)
+{
+    return create_resampler(IN_RATE, out_rate, CHANNELS,
+                            RESAMPLER_QUALITY_DEFAULT, provider, resampler);
+}
+
+static const struct engine engines[] = {
+    { "poly low", create_low, release_poly_resampler },
+    { "poly medium", create_medium, release_poly_resampler },
+    { "poly high", create_high, release_poly_resampler },
+    { "poly medium C", create_medium_c, ref_release_poly_resampler },
+#ifdef HAVE_SPEEXDSP
+    { "speex", create_audio_utils, release_resampler },
+#else
+    { "linear", create_audio_utils, release_resampler },
+#endif
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* resamples the second of input a period at a time, as in_read() does */
+static size_t resample(struct resampler_itfe *r, struct test_provider *p,
+                       uint32_t out_rate)
+{
+    size_t period = (size_t)PERIOD_FRAMES * out_rate / IN_RATE;
+    size_t frames = 0;
+
+    r->reset(r);
+    p->pos = 0;
+    for (;;) {
+        size_t count = MAX_OUT_FRAMES - frames < period ?
+                       MAX_OUT_FRAMES - frames : period;
+
+        r->resample_from_provider(r, out_s16 + frames * CHANNELS, &count);
+        if (count == 0)
+            return frames;
+        frames += count;
+    }
+}
+
+static void bench_engine(const struct engine *e, uint32_t out_rate)
+{
+    struct resampler_itfe *r;
+    struct test_provider p;
+    /* a quarter of the way from the output to the input Nyquist frequency */
+    double stop = 5 * floor((out_rate / 2 + (IN_RATE - out_rate) / 8) / 5);
+    double alias = out_rate - stop;
+    double start, best = 0, thd_n, level;
+    size_t frames = 0;
+    int pass, i;
+
+    test_provider_init(&p, in_s16, IN_FRAMES, CHANNELS, PERIOD_FRAMES);
+    if (e->create(out_rate, &p.provider, &r) != 0) {
+        printf("%-16s %6u cannot create the resampler\n", e->name, out_rate);
+        return;
+    }
+
+    /* the best of 3 passes, the others are disturbed by something else */
+    for (pass = 0; pass < 3; pass++) {
+        double elapsed;
+
+        start = now_ns();
+        for (i = 0; i < BENCH_FRAMES / IN_FRAMES; i++)
+            frames = resample(r, &p, out_rate);
+        elapsed = (now_ns() - start) / (BENCH_FRAMES / IN_FRAMES * frames);
+        if (pass == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    /* 0.4 s once the filter settled, a whole number of cycles */
+    test_sine_level(out_s16 + out_rate / 10 * CHANNELS, out_rate * 2 / 5,
+                    CHANNELS, 1000.0, out_rate, &thd_n);
+
+    test_sine_s16(stop_s16, IN_FRAMES, CHANNELS, stop, IN_RATE, 0.5);
+    p.data = stop_s16;
+    resample(r, &p, out_rate);
+    level = test_sine_level(out_s16 + out_rate / 10 * CHANNELS,
+                            out_rate * 2 / 5, CHANNELS, alias, out_rate, NULL);
+
+    printf("%-16s %6u %10.1f %10.1f %10.1f\n", e->name, out_rate, best, thd_n,
+           level > 0 ? 20 * log10(level / 0.5) : -INFINITY);
+
+    e->release(r);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int i, e;
+
+    test_sine_s16(in_s16, IN_FRAMES, CHANNELS, 1000.0, IN_RATE, 0.5);
+
+    printf("%-16s %6s %10s %10s %10s\n", "resampler", "rate", "ns/frame",
+           "THD+N dB", "alias dB");
+    for (i = 0; i < sizeof(bench_rates) / sizeof(bench_rates[0]); i++) {
+        if (argc > 1 && (uint32_t)atoi(argv[1]) != bench_rates[i])
+            continue;
+        for (e = 0; e < sizeof(engines) / sizeof(engines[0]); e++)
+            bench_engine(&engines[e], bench_rates[i]);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The C versions of the dsp.c kernels, which the vector versions must
+ * match bit for bit: dsp.c is built a second time with DSP_NO_SIMD and
+ * this header included first, which renames its functions with a ref_
+ * prefix. resampler_poly.c is built the same way, so that the polyphase
+ * resampler can be compared with its C version as a whole.
+ *
+ * dsp.c is also built with DSP_NEON_EMULATED, __ARM_NEON and the NEON
+ * intrinsics of neon/arm_neon.h, which renames its functions with a neon_
+ * prefix, so that the NEON versions are checked too.
+ */
+
+#ifndef DSP_REF_H
+#define DSP_REF_H
+
+#ifdef DSP_NO_SIMD
+
+#define dsp_ramp_s16 ref_dsp_ramp_s16
+#define dsp_gain_s16 ref_dsp_gain_s16
+#define dsp_stereo_to_mono_s16 ref_dsp_stereo_to_mono_s16
+#define dsp_dot_s16 ref_dsp_dot_s16
+#define dsp_mix_stereo_s16 ref_dsp_mix_stereo_s16
+#define dsp_matrix_s16 ref_dsp_matrix_s16
+#define dsp_convert ref_dsp_convert
+#define dsp_gain_s24 ref_dsp_gain_s24
+#define create_poly_resampler ref_create_poly_resampler
+#define release_poly_resampler ref_release_poly_resampler
+
+#elif defined(DSP_NEON_EMULATED)
+
+#define dsp_ramp_s16 neon_dsp_ramp_s16
+#define dsp_gain_s16 neon_dsp_gain_s16
+#define dsp_stereo_to_mono_s16 neon_dsp_stereo_to_mono_s16
+#define dsp_dot_s16 neon_dsp_dot_s16
+#define dsp_mix_stereo_s16 neon_dsp_mix_stereo_s16
+#define dsp_matrix_s16 neon_dsp_matrix_s16
+#define dsp_convert neon_dsp_convert
+#define dsp_gain_s24 neon_dsp_gain_s24
+
+#else
+
+#include "dsp.h"
+#include "resampler_poly.h"
+
+extern __typeof__(dsp_ramp_s16) ref_dsp_ramp_s16;
+extern __typeof__(dsp_gain_s16) ref_dsp_gain_s16;
+extern __typeof__(dsp_stereo_to_mono_s16) ref_dsp_stereo_to_mono_s16;
+extern __typeof__(dsp_dot_s16) ref_dsp_dot_s16;
+extern __typeof__(dsp_mix_stereo_s16) ref_dsp_mix_stereo_s16;
+extern __typeof__(dsp_matrix_s16) ref_dsp_matrix_s16;
+extern __typeof__(dsp_convert) ref_dsp_convert;
+extern __typeof__(dsp_gain_s24) ref_dsp_gain_s24;
+extern __typeof__(create_poly_resampler) ref_create_poly_resampler;
+extern __typeof__(release_poly_resampler) ref_release_poly_resampler;
+
+extern __typeof__(dsp_ramp_s16) neon_dsp_ramp_s16;
+extern __typeof__(dsp_gain_s16) neon_dsp_gain_s16;
+extern __typeof__(dsp_stereo_to_mono_s16) neon_dsp_stereo_to_mono_s16;
+extern __typeof__(dsp_dot_s16) neon_dsp_dot_s16;
+extern __typeof__(dsp_mix_stereo_s16) neon_dsp_mix_stereo_s16;
+extern __typeof__(dsp_matrix_s16) neon_dsp_matrix_s16;
+extern __typeof__(dsp_convert) neon_dsp_convert;
+extern __typeof__(dsp_gain_s24) neon_dsp_gain_s24;
+
+#endif
+
+#endif
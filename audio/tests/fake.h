@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Controls of the fakes the HAL is built against on the host: the sound
+ * card (fake_alsa.c), the log (fake_android.c) and the modem client
+ * (fake_secril.c). The properties are set with property_set() and the
+ * clock is controlled through fake_clock.h.
+ */
+
+#ifndef FAKE_H
+#define FAKE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cutils/log.h>
+#include <tinyalsa/asoundlib.h>
+
+#include "fake_clock.h"
+
+/*
+ * PCMs
+ *
+ * A PCM plays or captures at its rate on the fake clock. Writes and reads
+ * block until there is room or audio, like the kernel driver, and a stream
+ * which is not fed or read in time has an xrun. Card 0 has all devices,
+ * card 1 (the dock) none.
+ */
+
+#define FAKE_PCM_CARDS 2
+#define FAKE_PCM_DEVICES 8
+
+struct fake_pcm_stats {
+    unsigned int opens;
+    unsigned int open_errors;
+    unsigned int writes;      /* pcm_write() and pcm_mmap_commit() calls */
+    unsigned int reads;       /* pcm_read() calls */
+    unsigned int waits;       /* calls which blocked for the DMA */
+    unsigned int xruns;
+    uint64_t frames;          /* frames written or read */
+    const void *data;         /* buffer of the last write or read */
+    struct pcm_config config; /* of the last open */
+    unsigned int flags;
+};
+
+/* called with the audio written to a playback PCM */
+typedef void (*fake_pcm_tap_t)(unsigned int card, unsigned int device,
+                               const struct pcm_config *config,
+                               const void *data, unsigned int frames);
+
+/* fills the audio captured from the frame position of a capture PCM */
+typedef void (*fake_pcm_source_t)(unsigned int card, unsigned int device,
+                                  const struct pcm_config *config,
+                                  void *data, uint64_t position,
+                                  unsigned int frames);
+
+void fake_pcm_set_present(unsigned int card, unsigned int device, bool present);
+void fake_pcm_set_mmap(bool supported);
+void fake_pcm_set_formats(unsigned int card, unsigned int format_mask);
+void fake_pcm_set_open_delay_us(unsigned int us);
+void fake_pcm_set_tap(fake_pcm_tap_t tap);
+void fake_pcm_set_source(fake_pcm_source_t source);
+
+/* the next write or read of the PCM fails with an xrun */
+void fake_pcm_inject_xrun(unsigned int card, unsigned int device,
+                          unsigned int flags);
+
+/* the next write or read of the PCM returns error, errno is left alone */
+void fake_pcm_inject_error(unsigned int card, unsigned int device,
+                           unsigned int flags, int error);
+
+/* PCM_OUT or PCM_IN in flags selects the direction */
+struct fake_pcm_stats fake_pcm_get_stats(unsigned int card, unsigned int device,
+                                         unsigned int flags);
+unsigned int fake_pcm_open_count(void);
+/* PCMs opened and not closed yet */
+unsigned int fake_pcm_active_count(void);
+
+/* the default source: a 1 kHz sine at half scale on all channels */
+void fake_pcm_sine_source(unsigned int card, unsigned int device,
+                          const struct pcm_config *config, void *data,
+                          uint64_t position, unsigned int frames);
+
+/*
+ * Compress devices
+ *
+ * The offload output plays through compress_mock.c, on the fake clock.
+ */
+
+/* whether the compress device decodes anything */
+void fake_compress_set_present(bool present);
+
+/*
+ * Mixer
+ *
+ * The controls are those of mixer_paths.xml: enums when a path sets them
+ * to a string, byte arrays when a path sets several numbers, switches or
+ * integers otherwise. Changes apply to the next mixer_open().
+ */
+
+void fake_mixer_add_ctl(const char *name, enum mixer_ctl_type type,
+                        unsigned int num_values);
+void fake_mixer_remove_ctl(const char *name);
+
+/* time taken by each control read or write, like the codec driver */
+void fake_mixer_set_access_delay_us(unsigned int us);
+
+/* the value of a control as the HAL left it, -1 if it does not exist */
+int fake_mixer_get_value(const char *name, unsigned int id);
+void fake_mixer_set_value(const char *name, unsigned int id, int value);
+
+unsigned int fake_mixer_get_writes(void);
+unsigned int fake_mixer_get_reads(void);
+
+/*
+ * Log
+ *
+ * The messages from prio up are printed, ANDROID_LOG_WARN by default or
+ * the level of the FAKE_LOG_LEVEL environment variable (2 to 6).
+ */
+
+void fake_log_set_level(int prio);
+unsigned int fake_log_count(int prio);
+/* number of messages from prio up containing text */
+unsigned int fake_log_find(int prio, const char *text);
+
+/*
+ * Modem
+ */
+
+struct fake_secril_stats {
+    unsigned int audio_paths;  /* SetCallAudioPath() calls */
+    int audio_path;
+    unsigned int clock_syncs;
+    int clock_sync;
+    unsigned int volumes;
+    unsigned int mutes;
+    unsigned int two_mic_controls;
+};
+
+/* time taken by each request, the RIL answers through a socket */
+void fake_secril_set_delay_us(unsigned int us);
+struct fake_secril_stats fake_secril_get_stats(void);
+/* sends the wideband AMR report of the modem to the HAL */
+void fake_secril_report_wb_amr(int enable);
+
+#endif
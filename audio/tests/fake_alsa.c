@@ -0,0 +1,1060 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Mock tinyalsa: PCMs which play and capture on the fake clock, PCM
+ * parameters, and a mixer with the controls of mixer_paths.xml. The
+ * compress devices are those of compress_mock.c, which the HAL is built
+ * with, only their presence is controlled here.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sound/compress_params.h>
+#include <tinyalsa/asoundlib.h>
+#include <tinycompress/tinycompress.h>
+
+#include "fake.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/**********************************************************
+ * PCMs
+ **********************************************************/
+
+struct pcm_slot {
+    bool present;
+    bool xrun_pending;
+    int error_pending;
+    struct fake_pcm_stats stats;
+};
+
+struct pcm {
+    unsigned int card;
+    unsigned int device;
+    unsigned int flags;
+    struct pcm_config config;
+    struct pcm_slot *slot;
+    bool ready;
+    char error[128];
+    unsigned int buffer_size;   /* frames */
+    unsigned int frame_size;
+    char *ring;                 /* the DMA buffer */
+    bool running;
+    bool xrun;
+    int64_t start_ns;           /* clock time of hw_base */
+    uint64_t hw_base;           /* DMA position when started */
+    uint64_t appl;              /* frames written or read */
+};
+
+struct pcm_params {
+    unsigned int card;
+};
+
+static pthread_mutex_t alsa_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pcm_slot slots[FAKE_PCM_CARDS][FAKE_PCM_DEVICES][2];
+static bool slots_init;
+static bool mmap_supported = true;
+static unsigned int card_formats[FAKE_PCM_CARDS] = {
+    1 << PCM_FORMAT_S16_LE, 1 << PCM_FORMAT_S16_LE,
+};
+static unsigned int open_delay_us;
+static unsigned int open_count;
+static unsigned int active_count; /* PCMs open and not closed yet */
+static fake_pcm_tap_t pcm_tap;
+static fake_pcm_source_t pcm_source = fake_pcm_sine_source;
+
+/* must be called with alsa_lock locked */
+static void init_slots(void)
+{
+    unsigned int device;
+
+    if (slots_init)
+        return;
+    for (device = 0; device < FAKE_PCM_DEVICES; device++) {
+        slots[0][device][0].present = true;
+        slots[0][device][1].present = true;
+    }
+    slots_init = true;
+}
+
+/* must be called with alsa_lock locked */
+static struct pcm_slot *get_slot(unsigned int card, unsigned int device,
+                                 unsigned int flags)
+{
+    if (card >= FAKE_PCM_CARDS || device >= FAKE_PCM_DEVICES)
+        return NULL;
+    init_slots();
+    return &slots[card][device][(flags & PCM_IN) ? 1 : 0];
+}
+
+void fake_pcm_set_present(unsigned int card, unsigned int device, bool present)
+{
+    pthread_mutex_lock(&alsa_lock);
+    if (get_slot(card, device, PCM_OUT)) {
+        get_slot(card, device, PCM_OUT)->present = present;
+        get_slot(card, device, PCM_IN)->present = present;
+    }
+    pthread_mutex_unlock(&alsa_lock);
+}
+
+void fake_pcm_set_mmap(bool supported)
+{
+    mmap_supported = supported;
+}
+
+void fake_pcm_set_formats(unsigned int card, unsigned int format_mask)
+{
+    if (card < FAKE_PCM_CARDS)
+        card_formats[card] = format_mask;
+}
+
+void fake_pcm_set_open_delay_us(unsigned int us)
+{
+    open_delay_us = us;
+}
+
+void fake_pcm_set_tap(fake_pcm_tap_t tap)
+{
+    pcm_tap = tap;
+}
+
+void fake_pcm_set_source(fake_pcm_source_t source)
+{
+    pcm_source = source ? source : fake_pcm_sine_source;
+}
+
+void fake_pcm_inject_xrun(unsigned int card, unsigned int device,
+                          unsigned int flags)
+{
+    struct pcm_slot *slot;
+
+    pthread_mutex_lock(&alsa_lock);
+    slot = get_slot(card, device, flags);
+    if (slot)
+        slot->xrun_pending = true;
+    pthread_mutex_unlock(&alsa_lock);
+}
+
+void fake_pcm_inject_error(unsigned int card, unsigned int device,
+                           unsigned int flags, int error)
+{
+    struct pcm_slot *slot;
+
+    pthread_mutex_lock(&alsa_lock);
+    slot = get_slot(card, device, flags);
+    if (slot)
+        slot->error_pending = error;
+    pthread_mutex_unlock(&alsa_lock);
+}
+
+struct fake_pcm_stats fake_pcm_get_stats(unsigned int card, unsigned int device,
+                                         unsigned int flags)
+{
+    struct fake_pcm_stats stats = { 0 };
+    struct pcm_slot *slot;
+
+    pthread_mutex_lock(&alsa_lock);
+    slot = get_slot(card, device, flags);
+    if (slot)
+        stats = slot->stats;
+    pthread_mutex_unlock(&alsa_lock);
+    return stats;
+}
+
+unsigned int fake_pcm_open_count(void)
+{
+    unsigned int count;
+
+    pthread_mutex_lock(&alsa_lock);
+    count = open_count;
+    pthread_mutex_unlock(&alsa_lock);
+    return count;
+}
+
+unsigned int fake_pcm_active_count(void)
+{
+    unsigned int count;
+
+    pthread_mutex_lock(&alsa_lock);
+    count = active_count;
+    pthread_mutex_unlock(&alsa_lock);
+    return count;
+}
+
+void fake_pcm_sine_source(unsigned int card, unsigned int device,
+                          const struct pcm_config *config, void *data,
+                          uint64_t position, unsigned int frames)
+{
+    unsigned int i, c;
+
+    for (i = 0; i < frames; i++) {
+        double phase = 2 * M_PI * 1000 * (double)((position + i) % config->rate) /
+                       config->rate;
+        int32_t sample = lrint(16384 * sin(phase));
+
+        for (c = 0; c < config->channels; c++) {
+            if (config->format == PCM_FORMAT_S16_LE)
+                ((int16_t *)data)[i * config->channels + c] = sample;
+            else
+                ((int32_t *)data)[i * config->channels + c] = sample << 8;
+        }
+    }
+}
+
+static unsigned int format_bytes(enum pcm_format format)
+{
+    switch (format) {
+    case PCM_FORMAT_S8:
+        return 1;
+    case PCM_FORMAT_S24_3LE:
+        return 3;
+    case PCM_FORMAT_S24_LE:
+    case PCM_FORMAT_S32_LE:
+        return 4;
+    default:
+        return 2;
+    }
+}
+
+int pcm_format_to_bits(enum pcm_format format)
+{
+    switch (format) {
+    case PCM_FORMAT_S32_LE:
+    case PCM_FORMAT_S24_LE:
+        return 32;
+    case PCM_FORMAT_S24_3LE:
+        return 24;
+    case PCM_FORMAT_S8:
+        return 8;
+    default:
+        return 16;
+    }
+}
+
+static uint64_t frames_to_ns(const struct pcm *pcm, uint64_t frames)
+{
+    /* rounded up, so that the frames are there once the time has passed */
+    return (frames * 1000000000 + pcm->config.rate - 1) / pcm->config.rate;
+}
+
+static uint64_t hw_ptr(const struct pcm *pcm)
+{
+    if (!pcm->running)
+        return pcm->hw_base;
+    return pcm->hw_base + (uint64_t)(fake_clock_now_ns() - pcm->start_ns) *
+                          pcm->config.rate / 1000000000;
+}
+
+/* frames which can be written to a playback PCM or read from a capture PCM */
+static int64_t pcm_avail(const struct pcm *pcm)
+{
+    int64_t hw = hw_ptr(pcm);
+
+    if (pcm->flags & PCM_IN)
+        return hw - (int64_t)pcm->appl;
+    return (int64_t)pcm->buffer_size - ((int64_t)pcm->appl - hw);
+}
+
+static void count_xrun(struct pcm *pcm)
+{
+    pthread_mutex_lock(&alsa_lock);
+    pcm->slot->stats.xruns++;
+    pthread_mutex_unlock(&alsa_lock);
+}
+
+static void count_io(struct pcm *pcm, unsigned int *calls, const void *data,
+                     uint64_t frames, bool waited)
+{
+    pthread_mutex_lock(&alsa_lock);
+    (*calls)++;
+    pcm->slot->stats.data = data;
+    pcm->slot->stats.frames += frames;
+    if (waited)
+        pcm->slot->stats.waits++;
+    pthread_mutex_unlock(&alsa_lock);
+}
+
+static bool take_injected_xrun(struct pcm *pcm)
+{
+    bool xrun;
+
+    pthread_mutex_lock(&alsa_lock);
+    xrun = pcm->slot->xrun_pending;
+    pcm->slot->xrun_pending = false;
+    pthread_mutex_unlock(&alsa_lock);
+    return xrun;
+}
+
+static int take_injected_error(struct pcm *pcm)
+{
+    int error;
+
+    pthread_mutex_lock(&alsa_lock);
+    error = pcm->slot->error_pending;
+    pcm->slot->error_pending = 0;
+    pthread_mutex_unlock(&alsa_lock);
+    return error;
+}
+
+/* the DMA stopped: the stream has to be prepared again */
+static void stop_on_xrun(struct pcm *pcm)
+{
+    pcm->running = false;
+    pcm->xrun = true;
+    pcm->hw_base = pcm->appl;
+    count_xrun(pcm);
+}
+
+struct pcm *pcm_open(unsigned int card, unsigned int device,
+                     unsigned int flags, struct pcm_config *config)
+{
+    struct pcm *pcm = calloc(1, sizeof(struct pcm));
+    struct pcm_slot *slot;
+
+    if (!pcm)
+        return NULL;
+
+    fake_clock_sleep_ns(open_delay_us * 1000LL);
+
+    pcm->card = card;
+    pcm->device = device;
+    pcm->flags = flags;
+    pcm->config = *config;
+    pcm->buffer_size = config->period_size * config->period_count;
+    pcm->frame_size = config->channels * format_bytes(config->format);
+    if (pcm->config.start_threshold == 0)
+        pcm->config.start_threshold = (flags & PCM_IN) ? 1 :
+                                      pcm->buffer_size / 2;
+    if (pcm->config.avail_min == 0)
+        pcm->config.avail_min = config->period_size;
+
+    pthread_mutex_lock(&alsa_lock);
+    slot = get_slot(card, device, flags);
+    if (!slot || !slot->present) {
+        snprintf(pcm->error, sizeof(pcm->error),
+                 "cannot open device %u of card %u", device, card);
+    } else if ((flags & PCM_MMAP) && !mmap_supported) {
+        snprintf(pcm->error, sizeof(pcm->error), "mmap failed");
+    } else if (!(card_formats[card] & (1 << config->format))) {
+        snprintf(pcm->error, sizeof(pcm->error), "cannot set hw params");
+    } else if (pcm->buffer_size == 0 || config->rate == 0) {
+        snprintf(pcm->error, sizeof(pcm->error), "invalid config");
+    } else {
+        pcm->ring = calloc(pcm->buffer_size, pcm->frame_size);
+        pcm->ready = pcm->ring != NULL;
+    }
+    if (slot) {
+        pcm->slot = slot;
+        slot->stats.opens++;
+        if (!pcm->ready)
+            slot->stats.open_errors++;
+        slot->stats.config = pcm->config;
+        slot->stats.flags = flags;
+    }
+    if (pcm->ready) {
+        open_count++;
+        active_count++;
+    }
+    pthread_mutex_unlock(&alsa_lock);
+
+    return pcm;
+}
+
+int pcm_close(struct pcm *pcm)
+{
+    if (!pcm)
+        return -EFAULT;
+    if (pcm->ready) {
+        pthread_mutex_lock(&alsa_lock);
+        active_count--;
+        pthread_mutex_unlock(&alsa_lock);
+    }
+    free(pcm->ring);
+    free(pcm);
+    return 0;
+}
+
+int pcm_is_ready(struct pcm *pcm)
+{
+    return pcm && pcm->ready;
+}
+
+const char *pcm_get_error(struct pcm *pcm)
+{
+    return pcm->error;
+}
+
+unsigned int pcm_get_buffer_size(struct pcm *pcm)
+{
+    return pcm->buffer_size;
+}
+
+unsigned int pcm_frames_to_bytes(struct pcm *pcm, unsigned int frames)
+{
+    return frames * pcm->frame_size;
+}
+
+unsigned int pcm_bytes_to_frames(struct pcm *pcm, unsigned int bytes)
+{
+    return bytes / pcm->frame_size;
+}
+
+int pcm_prepare(struct pcm *pcm)
+{
+    pcm->running = false;
+    pcm->xrun = false;
+    pcm->hw_base = pcm->appl;
+    return 0;
+}
+
+int pcm_start(struct pcm *pcm)
+{
+    if (pcm->xrun)
+        return -EBADFD;
+    pcm->hw_base = hw_ptr(pcm);
+    pcm->start_ns = fake_clock_now_ns();
+    pcm->running = true;
+    return 0;
+}
+
+int pcm_stop(struct pcm *pcm)
+{
+    pcm->running = false;
+    pcm->hw_base = pcm->appl;
+    return 0;
+}
+
+/* copies between a buffer and the DMA buffer, from the frame position pos */
+static void ring_copy(struct pcm *pcm, uint64_t pos, void *data,
+                      unsigned int frames, bool to_ring)
+{
+    char *buf = data;
+
+    while (frames > 0) {
+        unsigned int offset = pos % pcm->buffer_size;
+        unsigned int count = pcm->buffer_size - offset;
+        char *ring = pcm->ring + offset * pcm->frame_size;
+
+        if (count > frames)
+            count = frames;
+        if (to_ring)
+            memcpy(ring, buf, count * pcm->frame_size);
+        else
+            memcpy(buf, ring, count * pcm->frame_size);
+        buf += count * pcm->frame_size;
+        pos += count;
+        frames -= count;
+    }
+}
+
+/* captures the frames from pos into the DMA buffer */
+static void ring_capture(struct pcm *pcm, uint64_t pos, unsigned int frames)
+{
+    char buf[4096];
+    unsigned int max = sizeof(buf) / pcm->frame_size;
+
+    while (frames > 0) {
+        unsigned int count = frames < max ? frames : max;
+
+        pcm_source(pcm->card, pcm->device, &pcm->config, buf, pos, count);
+        ring_copy(pcm, pos, buf, count, true);
+        pos += count;
+        frames -= count;
+    }
+}
+
+int pcm_write(struct pcm *pcm, const void *data, unsigned int count)
+{
+    const char *src = data;
+    unsigned int frames;
+    bool waited = false;
+    int error;
+
+    if (!pcm->ready || (pcm->flags & PCM_IN))
+        return -EINVAL;
+    error = take_injected_error(pcm);
+    if (error != 0)
+        return error;
+
+    frames = count / pcm->frame_size;
+    if (take_injected_xrun(pcm) && pcm->running)
+        pcm->start_ns -= frames_to_ns(pcm, pcm->buffer_size * 2ULL);
+
+    while (frames > 0) {
+        int64_t avail = pcm_avail(pcm);
+        unsigned int n;
+
+        if (pcm->running && avail > (int64_t)pcm->buffer_size) {
+            /* underrun: the DMA went past the audio written */
+            stop_on_xrun(pcm);
+            if (pcm->flags & PCM_NORESTART) {
+                errno = EPIPE;
+                return -EPIPE;
+            }
+            pcm_prepare(pcm);
+            continue;
+        }
+        if (pcm->xrun) {
+            errno = EPIPE;
+            return -EPIPE;
+        }
+
+        if (avail == 0) {
+            unsigned int wait = frames < pcm->config.avail_min ?
+                                frames : pcm->config.avail_min;
+
+            if (!pcm->running)
+                pcm_start(pcm);
+            fake_clock_sleep_ns(frames_to_ns(pcm, wait));
+            waited = true;
+            continue;
+        }
+
+        n = avail < frames ? avail : frames;
+        ring_copy(pcm, pcm->appl, (void *)src, n, true);
+        if (pcm_tap)
+            pcm_tap(pcm->card, pcm->device, &pcm->config, src, n);
+        pcm->appl += n;
+        src += n * pcm->frame_size;
+        frames -= n;
+
+        if (!pcm->running &&
+            pcm->appl - pcm->hw_base >= pcm->config.start_threshold)
+            pcm_start(pcm);
+    }
+
+    count_io(pcm, &pcm->slot->stats.writes, data, count / pcm->frame_size,
+             waited);
+    return 0;
+}
+
+int pcm_read(struct pcm *pcm, void *data, unsigned int count)
+{
+    unsigned int frames;
+    bool waited = false;
+    int error;
+
+    if (!pcm->ready || !(pcm->flags & PCM_IN))
+        return -EINVAL;
+    error = take_injected_error(pcm);
+    if (error != 0)
+        return error;
+
+    frames = count / pcm->frame_size;
+    if (!pcm->running)
+        pcm_start(pcm);
+    if (take_injected_xrun(pcm))
+        pcm->start_ns -= frames_to_ns(pcm, pcm->buffer_size * 2ULL);
+
+    for (;;) {
+        int64_t avail = pcm_avail(pcm);
+
+        if (avail > (int64_t)pcm->buffer_size) {
+            /* overrun: the DMA overwrote audio which was not read */
+            stop_on_xrun(pcm);
+            if (pcm->flags & PCM_NORESTART) {
+                errno = EPIPE;
+                return -EPIPE;
+            }
+            /* tinyalsa restarts the stream on its own */
+            pcm_prepare(pcm);
+            pcm_start(pcm);
+            continue;
+        }
+        if (avail >= frames)
+            break;
+
+        fake_clock_sleep_ns(frames_to_ns(pcm, frames - avail));
+        waited = true;
+    }
+
+    ring_capture(pcm, pcm->appl, frames);
+    ring_copy(pcm, pcm->appl, data, frames, false);
+    pcm->appl += frames;
+
+    count_io(pcm, &pcm->slot->stats.reads, data, frames, waited);
+    return 0;
+}
+
+int pcm_wait(struct pcm *pcm, int timeout)
+{
+    int64_t avail = pcm_avail(pcm);
+    int64_t wait_ns;
+
+    if (avail >= pcm->config.avail_min || !pcm->running)
+        return 1;
+
+    wait_ns = frames_to_ns(pcm, pcm->config.avail_min - avail);
+    if (timeout >= 0 && wait_ns > timeout * 1000000LL) {
+        fake_clock_sleep_ns(timeout * 1000000LL);
+        return 0;
+    }
+    fake_clock_sleep_ns(wait_ns);
+
+    pthread_mutex_lock(&alsa_lock);
+    pcm->slot->stats.waits++;
+    pthread_mutex_unlock(&alsa_lock);
+    return 1;
+}
+
+int pcm_get_htimestamp(struct pcm *pcm, unsigned int *avail,
+                       struct timespec *tstamp)
+{
+    int64_t frames;
+
+    if (!pcm->ready || !pcm->running)
+        return -1;
+
+    frames = pcm_avail(pcm);
+    *avail = frames < 0 ? 0 : frames;
+    fake_clock_gettime(CLOCK_MONOTONIC, tstamp);
+    return 0;
+}
+
+int pcm_mmap_avail(struct pcm *pcm)
+{
+    int64_t avail = pcm_avail(pcm);
+
+    if (pcm->running && !pcm->xrun && avail > (int64_t)pcm->buffer_size) {
+        /* the HAL sees the xrun from the avail, and prepares the PCM */
+        pcm->xrun = true;
+        count_xrun(pcm);
+    }
+    return avail;
+}
+
+int pcm_mmap_begin(struct pcm *pcm, void **areas, unsigned int *offset,
+                   unsigned int *frames)
+{
+    int64_t avail = pcm_avail(pcm);
+    unsigned int continuous;
+
+    if (!pcm->ready || !(pcm->flags & PCM_MMAP))
+        return -EINVAL;
+
+    if (avail > (int64_t)pcm->buffer_size)
+        avail = pcm->buffer_size;
+    if (avail < 0)
+        avail = 0;
+
+    *areas = pcm->ring;
+    *offset = pcm->appl % pcm->buffer_size;
+    continuous = pcm->buffer_size - *offset;
+    if (*frames > avail)
+        *frames = avail;
+    if (*frames > continuous)
+        *frames = continuous;
+
+    if (pcm->flags & PCM_IN)
+        ring_capture(pcm, pcm->appl, *frames);
+    return 0;
+}
+
+int pcm_mmap_commit(struct pcm *pcm, unsigned int offset, unsigned int frames)
+{
+    if (!(pcm->flags & PCM_IN) && pcm_tap)
+        pcm_tap(pcm->card, pcm->device, &pcm->config,
+                pcm->ring + offset * pcm->frame_size, frames);
+    pcm->appl += frames;
+
+    count_io(pcm, (pcm->flags & PCM_IN) ? &pcm->slot->stats.reads :
+                                          &pcm->slot->stats.writes,
+             pcm->ring + offset * pcm->frame_size, frames, false);
+    return frames;
+}
+
+struct pcm_params *pcm_params_get(unsigned int card, unsigned int device,
+                                  unsigned int flags)
+{
+    struct pcm_params *params = NULL;
+    struct pcm_slot *slot;
+
+    pthread_mutex_lock(&alsa_lock);
+    slot = get_slot(card, device, flags);
+    if (slot && slot->present) {
+        params = malloc(sizeof(struct pcm_params));
+        if (params)
+            params->card = card;
+    }
+    pthread_mutex_unlock(&alsa_lock);
+    return params;
+}
+
+void pcm_params_free(struct pcm_params *pcm_params)
+{
+    free(pcm_params);
+}
+
+int pcm_params_format_test(struct pcm_params *params, enum pcm_format format)
+{
+    return (card_formats[params->card] & (1 << format)) != 0;
+}
+
+/**********************************************************
+ * Mixer
+ **********************************************************/
+
+/* Types of the tables generated by gen_mixer_paths.py, as in mixer_route.c */
+struct mixer_value {
+    const char *string;
+    uint16_t first;
+    uint16_t count;
+};
+
+struct mixer_path {
+    const char *name;
+    uint16_t first;
+    uint16_t count;
+};
+
+struct mixer_setting {
+    uint16_t ctl;
+    uint16_t value;
+};
+
+#include "mixer_paths_table.h"
+
+#define MIXER_MAX_CTLS (MIXER_CTL_COUNT + 16)
+#define MIXER_MAX_VALUES 256
+#define MIXER_MAX_ENUMS 32
+
+struct mixer_ctl {
+    char name[64];
+    enum mixer_ctl_type type;
+    unsigned int num_values;
+    int values[MIXER_MAX_VALUES];
+    const char *enums[MIXER_MAX_ENUMS];
+    unsigned int num_enums;
+};
+
+struct mixer {
+    struct mixer_ctl ctls[MIXER_MAX_CTLS];
+    unsigned int num_ctls;
+};
+
+struct ctl_change {
+    char name[64];
+    enum mixer_ctl_type type;
+    unsigned int num_values;    /* 0 to remove the control */
+};
+
+static struct mixer *the_mixer;
+static struct ctl_change ctl_changes[16];
+static unsigned int num_ctl_changes;
+static unsigned int access_delay_us;
+static unsigned int mixer_writes;
+static unsigned int mixer_reads;
+
+void fake_mixer_add_ctl(const char *name, enum mixer_ctl_type type,
+                        unsigned int num_values)
+{
+    struct ctl_change *change = &ctl_changes[num_ctl_changes++];
+
+    snprintf(change->name, sizeof(change->name), "%s", name);
+    change->type = type;
+    change->num_values = num_values;
+}
+
+void fake_mixer_remove_ctl(const char *name)
+{
+    fake_mixer_add_ctl(name, MIXER_CTL_TYPE_UNKNOWN, 0);
+}
+
+void fake_mixer_set_access_delay_us(unsigned int us)
+{
+    access_delay_us = us;
+}
+
+unsigned int fake_mixer_get_writes(void)
+{
+    return __atomic_load_n(&mixer_writes, __ATOMIC_RELAXED);
+}
+
+unsigned int fake_mixer_get_reads(void)
+{
+    return __atomic_load_n(&mixer_reads, __ATOMIC_RELAXED);
+}
+
+static void mixer_access(unsigned int *counter)
+{
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+    fake_clock_sleep_ns(access_delay_us * 1000LL);
+}
+
+static void add_enum(struct mixer_ctl *ctl, const char *string)
+{
+    unsigned int i;
+
+    for (i = 0; i < ctl->num_enums; i++) {
+        if (strcmp(ctl->enums[i], string) == 0)
+            return;
+    }
+    if (ctl->num_enums < MIXER_MAX_ENUMS)
+        ctl->enums[ctl->num_enums++] = string;
+}
+
+/* the type and values of a control from the settings of the paths */
+static void init_table_ctl(struct mixer_ctl *ctl, unsigned int index)
+{
+    unsigned int i;
+
+    snprintf(ctl->name, sizeof(ctl->name), "%s", mixer_ctl_names[index]);
+    ctl->type = MIXER_CTL_TYPE_INT;
+    ctl->num_values = 1;
+
+    for (i = 0; i < ARRAY_SIZE(mixer_settings); i++) {
+        const struct mixer_value *value;
+
+        if (mixer_settings[i].ctl != index)
+            continue;
+        value = &mixer_values[mixer_settings[i].value];
+        if (value->count == 0) {
+            ctl->type = MIXER_CTL_TYPE_ENUM;
+            add_enum(ctl, value->string);
+        } else if (value->count > 1 && ctl->type != MIXER_CTL_TYPE_ENUM) {
+            ctl->type = MIXER_CTL_TYPE_BYTE;
+            if (value->count > ctl->num_values)
+                ctl->num_values = value->count;
+        }
+    }
+
+    if (ctl->type == MIXER_CTL_TYPE_INT) {
+        size_t len = strlen(ctl->name);
+
+        if (len > 6 && strcmp(ctl->name + len - 6, "Switch") == 0)
+            ctl->type = MIXER_CTL_TYPE_BOOL;
+    }
+    if (ctl->num_values > MIXER_MAX_VALUES)
+        ctl->num_values = MIXER_MAX_VALUES;
+}
+
+static struct mixer_ctl *find_ctl(struct mixer *mixer, const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < mixer->num_ctls; i++) {
+        if (strcmp(mixer->ctls[i].name, name) == 0)
+            return &mixer->ctls[i];
+    }
+    return NULL;
+}
+
+struct mixer *mixer_open(unsigned int card)
+{
+    struct mixer *mixer;
+    unsigned int i;
+
+    if (card != 0)
+        return NULL;
+
+    mixer = calloc(1, sizeof(struct mixer));
+    if (!mixer)
+        return NULL;
+
+    for (i = 0; i < MIXER_CTL_COUNT; i++)
+        init_table_ctl(&mixer->ctls[mixer->num_ctls++], i);
+
+    for (i = 0; i < num_ctl_changes; i++) {
+        const struct ctl_change *change = &ctl_changes[i];
+        struct mixer_ctl *ctl = find_ctl(mixer, change->name);
+
+        if (change->num_values == 0) {
+            if (ctl)
+                *ctl = mixer->ctls[--mixer->num_ctls];
+            continue;
+        }
+        if (!ctl) {
+            if (mixer->num_ctls == MIXER_MAX_CTLS)
+                continue;
+            ctl = &mixer->ctls[mixer->num_ctls++];
+        }
+        memset(ctl, 0, sizeof(*ctl));
+        memcpy(ctl->name, change->name, sizeof(ctl->name));
+        ctl->type = change->type;
+        ctl->num_values = change->num_values;
+    }
+
+    the_mixer = mixer;
+    return mixer;
+}
+
+void mixer_close(struct mixer *mixer)
+{
+    if (the_mixer == mixer)
+        the_mixer = NULL;
+    free(mixer);
+}
+
+unsigned int mixer_get_num_ctls(struct mixer *mixer)
+{
+    return mixer->num_ctls;
+}
+
+struct mixer_ctl *mixer_get_ctl(struct mixer *mixer, unsigned int id)
+{
+    return id < mixer->num_ctls ? &mixer->ctls[id] : NULL;
+}
+
+struct mixer_ctl *mixer_get_ctl_by_name(struct mixer *mixer, const char *name)
+{
+    return find_ctl(mixer, name);
+}
+
+const char *mixer_ctl_get_name(struct mixer_ctl *ctl)
+{
+    return ctl->name;
+}
+
+enum mixer_ctl_type mixer_ctl_get_type(struct mixer_ctl *ctl)
+{
+    return ctl->type;
+}
+
+unsigned int mixer_ctl_get_num_values(struct mixer_ctl *ctl)
+{
+    return ctl->num_values;
+}
+
+unsigned int mixer_ctl_get_num_enums(struct mixer_ctl *ctl)
+{
+    return ctl->num_enums;
+}
+
+const char *mixer_ctl_get_enum_string(struct mixer_ctl *ctl,
+                                      unsigned int enum_id)
+{
+    return enum_id < ctl->num_enums ? ctl->enums[enum_id] : NULL;
+}
+
+int mixer_ctl_get_value(struct mixer_ctl *ctl, unsigned int id)
+{
+    if (id >= ctl->num_values)
+        return -EINVAL;
+    mixer_access(&mixer_reads);
+    return ctl->values[id];
+}
+
+int mixer_ctl_get_array(struct mixer_ctl *ctl, void *array, size_t count)
+{
+    unsigned int i;
+
+    if (count > ctl->num_values)
+        return -EINVAL;
+    mixer_access(&mixer_reads);
+    for (i = 0; i < count; i++) {
+        if (ctl->type == MIXER_CTL_TYPE_BYTE)
+            ((unsigned char *)array)[i] = ctl->values[i];
+        else
+            ((long *)array)[i] = ctl->values[i];
+    }
+    return 0;
+}
+
+int mixer_ctl_set_value(struct mixer_ctl *ctl, unsigned int id, int value)
+{
+    if (id >= ctl->num_values)
+        return -EINVAL;
+    if (ctl->type == MIXER_CTL_TYPE_ENUM && (unsigned int)value >= ctl->num_enums)
+        return -EINVAL;
+    mixer_access(&mixer_writes);
+    ctl->values[id] = value;
+    return 0;
+}
+
+int mixer_ctl_set_array(struct mixer_ctl *ctl, const void *array, size_t count)
+{
+    unsigned int i;
+
+    /* like tinyalsa, enums cannot be written as an array */
+    if (count > ctl->num_values || ctl->type == MIXER_CTL_TYPE_ENUM)
+        return -EINVAL;
+    mixer_access(&mixer_writes);
+    for (i = 0; i < count; i++) {
+        if (ctl->type == MIXER_CTL_TYPE_BYTE)
+            ctl->values[i] = ((const unsigned char *)array)[i];
+        else
+            ctl->values[i] = ((const long *)array)[i];
+    }
+    return 0;
+}
+
+int mixer_ctl_set_enum_by_string(struct mixer_ctl *ctl, const char *string)
+{
+    unsigned int i;
+
+    for (i = 0; i < ctl->num_enums; i++) {
+        if (strcmp(ctl->enums[i], string) == 0) {
+            mixer_access(&mixer_writes);
+            ctl->values[0] = i;
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+int mixer_ctl_set_percent(struct mixer_ctl *ctl, unsigned int id, int percent)
+{
+    if (ctl->type != MIXER_CTL_TYPE_INT || id >= ctl->num_values)
+        return -EINVAL;
+    mixer_access(&mixer_writes);
+    ctl->values[id] = percent;
+    return 0;
+}
+
+int fake_mixer_get_value(const char *name, unsigned int id)
+{
+    struct mixer_ctl *ctl = the_mixer ? find_ctl(the_mixer, name) : NULL;
+
+    if (!ctl || id >= ctl->num_values)
+        return -1;
+    return ctl->values[id];
+}
+
+void fake_mixer_set_value(const char *name, unsigned int id, int value)
+{
+    struct mixer_ctl *ctl = the_mixer ? find_ctl(the_mixer, name) : NULL;
+
+    if (ctl && id < ctl->num_values)
+        ctl->values[id] = value;
+}
+
+/**********************************************************
+ * Compress devices
+ **********************************************************/
+
+static bool compress_present = true;
+
+void fake_compress_set_present(bool present)
+{
+    compress_present = present;
+}
+
+/* compress_mock.c is built with its is_codec_supported() renamed */
+bool mock_is_codec_supported(unsigned int card, unsigned int device,
+                             unsigned int flags, struct snd_codec *codec);
+
+bool is_codec_supported(unsigned int card, unsigned int device,
+                        unsigned int flags, struct snd_codec *codec)
+{
+    return compress_present &&
+           mock_is_codec_supported(card, device, flags, codec);
+}
@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host versions of the libcutils and liblog functions used by the HAL:
+ * the log, the system properties and the key=value parameter strings.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include <cutils/str_parms.h>
+
+#include "fake.h"
+
+/**********************************************************
+ * Log
+ **********************************************************/
+
+#define LOG_HISTORY 256
+#define LOG_LINE_MAX 256
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static int log_level = -1;
+static unsigned int log_counts[ANDROID_LOG_ERROR + 1];
+static struct {
+    int prio;
+    char text[LOG_LINE_MAX];
+} log_history[LOG_HISTORY];
+static unsigned int log_next;
+
+/* must be called with log_lock locked */
+static int get_log_level(void)
+{
+    if (log_level < 0) {
+        const char *env = getenv("FAKE_LOG_LEVEL");
+
+        log_level = env ? atoi(env) : ANDROID_LOG_WARN;
+    }
+    return log_level;
+}
+
+void fake_log_set_level(int prio)
+{
+    pthread_mutex_lock(&log_lock);
+    log_level = prio;
+    pthread_mutex_unlock(&log_lock);
+}
+
+unsigned int fake_log_count(int prio)
+{
+    unsigned int count = 0;
+
+    pthread_mutex_lock(&log_lock);
+    if (prio >= ANDROID_LOG_VERBOSE && prio <= ANDROID_LOG_ERROR)
+        count = log_counts[prio];
+    pthread_mutex_unlock(&log_lock);
+    return count;
+}
+
+unsigned int fake_log_find(int prio, const char *text)
+{
+    unsigned int count = 0;
+    unsigned int i;
+
+    pthread_mutex_lock(&log_lock);
+    for (i = 0; i < LOG_HISTORY; i++) {
+        if (log_history[i].prio >= prio &&
+            strstr(log_history[i].text, text) != NULL)
+            count++;
+    }
+    pthread_mutex_unlock(&log_lock);
+    return count;
+}
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...)
+{
+    static const char prio_chars[] = "  VDIWE";
+    char text[LOG_LINE_MAX];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+
+    pthread_mutex_lock(&log_lock);
+    if (prio >= ANDROID_LOG_VERBOSE && prio <= ANDROID_LOG_ERROR)
+        log_counts[prio]++;
+    log_history[log_next].prio = prio;
+    memcpy(log_history[log_next].text, text, sizeof(text));
+    log_next = (log_next + 1) % LOG_HISTORY;
+    if (prio >= get_log_level())
+        fprintf(stderr, "%c %s: %s\n",
+                prio <= ANDROID_LOG_ERROR ? prio_chars[prio] : '?',
+                tag ? tag : "", text);
+    pthread_mutex_unlock(&log_lock);
+
+    return 0;
+}
+
+/**********************************************************
+ * Properties
+ **********************************************************/
+
+#define PROPERTY_MAX 64
+
+static pthread_mutex_t property_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    char key[PROPERTY_KEY_MAX * 2];
+    char value[PROPERTY_VALUE_MAX];
+} properties[PROPERTY_MAX];
+static unsigned int num_properties;
+
+int property_set(const char *key, const char *value)
+{
+    unsigned int i;
+    int ret = 0;
+
+    pthread_mutex_lock(&property_lock);
+    for (i = 0; i < num_properties; i++) {
+        if (strcmp(properties[i].key, key) == 0)
+            break;
+    }
+    if (i == num_properties) {
+        if (num_properties == PROPERTY_MAX) {
+            ret = -1;
+            goto exit;
+        }
+        num_properties++;
+        snprintf(properties[i].key, sizeof(properties[i].key), "%s", key);
+    }
+    snprintf(properties[i].value, sizeof(properties[i].value), "%s",
+             value ? value : "");
+
+exit:
+    pthread_mutex_unlock(&property_lock);
+    return ret;
+}
+
+int property_get(const char *key, char *value, const char *default_value)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&property_lock);
+    for (i = 0; i < num_properties; i++) {
+        if (strcmp(properties[i].key, key) == 0 && properties[i].value[0]) {
+            strcpy(value, properties[i].value);
+            pthread_mutex_unlock(&property_lock);
+            return strlen(value);
+        }
+    }
+    pthread_mutex_unlock(&property_lock);
+
+    snprintf(value, PROPERTY_VALUE_MAX, "%s",
+             default_value ? default_value : "");
+    return strlen(value);
+}
+
+bool property_get_bool(const char *key, bool default_value)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    if (property_get(key, value, NULL) == 0)
+        return default_value;
+    if (strcmp(value, "1") == 0 || strcmp(value, "y") == 0 ||
+        strcmp(value, "yes") == 0 || strcmp(value, "on") == 0 ||
+        strcmp(value, "true") == 0)
+        return true;
+    if (strcmp(value, "0") == 0 || strcmp(value, "n") == 0 ||
+        strcmp(value, "no") == 0 || strcmp(value, "off") == 0 ||
+        strcmp(value, "false") == 0)
+        return false;
+    return default_value;
+}
+
+int32_t property_get_int32(const char *key, int32_t default_value)
+{
+    char value[PROPERTY_VALUE_MAX];
+    char *end;
+    long result;
+
+    if (property_get(key, value, NULL) == 0)
+        return default_value;
+    result = strtol(value, &end, 0);
+    return *end == '\0' ? result : default_value;
+}
+
+/**********************************************************
+ * Parameter strings
+ **********************************************************/
+
+#define STR_PARMS_MAX 32
+
+struct str_parms {
+    char *keys[STR_PARMS_MAX];
+    char *values[STR_PARMS_MAX];
+    unsigned int count;
+};
+
+struct str_parms *str_parms_create(void)
+{
+    return calloc(1, sizeof(struct str_parms));
+}
+
+void str_parms_destroy(struct str_parms *str_parms)
+{
+    unsigned int i;
+
+    for (i = 0; i < str_parms->count; i++) {
+        free(str_parms->keys[i]);
+        free(str_parms->values[i]);
+    }
+    free(str_parms);
+}
+
+static int find_key(struct str_parms *str_parms, const char *key)
+{
+    unsigned int i;
+
+    for (i = 0; i < str_parms->count; i++) {
+        if (strcmp(str_parms->keys[i], key) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int str_parms_add_str(struct str_parms *str_parms, const char *key,
+                      const char *value)
+{
+    int i = find_key(str_parms, key);
+
+    if (i >= 0) {
+        free(str_parms->values[i]);
+        str_parms->values[i] = strdup(value);
+        return 0;
+    }
+    if (str_parms->count == STR_PARMS_MAX)
+        return -ENOMEM;
+    str_parms->keys[str_parms->count] = strdup(key);
+    str_parms->values[str_parms->count] = strdup(value);
+    str_parms->count++;
+    return 0;
+}
+
+int str_parms_add_int(struct str_parms *str_parms, const char *key, int value)
+{
+    char string[16];
+
+    snprintf(string, sizeof(string), "%d", value);
+    return str_parms_add_str(str_parms, key, string);
+}
+
+struct str_parms *str_parms_create_str(const char *_string)
+{
+    struct str_parms *str_parms = str_parms_create();
+    char *string, *pair, *save;
+
+    if (!str_parms)
+        return NULL;
+    string = strdup(_string);
+    for (pair = strtok_r(string, ";", &save); pair;
+         pair = strtok_r(NULL, ";", &save)) {
+        char *value = strchr(pair, '=');
+
+        if (value)
+            *value++ = '\0';
+        str_parms_add_str(str_parms, pair, value ? value : "");
+    }
+    free(string);
+    return str_parms;
+}
+
+int str_parms_has_key(struct str_parms *str_parms, const char *key)
+{
+    return find_key(str_parms, key) >= 0;
+}
+
+int str_parms_get_str(struct str_parms *str_parms, const char *key,
+                      char *out_val, int len)
+{
+    int i = find_key(str_parms, key);
+
+    if (i < 0)
+        return -ENOENT;
+    snprintf(out_val, len, "%s", str_parms->values[i]);
+    return strlen(out_val);
+}
+
+int str_parms_get_int(struct str_parms *str_parms, const char *key,
+                      int *out_val)
+{
+    int i = find_key(str_parms, key);
+    char *end;
+
+    if (i < 0)
+        return -ENOENT;
+    *out_val = strtol(str_parms->values[i], &end, 0);
+    return *end == '\0' && end != str_parms->values[i] ? 0 : -EINVAL;
+}
+
+int str_parms_get_float(struct str_parms *str_parms, const char *key,
+                        float *out_val)
+{
+    int i = find_key(str_parms, key);
+    char *end;
+
+    if (i < 0)
+        return -ENOENT;
+    *out_val = strtof(str_parms->values[i], &end);
+    return *end == '\0' && end != str_parms->values[i] ? 0 : -EINVAL;
+}
+
+char *str_parms_to_str(struct str_parms *str_parms)
+{
+    size_t size = 1;
+    unsigned int i;
+    char *string;
+
+    for (i = 0; i < str_parms->count; i++)
+        size += strlen(str_parms->keys[i]) + strlen(str_parms->values[i]) + 2;
+    string = calloc(1, size);
+    if (!string)
+        return NULL;
+    for (i = 0; i < str_parms->count; i++) {
+        if (i > 0)
+            strcat(string, ";");
+        strcat(string, str_parms->keys[i]);
+        strcat(string, "=");
+        strcat(string, str_parms->values[i]);
+    }
+    return string;
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The audio_utils resampler on the host. It is the speex resampler, as on
+ * the device, when the tests are built with HAVE_SPEEXDSP, and a linear
+ * interpolation otherwise, which is enough for the HAL tests but not for
+ * measuring the quality of the resampling.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <audio_utils/resampler.h>
+
+#ifdef HAVE_SPEEXDSP
+#include <speex/speex_resampler.h>
+#endif
+
+struct host_resampler {
+    struct resampler_itfe itfe;
+    struct resampler_buffer_provider *provider;
+    uint32_t in_rate;
+    uint32_t out_rate;
+    uint32_t channels;
+    int16_t *in_buf;        /* frames from the provider not resampled yet */
+    size_t in_buf_size;
+    size_t frames_in;
+    size_t frames_rq;
+    size_t frames_needed;
+#ifdef HAVE_SPEEXDSP
+    SpeexResamplerState *speex;
+#else
+    uint64_t step;          /* input frames per output frame, Q32 */
+    uint64_t pos;           /* position after prev, Q32 */
+    int16_t prev[2];
+#endif
+};
+
+#ifdef HAVE_SPEEXDSP
+static void process(struct host_resampler *rsmp, const int16_t *in,
+                    uint32_t *in_frames, int16_t *out, uint32_t *out_frames)
+{
+    speex_resampler_process_interleaved_int(rsmp->speex, in, in_frames,
+                                            out, out_frames);
+}
+#else
+static void process(struct host_resampler *rsmp, const int16_t *in,
+                    uint32_t *in_frames, int16_t *out, uint32_t *out_frames)
+{
+    uint32_t i = 0, o = 0, c;
+
+    while (o < *out_frames) {
+        while (rsmp->pos >= (1ULL << 32) && i < *in_frames) {
+            for (c = 0; c < rsmp->channels; c++)
+                rsmp->prev[c] = in[i * rsmp->channels + c];
+            rsmp->pos -= 1ULL << 32;
+            i++;
+        }
+        if (i == *in_frames)
+            break;
+        for (c = 0; c < rsmp->channels; c++) {
+            int32_t next = in[i * rsmp->channels + c];
+
+            out[o * rsmp->channels + c] = rsmp->prev[c] +
+                    (((next - rsmp->prev[c]) * (int64_t)rsmp->pos) >> 32);
+        }
+        rsmp->pos += rsmp->step;
+        o++;
+    }
+
+    *in_frames = i;
+    *out_frames = o;
+}
+#endif
+
+static void resampler_reset(struct resampler_itfe *resampler)
+{
+    struct host_resampler *rsmp = (struct host_resampler *)resampler;
+
+    rsmp->frames_in = 0;
+    rsmp->frames_rq = 0;
+#ifdef HAVE_SPEEXDSP
+    speex_resampler_reset_mem(rsmp->speex);
+#else
+    rsmp->pos = 0;
+    memset(rsmp->prev, 0, sizeof(rsmp->prev));
+#endif
+}
+
+static int32_t resampler_delay_ns(struct resampler_itfe *resampler)
+{
+    struct host_resampler *rsmp = (struct host_resampler *)resampler;
+    int32_t delay = rsmp->frames_in;
+
+#ifdef HAVE_SPEEXDSP
+    delay += speex_resampler_get_input_latency(rsmp->speex);
+#else
+    delay += 1;
+#endif
+    return (int32_t)((int64_t)delay * 1000000000 / rsmp->in_rate);
+}
+
+static int resampler_resample_from_provider(struct resampler_itfe *resampler,
+                                            int16_t *out,
+                                            size_t *outFrameCount)
+{
+    struct host_resampler *rsmp = (struct host_resampler *)resampler;
+    size_t frames_rq = *outFrameCount;
+    size_t frames_wr = 0;
+
+    if (!rsmp->provider)
+        return -EINVAL;
+
+    if (frames_rq != rsmp->frames_rq) {
+        rsmp->frames_needed = frames_rq * rsmp->in_rate / rsmp->out_rate + 1;
+        rsmp->frames_rq = frames_rq;
+    }
+
+    while (frames_wr < frames_rq) {
+        uint32_t in_frames, out_frames;
+
+        if (rsmp->frames_in < rsmp->frames_needed) {
+            struct resampler_buffer buf;
+
+            if (rsmp->in_buf_size < rsmp->frames_needed) {
+                int16_t *in_buf = realloc(rsmp->in_buf, rsmp->frames_needed *
+                                          rsmp->channels * sizeof(int16_t));
+
+                if (!in_buf)
+                    return -ENOMEM;
+                rsmp->in_buf = in_buf;
+                rsmp->in_buf_size = rsmp->frames_needed;
+            }
+            buf.frame_count = rsmp->frames_needed - rsmp->frames_in;
+            rsmp->provider->get_next_buffer(rsmp->provider, &buf);
+            if (buf.raw == NULL)
+                break;
+            memcpy(rsmp->in_buf + rsmp->frames_in * rsmp->channels, buf.raw,
+                   buf.frame_count * rsmp->channels * sizeof(int16_t));
+            rsmp->frames_in += buf.frame_count;
+            rsmp->provider->release_buffer(rsmp->provider, &buf);
+        }
+
+        in_frames = rsmp->frames_in;
+        out_frames = frames_rq - frames_wr;
+        process(rsmp, rsmp->in_buf, &in_frames,
+                out + frames_wr * rsmp->channels, &out_frames);
+        frames_wr += out_frames;
+        rsmp->frames_in -= in_frames;
+        if (rsmp->frames_in)
+            memmove(rsmp->in_buf, rsmp->in_buf + in_frames * rsmp->channels,
+                    rsmp->frames_in * rsmp->channels * sizeof(int16_t));
+    }
+
+    *outFrameCount = frames_wr;
+    return 0;
+}
+
+static int resampler_resample_from_input(struct resampler_itfe *resampler,
+                                         int16_t *in, size_t *inFrameCount,
+                                         int16_t *out, size_t *outFrameCount)
+{
+    struct host_resampler *rsmp = (struct host_resampler *)resampler;
+    uint32_t in_frames = *inFrameCount;
+    uint32_t out_frames = *outFrameCount;
+
+    if (rsmp->provider)
+        return -ENOSYS;
+
+    process(rsmp, in, &in_frames, out, &out_frames);
+    *inFrameCount = in_frames;
+    *outFrameCount = out_frames;
+    return 0;
+}
+
+int create_resampler(uint32_t inSampleRate, uint32_t outSampleRate,
+                     uint32_t channelCount, uint32_t quality,
+                     struct resampler_buffer_provider *provider,
+                     struct resampler_itfe **resampler)
+{
+    struct host_resampler *rsmp;
+
+    if (!resampler || channelCount < 1 || channelCount > 2 ||
+        inSampleRate == 0 || outSampleRate == 0)
+        return -EINVAL;
+
+    rsmp = calloc(1, sizeof(struct host_resampler));
+    if (!rsmp)
+        return -ENOMEM;
+
+#ifdef HAVE_SPEEXDSP
+    {
+        int error;
+
+        rsmp->speex = speex_resampler_init(channelCount, inSampleRate,
+                                           outSampleRate, quality, &error);
+        if (!rsmp->speex) {
+            free(rsmp);
+            return -ENODEV;
+        }
+        speex_resampler_skip_zeros(rsmp->speex);
+    }
+#else
+    (void)quality;
+    rsmp->step = ((uint64_t)inSampleRate << 32) / outSampleRate;
+#endif
+
+    rsmp->itfe.reset = resampler_reset;
+    rsmp->itfe.resample_from_provider = resampler_resample_from_provider;
+    rsmp->itfe.resample_from_input = resampler_resample_from_input;
+    rsmp->itfe.delay_ns = resampler_delay_ns;
+    rsmp->provider = provider;
+    rsmp->in_rate = inSampleRate;
+    rsmp->out_rate = outSampleRate;
+    rsmp->channels = channelCount;
+
+    *resampler = &rsmp->itfe;
+    return 0;
+}
+
+void release_resampler(struct resampler_itfe *resampler)
+{
+    struct host_resampler *rsmp = (struct host_resampler *)resampler;
+
+    if (!rsmp)
+        return;
+#ifdef HAVE_SPEEXDSP
+    speex_resampler_destroy(rsmp->speex);
+#endif
+    free(rsmp->in_buf);
+    free(rsmp);
+}
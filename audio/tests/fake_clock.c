@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "fake_clock.h"
+
+static _Atomic int clock_mode = FAKE_CLOCK_REAL;
+
+/* time added to CLOCK_MONOTONIC by the simulated sleeps */
+static _Atomic int64_t clock_offset_ns;
+
+static int64_t timespec_to_ns(const struct timespec *ts)
+{
+    return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void ns_to_timespec(int64_t ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
+static int64_t real_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespec_to_ns(&ts);
+}
+
+void fake_clock_set_mode(enum fake_clock_mode mode)
+{
+    atomic_store(&clock_mode, mode);
+}
+
+enum fake_clock_mode fake_clock_get_mode(void)
+{
+    return atomic_load(&clock_mode);
+}
+
+int64_t fake_clock_now_ns(void)
+{
+    return real_now_ns() + atomic_load(&clock_offset_ns);
+}
+
+int64_t fake_clock_slept_ns(void)
+{
+    return atomic_load(&clock_offset_ns);
+}
+
+void fake_clock_sleep_ns(int64_t ns)
+{
+    struct timespec ts;
+
+    if (ns <= 0)
+        return;
+
+    if (atomic_load(&clock_mode) == FAKE_CLOCK_SIMULATED) {
+        atomic_fetch_add(&clock_offset_ns, ns);
+        /* let the other threads run, like a real sleep would */
+        sched_yield();
+        return;
+    }
+
+    ns_to_timespec(ns, &ts);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+}
+
+int fake_clock_gettime(clockid_t clock, struct timespec *ts)
+{
+    if (clock != CLOCK_MONOTONIC)
+        return clock_gettime(clock, ts);
+
+    ns_to_timespec(fake_clock_now_ns(), ts);
+    return 0;
+}
+
+int fake_usleep(useconds_t us)
+{
+    fake_clock_sleep_ns(us * 1000LL);
+    return 0;
+}
+
+/*
+ * The conditions of the HAL and the mocks wait on CLOCK_MONOTONIC: the
+ * deadline is converted back to the real clock. In simulated mode, a wait
+ * which times out moves the clock to the deadline.
+ */
+int fake_pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                                const struct timespec *abstime)
+{
+    int64_t deadline_ns = timespec_to_ns(abstime);
+    int64_t offset_ns = atomic_load(&clock_offset_ns);
+    struct timespec real_deadline;
+    int ret;
+
+    ns_to_timespec(deadline_ns - offset_ns, &real_deadline);
+    ret = pthread_cond_timedwait(cond, mutex, &real_deadline);
+
+    if (ret == ETIMEDOUT && atomic_load(&clock_mode) == FAKE_CLOCK_SIMULATED) {
+        int64_t late_ns = deadline_ns - fake_clock_now_ns();
+
+        if (late_ns > 0)
+            atomic_fetch_add(&clock_offset_ns, late_ns);
+    }
+    return ret;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Clock of the host tests.
+ *
+ * The HAL and the mocks are built with this header included first and
+ * FAKE_CLOCK_INTERPOSE defined, so that their calls to clock_gettime(),
+ * usleep() and pthread_cond_timedwait() go through the fake clock.
+ *
+ * In FAKE_CLOCK_REAL mode, the default, it is CLOCK_MONOTONIC and the
+ * sleeps are real. In FAKE_CLOCK_SIMULATED mode, a sleep returns at once
+ * and moves the clock forward instead, so that the audio of a stream is
+ * played in a fraction of its duration while the code still measures the
+ * elapsed time it expects: the time spent running code is real, the time
+ * spent sleeping is simulated. The clock is shared by all the threads, so
+ * two threads sleeping at the same time both move it forward; the timings
+ * are exact when a single thread paces the audio.
+ */
+
+#ifndef FAKE_CLOCK_H
+#define FAKE_CLOCK_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+enum fake_clock_mode {
+    FAKE_CLOCK_REAL,
+    FAKE_CLOCK_SIMULATED,
+};
+
+void fake_clock_set_mode(enum fake_clock_mode mode);
+enum fake_clock_mode fake_clock_get_mode(void);
+
+/* CLOCK_MONOTONIC of the HAL, in ns */
+int64_t fake_clock_now_ns(void);
+
+/* time simulated by the sleeps so far, in ns */
+int64_t fake_clock_slept_ns(void);
+
+void fake_clock_sleep_ns(int64_t ns);
+
+int fake_clock_gettime(clockid_t clock, struct timespec *ts);
+int fake_usleep(useconds_t us);
+int fake_pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                                const struct timespec *abstime);
+
+#ifdef FAKE_CLOCK_INTERPOSE
+#define clock_gettime fake_clock_gettime
+#define usleep fake_usleep
+#define pthread_cond_timedwait fake_pthread_cond_timedwait
+#endif
+
+#endif
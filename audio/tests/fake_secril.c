@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Modem client of the host tests: records the requests of ril_interface.c.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <secril-client.h>
+#include <telephony/ril.h>
+
+#include "fake.h"
+
+struct fake_client {
+    bool connected;
+    RilOnUnsolicited wb_amr_handler;
+};
+
+static pthread_mutex_t secril_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fake_client *the_client;
+static struct fake_secril_stats secril_stats;
+static unsigned int secril_delay_us;
+
+void fake_secril_set_delay_us(unsigned int us)
+{
+    secril_delay_us = us;
+}
+
+struct fake_secril_stats fake_secril_get_stats(void)
+{
+    struct fake_secril_stats stats;
+
+    pthread_mutex_lock(&secril_lock);
+    stats = secril_stats;
+    pthread_mutex_unlock(&secril_lock);
+    return stats;
+}
+
+void fake_secril_report_wb_amr(int enable)
+{
+    RilOnUnsolicited handler = NULL;
+    void *client;
+
+    pthread_mutex_lock(&secril_lock);
+    client = the_client;
+    if (client)
+        handler = the_client->wb_amr_handler;
+    pthread_mutex_unlock(&secril_lock);
+
+    if (handler)
+        handler(client, &enable, sizeof(enable));
+}
+
+/* the time taken by the RIL to answer a request */
+static void request(void)
+{
+    fake_clock_sleep_ns(secril_delay_us * 1000LL);
+}
+
+void *OpenClient_RILD(void)
+{
+    struct fake_client *client = calloc(1, sizeof(struct fake_client));
+
+    pthread_mutex_lock(&secril_lock);
+    the_client = client;
+    pthread_mutex_unlock(&secril_lock);
+    return client;
+}
+
+int CloseClient_RILD(void *client)
+{
+    pthread_mutex_lock(&secril_lock);
+    if (the_client == client)
+        the_client = NULL;
+    pthread_mutex_unlock(&secril_lock);
+    free(client);
+    return RIL_CLIENT_ERR_SUCCESS;
+}
+
+int Connect_RILD(void *client)
+{
+    ((struct fake_client *)client)->connected = true;
+    return RIL_CLIENT_ERR_SUCCESS;
+}
+
+int isConnected_RILD(void *client)
+{
+    return ((struct fake_client *)client)->connected;
+}
+
+int Disconnect_RILD(void *client)
+{
+    ((struct fake_client *)client)->connected = false;
+    return RIL_CLIENT_ERR_SUCCESS;
+}
+
+int RegisterUnsolicitedHandler(void *client, unsigned int id,
+                               RilOnUnsolicited handler)
+{
+    if (id != RIL_UNSOL_SNDMGR_WB_AMR_REPORT)
+        return RIL_CLIENT_ERR_INVAL;
+    pthread_mutex_lock(&secril_lock);
+    ((struct fake_client *)client)->wb_amr_handler = handler;
+    pthread_mutex_unlock(&secril_lock);
+    return RIL_CLIENT_ERR_SUCCESS;
+}
+
+int SetCallVolume(void *client __attribute__((unused)),
+                  enum _SoundType type __attribute__((unused)),
+                  int vol_level __attribute__((unused)))
+{
+    request();
+    pthread_mutex_lock(&secril_lock);
+    secril_stats.volumes++;
+    pthread_mutex_unlock(&secril_lock);
+    return RIL_CLIENT_ERR_SUCCESS;
+}
+
+int SetCallAudioPath(void *client __attribute__((unused)), enum _AudioPath path)
+{
+    request();
+    pthread_mutex_lock(&secril_lock);
+    secril_stats.audio_paths++;
+    secril_stats.audio_path = path;
+    pthread_mutex_unlock(&secril_lock);
+    return RIL_CLIENT_ERR_SUCCESS;
+}
+
+int SetCallClockSync(void *client __attribute__((unused)),
+                     enum _SoundClockCondition condition)
+{
+    request();
+    pthread_mutex_lock(&secril_lock);
+    secril_stats.clock_syncs++;
+    secril_stats.clock_sync = condition;
+    pthread_mutex_unlock(&secril_lock);
+    return RIL_CLIENT_ERR_SUCCESS;
+}
+
+int SetMute(void *client __attribute__((unused)),
+            enum _MuteCondition condition __attribute__((unused)))
+{
+    request();
+    pthread_mutex_lock(&secril_lock);
+    secril_stats.mutes++;
+    pthread_mutex_unlock(&secril_lock);
+    return RIL_CLIENT_ERR_SUCCESS;
+}
+
+int SetTwoMicControl(void *client __attribute__((unused)),
+                     enum __TwoMicSolDevice device __attribute__((unused)),
+                     enum __TwoMicSolReport report __attribute__((unused)))
+{
+    request();
+    pthread_mutex_lock(&secril_lock);
+    secril_stats.two_mic_controls++;
+    pthread_mutex_unlock(&secril_lock);
+    return RIL_CLIENT_ERR_SUCCESS;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of <audio_utils/resampler.h>, implemented by
+ * fake_audio_utils.c.
+ */
+
+#ifndef FAKE_AUDIO_UTILS_RESAMPLER_H
+#define FAKE_AUDIO_UTILS_RESAMPLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RESAMPLER_QUALITY_MAX 10
+#define RESAMPLER_QUALITY_MIN 0
+#define RESAMPLER_QUALITY_DEFAULT 4
+#define RESAMPLER_QUALITY_VOIP 3
+#define RESAMPLER_QUALITY_DESKTOP 5
+
+struct resampler_buffer {
+    union {
+        void *raw;
+        short *i16;
+        int8_t *i8;
+    };
+    size_t frame_count;
+};
+
+struct resampler_buffer_provider {
+    int (*get_next_buffer)(struct resampler_buffer_provider *provider,
+                           struct resampler_buffer *buffer);
+    void (*release_buffer)(struct resampler_buffer_provider *provider,
+                           struct resampler_buffer *buffer);
+};
+
+struct resampler_itfe {
+    void (*reset)(struct resampler_itfe *resampler);
+    int (*resample_from_provider)(struct resampler_itfe *resampler,
+                                  int16_t *out, size_t *outFrameCount);
+    int (*resample_from_input)(struct resampler_itfe *resampler,
+                               int16_t *in, size_t *inFrameCount,
+                               int16_t *out, size_t *outFrameCount);
+    int32_t (*delay_ns)(struct resampler_itfe *resampler);
+};
+
+int create_resampler(uint32_t inSampleRate, uint32_t outSampleRate,
+                     uint32_t channelCount, uint32_t quality,
+                     struct resampler_buffer_provider *provider,
+                     struct resampler_itfe **);
+void release_resampler(struct resampler_itfe *);
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of <cutils/log.h>. The messages are printed by fake_android.c,
+ * which also counts them so that the tests can check for errors. ALOGV()
+ * is compiled out unless LOG_NDEBUG is 0, like on the device.
+ */
+
+#ifndef FAKE_CUTILS_LOG_H
+#define FAKE_CUTILS_LOG_H
+
+#ifndef __unused
+#define __unused __attribute__((__unused__))
+#endif
+
+typedef enum android_LogPriority {
+    ANDROID_LOG_VERBOSE = 2,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+} android_LogPriority;
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#ifndef LOG_TAG
+#define LOG_TAG NULL
+#endif
+
+#ifndef LOG_NDEBUG
+#define LOG_NDEBUG 1
+#endif
+
+#define ALOG(prio, ...) __android_log_print(prio, LOG_TAG, __VA_ARGS__)
+
+#if LOG_NDEBUG
+#define ALOGV(...) do { if (0) ALOG(ANDROID_LOG_VERBOSE, __VA_ARGS__); } while (0)
+#else
+#define ALOGV(...) ALOG(ANDROID_LOG_VERBOSE, __VA_ARGS__)
+#endif
+#define ALOGD(...) ALOG(ANDROID_LOG_DEBUG, __VA_ARGS__)
+#define ALOGI(...) ALOG(ANDROID_LOG_INFO, __VA_ARGS__)
+#define ALOGW(...) ALOG(ANDROID_LOG_WARN, __VA_ARGS__)
+#define ALOGE(...) ALOG(ANDROID_LOG_ERROR, __VA_ARGS__)
+
+#define ALOGV_IF(cond, ...) do { if (cond) ALOGV(__VA_ARGS__); } while (0)
+#define ALOGW_IF(cond, ...) do { if (cond) ALOGW(__VA_ARGS__); } while (0)
+#define ALOGE_IF(cond, ...) do { if (cond) ALOGE(__VA_ARGS__); } while (0)
+
+#endif
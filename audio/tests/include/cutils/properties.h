@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of <cutils/properties.h>. The tests set the properties with
+ * property_set() before opening the HAL.
+ */
+
+#ifndef FAKE_CUTILS_PROPERTIES_H
+#define FAKE_CUTILS_PROPERTIES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PROPERTY_KEY_MAX 32
+#define PROPERTY_VALUE_MAX 92
+
+int property_get(const char *key, char *value, const char *default_value);
+bool property_get_bool(const char *key, bool default_value);
+int32_t property_get_int32(const char *key, int32_t default_value);
+int property_set(const char *key, const char *value);
+
+#endif
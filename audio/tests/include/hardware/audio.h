@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of <hardware/audio.h>: the audio HAL interface of the platform
+ * version targeted by the HAL.
+ */
+
+#ifndef FAKE_HARDWARE_AUDIO_H
+#define FAKE_HARDWARE_AUDIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <hardware/hardware.h>
+#include <system/audio.h>
+
+#define AUDIO_HARDWARE_MODULE_ID "audio"
+#define AUDIO_HARDWARE_INTERFACE "audio_hw_if"
+
+#define AUDIO_MODULE_API_VERSION_0_1 0x0001
+#define AUDIO_DEVICE_API_VERSION_2_0 0x0200
+
+#define AUDIO_PARAMETER_KEY_BT_NREC "bt_headset_nrec"
+#define AUDIO_PARAMETER_VALUE_ON "on"
+#define AUDIO_PARAMETER_VALUE_OFF "off"
+#define AUDIO_PARAMETER_DEVICE_CONNECT "connect"
+#define AUDIO_PARAMETER_DEVICE_DISCONNECT "disconnect"
+#define AUDIO_PARAMETER_STREAM_ROUTING "routing"
+#define AUDIO_PARAMETER_STREAM_INPUT_SOURCE "input_source"
+#define AUDIO_PARAMETER_STREAM_SUP_CHANNELS "sup_channels"
+#define AUDIO_OFFLOAD_CODEC_DELAY_SAMPLES "delay_samples"
+#define AUDIO_OFFLOAD_CODEC_PADDING_SAMPLES "padding_samples"
+
+typedef void *effect_handle_t;
+
+typedef enum {
+    STREAM_CBK_EVENT_WRITE_READY,
+    STREAM_CBK_EVENT_DRAIN_READY,
+} stream_callback_event_t;
+
+typedef int (*stream_callback_t)(stream_callback_event_t event, void *param,
+                                 void *cookie);
+
+typedef enum {
+    AUDIO_DRAIN_ALL,
+    AUDIO_DRAIN_EARLY_NOTIFY,
+} audio_drain_type_t;
+
+struct audio_config {
+    uint32_t sample_rate;
+    audio_channel_mask_t channel_mask;
+    audio_format_t format;
+    audio_offload_info_t offload_info;
+    size_t frame_count;
+};
+
+struct audio_stream {
+    uint32_t (*get_sample_rate)(const struct audio_stream *stream);
+    int (*set_sample_rate)(struct audio_stream *stream, uint32_t rate);
+    size_t (*get_buffer_size)(const struct audio_stream *stream);
+    audio_channel_mask_t (*get_channels)(const struct audio_stream *stream);
+    audio_format_t (*get_format)(const struct audio_stream *stream);
+    int (*set_format)(struct audio_stream *stream, audio_format_t format);
+    int (*standby)(struct audio_stream *stream);
+    int (*dump)(const struct audio_stream *stream, int fd);
+    audio_devices_t (*get_device)(const struct audio_stream *stream);
+    int (*set_device)(struct audio_stream *stream, audio_devices_t device);
+    int (*set_parameters)(struct audio_stream *stream, const char *kv_pairs);
+    char *(*get_parameters)(const struct audio_stream *stream,
+                            const char *keys);
+    int (*add_audio_effect)(const struct audio_stream *stream,
+                            effect_handle_t effect);
+    int (*remove_audio_effect)(const struct audio_stream *stream,
+                               effect_handle_t effect);
+};
+typedef struct audio_stream audio_stream_t;
+
+struct audio_stream_out {
+    struct audio_stream common;
+    uint32_t (*get_latency)(const struct audio_stream_out *stream);
+    int (*set_volume)(struct audio_stream_out *stream, float left, float right);
+    ssize_t (*write)(struct audio_stream_out *stream, const void *buffer,
+                     size_t bytes);
+    int (*get_render_position)(const struct audio_stream_out *stream,
+                               uint32_t *dsp_frames);
+    int (*get_next_write_timestamp)(const struct audio_stream_out *stream,
+                                    int64_t *timestamp);
+    int (*set_callback)(struct audio_stream_out *stream,
+                        stream_callback_t callback, void *cookie);
+    int (*pause)(struct audio_stream_out *stream);
+    int (*resume)(struct audio_stream_out *stream);
+    int (*drain)(struct audio_stream_out *stream, audio_drain_type_t type);
+    int (*flush)(struct audio_stream_out *stream);
+    int (*get_presentation_position)(const struct audio_stream_out *stream,
+                                     uint64_t *frames,
+                                     struct timespec *timestamp);
+};
+typedef struct audio_stream_out audio_stream_out_t;
+
+struct audio_stream_in {
+    struct audio_stream common;
+    int (*set_gain)(struct audio_stream_in *stream, float gain);
+    ssize_t (*read)(struct audio_stream_in *stream, void *buffer,
+                    size_t bytes);
+    uint32_t (*get_input_frames_lost)(struct audio_stream_in *stream);
+    int (*get_capture_position)(const struct audio_stream_in *stream,
+                                int64_t *frames, int64_t *time);
+};
+typedef struct audio_stream_in audio_stream_in_t;
+
+static inline size_t audio_stream_out_frame_size(const struct audio_stream_out *s)
+{
+    return audio_channel_count_from_out_mask(s->common.get_channels(&s->common)) *
+           audio_bytes_per_sample(s->common.get_format(&s->common));
+}
+
+static inline size_t audio_stream_in_frame_size(const struct audio_stream_in *s)
+{
+    return audio_channel_count_from_in_mask(s->common.get_channels(&s->common)) *
+           audio_bytes_per_sample(s->common.get_format(&s->common));
+}
+
+struct audio_module {
+    struct hw_module_t common;
+};
+
+struct audio_hw_device {
+    struct hw_device_t common;
+    uint32_t (*get_supported_devices)(const struct audio_hw_device *dev);
+    int (*init_check)(const struct audio_hw_device *dev);
+    int (*set_voice_volume)(struct audio_hw_device *dev, float volume);
+    int (*set_master_volume)(struct audio_hw_device *dev, float volume);
+    int (*get_master_volume)(struct audio_hw_device *dev, float *volume);
+    int (*set_mode)(struct audio_hw_device *dev, audio_mode_t mode);
+    int (*set_mic_mute)(struct audio_hw_device *dev, bool state);
+    int (*get_mic_mute)(const struct audio_hw_device *dev, bool *state);
+    int (*set_parameters)(struct audio_hw_device *dev, const char *kv_pairs);
+    char *(*get_parameters)(const struct audio_hw_device *dev,
+                            const char *keys);
+    size_t (*get_input_buffer_size)(const struct audio_hw_device *dev,
+                                    const struct audio_config *config);
+    int (*open_output_stream)(struct audio_hw_device *dev,
+                              audio_io_handle_t handle,
+                              audio_devices_t devices,
+                              audio_output_flags_t flags,
+                              struct audio_config *config,
+                              struct audio_stream_out **stream_out,
+                              const char *address);
+    void (*close_output_stream)(struct audio_hw_device *dev,
+                                struct audio_stream_out *stream_out);
+    int (*open_input_stream)(struct audio_hw_device *dev,
+                             audio_io_handle_t handle,
+                             audio_devices_t devices,
+                             struct audio_config *config,
+                             struct audio_stream_in **stream_in,
+                             audio_input_flags_t flags,
+                             const char *address,
+                             audio_source_t source);
+    void (*close_input_stream)(struct audio_hw_device *dev,
+                               struct audio_stream_in *stream_in);
+    int (*dump)(const struct audio_hw_device *dev, int fd);
+};
+typedef struct audio_hw_device audio_hw_device_t;
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host stub of the Exynos TV out controls of <linux/videodev2_exynos_media.h> */
+
+#ifndef FAKE_VIDEODEV2_EXYNOS_MEDIA_H
+#define FAKE_VIDEODEV2_EXYNOS_MEDIA_H
+
+#include <linux/videodev2.h>
+
+#define V4L2_CID_TV_HPD_STATUS (V4L2_CID_PRIVATE_BASE + 55)
+#define V4L2_CID_TV_ENABLE_HDMI_AUDIO (V4L2_CID_PRIVATE_BASE + 56)
+#define V4L2_CID_TV_SET_NUM_CHANNELS (V4L2_CID_PRIVATE_BASE + 57)
+#define V4L2_CID_TV_MAX_AUDIO_CHANNELS (V4L2_CID_PRIVATE_BASE + 64)
+
+#endif
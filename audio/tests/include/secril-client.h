@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of libsecril-client, implemented by fake_secril.c, which
+ * records the requests of the HAL to the modem.
+ */
+
+#ifndef FAKE_SECRIL_CLIENT_H
+#define FAKE_SECRIL_CLIENT_H
+
+#include <stddef.h>
+
+#define RIL_CLIENT_ERR_SUCCESS 0
+#define RIL_CLIENT_ERR_AGAIN 1
+#define RIL_CLIENT_ERR_INIT 2
+#define RIL_CLIENT_ERR_INVAL 3
+#define RIL_CLIENT_ERR_CONNECT 4
+#define RIL_CLIENT_ERR_IO 5
+#define RIL_CLIENT_ERR_RESOURCE 6
+#define RIL_CLIENT_ERR_UNKNOWN 7
+
+enum _SoundType {
+    SOUND_TYPE_VOICE,
+    SOUND_TYPE_SPEAKER,
+    SOUND_TYPE_HEADSET,
+    SOUND_TYPE_BTVOICE,
+};
+
+enum _AudioPath {
+    SOUND_AUDIO_PATH_HANDSET,
+    SOUND_AUDIO_PATH_HEADSET,
+    SOUND_AUDIO_PATH_SPEAKER,
+    SOUND_AUDIO_PATH_BLUETOOTH,
+    SOUND_AUDIO_PATH_STEREO_BT,
+    SOUND_AUDIO_PATH_HEADPHONE,
+    SOUND_AUDIO_PATH_BLUETOOTH_NO_NR,
+};
+
+enum _SoundClockCondition {
+    SOUND_CLOCK_STOP,
+    SOUND_CLOCK_START,
+};
+
+enum _MuteCondition {
+    TX_UNMUTE,
+    TX_MUTE,
+};
+
+enum __TwoMicSolDevice {
+    AUDIENCE,
+    FORTEMEDIA,
+};
+
+enum __TwoMicSolReport {
+    TWO_MIC_SOLUTION_OFF,
+    TWO_MIC_SOLUTION_ON,
+};
+
+typedef int (*RilOnUnsolicited)(void *client, const void *data, size_t datalen);
+
+void *OpenClient_RILD(void);
+int CloseClient_RILD(void *client);
+int Connect_RILD(void *client);
+int isConnected_RILD(void *client);
+int Disconnect_RILD(void *client);
+int RegisterUnsolicitedHandler(void *client, unsigned int id,
+                               RilOnUnsolicited handler);
+
+int SetCallVolume(void *client, enum _SoundType type, int vol_level);
+int SetCallAudioPath(void *client, enum _AudioPath path);
+int SetCallClockSync(void *client, enum _SoundClockCondition condition);
+int SetMute(void *client, enum _MuteCondition condition);
+int SetTwoMicControl(void *client, enum __TwoMicSolDevice device,
+                     enum __TwoMicSolReport report);
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of <system/audio.h>: the types, constants and helpers used by
+ * the HAL, with the values of the platform headers.
+ */
+
+#ifndef FAKE_SYSTEM_AUDIO_H
+#define FAKE_SYSTEM_AUDIO_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+typedef int audio_io_handle_t;
+typedef int audio_source_t;
+typedef int audio_mode_t;
+typedef uint32_t audio_devices_t;
+typedef uint32_t audio_channel_mask_t;
+typedef uint32_t audio_format_t;
+typedef uint32_t audio_output_flags_t;
+typedef uint32_t audio_input_flags_t;
+
+enum {
+    AUDIO_SOURCE_DEFAULT = 0,
+    AUDIO_SOURCE_MIC = 1,
+    AUDIO_SOURCE_VOICE_UPLINK = 2,
+    AUDIO_SOURCE_VOICE_DOWNLINK = 3,
+    AUDIO_SOURCE_VOICE_CALL = 4,
+    AUDIO_SOURCE_CAMCORDER = 5,
+    AUDIO_SOURCE_VOICE_RECOGNITION = 6,
+    AUDIO_SOURCE_VOICE_COMMUNICATION = 7,
+};
+
+enum {
+    AUDIO_MODE_NORMAL = 0,
+    AUDIO_MODE_RINGTONE = 1,
+    AUDIO_MODE_IN_CALL = 2,
+    AUDIO_MODE_IN_COMMUNICATION = 3,
+};
+
+enum {
+    AUDIO_FORMAT_DEFAULT = 0,
+    AUDIO_FORMAT_PCM_16_BIT = 0x1,
+    AUDIO_FORMAT_PCM_8_BIT = 0x2,
+    AUDIO_FORMAT_PCM_32_BIT = 0x3,
+    AUDIO_FORMAT_PCM_8_24_BIT = 0x4,
+    AUDIO_FORMAT_PCM_FLOAT = 0x5,
+    AUDIO_FORMAT_PCM_24_BIT_PACKED = 0x6,
+    AUDIO_FORMAT_MP3 = 0x01000000,
+    AUDIO_FORMAT_AAC = 0x04000000,
+};
+
+#define AUDIO_FORMAT_MAIN_MASK 0xFF000000u
+
+enum {
+    AUDIO_CHANNEL_OUT_MONO = 0x1,
+    AUDIO_CHANNEL_OUT_STEREO = 0x3,
+    AUDIO_CHANNEL_OUT_5POINT1 = 0x3f,
+    AUDIO_CHANNEL_OUT_7POINT1 = 0x63f,
+    AUDIO_CHANNEL_IN_LEFT = 0x4,
+    AUDIO_CHANNEL_IN_RIGHT = 0x8,
+    AUDIO_CHANNEL_IN_FRONT = 0x10,
+    AUDIO_CHANNEL_IN_MONO = AUDIO_CHANNEL_IN_FRONT,
+    AUDIO_CHANNEL_IN_STEREO = AUDIO_CHANNEL_IN_LEFT | AUDIO_CHANNEL_IN_RIGHT,
+};
+
+enum {
+    AUDIO_DEVICE_NONE = 0x0,
+    AUDIO_DEVICE_BIT_IN = 0x80000000u,
+    AUDIO_DEVICE_OUT_EARPIECE = 0x1,
+    AUDIO_DEVICE_OUT_SPEAKER = 0x2,
+    AUDIO_DEVICE_OUT_WIRED_HEADSET = 0x4,
+    AUDIO_DEVICE_OUT_WIRED_HEADPHONE = 0x8,
+    AUDIO_DEVICE_OUT_BLUETOOTH_SCO = 0x10,
+    AUDIO_DEVICE_OUT_BLUETOOTH_SCO_HEADSET = 0x20,
+    AUDIO_DEVICE_OUT_BLUETOOTH_SCO_CARKIT = 0x40,
+    AUDIO_DEVICE_OUT_AUX_DIGITAL = 0x400,
+    AUDIO_DEVICE_OUT_DGTL_DOCK_HEADSET = 0x1000,
+    AUDIO_DEVICE_OUT_ALL_SCO = 0x70,
+    AUDIO_DEVICE_IN_BUILTIN_MIC = 0x80000004u,
+    AUDIO_DEVICE_IN_BLUETOOTH_SCO_HEADSET = 0x80000008u,
+    AUDIO_DEVICE_IN_WIRED_HEADSET = 0x80000010u,
+    AUDIO_DEVICE_IN_BACK_MIC = 0x80000080u,
+};
+
+enum {
+    AUDIO_OUTPUT_FLAG_NONE = 0x0,
+    AUDIO_OUTPUT_FLAG_DIRECT = 0x1,
+    AUDIO_OUTPUT_FLAG_PRIMARY = 0x2,
+    AUDIO_OUTPUT_FLAG_FAST = 0x4,
+    AUDIO_OUTPUT_FLAG_DEEP_BUFFER = 0x8,
+    AUDIO_OUTPUT_FLAG_COMPRESS_OFFLOAD = 0x10,
+    AUDIO_OUTPUT_FLAG_NON_BLOCKING = 0x20,
+};
+
+enum {
+    AUDIO_INPUT_FLAG_NONE = 0x0,
+    AUDIO_INPUT_FLAG_FAST = 0x1,
+};
+
+typedef struct {
+    uint16_t version;
+    uint16_t size;
+    uint32_t sample_rate;
+    audio_channel_mask_t channel_mask;
+    audio_format_t format;
+    int stream_type;
+    uint32_t bit_rate;
+    int64_t duration_us;
+    bool has_video;
+    bool is_streaming;
+} audio_offload_info_t;
+
+static inline int popcount(uint32_t u)
+{
+    return __builtin_popcount(u);
+}
+
+static inline size_t audio_bytes_per_sample(audio_format_t format)
+{
+    switch (format) {
+    case AUDIO_FORMAT_PCM_8_BIT:
+        return 1;
+    case AUDIO_FORMAT_PCM_16_BIT:
+        return 2;
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+        return 3;
+    case AUDIO_FORMAT_PCM_32_BIT:
+    case AUDIO_FORMAT_PCM_8_24_BIT:
+    case AUDIO_FORMAT_PCM_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static inline uint32_t audio_channel_count_from_in_mask(audio_channel_mask_t mask)
+{
+    return popcount(mask & (AUDIO_CHANNEL_IN_LEFT | AUDIO_CHANNEL_IN_RIGHT |
+                            AUDIO_CHANNEL_IN_FRONT));
+}
+
+static inline uint32_t audio_channel_count_from_out_mask(audio_channel_mask_t mask)
+{
+    return popcount(mask);
+}
+
+#endif
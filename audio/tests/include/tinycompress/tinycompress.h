@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stub of <tinycompress/tinycompress.h>, implemented by the mock
+ * compress device of the HAL, compress_mock.c.
+ */
+
+#ifndef FAKE_TINYCOMPRESS_H
+#define FAKE_TINYCOMPRESS_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <linux/types.h>
+
+#define COMPRESS_OUT 0x20000000
+#define COMPRESS_IN 0x10000000
+
+struct compress;
+struct snd_codec;
+
+struct compr_config {
+    __u32 fragment_size;
+    __u32 fragments;
+    struct snd_codec *codec;
+};
+
+struct compr_gapless_mdata {
+    __u32 encoder_delay;
+    __u32 encoder_padding;
+};
+
+struct compress *compress_open(unsigned int card, unsigned int device,
+                               unsigned int flags, struct compr_config *config);
+void compress_close(struct compress *compress);
+int is_compress_ready(struct compress *compress);
+int is_compress_running(struct compress *compress);
+const char *compress_get_error(struct compress *compress);
+bool is_codec_supported(unsigned int card, unsigned int device,
+                        unsigned int flags, struct snd_codec *codec);
+
+void compress_set_max_poll_wait(struct compress *compress, int milliseconds);
+void compress_nonblock(struct compress *compress, int nonblock);
+int compress_write(struct compress *compress, const void *buf,
+                   unsigned int size);
+int compress_read(struct compress *compress, void *buf, unsigned int size);
+int compress_wait(struct compress *compress, int timeout_ms);
+
+int compress_start(struct compress *compress);
+int compress_stop(struct compress *compress);
+int compress_pause(struct compress *compress);
+int compress_resume(struct compress *compress);
+int compress_drain(struct compress *compress);
+int compress_partial_drain(struct compress *compress);
+int compress_next_track(struct compress *compress);
+int compress_set_gapless_metadata(struct compress *compress,
+                                  struct compr_gapless_mdata *mdata);
+
+int compress_get_hpointer(struct compress *compress, unsigned int *avail,
+                          struct timespec *tstamp);
+int compress_get_tstamp(struct compress *compress, unsigned long *samples,
+                        unsigned int *sampling_rate);
+
+#endif
@@ -0,0 +1,659 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The NEON intrinsics dsp.c uses, in plain C, so that its NEON versions
+ * can be built and checked on the host where there is no ARM toolchain:
+ * dsp.c is built with __ARM_NEON defined and this directory first in the
+ * include path, see the Makefile and dsp_ref.h.
+ *
+ * Each intrinsic computes what the ARM reference manual specifies for its
+ * instruction, lane by lane, including the wrapping, saturation, rounding
+ * and truncation of the results. The vector types are structures, so the
+ * code which uses them must not rely on operators or on casts between
+ * them, which the compilers for ARM would accept. Floats are computed
+ * without flushing denormals to zero, which ARMv7 NEON does: dsp.c scales
+ * the floats by 2^23 before rounding them, the denormals round to 0
+ * either way.
+ */
+
+#ifndef TEST_ARM_NEON_H
+#define TEST_ARM_NEON_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct { int16_t v[4]; } int16x4_t;
+typedef struct { int16_t v[8]; } int16x8_t;
+typedef struct { int32_t v[2]; } int32x2_t;
+typedef struct { int32_t v[4]; } int32x4_t;
+typedef struct { int64_t v[2]; } int64x2_t;
+typedef struct { uint8_t v[8]; } uint8x8_t;
+typedef struct { uint16_t v[4]; } uint16x4_t;
+typedef struct { uint16_t v[8]; } uint16x8_t;
+typedef struct { uint32_t v[2]; } uint32x2_t;
+typedef struct { uint32_t v[4]; } uint32x4_t;
+typedef struct { float v[4]; } float32x4_t;
+
+typedef struct { int16x4_t val[2]; } int16x4x2_t;
+typedef struct { int16x8_t val[2]; } int16x8x2_t;
+typedef struct { uint8x8_t val[3]; } uint8x8x3_t;
+
+static inline int16_t neon_sat_s16(int64_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : (int16_t)v;
+}
+
+/* Loads and stores */
+
+static inline int16x4_t vld1_lane_s16(const int16_t *p, int16x4_t a, int lane)
+{
+    a.v[lane] = *p;
+    return a;
+}
+
+static inline void vst1_lane_s16(int16_t *p, int16x4_t a, int lane)
+{
+    *p = a.v[lane];
+}
+
+static inline int16x8_t vld1q_s16(const int16_t *p)
+{
+    int16x8_t r;
+
+    memcpy(r.v, p, sizeof(r.v));
+    return r;
+}
+
+static inline void vst1q_s16(int16_t *p, int16x8_t a)
+{
+    memcpy(p, a.v, sizeof(a.v));
+}
+
+static inline uint16x8_t vld1q_u16(const uint16_t *p)
+{
+    uint16x8_t r;
+
+    memcpy(r.v, p, sizeof(r.v));
+    return r;
+}
+
+static inline int32x4_t vld1q_s32(const int32_t *p)
+{
+    int32x4_t r;
+
+    memcpy(r.v, p, sizeof(r.v));
+    return r;
+}
+
+static inline void vst1q_s32(int32_t *p, int32x4_t a)
+{
+    memcpy(p, a.v, sizeof(a.v));
+}
+
+static inline uint32x4_t vld1q_u32(const uint32_t *p)
+{
+    uint32x4_t r;
+
+    memcpy(r.v, p, sizeof(r.v));
+    return r;
+}
+
+static inline float32x4_t vld1q_f32(const float *p)
+{
+    float32x4_t r;
+
+    memcpy(r.v, p, sizeof(r.v));
+    return r;
+}
+
+/* de-interleaving loads and interleaving stores */
+static inline int16x4x2_t vld2_s16(const int16_t *p)
+{
+    int16x4x2_t r;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        r.val[0].v[i] = p[2 * i];
+        r.val[1].v[i] = p[2 * i + 1];
+    }
+    return r;
+}
+
+static inline void vst2_s16(int16_t *p, int16x4x2_t a)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        p[2 * i] = a.val[0].v[i];
+        p[2 * i + 1] = a.val[1].v[i];
+    }
+}
+
+static inline int16x4x2_t vld2_lane_s16(const int16_t *p, int16x4x2_t a,
+                                        int lane)
+{
+    a.val[0].v[lane] = p[0];
+    a.val[1].v[lane] = p[1];
+    return a;
+}
+
+static inline void vst2_lane_s16(int16_t *p, int16x4x2_t a, int lane)
+{
+    p[0] = a.val[0].v[lane];
+    p[1] = a.val[1].v[lane];
+}
+
+static inline int16x8x2_t vld2q_s16(const int16_t *p)
+{
+    int16x8x2_t r;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        r.val[0].v[i] = p[2 * i];
+        r.val[1].v[i] = p[2 * i + 1];
+    }
+    return r;
+}
+
+static inline uint8x8x3_t vld3_u8(const uint8_t *p)
+{
+    uint8x8x3_t r;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        r.val[0].v[i] = p[3 * i];
+        r.val[1].v[i] = p[3 * i + 1];
+        r.val[2].v[i] = p[3 * i + 2];
+    }
+    return r;
+}
+
+/* Lanes */
+
+static inline int16x4_t vdup_n_s16(int16_t x)
+{
+    int16x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = x;
+    return r;
+}
+
+static inline int16x8_t vdupq_n_s16(int16_t x)
+{
+    int16x8_t r;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        r.v[i] = x;
+    return r;
+}
+
+static inline uint16x8_t vdupq_n_u16(uint16_t x)
+{
+    uint16x8_t r;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        r.v[i] = x;
+    return r;
+}
+
+static inline uint32x4_t vdupq_n_u32(uint32_t x)
+{
+    uint32x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = x;
+    return r;
+}
+
+static inline int32x4_t vdupq_n_s32(int32_t x)
+{
+    int32x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = x;
+    return r;
+}
+
+static inline float32x4_t vdupq_n_f32(float x)
+{
+    float32x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = x;
+    return r;
+}
+
+static inline int32_t vgetq_lane_s32(int32x4_t a, int lane)
+{
+    return a.v[lane];
+}
+
+static inline int16x4_t vget_low_s16(int16x8_t a)
+{
+    int16x4_t r;
+
+    memcpy(r.v, a.v, sizeof(r.v));
+    return r;
+}
+
+static inline int16x4_t vget_high_s16(int16x8_t a)
+{
+    int16x4_t r;
+
+    memcpy(r.v, a.v + 4, sizeof(r.v));
+    return r;
+}
+
+static inline uint16x4_t vget_low_u16(uint16x8_t a)
+{
+    uint16x4_t r;
+
+    memcpy(r.v, a.v, sizeof(r.v));
+    return r;
+}
+
+static inline uint16x4_t vget_high_u16(uint16x8_t a)
+{
+    uint16x4_t r;
+
+    memcpy(r.v, a.v + 4, sizeof(r.v));
+    return r;
+}
+
+static inline int32x2_t vget_low_s32(int32x4_t a)
+{
+    int32x2_t r;
+
+    memcpy(r.v, a.v, sizeof(r.v));
+    return r;
+}
+
+static inline int32x2_t vget_high_s32(int32x4_t a)
+{
+    int32x2_t r;
+
+    memcpy(r.v, a.v + 2, sizeof(r.v));
+    return r;
+}
+
+static inline uint32x2_t vget_low_u32(uint32x4_t a)
+{
+    uint32x2_t r;
+
+    memcpy(r.v, a.v, sizeof(r.v));
+    return r;
+}
+
+static inline uint32x2_t vget_high_u32(uint32x4_t a)
+{
+    uint32x2_t r;
+
+    memcpy(r.v, a.v + 2, sizeof(r.v));
+    return r;
+}
+
+static inline int32x4_t vcombine_s32(int32x2_t lo, int32x2_t hi)
+{
+    int32x4_t r;
+
+    memcpy(r.v, lo.v, sizeof(lo.v));
+    memcpy(r.v + 2, hi.v, sizeof(hi.v));
+    return r;
+}
+
+static inline int16x8_t vcombine_s16(int16x4_t lo, int16x4_t hi)
+{
+    int16x8_t r;
+
+    memcpy(r.v, lo.v, sizeof(lo.v));
+    memcpy(r.v + 4, hi.v, sizeof(hi.v));
+    return r;
+}
+
+/* Reinterpretation, the bits are kept */
+
+static inline int32x2_t vreinterpret_s32_u32(uint32x2_t a)
+{
+    int32x2_t r;
+
+    memcpy(&r, &a, sizeof(r));
+    return r;
+}
+
+static inline int32x4_t vreinterpretq_s32_u32(uint32x4_t a)
+{
+    int32x4_t r;
+
+    memcpy(&r, &a, sizeof(r));
+    return r;
+}
+
+/* Widening and narrowing */
+
+static inline int32x4_t vmovl_s16(int16x4_t a)
+{
+    int32x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = a.v[i];
+    return r;
+}
+
+static inline uint32x4_t vmovl_u16(uint16x4_t a)
+{
+    uint32x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = a.v[i];
+    return r;
+}
+
+static inline uint16x8_t vmovl_u8(uint8x8_t a)
+{
+    uint16x8_t r;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        r.v[i] = a.v[i];
+    return r;
+}
+
+static inline uint16x8_t vshll_n_u8(uint8x8_t a, int n)
+{
+    uint16x8_t r;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        r.v[i] = (uint16_t)(a.v[i] << n);
+    return r;
+}
+
+/* shift right and keep the low half */
+static inline int16x4_t vshrn_n_s32(int32x4_t a, int n)
+{
+    int16x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = (int16_t)(uint16_t)(a.v[i] >> n);
+    return r;
+}
+
+static inline int32x2_t vshrn_n_s64(int64x2_t a, int n)
+{
+    int32x2_t r;
+    int i;
+
+    for (i = 0; i < 2; i++)
+        r.v[i] = (int32_t)(uint32_t)(a.v[i] >> n);
+    return r;
+}
+
+/* shift right with rounding, and saturate */
+static inline int16x4_t vqrshrn_n_s32(int32x4_t a, int n)
+{
+    int16x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = neon_sat_s16(((int64_t)a.v[i] + (1 << (n - 1))) >> n);
+    return r;
+}
+
+/* Arithmetic */
+
+static inline uint16x8_t vaddq_u16(uint16x8_t a, uint16x8_t b)
+{
+    uint16x8_t r;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        r.v[i] = (uint16_t)(a.v[i] + b.v[i]);
+    return r;
+}
+
+static inline uint32x4_t vaddq_u32(uint32x4_t a, uint32x4_t b)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        a.v[i] += b.v[i];
+    return a;
+}
+
+static inline int16x4_t vqadd_s16(int16x4_t a, int16x4_t b)
+{
+    int16x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = neon_sat_s16(a.v[i] + b.v[i]);
+    return r;
+}
+
+/* (a + b) >> 1 without overflow */
+static inline int16x8_t vhaddq_s16(int16x8_t a, int16x8_t b)
+{
+    int16x8_t r;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        r.v[i] = (int16_t)((a.v[i] + b.v[i]) >> 1);
+    return r;
+}
+
+/* (2 * a * b) >> 16, saturated */
+static inline int16x4_t vqdmulh_s16(int16x4_t a, int16x4_t b)
+{
+    int16x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = neon_sat_s16((2 * (int64_t)a.v[i] * b.v[i]) >> 16);
+    return r;
+}
+
+/* the low 32 bits of the products */
+static inline int32x4_t vmulq_s32(int32x4_t a, int32x4_t b)
+{
+    int32x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = (int32_t)((uint32_t)a.v[i] * (uint32_t)b.v[i]);
+    return r;
+}
+
+static inline int64x2_t vmull_s32(int32x2_t a, int32x2_t b)
+{
+    int64x2_t r;
+    int i;
+
+    for (i = 0; i < 2; i++)
+        r.v[i] = (int64_t)a.v[i] * b.v[i];
+    return r;
+}
+
+/* the sums wrap modulo 2^32 */
+static inline int32x4_t vmlal_s16(int32x4_t acc, int16x4_t a, int16x4_t b)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        acc.v[i] = (int32_t)((uint32_t)acc.v[i] +
+                             (uint32_t)(a.v[i] * b.v[i]));
+    return acc;
+}
+
+static inline int32x4_t vmlal_n_s16(int32x4_t acc, int16x4_t a, int16_t b)
+{
+    return vmlal_s16(acc, a, vdup_n_s16(b));
+}
+
+static inline int32x4_t vmaxq_s32(int32x4_t a, int32x4_t b)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+    return a;
+}
+
+static inline int32x4_t vminq_s32(int32x4_t a, int32x4_t b)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i];
+    return a;
+}
+
+static inline float32x4_t vaddq_f32(float32x4_t a, float32x4_t b)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        a.v[i] += b.v[i];
+    return a;
+}
+
+static inline float32x4_t vmulq_n_f32(float32x4_t a, float b)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        a.v[i] *= b;
+    return a;
+}
+
+/* Bitwise operations and shifts */
+
+static inline uint16x8_t vorrq_u16(uint16x8_t a, uint16x8_t b)
+{
+    int i;
+
+    for (i = 0; i < 8; i++)
+        a.v[i] |= b.v[i];
+    return a;
+}
+
+static inline uint32x4_t vandq_u32(uint32x4_t a, uint32x4_t b)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        a.v[i] &= b.v[i];
+    return a;
+}
+
+static inline uint32x4_t vorrq_u32(uint32x4_t a, uint32x4_t b)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        a.v[i] |= b.v[i];
+    return a;
+}
+
+static inline uint32x4_t vshlq_n_u32(uint32x4_t a, int n)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        a.v[i] <<= n;
+    return a;
+}
+
+static inline int32x4_t vshrq_n_s32(int32x4_t a, int n)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        a.v[i] >>= n;
+    return a;
+}
+
+/* Floating point comparisons and conversion */
+
+/* all ones when the comparison is true, false for NaN */
+static inline uint32x4_t vcgtq_f32(float32x4_t a, float32x4_t b)
+{
+    uint32x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = a.v[i] > b.v[i] ? UINT32_MAX : 0;
+    return r;
+}
+
+static inline uint32x4_t vcltq_f32(float32x4_t a, float32x4_t b)
+{
+    uint32x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        r.v[i] = a.v[i] < b.v[i] ? UINT32_MAX : 0;
+    return r;
+}
+
+/* the bits of a where the mask is set, of b elsewhere */
+static inline float32x4_t vbslq_f32(uint32x4_t mask, float32x4_t a,
+                                    float32x4_t b)
+{
+    float32x4_t r;
+    uint32_t x, y;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        memcpy(&x, &a.v[i], sizeof(x));
+        memcpy(&y, &b.v[i], sizeof(y));
+        x = (x & mask.v[i]) | (y & ~mask.v[i]);
+        memcpy(&r.v[i], &x, sizeof(x));
+    }
+    return r;
+}
+
+/* rounds toward zero and saturates, NaN gives 0 */
+static inline int32x4_t vcvtq_s32_f32(float32x4_t a)
+{
+    int32x4_t r;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        if (isnan(a.v[i]))
+            r.v[i] = 0;
+        else if (a.v[i] >= 2147483648.0f)
+            r.v[i] = INT32_MAX;
+        else if (a.v[i] < -2147483648.0f)
+            r.v[i] = INT32_MIN;
+        else
+            r.v[i] = (int32_t)a.v[i];
+    }
+    return r;
+}
+
+#endif
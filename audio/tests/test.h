@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Helpers of the host tests and benchmarks: checks, and opening the HAL
+ * and its streams through the audio_hw_device interface, as AudioFlinger
+ * does.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <audio_utils/resampler.h>
+#include <hardware/audio.h>
+#include <hardware/hardware.h>
+
+#include "fake.h"
+#include <secril-client.h>
+
+static int test_failures;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: %s: CHECK(%s) failed\n",            \
+                    __FILE__, __LINE__, __func__, #cond);               \
+            test_failures++;                                            \
+        }                                                               \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                  \
+    do {                                                                \
+        long long _a = (long long)(a), _b = (long long)(b);             \
+        if (_a != _b) {                                                 \
+            fprintf(stderr, "%s:%d: %s: %s == %s failed: %lld != %lld\n", \
+                    __FILE__, __LINE__, __func__, #a, #b, _a, _b);      \
+            test_failures++;                                            \
+        }                                                               \
+    } while (0)
+
+#define CHECK_RANGE(a, min, max)                                        \
+    do {                                                                \
+        double _a = (double)(a);                                        \
+        if (_a < (double)(min) || _a > (double)(max)) {                 \
+            fprintf(stderr, "%s:%d: %s: %s = %g not in [%g, %g]\n",     \
+                    __FILE__, __LINE__, __func__, #a, _a,               \
+                    (double)(min), (double)(max));                      \
+            test_failures++;                                            \
+        }                                                               \
+    } while (0)
+
+#define RUN_TEST(test)                                                  \
+    do {                                                                \
+        int _failures = test_failures;                                  \
+        test();                                                         \
+        printf("%s %s\n", test_failures == _failures ? "PASS" : "FAIL", \
+               #test);                                                  \
+    } while (0)
+
+static inline int test_result(void)
+{
+    if (test_failures)
+        printf("%d check(s) failed\n", test_failures);
+    return test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* deterministic pseudo random numbers, xorshift32 */
+static uint32_t test_seed = 2463534242u;
+
+static inline uint32_t test_rand(void)
+{
+    test_seed ^= test_seed << 13;
+    test_seed ^= test_seed >> 17;
+    test_seed ^= test_seed << 5;
+    return test_seed;
+}
+
+/* random 16 bit samples, with full scale values at both ends */
+static inline void test_fill_s16(int16_t *buf, size_t samples)
+{
+    size_t i;
+
+    for (i = 0; i < samples; i++)
+        buf[i] = (int16_t)test_rand();
+    if (samples > 0)
+        buf[0] = INT16_MIN;
+    if (samples > 1)
+        buf[samples - 1] = INT16_MAX;
+}
+
+/* a sine of amplitude amp, 1 being full scale, on all the channels */
+static inline void test_sine_s16(int16_t *buf, size_t frames,
+                                 unsigned int channels, double freq,
+                                 double rate, double amp)
+{
+    size_t i;
+    unsigned int c;
+
+    for (i = 0; i < frames; i++) {
+        int16_t v = (int16_t)lrint(32767.0 * amp *
+                                   sin(2 * M_PI * freq * i / rate));
+
+        for (c = 0; c < channels; c++)
+            buf[i * channels + c] = v;
+    }
+}
+
+/*
+ * Amplitude of the sine of frequency freq in the first channel of buf,
+ * 1 being full scale, and in thd_n_db if not NULL, the level of all the
+ * rest relative to it. The frames must hold a whole number of cycles.
+ */
+static inline double test_sine_level(const int16_t *buf, size_t frames,
+                                     unsigned int channels, double freq,
+                                     double rate, double *thd_n_db)
+{
+    double re = 0.0, im = 0.0, mean = 0.0, amp, residual = 0.0;
+    size_t i;
+
+    for (i = 0; i < frames; i++) {
+        double x = buf[i * channels] / 32767.0;
+
+        re += x * sin(2 * M_PI * freq * i / rate);
+        im += x * cos(2 * M_PI * freq * i / rate);
+        mean += x;
+    }
+    re *= 2.0 / frames;
+    im *= 2.0 / frames;
+    mean /= frames;
+    amp = sqrt(re * re + im * im);
+
+    if (thd_n_db) {
+        for (i = 0; i < frames; i++) {
+            double d = buf[i * channels] / 32767.0 - mean -
+                       re * sin(2 * M_PI * freq * i / rate) -
+                       im * cos(2 * M_PI * freq * i / rate);
+
+            residual += d * d;
+        }
+        *thd_n_db = 10 * log10(residual / frames / (amp * amp / 2));
+    }
+
+    return amp;
+}
+
+/* gives a resampler the frames of a buffer, chunk frames at a time */
+struct test_provider {
+    struct resampler_buffer_provider provider;
+    const int16_t *data;
+    size_t frames;
+    size_t pos;
+    size_t chunk;
+    unsigned int channels;
+};
+
+static inline int test_provider_get(struct resampler_buffer_provider *provider,
+                                    struct resampler_buffer *buffer)
+{
+    struct test_provider *p = (struct test_provider *)provider;
+    size_t frames = p->frames - p->pos;
+
+    if (frames > p->chunk)
+        frames = p->chunk;
+    if (frames > buffer->frame_count)
+        frames = buffer->frame_count;
+    if (frames == 0) {
+        buffer->raw = NULL;
+        buffer->frame_count = 0;
+        return -ENODATA;
+    }
+    buffer->i16 = (short *)p->data + p->pos * p->channels;
+    buffer->frame_count = frames;
+    return 0;
+}
+
+static inline void test_provider_release(
+        struct resampler_buffer_provider *provider,
+        struct resampler_buffer *buffer)
+{
+    struct test_provider *p = (struct test_provider *)provider;
+
+    p->pos += buffer->frame_count;
+}
+
+static inline void test_provider_init(struct test_provider *p,
+                                      const int16_t *data, size_t frames,
+                                      unsigned int channels, size_t chunk)
+{
+    p->provider.get_next_buffer = test_provider_get;
+    p->provider.release_buffer = test_provider_release;
+    p->data = data;
+    p->frames = frames;
+    p->pos = 0;
+    p->chunk = chunk;
+    p->channels = channels;
+}
+
+extern struct audio_module HAL_MODULE_INFO_SYM;
+
+static inline struct audio_hw_device *hal_open(void)
+{
+    struct hw_module_t *module = &HAL_MODULE_INFO_SYM.common;
+    struct audio_hw_device *dev = NULL;
+
+    if (module->methods->open(module, AUDIO_HARDWARE_INTERFACE,
+                              (struct hw_device_t **)&dev) != 0)
+        return NULL;
+    return dev;
+}
+
+static inline void hal_close(struct audio_hw_device *dev)
+{
+    dev->common.close(&dev->common);
+}
+
+static inline struct audio_stream_out *hal_open_output(
+        struct audio_hw_device *dev, audio_devices_t device,
+        audio_output_flags_t flags, struct audio_config *config)
+{
+    struct audio_stream_out *out = NULL;
+
+    if (dev->open_output_stream(dev, 0, device, flags, config, &out,
+                                NULL) != 0)
+        return NULL;
+    return out;
+}
+
+static inline struct audio_stream_in *hal_open_input(
+        struct audio_hw_device *dev, audio_devices_t device,
+        audio_input_flags_t flags, struct audio_config *config)
+{
+    struct audio_stream_in *in = NULL;
+
+    if (dev->open_input_stream(dev, 0, device, config, &in, flags, NULL,
+                               AUDIO_SOURCE_MIC) != 0)
+        return NULL;
+    return in;
+}
+
+/* writes a buffer of the size the stream asks for */
+static inline ssize_t hal_write_buffer(struct audio_stream_out *out, void *buf)
+{
+    size_t bytes = out->common.get_buffer_size(&out->common);
+
+    return out->write(out, buf, bytes);
+}
+
+/* a buffer of a 16 bit stereo stream, with a 1 kHz square wave at 48 kHz */
+static inline void *hal_alloc_buffer(struct audio_stream *stream)
+{
+    size_t bytes = stream->get_buffer_size(stream);
+    int16_t *buf = malloc(bytes);
+    size_t i;
+
+    for (i = 0; buf && i < bytes / sizeof(int16_t); i++)
+        buf[i] = (int16_t)(8192 * ((i / 2) % 48 < 24 ? 1 : -1));
+    return buf;
+}
+
+/* simulated time in seconds */
+static inline double test_now(void)
+{
+    return fake_clock_now_ns() / 1e9;
+}
+
+#endif
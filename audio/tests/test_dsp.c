@@ -0,0 +1,494 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Bit exactness of the dsp.c kernels: the vector versions built for the
+ * host (SSE2) and the NEON versions built on neon/arm_neon.h must give the
+ * output of the C versions (dsp_ref.h) for all lengths, which covers the
+ * vector loops and their C tails, and the C versions the output of the
+ * code of the HAL they replaced.
+ */
+
+#include "dsp_ref.h"
+#include "test.h"
+
+/* 8 channel frames, and one sample for the misaligned frames of test_mix() */
+#define MAX_SAMPLES (4801 * 8 + 1)
+
+static const size_t test_frames[] = { 0, 1, 3, 7, 8, 9, 15, 16, 17, 240, 320,
+                                      960, 4801 };
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static int16_t src_s16[MAX_SAMPLES];
+static int16_t out_s16[MAX_SAMPLES];
+static int16_t ref_s16[MAX_SAMPLES];
+static int16_t neon_s16[MAX_SAMPLES];
+static int16_t old_s16[MAX_SAMPLES];
+static int32_t src_s32[MAX_SAMPLES];
+static int32_t out_s32[MAX_SAMPLES];
+static int32_t ref_s32[MAX_SAMPLES];
+static int32_t neon_s32[MAX_SAMPLES];
+
+static bool same_s16(const int16_t *a, const int16_t *b, size_t samples)
+{
+    return memcmp(a, b, samples * sizeof(int16_t)) == 0;
+}
+
+static bool same_s32(const int32_t *a, const int32_t *b, size_t samples)
+{
+    return memcmp(a, b, samples * sizeof(int32_t)) == 0;
+}
+
+/* in_apply_ramp() before dsp_ramp_s16(), mono and stereo */
+static uint16_t old_apply_ramp(int16_t *buffer, size_t frames,
+                               unsigned int channels, uint16_t vol,
+                               uint16_t step)
+{
+    size_t i;
+
+    if (channels == 1)
+        for (i = 0; i < frames; i++) {
+            buffer[i] = (int16_t)((buffer[i] * vol) >> 16);
+            vol += step;
+        }
+    else
+        for (i = 0; i < frames; i++) {
+            buffer[2*i] = (int16_t)((buffer[2*i] * vol) >> 16);
+            buffer[2*i + 1] = (int16_t)((buffer[2*i + 1] * vol) >> 16);
+            vol += step;
+        }
+
+    return vol;
+}
+
+/* the capture start ramp, and ramps wrapping around and going down */
+static void test_ramp(void)
+{
+    static const unsigned int channels[] = { 1, 2, 6 };
+    unsigned int c, f, r;
+
+    for (c = 0; c < ARRAY_SIZE(channels); c++) {
+        for (f = 0; f < ARRAY_SIZE(test_frames); f++) {
+            size_t frames = test_frames[f];
+            size_t samples = frames * channels[c];
+
+            for (r = 0; r < 4; r++) {
+                uint16_t vol, step, out_vol, ref_vol, neon_vol;
+
+                switch (r) {
+                case 0: /* CAPTURE_START_RAMP_MS at 48 kHz */
+                    vol = 0;
+                    step = 65535 / 4800;
+                    break;
+                case 1:
+                    vol = 0xfff0;
+                    step = 1;
+                    break;
+                case 2: /* down */
+                    vol = 0xffff;
+                    step = (uint16_t)-7;
+                    break;
+                default:
+                    vol = test_rand();
+                    step = test_rand();
+                    break;
+                }
+
+                test_fill_s16(src_s16, samples);
+                memcpy(out_s16, src_s16, samples * sizeof(int16_t));
+                memcpy(ref_s16, src_s16, samples * sizeof(int16_t));
+                memcpy(neon_s16, src_s16, samples * sizeof(int16_t));
+                out_vol = dsp_ramp_s16(out_s16, frames, channels[c], vol, step);
+                ref_vol = ref_dsp_ramp_s16(ref_s16, frames, channels[c], vol,
+                                           step);
+                neon_vol = neon_dsp_ramp_s16(neon_s16, frames, channels[c], vol,
+                                             step);
+                CHECK(same_s16(out_s16, ref_s16, samples));
+                CHECK_EQ(out_vol, ref_vol);
+                CHECK(same_s16(neon_s16, ref_s16, samples));
+                CHECK_EQ(neon_vol, ref_vol);
+
+                if (channels[c] <= 2) {
+                    memcpy(old_s16, src_s16, samples * sizeof(int16_t));
+                    CHECK_EQ(old_apply_ramp(old_s16, frames, channels[c], vol,
+                                            step), ref_vol);
+                    CHECK(same_s16(old_s16, ref_s16, samples));
+                }
+            }
+        }
+    }
+}
+
+/*
+ * The software volume of the outputs, into another buffer as
+ * out_apply_volume() does, for the channels of all the outputs
+ */
+static void test_gain(void)
+{
+    static const unsigned int channels[] = { 1, 2, 3, 4, 6, 8 };
+    unsigned int c, f;
+
+    for (c = 0; c < ARRAY_SIZE(channels); c++) {
+        for (f = 0; f < ARRAY_SIZE(test_frames); f++) {
+            size_t frames = test_frames[f];
+            size_t samples = frames * channels[c];
+            uint16_t vol = test_rand();
+            int16_t step = (int16_t)test_rand();
+            uint16_t ref_vol;
+
+            test_fill_s16(src_s16, samples);
+            ref_vol = ref_dsp_gain_s16(ref_s16, src_s16, frames, channels[c],
+                                       vol, step);
+            CHECK_EQ(dsp_gain_s16(out_s16, src_s16, frames, channels[c], vol,
+                                  step), ref_vol);
+            CHECK(same_s16(out_s16, ref_s16, samples));
+            CHECK_EQ(neon_dsp_gain_s16(neon_s16, src_s16, frames, channels[c],
+                                       vol, step), ref_vol);
+            CHECK(same_s16(neon_s16, ref_s16, samples));
+
+            /* a constant gain, as after the ramp */
+            ref_dsp_gain_s16(ref_s16, src_s16, frames, channels[c], vol, 0);
+            dsp_gain_s16(out_s16, src_s16, frames, channels[c], vol, 0);
+            CHECK(same_s16(out_s16, ref_s16, samples));
+            neon_dsp_gain_s16(neon_s16, src_s16, frames, channels[c], vol, 0);
+            CHECK(same_s16(neon_s16, ref_s16, samples));
+        }
+    }
+}
+
+/* all modes, in place as get_next_buffer() does and into another buffer */
+static void test_stereo_to_mono(void)
+{
+    static const enum dsp_mono_mode modes[] = { DSP_MONO_LEFT, DSP_MONO_RIGHT,
+                                                DSP_MONO_AVERAGE };
+    unsigned int m, f;
+    size_t i;
+
+    for (m = 0; m < ARRAY_SIZE(modes); m++) {
+        for (f = 0; f < ARRAY_SIZE(test_frames); f++) {
+            size_t frames = test_frames[f];
+
+            test_fill_s16(src_s16, frames * 2);
+            dsp_stereo_to_mono_s16(out_s16, src_s16, frames, modes[m]);
+            ref_dsp_stereo_to_mono_s16(ref_s16, src_s16, frames, modes[m]);
+            CHECK(same_s16(out_s16, ref_s16, frames));
+            neon_dsp_stereo_to_mono_s16(neon_s16, src_s16, frames, modes[m]);
+            CHECK(same_s16(neon_s16, ref_s16, frames));
+
+            memcpy(out_s16, src_s16, frames * 2 * sizeof(int16_t));
+            dsp_stereo_to_mono_s16(out_s16, out_s16, frames, modes[m]);
+            CHECK(same_s16(out_s16, ref_s16, frames));
+
+            /* the loop of get_next_buffer() kept the left channel */
+            if (modes[m] == DSP_MONO_LEFT) {
+                memcpy(old_s16, src_s16, frames * 2 * sizeof(int16_t));
+                for (i = 1; i < frames; i++)
+                    old_s16[i] = old_s16[i * 2];
+                CHECK(same_s16(old_s16, ref_s16, frames));
+            }
+        }
+    }
+
+    /* the average of full scale samples does not wrap */
+    src_s16[0] = INT16_MIN;
+    src_s16[1] = INT16_MIN;
+    src_s16[2] = INT16_MAX;
+    src_s16[3] = INT16_MAX;
+    for (i = 4; i < 32; i++)
+        src_s16[i] = i & 1 ? INT16_MIN : INT16_MAX;
+    dsp_stereo_to_mono_s16(out_s16, src_s16, 16, DSP_MONO_AVERAGE);
+    CHECK_EQ(out_s16[0], INT16_MIN);
+    CHECK_EQ(out_s16[1], INT16_MAX);
+    CHECK_EQ(out_s16[2], -1);
+}
+
+/* the coefficient memory of the polyphase resampler */
+static void test_dot(void)
+{
+    unsigned int f;
+    size_t i;
+
+    for (f = 0; f < ARRAY_SIZE(test_frames); f++) {
+        size_t n = test_frames[f];
+        int32_t ref;
+
+        /* random samples small enough for the sum to fit in 32 bits */
+        test_fill_s16(src_s16, 2 * n);
+        for (i = 0; i < 2 * n; i++)
+            src_s16[i] >>= 6;
+        ref = ref_dsp_dot_s16(src_s16, src_s16 + n, n);
+        CHECK_EQ(dsp_dot_s16(src_s16, src_s16 + n, n), ref);
+        CHECK_EQ(neon_dsp_dot_s16(src_s16, src_s16 + n, n), ref);
+    }
+}
+
+/*
+ * The outputs mixed into the HDMI output, into frames of all the channel
+ * counts, with saturation, and at an odd sample so that the frames are
+ * not aligned on 32 bits
+ */
+static void test_mix(void)
+{
+    static const unsigned int channels[] = { 2, 3, 4, 6, 8 };
+    static const uint16_t gains[] = { DSP_UNITY_GAIN, 0, 0x4000, 0x7fff, 1 };
+    unsigned int c, f, g;
+
+    for (c = 0; c < ARRAY_SIZE(channels); c++) {
+        for (f = 0; f < ARRAY_SIZE(test_frames); f++) {
+            size_t frames = test_frames[f];
+            size_t samples = frames * channels[c] + 1;
+
+            for (g = 0; g < ARRAY_SIZE(gains); g++) {
+                test_fill_s16(src_s16, frames * 2);
+                test_fill_s16(ref_s16, samples);
+                memcpy(out_s16, ref_s16, samples * sizeof(int16_t));
+                memcpy(neon_s16, ref_s16, samples * sizeof(int16_t));
+
+                ref_dsp_mix_stereo_s16(ref_s16 + 1, channels[c], src_s16,
+                                       frames, gains[g]);
+                dsp_mix_stereo_s16(out_s16 + 1, channels[c], src_s16, frames,
+                                   gains[g]);
+                neon_dsp_mix_stereo_s16(neon_s16 + 1, channels[c], src_s16,
+                                        frames, gains[g]);
+                CHECK(same_s16(out_s16, ref_s16, samples));
+                CHECK(same_s16(neon_s16, ref_s16, samples));
+            }
+        }
+    }
+}
+
+/* random matrices between all the channel counts of the HDMI remixes */
+static void test_matrix(void)
+{
+    static const unsigned int channels[] = { 1, 2, 3, 4, 6, 8 };
+    struct dsp_matrix m;
+    unsigned int in, out, f, o, c;
+
+    for (in = 0; in < ARRAY_SIZE(channels); in++) {
+        for (out = 0; out < ARRAY_SIZE(channels); out++) {
+            /* the sum of the absolute coefficients of a row below 4.0 */
+            int lim = 4 * DSP_MATRIX_UNITY / channels[in] - 1;
+
+            if (lim > INT16_MAX)
+                lim = INT16_MAX;
+            m.in_channels = channels[in];
+            m.out_channels = channels[out];
+            for (o = 0; o < channels[out]; o++)
+                for (c = 0; c < channels[in]; c++)
+                    m.coef[o][c] = (int16_t)(test_rand() % (2 * lim + 1) - lim);
+
+            for (f = 0; f < ARRAY_SIZE(test_frames); f++) {
+                size_t frames = test_frames[f];
+                size_t samples = frames * channels[out];
+
+                test_fill_s16(src_s16, frames * channels[in]);
+                ref_dsp_matrix_s16(ref_s16, src_s16, frames, &m);
+                dsp_matrix_s16(out_s16, src_s16, frames, &m);
+                neon_dsp_matrix_s16(neon_s16, src_s16, frames, &m);
+                CHECK(same_s16(out_s16, ref_s16, samples));
+                CHECK(same_s16(neon_s16, ref_s16, samples));
+            }
+        }
+    }
+}
+
+/*
+ * The sources of all the formats, with the values which clip and round,
+ * to 16 and 24 bit
+ */
+static void test_convert(void)
+{
+    static const enum dsp_format src_formats[] = { DSP_FORMAT_S24_3LE,
+                                                   DSP_FORMAT_S24_LE,
+                                                   DSP_FORMAT_FLOAT };
+    static const float special[] = { NAN, INFINITY, -INFINITY, 1.0f, -1.0f,
+                                     1.5f, -1.5f, 0.5f / 8388608,
+                                     -0.5f / 8388608, 1.5f / 8388608, 1e-40f,
+                                     -0.0f, 0.99999994f, -0.99999994f };
+    float *src_f32 = (float *)src_s32;
+    unsigned int s, d, f;
+    size_t i;
+
+    for (s = 0; s < ARRAY_SIZE(src_formats); s++) {
+        for (d = 0; d < 2; d++) {
+            enum dsp_format dst_format = d ? DSP_FORMAT_S24_LE : DSP_FORMAT_S16;
+            size_t size = d ? sizeof(int32_t) : sizeof(int16_t);
+
+            for (f = 0; f < ARRAY_SIZE(test_frames); f++) {
+                size_t samples = test_frames[f];
+
+                for (i = 0; i < samples; i++) {
+                    switch (src_formats[s]) {
+                    case DSP_FORMAT_S24_3LE:
+                    case DSP_FORMAT_S24_LE:
+                        /* beyond 24 bit, and 3 bytes with any sign */
+                        src_s32[i] = (int32_t)test_rand() >> (test_rand() % 9);
+                        break;
+                    default:
+                        src_f32[i] = i < ARRAY_SIZE(special) ? special[i] :
+                                     ((int32_t)test_rand() / 1431655765.0f);
+                        break;
+                    }
+                }
+
+                memset(out_s32, 0x55, samples * size);
+                memset(ref_s32, 0x55, samples * size);
+                memset(neon_s32, 0x55, samples * size);
+                ref_dsp_convert(ref_s32, dst_format, src_s32, src_formats[s],
+                                samples);
+                dsp_convert(out_s32, dst_format, src_s32, src_formats[s],
+                            samples);
+                neon_dsp_convert(neon_s32, dst_format, src_s32, src_formats[s],
+                                 samples);
+                CHECK(memcmp(out_s32, ref_s32, samples * size) == 0);
+                CHECK(memcmp(neon_s32, ref_s32, samples * size) == 0);
+            }
+        }
+    }
+}
+
+/* converts with the three versions, and checks them against the values */
+static void check_convert(enum dsp_format dst_format, const void *src,
+                          enum dsp_format src_format, const int32_t *expected,
+                          size_t samples)
+{
+    __typeof__(dsp_convert) *convert[] = { dsp_convert, ref_dsp_convert,
+                                           neon_dsp_convert };
+    unsigned int v;
+    size_t i;
+
+    for (v = 0; v < ARRAY_SIZE(convert); v++) {
+        convert[v](out_s32, dst_format, src, src_format, samples);
+        for (i = 0; i < samples; i++) {
+            int32_t value = dst_format == DSP_FORMAT_S16 ?
+                            ((int16_t *)out_s32)[i] : out_s32[i];
+
+            if (value != expected[i]) {
+                fprintf(stderr, "version %u, sample %zu: %d != %d\n", v, i,
+                        value, expected[i]);
+                CHECK(value == expected[i]);
+            }
+        }
+    }
+}
+
+/*
+ * The rounding and clipping of each conversion of the outputs, with 16
+ * samples so that the vector versions convert them
+ */
+static void test_convert_values(void)
+{
+    static const float f32[16] = {
+        0.0f, 0.5f, -0.5f, 1.0f, -1.0f, 2.0f, NAN, INFINITY, -INFINITY,
+        0.5f / 8388608, -0.5f / 8388608, 1.5f / 8388608, 1e-40f,
+        128.0f / 8388608, -129.0f / 8388608, 0.25f,
+    };
+    static const int32_t f32_s24[16] = {
+        0, 0x400000, -0x400000, 0x7fffff, -0x800000, 0x7fffff, -0x800000,
+        0x7fffff, -0x800000, 1, -1, 2, 0, 128, -129, 0x200000,
+    };
+    static const int32_t f32_s16[16] = {
+        0, 0x4000, -0x4000, 0x7fff, -0x8000, 0x7fff, -0x8000, 0x7fff,
+        -0x8000, 0, 0, 0, 0, 1, -1, 0x2000,
+    };
+    /* the samples of s24_3le */
+    static const int32_t s24[16] = {
+        0, 1, -1, 0x7fffff, -0x800000, 0x80, -0x80, 0x7f, -0x81, 0x123456,
+        -0x123456, 0x7fff80, 0x7fff7f, 0x100, -0x100, 0x400000,
+    };
+    static const int32_t s24_s16[16] = {
+        0, 0, 0, 0x7fff, -0x8000, 1, 0, 0, -1, 0x1234, -0x1234, 0x7fff,
+        0x7fff, 1, -1, 0x4000,
+    };
+    /* 8_24 samples which use the headroom bits */
+    static const int32_t s8_24[16] = {
+        0x800000, -0x800001, 0x7fffffff, INT32_MIN, 0x1000000, -0x1000000,
+        0x7fffff, -0x800000, 1, -1, 0x123456, 0x7fff80, 0, 0x80, -0x80,
+        0x400000,
+    };
+    static const int32_t s8_24_s24[16] = {
+        0x7fffff, -0x800000, 0x7fffff, -0x800000, 0x7fffff, -0x800000,
+        0x7fffff, -0x800000, 1, -1, 0x123456, 0x7fff80, 0, 0x80, -0x80,
+        0x400000,
+    };
+    static const int32_t s8_24_s16[16] = {
+        0x7fff, -0x8000, 0x7fff, -0x8000, 0x7fff, -0x8000, 0x7fff, -0x8000,
+        0, 0, 0x1234, 0x7fff, 0, 1, 0, 0x4000,
+    };
+    uint8_t s24_3le[16 * 3];
+    size_t i;
+
+    for (i = 0; i < 16; i++) {
+        s24_3le[3 * i] = s24[i] & 0xff;
+        s24_3le[3 * i + 1] = (s24[i] >> 8) & 0xff;
+        s24_3le[3 * i + 2] = (s24[i] >> 16) & 0xff;
+    }
+
+    check_convert(DSP_FORMAT_S24_LE, f32, DSP_FORMAT_FLOAT, f32_s24, 16);
+    check_convert(DSP_FORMAT_S16, f32, DSP_FORMAT_FLOAT, f32_s16, 16);
+    check_convert(DSP_FORMAT_S24_LE, s24_3le, DSP_FORMAT_S24_3LE, s24, 16);
+    check_convert(DSP_FORMAT_S16, s24_3le, DSP_FORMAT_S24_3LE, s24_s16, 16);
+    check_convert(DSP_FORMAT_S24_LE, s8_24, DSP_FORMAT_S24_LE, s8_24_s24, 16);
+    check_convert(DSP_FORMAT_S16, s8_24, DSP_FORMAT_S24_LE, s8_24_s16, 16);
+}
+
+/* the software volume of the 24 bit outputs */
+static void test_gain_s24(void)
+{
+    static const unsigned int channels[] = { 1, 2, 3, 4, 6, 8 };
+    unsigned int c, f, r;
+    size_t i;
+
+    for (c = 0; c < ARRAY_SIZE(channels); c++) {
+        for (f = 0; f < ARRAY_SIZE(test_frames); f++) {
+            size_t frames = test_frames[f];
+            size_t samples = frames * channels[c];
+
+            for (r = 0; r < 3; r++) {
+                uint16_t vol = r == 1 ? 0xfff0 : test_rand();
+                int16_t step = r == 0 ? 0 : r == 1 ? 1 : (int16_t)test_rand();
+                uint16_t ref_vol;
+
+                for (i = 0; i < samples; i++)
+                    src_s32[i] = (int32_t)test_rand() >> 8;
+                ref_vol = ref_dsp_gain_s24(ref_s32, src_s32, frames,
+                                           channels[c], vol, step);
+                CHECK_EQ(dsp_gain_s24(out_s32, src_s32, frames, channels[c],
+                                      vol, step), ref_vol);
+                CHECK(same_s32(out_s32, ref_s32, samples));
+                CHECK_EQ(neon_dsp_gain_s24(neon_s32, src_s32, frames,
+                                           channels[c], vol, step), ref_vol);
+                CHECK(same_s32(neon_s32, ref_s32, samples));
+            }
+        }
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(test_ramp);
+    RUN_TEST(test_gain);
+    RUN_TEST(test_stereo_to_mono);
+    RUN_TEST(test_dot);
+    RUN_TEST(test_mix);
+    RUN_TEST(test_matrix);
+    RUN_TEST(test_convert);
+    RUN_TEST(test_convert_values);
+    RUN_TEST(test_gain_s24);
+
+    return test_result();
+}
@@ -0,0 +1,1542 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Tests of the HAL through its audio_hw_device interface, on the mock
+ * sound card and the simulated clock.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+
+#include <linux/videodev2.h>
+#include <linux/videodev2_exynos_media.h>
+
+#include "hdmi_v4l2.h"
+#include "mixer_route.h"
+#include "test.h"
+
+static void test_open_close(void)
+{
+    struct audio_hw_device *dev = hal_open();
+
+    CHECK(dev != NULL);
+    if (!dev)
+        return;
+    CHECK_EQ(dev->init_check(dev), 0);
+    /* all the routes of routing.h have their mixer paths */
+    CHECK_EQ(fake_log_find(ANDROID_LOG_ERROR, "mixer path"), 0);
+    hal_close(dev);
+}
+
+static void test_mixer_paths(void)
+{
+    int path = mixer_route_get_path("media-speaker");
+
+    CHECK(path != MIXER_PATH_INVALID);
+    CHECK(strcmp(mixer_route_get_path_name(path), "media-speaker") == 0);
+    CHECK_EQ(mixer_route_get_path(NULL), MIXER_PATH_INVALID);
+
+    /* a path missing from mixer_paths.xml is reported */
+    CHECK_EQ(mixer_route_get_path("media-nowhere"), MIXER_PATH_INVALID);
+    CHECK_EQ(fake_log_find(ANDROID_LOG_ERROR,
+                           "unknown mixer path media-nowhere"), 1);
+}
+
+/* the primary output plays in real time, without xruns */
+static void test_primary_output(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    struct fake_pcm_stats before, after;
+    size_t bytes;
+    void *buf;
+    double start;
+    int i;
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                          AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    CHECK(out != NULL);
+    if (!out)
+        goto exit;
+    bytes = out->common.get_buffer_size(&out->common);
+    buf = hal_alloc_buffer(&out->common);
+
+    before = fake_pcm_get_stats(0, 0, PCM_OUT);
+    start = test_now();
+    for (i = 0; i < 500; i++)
+        CHECK_EQ(hal_write_buffer(out, buf), bytes);
+    out->common.standby(&out->common);
+    after = fake_pcm_get_stats(0, 0, PCM_OUT);
+
+    CHECK(after.opens > before.opens);
+    CHECK_EQ(after.xruns, before.xruns);
+    CHECK_EQ(after.frames - before.frames, 500 * bytes / 4);
+    /* the writes block for the audio played, minus the PCM buffer */
+    CHECK_RANGE(test_now() - start, 500.0 * bytes / 4 / 48000 * 0.9,
+                500.0 * bytes / 4 / 48000 * 1.1);
+
+    free(buf);
+    dev->close_output_stream(dev, out);
+exit:
+    hal_close(dev);
+}
+
+/*
+ * Writes to an output and checks after each write that the presented
+ * frames and the next write timestamp follow the audio written since the
+ * output was opened, less what the kernel buffer holds and the downstream
+ * latency.
+ */
+static void check_positions(struct audio_stream_out *out, void *buf,
+                            uint64_t *written, int writes,
+                            unsigned int latency_us)
+{
+    size_t write_frames = out->common.get_buffer_size(&out->common) / 4;
+    unsigned int latency = latency_us * 48 / 1000;
+    unsigned int buffer_frames = 0;
+    uint64_t frames, first_frames = 0, last_frames = 0;
+    int64_t next_us, last_next_us = 0;
+    struct timespec ts;
+    double t, first_t = 0, last_t = 0;
+    int i, positions = 0;
+
+    for (i = 0; i < writes; i++) {
+        hal_write_buffer(out, buf);
+        *written += write_frames;
+        /* the position is only known once the PCM is running */
+        if (out->get_presentation_position(out, &frames, &ts) != 0)
+            continue;
+        t = ts.tv_sec + ts.tv_nsec / 1e9;
+        if (positions++ == 0) {
+            struct fake_pcm_stats stats = fake_pcm_get_stats(0, 0, PCM_OUT);
+
+            buffer_frames = stats.config.period_size * stats.config.period_count;
+        }
+        /* the rate is measured once the fit has settled */
+        if (i < writes / 2 || first_t == 0) {
+            first_frames = frames;
+            first_t = t;
+        }
+        CHECK(frames >= last_frames);
+        CHECK(t >= last_t);
+        /* a larger latency than before the standby holds the position */
+        if (i >= writes / 2)
+            CHECK_RANGE(*written - frames, latency - 48.0,
+                        latency + buffer_frames + 48.0);
+        last_frames = frames;
+        last_t = t;
+
+        CHECK_EQ(out->get_next_write_timestamp(out, &next_us), 0);
+        CHECK(next_us >= last_next_us);
+        CHECK_RANGE(next_us - fake_clock_now_ns() / 1000, latency_us - 1000.0,
+                    latency_us + buffer_frames / 0.048 + 1000.0);
+        last_next_us = next_us;
+    }
+
+    CHECK(positions > writes / 2);
+    /* the fit of the DMA positions follows the rate of the PCM */
+    CHECK_RANGE((last_frames - first_frames) / (last_t - first_t),
+                48000 * 0.995, 48000 * 1.005);
+}
+
+/*
+ * The presentation position, render position and next write timestamp
+ * of the primary output account for the kernel buffer and for the
+ * downstream latency of audio_hal.latency_us.*, of the dock card when it
+ * plays too. They are not available in standby.
+ */
+static void test_positions(void)
+{
+    struct audio_hw_device *dev;
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    struct timespec ts;
+    uint64_t frames, written = 0, restart;
+    uint32_t render;
+    int64_t next_us;
+    void *buf;
+    int i;
+
+    property_set("audio_hal.latency_us.speaker", "10000");
+    property_set("audio_hal.latency_us.dock", "30000");
+    fake_pcm_set_present(1, 0, true);
+    dev = hal_open();
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                          AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    CHECK(out != NULL);
+    if (!out)
+        goto exit;
+    buf = hal_alloc_buffer(&out->common);
+
+    CHECK_EQ(out->get_presentation_position(out, &frames, &ts), -1);
+    CHECK_EQ(out->get_render_position(out, &render), -EINVAL);
+    CHECK_EQ(out->get_next_write_timestamp(out, &next_us), -EINVAL);
+
+    check_positions(out, buf, &written, 200, 10000);
+
+    /* the render position counts from the last start */
+    out->common.standby(&out->common);
+    /* until the worker closes the PCM */
+    while (out->get_presentation_position(out, &frames, &ts) == 0)
+        sched_yield();
+    restart = written;
+    for (i = 0; i < 50; i++) {
+        hal_write_buffer(out, buf);
+        written += out->common.get_buffer_size(&out->common) / 4;
+    }
+    CHECK_EQ(out->get_render_position(out, &render), 0);
+    CHECK_EQ(out->get_presentation_position(out, &frames, &ts), 0);
+    CHECK(render > 0);
+    CHECK(render <= written - restart);
+    CHECK_EQ(frames - render, restart);
+
+    /* the dock card is heard last */
+    CHECK(out->common.set_parameters(&out->common, "routing=4098") >= 0);
+    out->common.standby(&out->common);
+    check_positions(out, buf, &written, 200, 30000);
+    CHECK(fake_pcm_get_stats(1, 0, PCM_OUT).opens > 0);
+    CHECK_EQ(fake_pcm_get_stats(1, 0, PCM_OUT).xruns, 0);
+
+    free(buf);
+    dev->close_output_stream(dev, out);
+exit:
+    hal_close(dev);
+    fake_pcm_set_present(1, 0, false);
+    property_set("audio_hal.latency_us.speaker", "0");
+    property_set("audio_hal.latency_us.dock", "0");
+}
+
+/* the capture of the built in mic reaches the stream */
+static void test_primary_input(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_IN_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_in *in;
+    size_t bytes, j;
+    int16_t *buf;
+    int peak = 0;
+    int i;
+
+    in = hal_open_input(dev, AUDIO_DEVICE_IN_BUILTIN_MIC, AUDIO_INPUT_FLAG_NONE,
+                        &config);
+    CHECK(in != NULL);
+    if (!in)
+        goto exit;
+    bytes = in->common.get_buffer_size(&in->common);
+    buf = malloc(bytes);
+
+    for (i = 0; i < 50; i++) {
+        CHECK_EQ(in->read(in, buf, bytes), bytes);
+        for (j = 0; j < bytes / 2; j++)
+            peak = abs(buf[j]) > peak ? abs(buf[j]) : peak;
+    }
+    CHECK_RANGE(peak, 16000, 16384);
+    CHECK(fake_pcm_get_stats(0, 0, PCM_IN).reads > 0);
+
+    free(buf);
+    dev->close_input_stream(dev, in);
+exit:
+    hal_close(dev);
+}
+
+/*
+ * In MMAP mode the streams copy whole periods in and out of the DMA buffer:
+ * when the app comes back a few frames late, they sleep until a period is
+ * free or captured instead of copying the few frames the DMA has moved.
+ */
+static void test_mmap_output(void)
+{
+    struct audio_hw_device *dev;
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    struct fake_pcm_stats before, after;
+    size_t bytes;
+    void *buf;
+    int i;
+
+    property_set("audio_hal.fast_mmap", "true");
+    dev = hal_open();
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER, AUDIO_OUTPUT_FLAG_FAST,
+                          &config);
+    CHECK(out != NULL);
+    if (!out)
+        goto exit;
+    bytes = out->common.get_buffer_size(&out->common);
+    buf = hal_alloc_buffer(&out->common);
+
+    before = fake_pcm_get_stats(0, 0, PCM_OUT);
+    for (i = 0; i < 500; i++) {
+        fake_clock_sleep_ns(100000);
+        CHECK_EQ(hal_write_buffer(out, buf), bytes);
+    }
+    after = fake_pcm_get_stats(0, 0, PCM_OUT);
+    out->common.standby(&out->common);
+
+    CHECK(after.flags & PCM_MMAP);
+    CHECK_EQ(after.xruns, before.xruns);
+    CHECK_EQ(after.frames - before.frames, 500 * bytes / 4);
+    /* the buffers are periods, one commit each */
+    CHECK_EQ(after.writes - before.writes, 500);
+
+    free(buf);
+    dev->close_output_stream(dev, out);
+exit:
+    hal_close(dev);
+    property_set("audio_hal.fast_mmap", "false");
+}
+
+static void test_mmap_input(void)
+{
+    struct audio_hw_device *dev;
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_IN_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_in *in;
+    struct fake_pcm_stats before, after;
+    size_t bytes;
+    void *buf;
+    int i;
+
+    property_set("audio_hal.fast_mmap", "true");
+    dev = hal_open();
+    in = hal_open_input(dev, AUDIO_DEVICE_IN_BUILTIN_MIC, AUDIO_INPUT_FLAG_FAST,
+                        &config);
+    CHECK(in != NULL);
+    if (!in)
+        goto exit;
+    bytes = in->common.get_buffer_size(&in->common);
+    buf = malloc(bytes);
+
+    CHECK_EQ(in->read(in, buf, bytes), bytes);
+    before = fake_pcm_get_stats(0, 0, PCM_IN);
+    for (i = 0; i < 500; i++) {
+        fake_clock_sleep_ns(100000);
+        CHECK_EQ(in->read(in, buf, bytes), bytes);
+    }
+    after = fake_pcm_get_stats(0, 0, PCM_IN);
+
+    CHECK(after.flags & PCM_MMAP);
+    CHECK_EQ(after.xruns, before.xruns);
+    CHECK_EQ(after.frames - before.frames, 500 * bytes / 4);
+    CHECK_EQ(after.reads - before.reads, 500);
+
+    free(buf);
+    dev->close_input_stream(dev, in);
+exit:
+    hal_close(dev);
+    property_set("audio_hal.fast_mmap", "false");
+}
+
+/*
+ * The deep buffer periods come from the audio_hal.deep_buffer_* properties
+ * when the HAL is opened, and stay the same for the life of the output.
+ */
+static void test_deep_buffer(void)
+{
+    struct audio_hw_device *dev;
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    struct fake_pcm_stats stats;
+    size_t bytes;
+    void *buf;
+
+    property_set("audio_hal.deep_buffer_period_ms", "40");
+    property_set("audio_hal.deep_buffer_period_count", "4");
+    dev = hal_open();
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                          AUDIO_OUTPUT_FLAG_DEEP_BUFFER, &config);
+    CHECK(out != NULL);
+    if (!out)
+        goto exit;
+    bytes = out->common.get_buffer_size(&out->common);
+    CHECK_EQ(bytes, 40 * 48 * 4);
+    buf = hal_alloc_buffer(&out->common);
+
+    CHECK_EQ(hal_write_buffer(out, buf), bytes);
+    stats = fake_pcm_get_stats(0, 3, PCM_OUT);
+    CHECK_EQ(stats.config.period_size, 40 * 48);
+    CHECK_EQ(stats.config.period_count, 4);
+
+    /* AudioFlinger keeps the buffer size it read at open */
+    out->common.set_parameters(&out->common, "deep_buffer_period_ms=100");
+    CHECK_EQ(out->common.get_buffer_size(&out->common), bytes);
+
+    free(buf);
+    dev->close_output_stream(dev, out);
+exit:
+    hal_close(dev);
+    property_set("audio_hal.deep_buffer_period_ms", "20");
+    property_set("audio_hal.deep_buffer_period_count", "5");
+}
+
+/*
+ * Format and first frame of the last audio the deep buffer PCM received,
+ * from the thread of the HAL which writes it: the format is set last.
+ */
+static atomic_int format_pcm_format = -1;
+static int32_t format_frame[2];
+
+static void format_tap(unsigned int card, unsigned int device,
+                       const struct pcm_config *config, const void *data,
+                       unsigned int frames)
+{
+    if (card != 0 || device != 3 || frames == 0)
+        return;
+    if (config->format == PCM_FORMAT_S24_LE) {
+        const uint32_t *samples = data;
+
+        /* the upper byte is padding, sign extend the low 24 bits */
+        format_frame[0] = (int32_t)(samples[0] << 8) >> 8;
+        format_frame[1] = (int32_t)(samples[1] << 8) >> 8;
+    } else {
+        const int16_t *samples = data;
+
+        format_frame[0] = samples[0];
+        format_frame[1] = samples[1];
+    }
+    atomic_store(&format_pcm_format, config->format);
+}
+
+/*
+ * Plays a deep buffer output of format with all its frames set to frame,
+ * and checks the PCM format and the first frame the PCM received. The 16
+ * bit samples may be rounded either way.
+ */
+static void check_format(struct audio_hw_device *dev, audio_format_t format,
+                         const void *frame, size_t frame_size,
+                         enum pcm_format pcm_format, int32_t left,
+                         int32_t right)
+{
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = format };
+    struct audio_stream_out *out;
+    int32_t error = pcm_format == PCM_FORMAT_S16_LE ? 1 : 0;
+    size_t bytes, i;
+    char *buf;
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                          AUDIO_OUTPUT_FLAG_DEEP_BUFFER, &config);
+    CHECK(out != NULL);
+    if (!out)
+        return;
+    CHECK_EQ(out->common.get_format(&out->common), format);
+    bytes = out->common.get_buffer_size(&out->common);
+    CHECK_EQ(bytes % frame_size, 0);
+    buf = malloc(bytes);
+    for (i = 0; i < bytes; i += frame_size)
+        memcpy(buf + i, frame, frame_size);
+
+    /* the first write may wait in the HAL while the PCM opens */
+    atomic_store(&format_pcm_format, -1);
+    for (i = 0; i < 4 && atomic_load(&format_pcm_format) == -1; i++)
+        CHECK_EQ(out->write(out, buf, bytes), bytes);
+    CHECK_EQ(atomic_load(&format_pcm_format), pcm_format);
+    CHECK_RANGE(format_frame[0], left - error, left + error);
+    CHECK_RANGE(format_frame[1], right - error, right + error);
+
+    free(buf);
+    dev->close_output_stream(dev, out);
+}
+
+/*
+ * The 24 bit and float outputs play in 24 bit on a PCM which takes it, on
+ * the codec card and on the dock when it is there, and are converted to
+ * 16 bit otherwise. Samples out of range are clipped.
+ */
+static void test_formats(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    const uint8_t packed[6] = { 0x56, 0x34, 0x12, 0xaa, 0xcb, 0xed };
+    const int32_t s8_24[2] = { 0x123456, 0x1000000 };
+    const float f[2] = { 0.5f, -1.5f };
+    const int16_t s16[2] = { 0x1234, -0x1234 };
+
+    fake_pcm_set_tap(format_tap);
+
+    /* the PCM of the codec takes 16 bit only */
+    check_format(dev, AUDIO_FORMAT_PCM_24_BIT_PACKED, packed, 6,
+                 PCM_FORMAT_S16_LE, 0x1234, -0x1235);
+    check_format(dev, AUDIO_FORMAT_PCM_8_24_BIT, s8_24, 8,
+                 PCM_FORMAT_S16_LE, 0x1234, 32767);
+    check_format(dev, AUDIO_FORMAT_PCM_FLOAT, f, 8,
+                 PCM_FORMAT_S16_LE, 16384, -32768);
+
+    fake_pcm_set_formats(0, (1 << PCM_FORMAT_S16_LE) |
+                            (1 << PCM_FORMAT_S24_LE));
+    check_format(dev, AUDIO_FORMAT_PCM_24_BIT_PACKED, packed, 6,
+                 PCM_FORMAT_S24_LE, 0x123456, -0x123456);
+    check_format(dev, AUDIO_FORMAT_PCM_8_24_BIT, s8_24, 8,
+                 PCM_FORMAT_S24_LE, 0x123456, 0x7fffff);
+    check_format(dev, AUDIO_FORMAT_PCM_FLOAT, f, 8,
+                 PCM_FORMAT_S24_LE, 0x400000, -0x800000);
+    /* 16 bit is not converted */
+    check_format(dev, AUDIO_FORMAT_PCM_16_BIT, s16, 4,
+                 PCM_FORMAT_S16_LE, 0x1234, -0x1234);
+
+    /* the dock shares the config of the output and takes 16 bit only */
+    fake_pcm_set_present(1, 3, true);
+    check_format(dev, AUDIO_FORMAT_PCM_FLOAT, f, 8,
+                 PCM_FORMAT_S16_LE, 16384, -32768);
+    fake_pcm_set_present(1, 3, false);
+
+    fake_pcm_set_formats(0, 1 << PCM_FORMAT_S16_LE);
+    fake_pcm_set_tap(NULL);
+    hal_close(dev);
+}
+
+static int offload_callback(stream_callback_event_t event, void *param,
+                            void *cookie)
+{
+    return 0;
+}
+
+static struct audio_stream_out *open_offload_output(
+        struct audio_hw_device *dev)
+{
+    struct audio_config config = {
+        .sample_rate = 44100,
+        .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+        .format = AUDIO_FORMAT_MP3,
+        .offload_info = { .format = AUDIO_FORMAT_MP3, .bit_rate = 128000 },
+    };
+
+    return hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                           AUDIO_OUTPUT_FLAG_DIRECT |
+                           AUDIO_OUTPUT_FLAG_COMPRESS_OFFLOAD |
+                           AUDIO_OUTPUT_FLAG_NON_BLOCKING, &config);
+}
+
+/*
+ * The offload output is refused when the compress device or its volume
+ * control is missing, and standby and flush stop it while the offload
+ * thread waits on the DSP (the usleep() of the test is not simulated).
+ */
+static void test_offload(void)
+{
+    struct audio_hw_device *dev;
+    struct audio_stream_out *out;
+    size_t bytes;
+    char *buf;
+    int64_t next_us;
+    int i;
+
+    dev = hal_open();
+    CHECK(open_offload_output(dev) == NULL);
+    CHECK(fake_log_find(ANDROID_LOG_ERROR, "Compress Playback Volume") > 0);
+    hal_close(dev);
+
+    fake_mixer_add_ctl("Compress Playback Volume", MIXER_CTL_TYPE_INT, 2);
+    dev = hal_open();
+    fake_compress_set_present(false);
+    CHECK(open_offload_output(dev) == NULL);
+    fake_compress_set_present(true);
+    out = open_offload_output(dev);
+    CHECK(out != NULL);
+    if (!out)
+        goto exit;
+
+    CHECK_EQ(out->set_volume(out, 0.5f, 0.25f), 0);
+    CHECK_EQ(fake_mixer_get_value("Compress Playback Volume", 0), 50);
+    CHECK_EQ(fake_mixer_get_value("Compress Playback Volume", 1), 25);
+
+    /* the gapless metadata of the next track comes without a routing */
+    CHECK_EQ(out->common.set_parameters(&out->common, "delay_samples=576"), 0);
+    CHECK_EQ(out->common.set_parameters(&out->common,
+                                        "padding_samples=1152"), 0);
+
+    /* the frames of compressed data are not known */
+    CHECK_EQ(out->get_next_write_timestamp(out, &next_us), -EINVAL);
+
+    out->set_callback(out, offload_callback, NULL);
+    bytes = out->common.get_buffer_size(&out->common);
+    buf = calloc(1, bytes);
+
+    for (i = 0; i < 2; i++) {
+        /* fill the DSP buffer and let the offload thread wait for room */
+        while (out->write(out, buf, bytes) == (ssize_t)bytes)
+            ;
+        usleep(20000);
+        if (i == 0)
+            out->common.standby(&out->common);
+        else
+            out->flush(out);
+        /* the DSP buffer is empty again */
+        CHECK_EQ(out->write(out, buf, bytes), bytes);
+    }
+
+    free(buf);
+    dev->close_output_stream(dev, out);
+exit:
+    hal_close(dev);
+    fake_mixer_remove_ctl("Compress Playback Volume");
+}
+
+/* the value of an integer parameter of a stream, -1 if it is missing */
+static int get_int_parameter(struct audio_stream *stream, const char *key)
+{
+    char *reply = stream->get_parameters(stream, key);
+    char *value = reply ? strchr(reply, '=') : NULL;
+    int result = value ? atoi(value + 1) : -1;
+
+    free(reply);
+    return result;
+}
+
+/*
+ * Only -EPIPE from the PCM is an xrun: another error is reported as such
+ * even when errno was left at EPIPE by something else.
+ */
+static void test_pcm_errors(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    struct audio_stream_in *in;
+    unsigned int overruns, read_errors;
+    size_t bytes;
+    void *buf;
+    int i;
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                          AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    CHECK(out != NULL);
+    if (!out)
+        goto exit;
+    bytes = out->common.get_buffer_size(&out->common);
+    buf = hal_alloc_buffer(&out->common);
+    for (i = 0; i < 10; i++)
+        CHECK_EQ(hal_write_buffer(out, buf), bytes);
+
+    fake_pcm_inject_xrun(0, 0, PCM_OUT);
+    CHECK_EQ(hal_write_buffer(out, buf), bytes);
+    CHECK_EQ(get_int_parameter(&out->common, "xrun_underrun"), 1);
+    CHECK_EQ(get_int_parameter(&out->common, "xrun_write"), 0);
+
+    errno = EPIPE;
+    fake_pcm_inject_error(0, 0, PCM_OUT, -EIO);
+    CHECK_EQ(hal_write_buffer(out, buf), bytes);
+    CHECK_EQ(get_int_parameter(&out->common, "xrun_underrun"), 1);
+    CHECK_EQ(get_int_parameter(&out->common, "xrun_write"), 1);
+
+    free(buf);
+    dev->close_output_stream(dev, out);
+
+    config.channel_mask = AUDIO_CHANNEL_IN_STEREO;
+    in = hal_open_input(dev, AUDIO_DEVICE_IN_BUILTIN_MIC, AUDIO_INPUT_FLAG_NONE,
+                        &config);
+    CHECK(in != NULL);
+    if (!in)
+        goto exit;
+    bytes = in->common.get_buffer_size(&in->common);
+    buf = malloc(bytes);
+    CHECK_EQ(in->read(in, buf, bytes), bytes);
+
+    overruns = fake_log_find(ANDROID_LOG_WARN, "overrun");
+    read_errors = fake_log_find(ANDROID_LOG_ERROR, "pcm_read error");
+    errno = EPIPE;
+    fake_pcm_inject_error(0, 0, PCM_IN, -EIO);
+    in->read(in, buf, bytes);
+    CHECK_EQ(fake_log_find(ANDROID_LOG_WARN, "overrun"), overruns);
+    CHECK_EQ(fake_log_find(ANDROID_LOG_ERROR, "pcm_read error"),
+             read_errors + 1);
+
+    free(buf);
+    dev->close_input_stream(dev, in);
+exit:
+    hal_close(dev);
+}
+
+/* captures the frame position of the PCM, on all channels */
+static void position_source(unsigned int card, unsigned int device,
+                            const struct pcm_config *config, void *data,
+                            uint64_t position, unsigned int frames)
+{
+    int16_t *samples = data;
+    unsigned int i, c;
+
+    for (i = 0; i < frames; i++)
+        for (c = 0; c < config->channels; c++)
+            *samples++ = (int16_t)(position + i);
+}
+
+/* reads frames of a stereo input and checks they follow the last ones */
+static void read_positions(struct audio_stream_in *in, int16_t *buf,
+                           size_t frames, int16_t *next)
+{
+    bool follows = true;
+    size_t i;
+
+    CHECK_EQ(in->read(in, buf, frames * 4), frames * 4);
+    for (i = 0; i < frames; i++, (*next)++)
+        follows &= buf[2 * i] == *next && buf[2 * i + 1] == *next;
+    CHECK(follows);
+}
+
+/*
+ * The reads of whole periods at the rate of the PCM go straight into the
+ * buffer of the caller, unless the HAL holds frames from a previous read:
+ * they are returned first, and the audio stays continuous either way.
+ */
+static void test_read_period_direct(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_IN_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_in *in;
+    size_t period;
+    int16_t *buf, next;
+    int i;
+
+    fake_pcm_set_source(position_source);
+    in = hal_open_input(dev, AUDIO_DEVICE_IN_BUILTIN_MIC, AUDIO_INPUT_FLAG_NONE,
+                        &config);
+    CHECK(in != NULL);
+    if (!in)
+        goto exit;
+    /* the buffer size is the period of the PCM at 48 kHz */
+    period = in->common.get_buffer_size(&in->common) / 4;
+    buf = malloc(period * 2 * 4);
+
+    /* past the ramp of the start of the capture */
+    for (i = 0; i * period < 9600; i++)
+        CHECK_EQ(in->read(in, buf, period * 4), period * 4);
+    CHECK_EQ(fake_pcm_get_stats(0, 0, PCM_IN).config.period_size, period);
+    next = buf[2 * period - 2] + 1;
+
+    read_positions(in, buf, period, &next);
+    CHECK(fake_pcm_get_stats(0, 0, PCM_IN).data == buf);
+    read_positions(in, buf, 2 * period, &next);
+    CHECK(fake_pcm_get_stats(0, 0, PCM_IN).data == buf + 2 * period);
+
+    /* half a period stays in the HAL */
+    read_positions(in, buf, period / 2, &next);
+    read_positions(in, buf, period, &next);
+    CHECK(fake_pcm_get_stats(0, 0, PCM_IN).data != buf);
+    read_positions(in, buf, period / 2, &next);
+    read_positions(in, buf, period, &next);
+    CHECK(fake_pcm_get_stats(0, 0, PCM_IN).data == buf);
+
+    free(buf);
+    dev->close_input_stream(dev, in);
+exit:
+    fake_pcm_set_source(NULL);
+    hal_close(dev);
+}
+
+/* overruns and frames lost printed by the dump of an input */
+static void in_dump_overruns(struct audio_stream_in *in, unsigned int *overruns,
+                             unsigned long long *lost)
+{
+    FILE *file = tmpfile();
+    char line[256];
+
+    *overruns = 0;
+    *lost = 0;
+    in->common.dump(&in->common, fileno(file));
+    rewind(file);
+    while (fgets(line, sizeof(line), file))
+        sscanf(line, " Overruns: %u, frames lost: %llu", overruns, lost);
+    fclose(file);
+}
+
+/*
+ * An overrun returned by the driver and one inferred from a read which
+ * came too late are both counted, the frames lost are those captured
+ * while the stream was not read, beyond what the driver buffer holds.
+ */
+static void test_input_overrun(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_IN_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_in *in;
+    struct fake_pcm_stats stats;
+    unsigned int overruns, buffer_frames;
+    unsigned long long lost;
+    size_t bytes;
+    void *buf;
+    int i;
+
+    in = hal_open_input(dev, AUDIO_DEVICE_IN_BUILTIN_MIC, AUDIO_INPUT_FLAG_NONE,
+                        &config);
+    CHECK(in != NULL);
+    if (!in)
+        goto exit;
+    bytes = in->common.get_buffer_size(&in->common);
+    buf = malloc(bytes);
+
+    for (i = 0; i < 10; i++)
+        CHECK_EQ(in->read(in, buf, bytes), bytes);
+    CHECK_EQ(in->get_input_frames_lost(in), 0);
+    stats = fake_pcm_get_stats(0, 0, PCM_IN);
+    buffer_frames = stats.config.period_size * stats.config.period_count;
+
+    fake_pcm_inject_xrun(0, 0, PCM_IN);
+    CHECK_EQ(in->read(in, buf, bytes), bytes);
+    in_dump_overruns(in, &overruns, &lost);
+    CHECK_EQ(overruns, 1);
+    CHECK_EQ(lost, 0);
+    CHECK_EQ(in->get_input_frames_lost(in), 0);
+
+    /* one second without reading */
+    fake_clock_sleep_ns(1000000000LL);
+    CHECK_EQ(in->read(in, buf, bytes), bytes);
+    in_dump_overruns(in, &overruns, &lost);
+    CHECK_EQ(overruns, 2);
+    CHECK_RANGE(lost, 48000 - buffer_frames - 48, 48000 - buffer_frames + 48);
+    CHECK_EQ(in->get_input_frames_lost(in), lost);
+    /* the frames lost are reported once */
+    CHECK_EQ(in->get_input_frames_lost(in), 0);
+    CHECK_EQ(in->read(in, buf, bytes), bytes);
+    CHECK_EQ(in->get_input_frames_lost(in), 0);
+
+    free(buf);
+    dev->close_input_stream(dev, in);
+exit:
+    hal_close(dev);
+}
+
+/*
+ * The capture position of a 16 kHz input, resampled from 48 kHz, counts
+ * the frames read plus those waiting in the driver, in the buffer of the
+ * HAL and in the resampler: it follows the capture clock whatever the
+ * reads leave behind, ahead of it by the half filter of silence the
+ * resampler starts with.
+ */
+static void test_capture_position(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 16000,
+                                   .channel_mask = AUDIO_CHANNEL_IN_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_in *in;
+    int64_t frames, time, last_frames = 0;
+    uint64_t read = 0;
+    size_t bytes;
+    double start, offset, first_offset = 0;
+    void *buf;
+    int i;
+
+    in = hal_open_input(dev, AUDIO_DEVICE_IN_BUILTIN_MIC, AUDIO_INPUT_FLAG_NONE,
+                        &config);
+    CHECK(in != NULL);
+    if (!in)
+        goto exit;
+    CHECK_EQ(in->get_capture_position(in, &frames, &time), -ENOSYS);
+
+    /* reads of 7 ms, which do not line up with the periods */
+    bytes = 112 * 4;
+    buf = malloc(bytes);
+    start = test_now();
+    for (i = 0; i < 200; i++) {
+        CHECK_EQ(in->read(in, buf, bytes), bytes);
+        read += 112;
+        CHECK_EQ(in->get_capture_position(in, &frames, &time), 0);
+        CHECK(frames >= last_frames);
+        CHECK(frames >= (int64_t)read);
+        /* frames captured since the first read started */
+        offset = frames - (time / 1e9 - start) * 16000;
+        if (i == 0) {
+            CHECK_RANGE(offset, 0, 32);
+            first_offset = offset;
+        }
+        CHECK_RANGE(offset - first_offset, -2, 2);
+        last_frames = frames;
+    }
+
+    free(buf);
+    dev->close_input_stream(dev, in);
+exit:
+    hal_close(dev);
+}
+
+/*
+ * A slow PCM open does not lose the audio written meanwhile: out_write()
+ * buffers one kernel buffer, then blocks until the PCM is open.
+ */
+static void test_slow_start(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    struct fake_pcm_stats before, after;
+    size_t bytes;
+    void *buf;
+    int i;
+
+    /* the worker and the writer really run concurrently */
+    fake_clock_set_mode(FAKE_CLOCK_REAL);
+    fake_pcm_set_open_delay_us(30000);
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                          AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    CHECK(out != NULL);
+    if (!out)
+        goto exit;
+    bytes = out->common.get_buffer_size(&out->common);
+    buf = hal_alloc_buffer(&out->common);
+
+    before = fake_pcm_get_stats(0, 0, PCM_OUT);
+    for (i = 0; i < 20; i++)
+        CHECK_EQ(hal_write_buffer(out, buf), bytes);
+    dev->close_output_stream(dev, out);
+    after = fake_pcm_get_stats(0, 0, PCM_OUT);
+
+    CHECK_EQ(after.opens - before.opens, 1);
+    CHECK_EQ(after.frames - before.frames, 20 * bytes / 4);
+    free(buf);
+exit:
+    fake_pcm_set_open_delay_us(0);
+    fake_clock_set_mode(FAKE_CLOCK_SIMULATED);
+    hal_close(dev);
+}
+
+/*
+ * A write which waits for a start which fails returns the error, and the
+ * audio buffered for that start is not played by the next.
+ */
+static void test_failed_start(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out, *deep;
+    struct fake_pcm_stats before, after;
+    ssize_t ret = 0;
+    size_t bytes;
+    void *buf, *deep_buf;
+    int i, xruns;
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                          AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    CHECK(out != NULL);
+    if (!out)
+        goto exit;
+    bytes = out->common.get_buffer_size(&out->common);
+    buf = hal_alloc_buffer(&out->common);
+
+    /*
+     * While the worker opens the deep buffer PCM, the writes are buffered
+     * until the kernel buffer is full, then wait for the start.
+     */
+    fake_clock_set_mode(FAKE_CLOCK_REAL);
+    deep = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                           AUDIO_OUTPUT_FLAG_DEEP_BUFFER, &config);
+    CHECK(deep != NULL);
+    if (deep) {
+        deep_buf = hal_alloc_buffer(&deep->common);
+        fake_pcm_set_open_delay_us(200000);
+        hal_write_buffer(deep, deep_buf);
+        fake_pcm_set_present(0, 0, false);
+        for (i = 0; i < 100; i++) {
+            ret = hal_write_buffer(out, buf);
+            if (ret != (ssize_t)bytes)
+                break;
+        }
+        CHECK(i > 0);
+        CHECK_EQ(ret, -ENODEV);
+        fake_pcm_set_open_delay_us(0);
+        free(deep_buf);
+        dev->close_output_stream(dev, deep);
+    }
+    fake_clock_set_mode(FAKE_CLOCK_SIMULATED);
+
+    xruns = get_int_parameter(&out->common, "xrun_start");
+    CHECK_EQ(hal_write_buffer(out, buf), bytes);
+    /* let the worker fail to open the PCM */
+    while (get_int_parameter(&out->common, "xrun_start") <= xruns)
+        sched_yield();
+    fake_pcm_set_present(0, 0, true);
+
+    before = fake_pcm_get_stats(0, 0, PCM_OUT);
+    for (i = 0; i < 10; i++)
+        CHECK_EQ(hal_write_buffer(out, buf), bytes);
+    dev->close_output_stream(dev, out);
+    after = fake_pcm_get_stats(0, 0, PCM_OUT);
+
+    CHECK_EQ(after.frames - before.frames, 10 * bytes / 4);
+    free(buf);
+exit:
+    fake_pcm_set_present(0, 0, true);
+    hal_close(dev);
+}
+
+/*
+ * Standby requests made while the worker is busy are merged, not dropped,
+ * and closing an output closes its PCM whatever the worker is doing.
+ */
+static void test_standby_requests(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out, *deep;
+    unsigned int active = fake_pcm_active_count();
+    size_t bytes;
+    void *buf, *deep_buf;
+    int i;
+
+    /* the worker and the writer really run concurrently */
+    fake_clock_set_mode(FAKE_CLOCK_REAL);
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                          AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    deep = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                           AUDIO_OUTPUT_FLAG_DEEP_BUFFER, &config);
+    CHECK(out != NULL && deep != NULL);
+    if (!out || !deep)
+        goto exit;
+    bytes = out->common.get_buffer_size(&out->common);
+    buf = hal_alloc_buffer(&out->common);
+    deep_buf = hal_alloc_buffer(&deep->common);
+    CHECK_EQ(hal_write_buffer(out, buf), bytes);
+    usleep(20000);
+
+    /* the worker opens the deep buffer PCM while the primary output toggles */
+    fake_pcm_set_open_delay_us(1000000);
+    hal_write_buffer(deep, deep_buf);
+    for (i = 0; i < 50; i++) {
+        CHECK_EQ(hal_write_buffer(out, buf), bytes);
+        CHECK_EQ(out->common.standby(&out->common), 0);
+    }
+    dev->close_output_stream(dev, out);
+    fake_pcm_set_open_delay_us(0);
+    dev->close_output_stream(dev, deep);
+
+    CHECK_EQ(fake_pcm_active_count(), active);
+    free(buf);
+    free(deep_buf);
+exit:
+    fake_pcm_set_open_delay_us(0);
+    fake_clock_set_mode(FAKE_CLOCK_SIMULATED);
+    hal_close(dev);
+}
+
+/* a call sets the modem path and clock, and the mixer path of the call */
+static void test_voice_call(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    struct fake_secril_stats before, after;
+    unsigned int writes;
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_EARPIECE,
+                          AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    CHECK(out != NULL);
+    if (!out)
+        goto exit;
+
+    before = fake_secril_get_stats();
+    writes = fake_mixer_get_writes();
+    CHECK_EQ(dev->set_mode(dev, AUDIO_MODE_IN_CALL), 0);
+    CHECK(out->common.set_parameters(&out->common, "routing=1") >= 0);
+    after = fake_secril_get_stats();
+
+    CHECK(after.audio_paths > before.audio_paths);
+    CHECK_EQ(after.audio_path, SOUND_AUDIO_PATH_HANDSET);
+    CHECK(fake_mixer_get_writes() > writes);
+
+    CHECK_EQ(dev->set_mode(dev, AUDIO_MODE_NORMAL), 0);
+    dev->close_output_stream(dev, out);
+exit:
+    hal_close(dev);
+}
+
+/* a device change writes the mixer, setting the same device again does not */
+static void test_routing(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    unsigned int writes;
+    void *buf;
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                          AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    CHECK(out != NULL);
+    if (!out)
+        goto exit;
+    buf = hal_alloc_buffer(&out->common);
+    hal_write_buffer(out, buf);
+
+    writes = fake_mixer_get_writes();
+    CHECK(out->common.set_parameters(&out->common, "routing=4") >= 0);
+    CHECK(fake_mixer_get_writes() > writes);
+
+    writes = fake_mixer_get_writes();
+    CHECK(out->common.set_parameters(&out->common, "routing=4") >= 0);
+    CHECK_EQ(fake_mixer_get_writes(), writes);
+
+    free(buf);
+    dev->close_output_stream(dev, out);
+exit:
+    hal_close(dev);
+}
+
+/* channels of the HDMI PCM when a 5.1 stream is played */
+static unsigned int hdmi_pcm_channels(struct audio_hw_device *dev)
+{
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_5POINT1,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    unsigned int channels;
+    void *buf;
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_AUX_DIGITAL,
+                          AUDIO_OUTPUT_FLAG_DIRECT, &config);
+    CHECK(out != NULL);
+    if (!out)
+        return 0;
+    buf = hal_alloc_buffer(&out->common);
+    hal_write_buffer(out, buf);
+    channels = fake_pcm_get_stats(0, 0, PCM_OUT).config.channels;
+    free(buf);
+    dev->close_output_stream(dev, out);
+    return channels;
+}
+
+/* the HDMI audio of the mock node, as the HAL last set it */
+static int hdmi_audio_enabled(void)
+{
+    int fd = hdmi_v4l2_open();
+    int32_t value = -1;
+
+    /* the HAL keeps the node open once it used it */
+    if (fd >= 0) {
+        hdmi_v4l2_close(fd);
+        return -1;
+    }
+    hdmi_v4l2_get_ctrl(16, V4L2_CID_TV_ENABLE_HDMI_AUDIO, &value);
+    return value;
+}
+
+/*
+ * The sink capabilities are read again when the HDMI output is opened
+ * after they expired, without a hotplug event, and routing enables the
+ * HDMI audio of the driver the HAL opened.
+ */
+static void test_hdmi(void)
+{
+    struct audio_hw_device *dev;
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    void *buf;
+
+    property_set("audio_hal.hdmi_mock.max_channels", "8");
+    dev = hal_open();
+    CHECK_EQ(hdmi_pcm_channels(dev), 6);
+
+    /* the repeated opens of a hotplug use the cached capabilities */
+    property_set("audio_hal.hdmi_mock.max_channels", "2");
+    CHECK_EQ(hdmi_pcm_channels(dev), 6);
+    fake_clock_sleep_ns(3000000000LL);
+    CHECK_EQ(hdmi_pcm_channels(dev), 2);
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                          AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    CHECK(out != NULL);
+    if (!out)
+        goto exit;
+    buf = hal_alloc_buffer(&out->common);
+    hal_write_buffer(out, buf);
+
+    CHECK(out->common.set_parameters(&out->common, "routing=1024") >= 0);
+    CHECK_EQ(hdmi_audio_enabled(), 1);
+    CHECK(out->common.set_parameters(&out->common, "routing=2") >= 0);
+    CHECK_EQ(hdmi_audio_enabled(), 0);
+
+    free(buf);
+    dev->close_output_stream(dev, out);
+exit:
+    hal_close(dev);
+    property_set("audio_hal.hdmi_mock.max_channels", "8");
+}
+
+/* frames the HDMI PCM received, by what they hold */
+static unsigned int hdmi_mix_frames[3]; /* silence, the mixed output, other */
+
+static void hdmi_mix_tap(unsigned int card, unsigned int device,
+                         const struct pcm_config *config, const void *data,
+                         unsigned int frames)
+{
+    const int16_t *samples = data;
+    unsigned int i, c;
+
+    /* the primary output plays in stereo on the same PCM */
+    if (card != 0 || device != 0 || config->channels != 6)
+        return;
+    for (i = 0; i < frames; i++, samples += 6) {
+        bool rear = false;
+
+        for (c = 2; c < 6; c++)
+            rear |= samples[c] != 0;
+        if (!rear && samples[0] == 0 && samples[1] == 0)
+            hdmi_mix_frames[0]++;
+        else if (!rear && samples[0] == 500 && samples[1] == -1000)
+            hdmi_mix_frames[1]++;
+        else
+            hdmi_mix_frames[2]++;
+    }
+}
+
+struct hdmi_mix_writer {
+    struct audio_stream_out *out;
+    int16_t *buf;
+    atomic_bool stop;
+};
+
+static void *hdmi_mix_writer_thread(void *context)
+{
+    struct hdmi_mix_writer *writer = context;
+
+    while (!atomic_load(&writer->stop))
+        hal_write_buffer(writer->out, writer->buf);
+    return NULL;
+}
+
+static double real_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 +
+           (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/*
+ * While the HDMI output plays, the primary output is mixed into its front
+ * left and right at the mix gain, and the standby of the HDMI output does
+ * not wait for the primary output blocked on the mix.
+ */
+static void test_hdmi_mix(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct hdmi_mix_writer writer = { .out = NULL };
+    struct audio_stream_out *hdmi;
+    struct timespec start;
+    pthread_t thread;
+    size_t bytes, frames, i;
+    double timeout_ms;
+    void *buf;
+
+    fake_clock_set_mode(FAKE_CLOCK_REAL);
+    writer.out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                                 AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    CHECK(writer.out != NULL);
+    if (!writer.out)
+        goto exit;
+    bytes = writer.out->common.get_buffer_size(&writer.out->common);
+    frames = bytes / 4;
+    writer.buf = malloc(bytes);
+    for (i = 0; i < frames; i++) {
+        writer.buf[2 * i] = 1000;
+        writer.buf[2 * i + 1] = -2000;
+    }
+    CHECK(writer.out->common.set_parameters(&writer.out->common,
+                                            "hdmi_mix_gain=0.5") >= 0);
+    pthread_create(&thread, NULL, hdmi_mix_writer_thread, &writer);
+    /* the primary output must be running to be mixed */
+    usleep(50000);
+
+    config.channel_mask = AUDIO_CHANNEL_OUT_5POINT1;
+    hdmi = hal_open_output(dev, AUDIO_DEVICE_OUT_AUX_DIGITAL,
+                           AUDIO_OUTPUT_FLAG_DIRECT, &config);
+    CHECK(hdmi != NULL);
+    if (!hdmi)
+        goto stop;
+    buf = calloc(1, hdmi->common.get_buffer_size(&hdmi->common));
+    memset(hdmi_mix_frames, 0, sizeof(hdmi_mix_frames));
+    fake_pcm_set_tap(hdmi_mix_tap);
+    for (i = 0; i < 50; i++)
+        hal_write_buffer(hdmi, buf);
+
+    /*
+     * The primary output now waits for the HDMI output to read its audio:
+     * it must not hold up the standby until the wait times out.
+     */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    hdmi->common.standby(&hdmi->common);
+    while (fake_pcm_get_stats(0, 0, PCM_OUT).config.channels != 2 &&
+           real_ms(&start) < 1000)
+        usleep(1000);
+    timeout_ms = (frames + 2048) * 1e3 / 48000;
+    CHECK(real_ms(&start) < timeout_ms / 2);
+    fake_pcm_set_tap(NULL);
+
+    CHECK(hdmi_mix_frames[1] > 10 * frames);
+    CHECK_EQ(hdmi_mix_frames[2], 0);
+    CHECK_EQ(get_int_parameter(&writer.out->common, "xrun_disabled"), 0);
+
+    free(buf);
+    dev->close_output_stream(dev, hdmi);
+stop:
+    atomic_store(&writer.stop, true);
+    pthread_join(thread, NULL);
+    free(writer.buf);
+    dev->close_output_stream(dev, writer.out);
+exit:
+    fake_clock_set_mode(FAKE_CLOCK_SIMULATED);
+    hal_close(dev);
+}
+
+/* left channel of the stereo audio the PCM of the outputs received */
+static int16_t volume_samples[16384];
+static unsigned int volume_frames;
+
+static void volume_tap(unsigned int card, unsigned int device,
+                       const struct pcm_config *config, const void *data,
+                       unsigned int frames)
+{
+    const int16_t *samples = data;
+    unsigned int i;
+
+    if (card != 0 || device != 0 || config->channels != 2)
+        return;
+    for (i = 0; i < frames && volume_frames < 16384; i++)
+        volume_samples[volume_frames++] = samples[2 * i];
+}
+
+/*
+ * Writes a buffer of constant samples and checks the level the PCM played:
+ * a ramp from level from to level to, monotonic and as long as the volume
+ * ramp, then the new level until the end. The buffer is left as it was.
+ */
+static void check_volume_ramp(struct audio_stream_out *out, int16_t *buf,
+                              int from, int to)
+{
+    size_t bytes = out->common.get_buffer_size(&out->common);
+    unsigned int ramp = 0, i;
+    bool monotonic = true, untouched = true;
+
+    volume_frames = 0;
+    while (volume_frames < 4800)
+        CHECK_EQ(hal_write_buffer(out, buf), bytes);
+    for (i = 0; i < bytes / sizeof(int16_t); i++)
+        untouched &= buf[i] == 16384;
+    CHECK(untouched);
+
+    CHECK_RANGE(volume_samples[0], from - 2, from + 2);
+    for (i = 1; i < volume_frames; i++) {
+        if (abs(volume_samples[i] - to) > 2)
+            ramp = i;
+        if (to < from)
+            monotonic &= volume_samples[i] <= volume_samples[i - 1];
+        else
+            monotonic &= volume_samples[i] >= volume_samples[i - 1];
+    }
+    CHECK(monotonic);
+    /* the ramp lasts 20 ms when the level changes */
+    if (from != to)
+        CHECK_RANGE(ramp, 900, 1000);
+    else
+        CHECK_EQ(ramp, 0);
+    CHECK_RANGE(volume_samples[volume_frames - 1], to - 2, to + 2);
+}
+
+/*
+ * The stream volume of the HDMI output and the master volume of the PCM
+ * outputs are applied by the HAL with a ramp, on a copy of the audio.
+ */
+static void test_volume(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    struct audio_config config = { .sample_rate = 48000,
+                                   .channel_mask = AUDIO_CHANNEL_OUT_STEREO,
+                                   .format = AUDIO_FORMAT_PCM_16_BIT };
+    struct audio_stream_out *out;
+    int16_t *buf;
+    float volume;
+    size_t i;
+
+    CHECK_EQ(dev->get_master_volume(dev, &volume), 0);
+    CHECK(volume == 1.0f);
+    CHECK_EQ(dev->set_master_volume(dev, 1.5f), -EINVAL);
+
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_AUX_DIGITAL,
+                          AUDIO_OUTPUT_FLAG_DIRECT, &config);
+    CHECK(out != NULL);
+    if (!out)
+        goto exit;
+    buf = hal_alloc_buffer(&out->common);
+    for (i = 0; i < out->common.get_buffer_size(&out->common) / 2; i++)
+        buf[i] = 16384;
+    fake_pcm_set_tap(volume_tap);
+
+    check_volume_ramp(out, buf, 16384, 16384);
+    CHECK_EQ(out->set_volume(out, 0.5f, 0.5f), 0);
+    check_volume_ramp(out, buf, 16384, 8192);
+    CHECK_EQ(dev->set_master_volume(dev, 0.5f), 0);
+    CHECK_EQ(dev->get_master_volume(dev, &volume), 0);
+    CHECK(volume == 0.5f);
+    check_volume_ramp(out, buf, 8192, 4096);
+    CHECK_EQ(out->set_volume(out, 0.0f, 0.0f), 0);
+    check_volume_ramp(out, buf, 4096, 0);
+    CHECK_EQ(out->set_volume(out, 1.0f, 1.0f), 0);
+    check_volume_ramp(out, buf, 0, 8192);
+    dev->close_output_stream(dev, out);
+
+    /* the primary output starts at the master volume, without a ramp */
+    out = hal_open_output(dev, AUDIO_DEVICE_OUT_SPEAKER,
+                          AUDIO_OUTPUT_FLAG_PRIMARY, &config);
+    CHECK(out != NULL);
+    if (out) {
+        CHECK_EQ(out->set_volume(out, 0.5f, 0.5f), -ENOSYS);
+        check_volume_ramp(out, buf, 8192, 8192);
+        CHECK_EQ(dev->set_master_volume(dev, 1.0f), 0);
+        check_volume_ramp(out, buf, 8192, 16384);
+        dev->close_output_stream(dev, out);
+    }
+
+    fake_pcm_set_tap(NULL);
+    free(buf);
+exit:
+    dev->set_master_volume(dev, 1.0f);
+    hal_close(dev);
+}
+
+/* a control changed behind the back of the HAL shows up in the dump */
+static void test_dump(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    FILE *file = tmpfile();
+    char line[256];
+    bool profile = false, changed = false;
+
+    fake_mixer_set_value("SPK Switch", 0, 1);
+    CHECK_EQ(dev->dump(dev, fileno(file)), 0);
+    rewind(file);
+    while (fgets(line, sizeof(line), file)) {
+        profile |= strstr(line, "Latency histograms") != NULL;
+        changed |= strstr(line, "SPK Switch: 0 (mixer: 1)") != NULL;
+    }
+    CHECK(profile);
+    CHECK(changed);
+
+    fclose(file);
+    hal_close(dev);
+}
+
+static void *dump_thread(void *context)
+{
+    struct audio_hw_device *dev = context;
+    FILE *file = tmpfile();
+
+    dev->dump(dev, fileno(file));
+    fclose(file);
+    return NULL;
+}
+
+/* the routing is not blocked while the dump reads the mixer back */
+static void test_dump_concurrency(void)
+{
+    struct audio_hw_device *dev = hal_open();
+    pthread_t thread;
+    struct timespec start, end;
+    double dump_ms, set_mode_ms;
+
+    fake_clock_set_mode(FAKE_CLOCK_REAL);
+    fake_mixer_set_access_delay_us(2000);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_create(&thread, NULL, dump_thread, dev);
+    usleep(20000);
+    CHECK_EQ(dev->set_mode(dev, AUDIO_MODE_RINGTONE), 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    set_mode_ms = (end.tv_sec - start.tv_sec) * 1e3 +
+                  (end.tv_nsec - start.tv_nsec) / 1e6;
+    pthread_join(thread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    dump_ms = (end.tv_sec - start.tv_sec) * 1e3 +
+              (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    /* 158 controls read at 2 ms each */
+    CHECK(dump_ms > 300);
+    CHECK(set_mode_ms < dump_ms / 2);
+
+    fake_mixer_set_access_delay_us(0);
+    fake_clock_set_mode(FAKE_CLOCK_SIMULATED);
+    hal_close(dev);
+}
+
+int main(void)
+{
+    fake_clock_set_mode(FAKE_CLOCK_SIMULATED);
+
+    RUN_TEST(test_open_close);
+    RUN_TEST(test_mixer_paths);
+    RUN_TEST(test_primary_output);
+    RUN_TEST(test_positions);
+    RUN_TEST(test_slow_start);
+    RUN_TEST(test_failed_start);
+    RUN_TEST(test_standby_requests);
+    RUN_TEST(test_pcm_errors);
+    RUN_TEST(test_primary_input);
+    RUN_TEST(test_read_period_direct);
+    RUN_TEST(test_input_overrun);
+    RUN_TEST(test_capture_position);
+    RUN_TEST(test_mmap_output);
+    RUN_TEST(test_mmap_input);
+    RUN_TEST(test_deep_buffer);
+    RUN_TEST(test_formats);
+    RUN_TEST(test_offload);
+    RUN_TEST(test_voice_call);
+    RUN_TEST(test_routing);
+    RUN_TEST(test_hdmi);
+    RUN_TEST(test_hdmi_mix);
+    RUN_TEST(test_volume);
+    RUN_TEST(test_dump);
+    RUN_TEST(test_dump_concurrency);
+
+    return test_result();
+}
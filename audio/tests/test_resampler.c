@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2016 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The polyphase resampler of the capture streams. Its vector version
+ * (dsp_dot_s16() on SSE2) must give the output of its C version
+ * (dsp_ref.h) bit for bit, whatever the size of the buffers it is given
+ * or asked for, and its filters must keep the passband and remove what
+ * would alias as much as each quality promises.
+ */
+
+#include "dsp_ref.h"
+#include "test.h"
+
+#define MAX_CHANNELS 2
+/* 0.4 s at 48 kHz */
+#define IN_FRAMES 19200
+#define MAX_OUT_FRAMES (IN_FRAMES * 6)
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+struct rates {
+    uint32_t in;
+    uint32_t out;
+};
+
+/* the capture rates of audio_policy.conf, and two upsamplings */
+static const struct rates test_rates[] = {
+    { 48000, 8000 }, { 48000, 11025 }, { 48000, 12000 }, { 48000, 16000 },
+    { 48000, 22050 }, { 48000, 24000 }, { 48000, 32000 }, { 48000, 44100 },
+    { 8000, 48000 }, { 44100, 48000 },
+};
+
+static const enum poly_resampler_quality test_qualities[] = {
+    POLY_RESAMPLER_LOW, POLY_RESAMPLER_MEDIUM, POLY_RESAMPLER_HIGH,
+};
+
+/*
+ * Attenuation of each quality, of the stopband and of the distortion and
+ * noise of a sine. The rounding of the coefficients to 16 bits, and to 15
+ * for the long filters of the high quality, limits it below the design
+ * attenuation of the filters, see resampler_poly.h.
+ */
+static const double test_attenuation_db[] = {
+    [POLY_RESAMPLER_LOW] = 60.0,
+    [POLY_RESAMPLER_MEDIUM] = 76.0,
+    [POLY_RESAMPLER_HIGH] = 63.0,
+};
+
+static int16_t in_s16[IN_FRAMES * MAX_CHANNELS];
+static int16_t out_s16[MAX_OUT_FRAMES * MAX_CHANNELS];
+static int16_t ref_s16[MAX_OUT_FRAMES * MAX_CHANNELS];
+
+/*
+ * Resamples in_s16 into out with the vector or the C version, from a
+ * provider giving in_chunk frames at a time and out_chunk output frames
+ * at a time, or with resample_from_input() in_chunk frames at a time if
+ * out_chunk is 0. Returns the output frames.
+ */
+static size_t resample(bool ref, const struct rates *rates,
+                       enum poly_resampler_quality quality,
+                       unsigned int channels, size_t in_chunk,
+                       size_t out_chunk, int16_t *out)
+{
+    struct resampler_itfe *r;
+    struct test_provider p;
+    size_t used = 0, frames = 0;
+    int ret;
+
+    test_provider_init(&p, in_s16, IN_FRAMES, channels, in_chunk);
+    ret = (ref ? ref_create_poly_resampler : create_poly_resampler)(
+            rates->in, rates->out, channels, quality, &p.provider, &r);
+    CHECK_EQ(ret, 0);
+    if (ret != 0)
+        return 0;
+
+    while (out_chunk > 0) {
+        size_t count = MAX_OUT_FRAMES - frames < out_chunk ?
+                       MAX_OUT_FRAMES - frames : out_chunk;
+
+        r->resample_from_provider(r, out + frames * channels, &count);
+        if (count == 0)
+            break;
+        frames += count;
+    }
+
+    while (out_chunk == 0 && used < IN_FRAMES) {
+        size_t in_count = IN_FRAMES - used < in_chunk ?
+                          IN_FRAMES - used : in_chunk;
+        size_t out_count = MAX_OUT_FRAMES - frames;
+
+        r->resample_from_input(r, in_s16 + used * channels, &in_count,
+                               out + frames * channels, &out_count);
+        used += in_count;
+        frames += out_count;
+    }
+
+    (ref ? ref_release_poly_resampler : release_poly_resampler)(r);
+    return frames;
+}
+
+/* the periods of the HAL against odd sizes, and resample_from_input() */
+static void test_bit_exact(void)
+{
+    unsigned int i, q, channels;
+
+    test_fill_s16(in_s16, IN_FRAMES * MAX_CHANNELS);
+
+    for (i = 0; i < ARRAY_SIZE(test_rates); i++) {
+        for (q = 0; q < ARRAY_SIZE(test_qualities); q++) {
+            for (channels = 1; channels <= MAX_CHANNELS; channels++) {
+                size_t frames, ref_frames;
+
+                frames = resample(false, &test_rates[i], test_qualities[q],
+                                  channels, 960, 320, out_s16);
+                ref_frames = resample(true, &test_rates[i], test_qualities[q],
+                                      channels, 97, 61, ref_s16);
+                CHECK_RANGE(frames, (uint64_t)IN_FRAMES * test_rates[i].out /
+                                    test_rates[i].in - 64,
+                            (uint64_t)IN_FRAMES * test_rates[i].out /
+                            test_rates[i].in + 1);
+                CHECK_EQ(frames, ref_frames);
+                CHECK(memcmp(out_s16, ref_s16,
+                             frames * channels * sizeof(int16_t)) == 0);
+
+                frames = resample(false, &test_rates[i], test_qualities[q],
+                                  channels, 480, 0, out_s16);
+                CHECK_EQ(frames, ref_frames);
+                CHECK(memcmp(out_s16, ref_s16,
+                             frames * channels * sizeof(int16_t)) == 0);
+            }
+        }
+    }
+}
+
+/*
+ * A 1 kHz sine keeps its level, and a sine above the lower Nyquist
+ * frequency, or the image of the 1 kHz sine when upsampling, is
+ * attenuated. The output is analysed for 0.2 s after the filter settled,
+ * a whole number of cycles of frequencies multiple of 5 Hz.
+ */
+static void test_response(void)
+{
+    unsigned int i, q;
+
+    for (i = 0; i < ARRAY_SIZE(test_rates); i++) {
+        const struct rates *rates = &test_rates[i];
+        double low = rates->in < rates->out ? rates->in : rates->out;
+        double high = rates->in < rates->out ? rates->out : rates->in;
+        /* in the stopband, or the first image of 1 kHz */
+        double stop = 5 * floor((low / 2 + (high - low) / 8) / 5);
+        double alias;
+
+        if (rates->in < rates->out)
+            stop = rates->in - 1000.0;
+        alias = fmod(stop, rates->out);
+        if (alias > rates->out / 2)
+            alias = rates->out - alias;
+
+        for (q = 0; q < ARRAY_SIZE(test_qualities); q++) {
+            size_t start = rates->out / 10;
+            size_t frames = rates->out / 5;
+            double thd_n, level;
+
+            test_sine_s16(in_s16, IN_FRAMES, 1, 1000.0, rates->in, 0.5);
+            CHECK_RANGE(resample(false, rates, test_qualities[q], 1, 960, 320,
+                                 out_s16), start + frames, MAX_OUT_FRAMES);
+            level = test_sine_level(out_s16 + start, frames, 1, 1000.0,
+                                    rates->out, &thd_n);
+            CHECK_RANGE(level, 0.5 * 0.99, 0.5 * 1.01);
+            CHECK(thd_n < -test_attenuation_db[test_qualities[q]]);
+
+            if (rates->in > rates->out)
+                test_sine_s16(in_s16, IN_FRAMES, 1, stop, rates->in, 0.5);
+            resample(false, rates, test_qualities[q], 1, 960, 320, out_s16);
+            level = test_sine_level(out_s16 + start, frames, 1, alias,
+                                    rates->out, NULL);
+            CHECK(20 * log10(level / 0.5) <
+                  -test_attenuation_db[test_qualities[q]]);
+        }
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(test_bit_exact);
+    RUN_TEST(test_response);
+
+    return test_result();
+}